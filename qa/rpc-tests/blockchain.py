@@ -16,6 +16,7 @@ Test the following RPCs:
 Tests correspond to code in rpc/blockchain.cpp.
 """
 
+import time
 from decimal import Decimal
 
 from test_framework.test_framework import BitcoinTestFramework
@@ -70,7 +71,7 @@ class BlockchainTest(BitcoinTestFramework):
         assert size > 6400
         assert size < 64000
         assert_equal(len(res['bestblock']), 64)
-        assert_equal(len(res['hash_serialized_2']), 64)
+        assert_equal(len(res['hash_serialized_3']), 64)
 
         print("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
@@ -82,7 +83,7 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res2['height'], 0)
         assert_equal(res2['txouts'], 0)
         assert_equal(res2['bestblock'], node.getblockhash(0))
-        assert_equal(len(res2['hash_serialized_2']), 64)
+        assert_equal(len(res2['hash_serialized_3']), 64)
 
         print("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
@@ -93,7 +94,20 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['height'], res3['height'])
         assert_equal(res['txouts'], res3['txouts'])
         assert_equal(res['bestblock'], res3['bestblock'])
-        assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        assert_equal(res['hash_serialized_3'], res3['hash_serialized_3'])
+        assert_equal(res['utxo_commitment'], res3['utxo_commitment'])
+
+        print("Test that the maintained commitment matches the scanned one")
+        assert_equal(node.gettxoutsetinfo(False)['utxo_commitment'], res['utxo_commitment'])
+
+        print("Test that a background scan returns the same result")
+        bg = node.gettxoutsetinfo(True, True)
+        while bg['status'] != 'done':
+            time.sleep(0.1)
+            bg = node.gettxoutsetinfo(True, True)
+        assert_equal(bg['progress'], 1)
+        assert_equal(bg['hash_serialized_3'], res['hash_serialized_3'])
+        assert_equal(bg['utxo_commitment'], res['utxo_commitment'])
 
     def _test_getblockheader(self):
         node = self.nodes[0]
@@ -359,5 +359,11 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         assert_equal(json_obj['bestblockhash'], bb_hash)
 
+        #test rest utxo commitment, which must match a full scan
+        json_string = http_get_call(url.hostname, url.port, '/rest/utxocommitment.json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bestblock'], bb_hash)
+        assert_equal(json_obj['utxo_commitment'], self.nodes[0].gettxoutsetinfo()['utxo_commitment'])
+
 if __name__ == '__main__':
     RESTTest ().main ()
@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "blockencodings.h"
+#include "compactprefiller.h"
+#include "compactthin.h"
+#include "compacttxfinder.h"
+#include "txmempool.h"
+
+#include <cassert>
+#include <vector>
+
+static CTransactionRef MakeTx(uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    return MakeTransactionRef(tx);
+}
+
+// Look up every transaction of a block announced as a compact block in a
+// mempool of 100k transactions, as done before reconstruction can start.
+static void CompactBlockFindTxs(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    LockPoints lp;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        CTransactionRef tx = MakeTx(i);
+        pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, true, false, lp, 1));
+        if (i % 40 == 0)
+            block.vtx.push_back(tx);
+    }
+
+    CompactBlock cmpct(block, CoinbaseOnlyPrefiller());
+    std::vector<ThinTx> txs = CompactStub(cmpct).allTransactions();
+
+    while (state.KeepRunning()) {
+        CompactTxFinder finder(pool, cmpct.shorttxidk0, cmpct.shorttxidk1);
+        for (size_t i = 1; i < txs.size(); ++i) {
+            bool fFound = finder(txs[i]) != nullptr;
+            assert(fFound);
+        }
+    }
+}
+
+BENCHMARK(CompactBlockFindTxs);
@@ -51,6 +51,21 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state, unsigned int backends)
+{
+    SHA256AutoDetect(backends);
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+    SHA256AutoDetect();
+}
+
+static void SHA256D64_1024_standard(benchmark::State& state) { SHA256D64_1024(state, 0); }
+static void SHA256D64_1024_sse41(benchmark::State& state) { SHA256D64_1024(state, SHA256_SSE41); }
+static void SHA256D64_1024_avx2(benchmark::State& state) { SHA256D64_1024(state, SHA256_AVX2); }
+static void SHA256D64_1024_shani(benchmark::State& state) { SHA256D64_1024(state, SHA256_SHANI); }
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -75,4 +90,8 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024_standard);
+BENCHMARK(SHA256D64_1024_sse41);
+BENCHMARK(SHA256D64_1024_avx2);
+BENCHMARK(SHA256D64_1024_shani);
 BENCHMARK(SipHash_32b);
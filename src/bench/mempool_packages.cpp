@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, pool.HasNoInputsOf(*tx),
+                                                     false, lp, 1));
+}
+
+static CTransactionRef Spend(const uint256& hash, size_t nInputs, size_t nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(nInputs);
+    for (size_t i = 0; i < nInputs; ++i) {
+        tx.vin[i].prevout = COutPoint(hash, i);
+        tx.vin[i].scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(nOutputs);
+    for (size_t i = 0; i < nOutputs; ++i) {
+        tx.vout[i].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[i].nValue = COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+static std::vector<CTransactionRef> Chain(size_t nLength)
+{
+    std::vector<CTransactionRef> txs(1, Spend(GetRandHash(), 1, 1));
+    while (txs.size() < nLength)
+        txs.push_back(Spend(txs.back()->GetHash(), 1, 1));
+    return txs;
+}
+
+// A chain of transactions enters the mempool, then is mined a transaction
+// at a time.
+static void MempoolLongChain(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> txs = Chain(500);
+    CTxMemPool pool(CFeeRate(1000));
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : txs)
+            AddTx(tx, pool);
+        for (const CTransactionRef& tx : txs) {
+            std::list<CTransaction> conflicts;
+            pool.removeForBlock(std::vector<CTransactionRef>(1, tx), 2, conflicts, false);
+        }
+    }
+}
+
+// A transaction with many children, which are mined without it, then it
+// is evicted.
+static void MempoolWideFanOut(benchmark::State& state)
+{
+    const size_t nChildren = 1000;
+    CTransactionRef parent = Spend(GetRandHash(), 1, nChildren);
+    std::vector<CTransactionRef> children;
+    for (size_t i = 0; i < nChildren; ++i) {
+        CMutableTransaction tx(*Spend(parent->GetHash(), 1, 1));
+        tx.vin[0].prevout.n = i;
+        children.push_back(MakeTransactionRef(tx));
+    }
+    // The grandchild of each child.
+    std::vector<CTransactionRef> grandChildren;
+    for (const CTransactionRef& child : children)
+        grandChildren.push_back(Spend(child->GetHash(), 1, 1));
+    CTxMemPool pool(CFeeRate(1000));
+
+    while (state.KeepRunning()) {
+        AddTx(parent, pool);
+        for (size_t i = 0; i < nChildren; ++i) {
+            AddTx(children[i], pool);
+            AddTx(grandChildren[i], pool);
+        }
+        std::list<CTransaction> conflicts;
+        pool.removeForBlock(std::vector<CTransactionRef>(children.begin(), children.begin() + nChildren / 2),
+                            2, conflicts, false);
+        std::list<CTransaction> removed;
+        pool.removeRecursive(*parent, removed);
+        pool.clear();
+    }
+}
+
+// A block is disconnected, and its transactions return to the mempool,
+// where the rest of the chain they are part of already is.
+static void MempoolReorgChain(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> txs = Chain(1000);
+    const size_t nInBlock = 500;
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nInBlock; ++i)
+        vHashes.push_back(txs[i]->GetHash());
+    CTxMemPool pool(CFeeRate(1000));
+
+    while (state.KeepRunning()) {
+        for (size_t i = nInBlock; i < txs.size(); ++i)
+            AddTx(txs[i], pool);
+        for (size_t i = 0; i < nInBlock; ++i)
+            AddTx(txs[i], pool);
+        pool.UpdateTransactionsFromBlock(vHashes, txs.size(), std::numeric_limits<uint64_t>::max());
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolLongChain);
+BENCHMARK(MempoolWideFanOut);
+BENCHMARK(MempoolReorgChain);
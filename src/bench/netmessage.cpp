@@ -0,0 +1,83 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "protocol.h"
+#include "random.h"
+#include "streams.h"
+
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+//! Append a message as it appears on the wire.
+void AppendMessage(std::vector<char>& stream, const char* command, size_t nPayloadSize)
+{
+    std::vector<unsigned char> payload(nPayloadSize);
+    GetRandBytes(payload.data(), payload.size());
+
+    CMessageHeader hdr(Params().NetworkMagic(), command, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    stream.insert(stream.end(), ss.begin(), ss.end());
+    stream.insert(stream.end(), payload.begin(), payload.end());
+}
+
+//! Feed the stream to a node the way the socket handler does, in chunks of
+//! at most MAX_RECV_CHUNK bytes, and verify the checksums like the message
+//! handler does. The messages are then dropped as if processed.
+void Replay(benchmark::State& state, const std::vector<char>& stream, size_t nMessages)
+{
+    CAddress addr(CService("127.0.0.1", 8333));
+    std::unique_ptr<CNode> node(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0));
+    while (state.KeepRunning()) {
+        for (size_t nPos = 0; nPos < stream.size(); nPos += MAX_RECV_CHUNK) {
+            unsigned int nBytes = std::min<size_t>(MAX_RECV_CHUNK, stream.size() - nPos);
+            bool fComplete;
+            bool fOk = node->ReceiveMsgBytes(&stream[nPos], nBytes, fComplete);
+            assert(fOk);
+        }
+        assert(node->vRecvMsg.size() == nMessages);
+        for (const CNetMessage& msg : node->vRecvMsg) {
+            const uint256& hash = msg.GetMessageHash();
+            bool fValid = memcmp(hash.begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0;
+            assert(fValid);
+        }
+        node->vRecvMsg.clear();
+    }
+}
+
+} // namespace
+
+// What a peer relaying transactions sends between blocks.
+static void NetMessageParseTxs(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    std::vector<char> stream;
+    for (int i = 0; i < 1000; ++i) {
+        AppendMessage(stream, NetMsgType::INV, 37);
+        AppendMessage(stream, NetMsgType::TX, 250 + (i % 8) * 100);
+    }
+    Replay(state, stream, 2000);
+}
+
+// A block of the maximum message size.
+static void NetMessageParseBlock32MB(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    std::vector<char> stream;
+    AppendMessage(stream, NetMsgType::BLOCK, MAX_SIZE - 1024);
+    Replay(state, stream, 1);
+}
+
+BENCHMARK(NetMessageParseTxs);
+BENCHMARK(NetMessageParseBlock32MB);
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Lookups on one thread while nThreads - 1 others hammer the same cache with
+// a mix of lookups and inserts, as script check threads do while a block is
+// connected.
+static void SigCacheContention(benchmark::State& state, int nThreads)
+{
+    CSignatureCache cache(DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+    FastRandomContext rng(true);
+
+    std::vector<CSignatureCache::Entry> entries(100000);
+    for (auto& entry : entries) {
+        entry.a = rng.rand64();
+        entry.b = rng.rand64();
+        cache.Set(entry);
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; ++t) {
+        threads.emplace_back([&]() {
+            FastRandomContext ctx;
+            while (!stop) {
+                const CSignatureCache::Entry& entry = entries[ctx.randrange(entries.size())];
+                if (ctx.randrange(10) == 0)
+                    cache.Set(CSignatureCache::Entry{entry.a ^ ctx.rand64(), entry.b});
+                else
+                    cache.Get(entry);
+            }
+        });
+    }
+
+    size_t i = 0;
+    uint64_t hits = 0;
+    while (state.KeepRunning()) {
+        hits += cache.Get(entries[i]);
+        if (++i == entries.size())
+            i = 0;
+    }
+    stop = true;
+    for (std::thread& thread : threads)
+        thread.join();
+    assert(hits > 0);
+}
+
+static void SigCacheContention_1(benchmark::State& state) { SigCacheContention(state, 1); }
+static void SigCacheContention_2(benchmark::State& state) { SigCacheContention(state, 2); }
+static void SigCacheContention_4(benchmark::State& state) { SigCacheContention(state, 4); }
+static void SigCacheContention_8(benchmark::State& state) { SigCacheContention(state, 8); }
+
+BENCHMARK(SigCacheContention_1);
+BENCHMARK(SigCacheContention_2);
+BENCHMARK(SigCacheContention_4);
+BENCHMARK(SigCacheContention_8);
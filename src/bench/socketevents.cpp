@@ -0,0 +1,129 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "compat.h"
+#include "socketevents.h"
+
+#include <cassert>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+
+// nPeers connected socket pairs, of which one becomes readable per round, as
+// on a node with many mostly idle connections. The network thread watches one
+// end of each pair, the other end stands in for the remote peer.
+namespace {
+class SocketPairs
+{
+public:
+    explicit SocketPairs(int nPeers)
+    {
+        for (int i = 0; i < nPeers; ++i) {
+            int fds[2];
+            int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+            assert(ret == 0);
+            local.push_back(fds[0]);
+            remote.push_back(fds[1]);
+        }
+    }
+
+    ~SocketPairs()
+    {
+        for (SOCKET s : local)
+            close(s);
+        for (SOCKET s : remote)
+            close(s);
+    }
+
+    //! Make peer i send a byte.
+    void Send(size_t i)
+    {
+        char c = 0;
+        ssize_t ret = send(remote[i], &c, 1, 0);
+        assert(ret == 1);
+    }
+
+    //! Consume the byte sent by peer i.
+    void Receive(size_t i)
+    {
+        char c;
+        ssize_t ret = recv(local[i], &c, 1, 0);
+        assert(ret == 1);
+    }
+
+    std::vector<SOCKET> local;
+    std::vector<SOCKET> remote;
+};
+} // namespace
+
+static void SocketEventsSelect(benchmark::State& state, int nPeers)
+{
+    SocketPairs pairs(nPeers);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        pairs.Send(i);
+
+        fd_set fdsetRecv;
+        FD_ZERO(&fdsetRecv);
+        SOCKET hSocketMax = 0;
+        for (SOCKET s : pairs.local) {
+            FD_SET(s, &fdsetRecv);
+            hSocketMax = std::max(hSocketMax, s);
+        }
+        struct timeval timeout = {1, 0};
+        int nReady = select(hSocketMax + 1, &fdsetRecv, NULL, NULL, &timeout);
+        assert(nReady == 1);
+        for (size_t j = 0; j < pairs.local.size(); ++j) {
+            if (FD_ISSET(pairs.local[j], &fdsetRecv))
+                pairs.Receive(j);
+        }
+        i = (i + 1) % pairs.local.size();
+    }
+}
+
+#ifdef USE_EPOLL
+static void SocketEventsEpoll(benchmark::State& state, int nPeers)
+{
+    SocketPairs pairs(nPeers);
+    EpollSet epollSet;
+    assert(epollSet.IsValid());
+    std::vector<size_t> index(pairs.local.size());
+    for (size_t j = 0; j < pairs.local.size(); ++j) {
+        index[j] = j;
+        bool fAdded = epollSet.Add(pairs.local[j], &index[j], true);
+        assert(fAdded);
+    }
+    std::vector<epoll_event> events(64);
+    // Drain the initial write readiness of all sockets.
+    while (epollSet.Wait(events, 0) > 0) {}
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        pairs.Send(i);
+        int nEvents = epollSet.Wait(events, 1000);
+        assert(nEvents == 1);
+        for (int j = 0; j < nEvents; ++j)
+            pairs.Receive(*static_cast<size_t*>(events[j].data.ptr));
+        i = (i + 1) % pairs.local.size();
+    }
+}
+#endif
+
+static void SocketEventsSelect_16(benchmark::State& state) { SocketEventsSelect(state, 16); }
+static void SocketEventsSelect_400(benchmark::State& state) { SocketEventsSelect(state, 400); }
+
+BENCHMARK(SocketEventsSelect_16);
+BENCHMARK(SocketEventsSelect_400);
+
+#ifdef USE_EPOLL
+static void SocketEventsEpoll_16(benchmark::State& state) { SocketEventsEpoll(state, 16); }
+static void SocketEventsEpoll_400(benchmark::State& state) { SocketEventsEpoll(state, 400); }
+
+BENCHMARK(SocketEventsEpoll_16);
+BENCHMARK(SocketEventsEpoll_400);
+#endif
+#endif // WIN32
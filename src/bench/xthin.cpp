@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "bloom.h"
+#include "consensus/consensus.h"
+#include "protocol.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+#include "xthin.h"
+
+#include <cassert>
+#include <vector>
+
+static CTransactionRef MakeTx(uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    return MakeTransactionRef(tx);
+}
+
+// A block of 1000 recent transactions requested as xthin by a peer with
+// 20k transactions in its mempool, 10 of the block transactions missing.
+// Covers getting the mempool filter, sending the request, building the
+// thin block on the other end and receiving it.
+static void XThinRoundTrip(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    LockPoints lp;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        CTransactionRef tx = MakeTx(i);
+        if (i % 100 != 0)
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, i, 1, true, false, lp, 1));
+        if (i >= 15000 && i % 5 == 0)
+            block.vtx.push_back(tx);
+    }
+    const CInv inv(MSG_XTHINBLOCK, block.GetHash());
+
+    while (state.KeepRunning()) {
+        CDataStream request(SER_NETWORK, PROTOCOL_VERSION);
+        request << inv << pool.GetRecentTxFilter();
+
+        CInv inv2;
+        CBloomFilter filter;
+        request >> inv2 >> filter;
+        filter.UpdateEmptyFull();
+
+        CDataStream response(SER_NETWORK, PROTOCOL_VERSION);
+        response << XThinBlock(block, filter);
+
+        XThinBlock thin;
+        response >> thin;
+        thin.selfValidate(THIRD_HF_INITIAL_MAX_BLOCK_SIZE);
+        assert(thin.missing.size() > 1 && thin.missing.size() < 100);
+    }
+}
+
+BENCHMARK(XThinRoundTrip);
@@ -32,6 +32,18 @@ uint64_t GetShortID(
     return GetShortID(idk.first, idk.second, txhash);
 }
 
+void GetShortIDs(
+        const uint64_t& shorttxidk0,
+        const uint64_t& shorttxidk1,
+        const std::vector<uint256>& txhashes,
+        std::vector<uint64_t>& shortids)
+{
+    shortids.resize(txhashes.size());
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes.data(), txhashes.size(), shortids.data());
+    for (uint64_t& id : shortids)
+        id &= 0xffffffffffffL;
+}
+
 CompactBlock::CompactBlock(const CBlock& block, const CompactPrefiller& prefiller) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())), header(block)
 {
@@ -44,17 +56,17 @@ CompactBlock::CompactBlock(const CBlock& block, const CompactPrefiller& prefille
 
     auto isPrefilled = [this](const uint256& tx) {
         for (auto& p : this->prefilledtxn)
-            if (p.tx.GetHash() == tx)
+            if (p.tx->GetHash() == tx)
                 return true;
         return false;
     };
 
     // Fill short IDs.
-    for (const CTransaction& tx : block.vtx) {
-        if (isPrefilled(tx.GetHash()))
+    for (const CTransactionRef& tx : block.vtx) {
+        if (isPrefilled(tx->GetHash()))
             continue;
 
-        shorttxids.push_back(GetShortID(tx.GetHash()));
+        shorttxids.push_back(GetShortID(tx->GetHash()));
     }
 }
 
@@ -91,7 +103,7 @@ void validateCompactBlock(const CompactBlock& cmpctblock, uint64_t currMaxBlockS
 
     int64_t lastprefilledindex = -1;
     for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
-        if (cmpctblock.prefilledtxn[i].tx.IsNull())
+        if (!cmpctblock.prefilledtxn[i].tx || cmpctblock.prefilledtxn[i].tx->IsNull())
             throw std::invalid_argument("null tx in compact block");
 
         lastprefilledindex += static_cast<uint64_t>(cmpctblock.prefilledtxn[i].index) + 1; //index is a uint32_t, so cant overflow here
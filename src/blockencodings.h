@@ -20,6 +20,13 @@ uint64_t GetShortID(
         const std::pair<uint64_t, uint64_t>& shorttxidk,
         const uint256& txhash);
 
+// Short IDs of many transactions at once, same order as txhashes.
+void GetShortIDs(
+        const uint64_t& shorttxidk0,
+        const uint64_t& shorttxidk1,
+        const std::vector<uint256>& txhashes,
+        std::vector<uint64_t>& shortids);
+
 class CTxMemPool;
 
 class CompactReRequest {
@@ -67,7 +74,7 @@ public:
 class CompactReReqResponse {
 public:
     uint256 blockhash;
-    std::vector<CTransaction> txn;
+    std::vector<CTransactionRef> txn;
 
     CompactReReqResponse() {}
     CompactReReqResponse(const CompactReRequest& req) :
@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "blockfilemapper.h"
+
+#include "chain.h"
+#include "main.h" // GetBlockPosFilename
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BlockFileMapping::~BlockFileMapping()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+}
+
+#ifndef WIN32
+static std::shared_ptr<const BlockFileMapping> MapBlockFile(int nFile)
+{
+    std::string path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk").string();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrint(Log::BLOCK, "%s: cannot map %s\n", __func__, path);
+        return nullptr;
+    }
+    return std::make_shared<const BlockFileMapping>(nFile, static_cast<const unsigned char*>(data), st.st_size);
+}
+#else
+static std::shared_ptr<const BlockFileMapping> MapBlockFile(int nFile)
+{
+    return nullptr;
+}
+#endif
+
+BlockFileMapper::BlockFileMapper(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn)
+{
+}
+
+std::shared_ptr<const BlockFileMapping> BlockFileMapper::Get(int nFile, size_t nEnd)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    for (auto it = mappings.begin(); it != mappings.end(); ++it) {
+        if ((*it)->nFile != nFile)
+            continue;
+        if ((*it)->size >= nEnd) {
+            mappings.splice(mappings.begin(), mappings, it);
+            return mappings.front();
+        }
+        // The file has grown since it was mapped.
+        mappings.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const BlockFileMapping> mapping = MapBlockFile(nFile);
+    if (!mapping)
+        return nullptr;
+    mappings.push_front(mapping);
+    if (mappings.size() > nMaxFiles)
+        mappings.pop_back();
+    if (mapping->size < nEnd)
+        return nullptr;
+    return mapping;
+}
+
+void BlockFileMapper::Invalidate(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mappings.remove_if([nFile](const std::shared_ptr<const BlockFileMapping>& m) {
+        return m->nFile == nFile;
+    });
+}
+
+void BlockFileMapper::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mappings.clear();
+}
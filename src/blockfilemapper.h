@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKFILEMAPPER_H
+#define BITCOIN_BLOCKFILEMAPPER_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+
+//! Block files kept mapped by the block file mapper.
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 32 : 2;
+
+/** A read-only memory mapping of a whole block file. */
+struct BlockFileMapping
+{
+    int nFile;
+    const unsigned char* data;
+    size_t size;
+
+    BlockFileMapping(int nFileIn, const unsigned char* dataIn, size_t sizeIn) :
+        nFile(nFileIn), data(dataIn), size(sizeIn) {}
+    ~BlockFileMapping();
+
+    BlockFileMapping(const BlockFileMapping&) = delete;
+    BlockFileMapping& operator=(const BlockFileMapping&) = delete;
+};
+
+/**
+ * Read-only memory mappings of the block files, with the most recently used
+ * ones kept open. Readers hold on to the mapping they got, so a mapping that
+ * is evicted or invalidated stays valid until the last reader is done.
+ *
+ * Block files grow as blocks are appended. A file is mapped again when a
+ * read goes past the end of its current mapping.
+ */
+class BlockFileMapper
+{
+public:
+    explicit BlockFileMapper(size_t nMaxFiles);
+
+    //! A mapping of block file nFile that is at least nEnd bytes long, or
+    //! null if the file is shorter or cannot be mapped.
+    std::shared_ptr<const BlockFileMapping> Get(int nFile, size_t nEnd);
+
+    //! Forget the mapping of a file that is truncated or deleted.
+    void Invalidate(int nFile);
+
+    void Clear();
+
+private:
+    const size_t nMaxFiles;
+    std::mutex cs;
+    //! Most recently used first.
+    std::list<std::shared_ptr<const BlockFileMapping>> mappings;
+};
+
+#endif // BITCOIN_BLOCKFILEMAPPER_H
@@ -4,6 +4,8 @@
 #include "blockencodings.h"
 #include "blocksender.h"
 #include "bloom.h"
+#include "compactprefiller.h"
+#include "graphene.h"
 #include "protocol.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -13,8 +15,9 @@
 #include "netmessagemaker.h"
 #include "xthin.h"
 #include "merkleblock.h"
-#include "main.h" // ReadBlockFromDisk
+#include "main.h" // ReadBlockFromDisk, ReadRawBlockFromDisk
 #include "nodestate.h"
+#include "rawblockcache.h"
 #include <vector>
 
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
@@ -29,10 +32,11 @@ BlockSender::BlockSender() {
 
 bool BlockSender::isBlockType(int t) const {
     return t == MSG_BLOCK || t == MSG_FILTERED_BLOCK
-        || t == MSG_THINBLOCK || t == MSG_XTHINBLOCK || t == MSG_CMPCT_BLOCK;
+        || t == MSG_THINBLOCK || t == MSG_XTHINBLOCK || t == MSG_CMPCT_BLOCK
+        || t == MSG_GRAPHENEBLOCK;
 }
 
-bool BlockSender::canSend(const CChain& activeChain, const CBlockIndex& block,
+bool BlockSender::canSend(const CChainSnapshot& activeChain, const CBlockIndex& block,
         CBlockIndex *pindexBestHeader)
 {
     // Pruned nodes may have deleted the block, so check whether
@@ -60,7 +64,7 @@ bool BlockSender::canSend(const CChain& activeChain, const CBlockIndex& block,
     return send;
 }
 
-void BlockSender::send(const CChain& activeChain, CConnman& connman, CNode& node,
+void BlockSender::send(const CChainSnapshot& activeChain, CConnman& connman, CNode& node,
         CBlockIndex& blockIndex, const CInv& inv)
 {
     sendBlock(connman, node, blockIndex, inv.type, activeChain.Height());
@@ -69,7 +73,7 @@ void BlockSender::send(const CChain& activeChain, CConnman& connman, CNode& node
 }
 
 // Trigger the peer node to send a getblocks request for the next batch of inventory
-void BlockSender::triggerNextRequest(const CChain& activeChain, const CInv& inv,
+void BlockSender::triggerNextRequest(const CChainSnapshot& activeChain, const CInv& inv,
                                      CConnman& connman, CNode& node) {
 
     if (inv.hash != node.hashContinue)
@@ -84,7 +88,8 @@ void BlockSender::triggerNextRequest(const CChain& activeChain, const CInv& inv,
     node.hashContinue.SetNull();
 }
 
-static bool thinIsSmaller(const CBlock& b, const XThinBlock& x) {
+template <typename ThinBlock>
+static bool thinIsSmaller(const CBlock& b, const ThinBlock& x) {
     return GetSerializeSize(x, SER_NETWORK, PROTOCOL_VERSION)
         < GetSerializeSize(b, SER_NETWORK, PROTOCOL_VERSION);
 }
@@ -96,16 +101,33 @@ static bool withinDepthLimits(int depth, int blockHeight, int activeChainHeight)
 void BlockSender::sendBlock(CConnman& connman, CNode& node,
         const CBlockIndex& blockIndex, int invType, int activeChainHeight)
 {
+    // We only support MSG_XTHINBLOCK, if peer wants MSG_THINBLOCK,
+    // fallback to full one.
+    const bool fullBlock = invType == MSG_BLOCK || (invType == MSG_THINBLOCK
+                && !NodeStatePtr(node.id)->supportsCompactBlocks);
+
+    // A full block is sent as stored, without deserializing it first.
+    // Recent blocks are queued for every peer from the same buffer.
+    if (fullBlock) {
+        RawBlockCache::Payload cached = readCachedEncoding(&blockIndex, RawBlockCache::FULL_BLOCK);
+        if (cached) {
+            connman.PushMessage(&node, SharedNetMsg(NetMsgType::BLOCK, std::move(cached)));
+            return;
+        }
+        CSerializedNetMsg raw;
+        if (readRawBlockFromDisk(raw.data, &blockIndex)) {
+            raw.command = NetMsgType::BLOCK;
+            connman.PushMessage(&node, std::move(raw));
+            return;
+        }
+    }
 
     // Send block from disk
     CBlock block;
     if (!readBlockFromDisk(block, &blockIndex) || block.IsNull())
         throw std::runtime_error("cannot read block from disk");
 
-    // We only support MSG_XTHINBLOCK, if peer wants MSG_THINBLOCK,
-    // fallback to full one.
-    if (invType == MSG_BLOCK || (invType == MSG_THINBLOCK
-                && !NodeStatePtr(node.id)->supportsCompactBlocks))
+    if (fullBlock)
     {
         // Fun fact:
         // Responding to a BUIP010 MSG_THINBLOCK is actually a BIP152 violation.
@@ -148,9 +170,38 @@ void BlockSender::sendBlock(CConnman& connman, CNode& node,
         return;
     }
 
+    if (invType == MSG_GRAPHENEBLOCK) {
+        try {
+            if (withinDepthLimits(MAX_CMPCTBLOCK_DEPTH, blockIndex.nHeight, activeChainHeight)) {
+                GrapheneBlock gblock(block, node.nGrapheneMempoolTxs);
+                if (thinIsSmaller(block, gblock)) {
+                    connman.PushMessage(&node, NetMsg(&node, NetMsgType::GRAPHENEBLOCK, gblock));
+                    return;
+                }
+            }
+        }
+        catch (const std::runtime_error& e) {
+            LogPrintf("cannot send graphene block %s: %s\n",
+                    block.GetHash().ToString(), e.what());
+        }
+        // fall back to full block
+        connman.PushMessage(&node, NetMsg(&node, NetMsgType::BLOCK, block));
+        return;
+    }
+
     if (invType == MSG_CMPCT_BLOCK && NodeStatePtr(node.id)->supportsCompactBlocks) {
         if (withinDepthLimits(MAX_CMPCTBLOCK_DEPTH, blockIndex.nHeight, activeChainHeight)) {
-            CompactBlock cmpct(block, *choosePrefiller(node));
+            std::unique_ptr<CompactPrefiller> prefiller = choosePrefiller(node);
+
+            // Peers that know all the transactions get the same encoding.
+            if (prefiller->fillFrom(block).size() == 1) {
+                RawBlockCache::Payload cached = readCachedEncoding(&blockIndex, RawBlockCache::CMPCT_BLOCK);
+                if (cached) {
+                    connman.PushMessage(&node, SharedNetMsg(NetMsgType::CMPCTBLOCK, std::move(cached)));
+                    return;
+                }
+            }
+            CompactBlock cmpct(block, *prefiller);
             connman.PushMessage(&node, NetMsg(&node, NetMsgType::CMPCTBLOCK, cmpct));
         }
         else {
@@ -178,7 +229,7 @@ void BlockSender::sendBlock(CConnman& connman, CNode& node,
     LOCK(node.cs_inventory);
     for (auto& tx : merkleBlock.vMatchedTxn) {
         if (!node.filterInventoryKnown.contains(tx.second)) {
-            connman.PushMessage(&node, NetMsg(&node, NetMsgType::TX, block.vtx[tx.first]));
+            connman.PushMessage(&node, NetMsg(&node, NetMsgType::TX, *block.vtx[tx.first]));
         }
     }
 }
@@ -216,5 +267,25 @@ void BlockSender::sendReReqReponse(CConnman& connman, CNode& node, const CBlockI
 }
 
 bool BlockSender::readBlockFromDisk(CBlock& block, const CBlockIndex* pindex) {
+    if (!pindex->GetBlockPos().IsNull()) {
+        std::shared_ptr<const CBlock> cached = GetRawBlockCache().GetBlock(pindex->GetBlockHash());
+        if (cached) {
+            block = *cached;
+            return true;
+        }
+    }
     return ::ReadBlockFromDisk(block, pindex, Params().GetConsensus());
 }
+
+bool BlockSender::readRawBlockFromDisk(std::vector<unsigned char>& raw, const CBlockIndex* pindex) {
+    return ::ReadRawBlockFromDisk(raw, pindex);
+}
+
+RawBlockCache::Payload BlockSender::readCachedEncoding(const CBlockIndex* pindex,
+        RawBlockCache::Encoding encoding)
+{
+    // Only blocks we have stored are served.
+    if (pindex->GetBlockPos().IsNull())
+        return nullptr;
+    return GetRawBlockCache().Get(pindex->GetBlockHash(), encoding);
+}
@@ -4,7 +4,11 @@
 #ifndef BITCOIN_BLOCKSENDER_H
 #define BITCOIN_BLOCKSENDER_H
 
-class CChain;
+#include "rawblockcache.h"
+
+#include <vector>
+
+class CChainSnapshot;
 class CConnman;
 class CBlockIndex;
 class CInv;
@@ -22,10 +26,10 @@ class BlockSender {
         bool isBlockType(int invType) const;
 
         // Are we able (and do we want to) send this block?
-        bool canSend(const CChain& activeChain, const CBlockIndex& block,
+        bool canSend(const CChainSnapshot& activeChain, const CBlockIndex& block,
             CBlockIndex *pindexBestHeader);
 
-        void send(const CChain& activeChain, CConnman&, CNode& node,
+        void send(const CChainSnapshot& activeChain, CConnman&, CNode& node,
             CBlockIndex& blockIndex, const CInv& inv);
 
         virtual void sendBlock(CConnman&, CNode& node,
@@ -42,8 +46,15 @@ class BlockSender {
             const CompactReRequest& req, int activeChainHeight);
 
     protected: // used in unit tests
-        virtual void triggerNextRequest(const CChain& activeChain, const CInv& inv, CConnman&, CNode& node);
+        virtual void triggerNextRequest(const CChainSnapshot& activeChain, const CInv& inv, CConnman&, CNode& node);
         virtual bool readBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+        // Serialized block as stored on disk; false if it's not available
+        // that way.
+        virtual bool readRawBlockFromDisk(std::vector<unsigned char>& raw, const CBlockIndex* pindex);
+        // Encoding shared by all peers, or null if the block is not in the
+        // raw block cache.
+        virtual RawBlockCache::Payload readCachedEncoding(const CBlockIndex* pindex,
+            RawBlockCache::Encoding);
 };
 
 #endif
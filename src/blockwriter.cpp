@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "blockwriter.h"
+
+#include "main.h" // WriteBlockToDisk
+#include "primitives/block.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+BlockWriter::BlockWriter(size_t nMaxBytesIn) :
+    nMaxBytes(nMaxBytesIn), nBytes(0), nQueuedBytes(0), nQueued(0), nWriting(0), fFailed(false)
+{
+}
+
+void BlockWriter::Write(const std::shared_ptr<const CBlock>& block, size_t nSize, CDiskBlockPos& pos,
+                        const CMessageHeader::MessageStartChars& messageStart)
+{
+    Entry entry;
+    entry.block = block;
+    entry.pos = pos;
+    entry.nSize = nSize;
+    std::memcpy(entry.messageStart, messageStart, sizeof(entry.messageStart));
+    entry.state = QUEUED;
+
+    // The index header is the message start and the size.
+    pos.nPos += sizeof(entry.messageStart) + sizeof(uint32_t);
+    const Key key(pos.nFile, pos.nPos);
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    assert(!entries.count(key));
+    entries.emplace(key, std::move(entry));
+    order.push_back(key);
+    nBytes += nSize;
+    nQueuedBytes += nSize;
+    ++nQueued;
+    condQueued.notify_one();
+
+    while (nQueuedBytes > nMaxBytes && nQueued > 0)
+        WriteNext(lock);
+    Evict();
+}
+
+std::shared_ptr<const CBlock> BlockWriter::Get(const CDiskBlockPos& pos) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = entries.find(Key(pos.nFile, pos.nPos));
+    if (it == entries.end())
+        return nullptr;
+    return it->second.block;
+}
+
+void BlockWriter::WriteNext(boost::unique_lock<boost::mutex>& lock)
+{
+    auto key = std::find_if(order.begin(), order.end(), [this](const Key& k) {
+        return entries.at(k).state == QUEUED;
+    });
+    assert(key != order.end());
+    Entry& entry = entries.at(*key);
+    entry.state = WRITING;
+    --nQueued;
+    ++nWriting;
+
+    // Entries are only erased once written, so entry stays valid.
+    std::shared_ptr<const CBlock> block = entry.block;
+    CDiskBlockPos pos = entry.pos;
+    CDiskBlockPos expected(pos.nFile, pos.nPos + sizeof(entry.messageStart) + sizeof(uint32_t));
+    lock.unlock();
+    bool fOk = WriteBlockToDisk(*block, pos, entry.messageStart) && pos == expected;
+    lock.lock();
+
+    if (!fOk) {
+        LogPrintf("ERROR: %s: failed to write block %s at %s\n", __func__,
+                  block->GetHash().ToString(), entry.pos.ToString());
+        fFailed = true;
+    }
+    entry.state = WRITTEN;
+    --nWriting;
+    nQueuedBytes -= entry.nSize;
+    condWritten.notify_all();
+}
+
+void BlockWriter::Evict()
+{
+    while (nBytes > nMaxBytes && !order.empty()) {
+        auto it = entries.find(order.front());
+        if (it->second.state != WRITTEN)
+            break;
+        nBytes -= it->second.nSize;
+        entries.erase(it);
+        order.pop_front();
+    }
+}
+
+bool BlockWriter::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (nQueued > 0 || nWriting > 0) {
+        if (nQueued > 0)
+            WriteNext(lock);
+        else
+            condWritten.wait(lock);
+    }
+    Evict();
+    return !fFailed;
+}
+
+void BlockWriter::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (nWriting > 0)
+        condWritten.wait(lock);
+    entries.clear();
+    order.clear();
+    nBytes = 0;
+    nQueuedBytes = 0;
+    nQueued = 0;
+}
+
+void BlockWriter::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (nQueued == 0)
+            condQueued.wait(lock);
+        WriteNext(lock);
+        Evict();
+    }
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKWRITER_H
+#define BITCOIN_BLOCKWRITER_H
+
+#include "chain.h"
+#include "protocol.h"
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+
+//! Bytes of block data kept in memory by the block writer.
+static const size_t BLOCK_WRITER_BUFFER_BYTES = 64 << 20;
+
+/**
+ * Writes accepted blocks to the block files on a background thread, so that
+ * connecting a block overlaps with writing it and the blocks before it.
+ *
+ * The space is reserved by FindBlockPos up front, so writes can finish in
+ * any order. Blocks stay in memory while queued and for a while after they
+ * are written, and ReadBlockFromDisk is served from memory while they do.
+ * Anything that relies on the files being complete, such as syncing them or
+ * writing the block index, must call Flush() first.
+ */
+class BlockWriter
+{
+public:
+    explicit BlockWriter(size_t nMaxBytes);
+
+    //! Queue block for writing at pos, the position reserved for it by
+    //! FindBlockPos. Like WriteBlockToDisk, moves pos to where the block
+    //! data starts. Writes on the calling thread if the queue is full.
+    void Write(const std::shared_ptr<const CBlock>& block, size_t nSize, CDiskBlockPos& pos,
+               const CMessageHeader::MessageStartChars& messageStart);
+
+    //! The block whose data starts at pos, if it is in memory.
+    std::shared_ptr<const CBlock> Get(const CDiskBlockPos& pos) const;
+
+    //! Write everything queued, helping the writer thread out. Returns false
+    //! if any write has failed.
+    bool Flush();
+
+    //! Drop all blocks. Blocks not written yet are lost.
+    void Clear();
+
+    //! Body of the writer thread. Returns when the thread is interrupted.
+    void Thread();
+
+private:
+    enum State { QUEUED, WRITING, WRITTEN };
+
+    typedef std::pair<int, unsigned int> Key;
+
+    struct Entry {
+        std::shared_ptr<const CBlock> block;
+        CDiskBlockPos pos;
+        size_t nSize;
+        CMessageHeader::MessageStartChars messageStart;
+        State state;
+    };
+
+    //! Write the oldest queued block. Releases the lock while writing.
+    void WriteNext(boost::unique_lock<boost::mutex>& lock);
+    void Evict();
+
+    const size_t nMaxBytes;
+    mutable boost::mutex cs;
+    boost::condition_variable condQueued;
+    boost::condition_variable condWritten;
+    std::map<Key, Entry> entries;
+    //! Entries in the order they were queued.
+    std::deque<Key> order;
+    size_t nBytes;
+    size_t nQueuedBytes;
+    int nQueued;
+    int nWriting;
+    bool fFailed;
+};
+
+#endif // BITCOIN_BLOCKWRITER_H
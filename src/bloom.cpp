@@ -11,6 +11,7 @@
 #include "random.h"
 #include "streams.h"
 
+#include <algorithm>
 #include <math.h>
 #include <stdlib.h>
 
@@ -134,6 +135,14 @@ bool CBloomFilter::IsWithinSizeConstraints() const
     return vData.size() <= MAX_BLOOM_FILTER_SIZE && nHashFuncs <= MAX_HASH_FUNCS;
 }
 
+double CBloomFilter::FalsePositiveRate(unsigned int nElements) const
+{
+    // With no bits or no hash functions everything matches.
+    if (vData.empty() || nHashFuncs == 0)
+        return 1.0;
+    return pow(1.0 - exp(-1.0 * nHashFuncs * nElements / (vData.size() * 8)), nHashFuncs);
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
 {
     bool fFound = false;
@@ -324,3 +333,44 @@ void CRollingBloomFilter::reset()
         *it = 0;
     }
 }
+
+CRotatingBloomFilter::CRotatingBloomFilter(const unsigned int nElements, const double nFPRate,
+                                           const unsigned int nTweak, unsigned char nFlags) :
+    current(nElements, nFPRate, nTweak, nFlags),
+    previous(current),
+    nEntriesPerGeneration(std::max(1u, nElements / 2)),
+    nEntriesThisGeneration(0)
+{
+}
+
+void CRotatingBloomFilter::insert(const uint256& hash)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration) {
+        std::swap(previous, current);
+        current.clear();
+        nEntriesThisGeneration = 0;
+    }
+    current.insert(hash);
+    ++nEntriesThisGeneration;
+}
+
+bool CRotatingBloomFilter::contains(const uint256& hash) const
+{
+    return current.contains(hash) || previous.contains(hash);
+}
+
+void CRotatingBloomFilter::clear()
+{
+    current.clear();
+    previous.clear();
+    nEntriesThisGeneration = 0;
+}
+
+CBloomFilter CRotatingBloomFilter::GetFilter() const
+{
+    CBloomFilter filter(current);
+    for (size_t i = 0; i < filter.vData.size(); ++i)
+        filter.vData[i] |= previous.vData[i];
+    filter.UpdateEmptyFull();
+    return filter;
+}
@@ -61,6 +61,7 @@ private:
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweak);
     friend class CRollingBloomFilter;
+    friend class CRotatingBloomFilter;
 
 public:
     bool IsEmpty() const { return isEmpty; }
@@ -102,6 +103,9 @@ public:
     //! (catch a filter which was just deserialized which was too big)
     bool IsWithinSizeConstraints() const;
 
+    //! Expected rate of false positives once nElements have been inserted
+    double FalsePositiveRate(unsigned int nElements) const;
+
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
 
@@ -152,4 +156,35 @@ private:
     int nHashFuncs;
 };
 
+/**
+ * RotatingBloomFilter keeps track of the most recently inserted items in a
+ * form that can be sent to peers as a CBloomFilter.
+ *
+ * Items go to the current of two generations. When it holds nElements / 2
+ * items it replaces the previous generation and a new one is started, so
+ * the last nElements / 2 to nElements items are kept. Both generations
+ * share size, hash functions and tweak, so GetFilter() can return their
+ * bitwise or, which has the false positive rate of a CBloomFilter created
+ * for nElements items.
+ */
+class CRotatingBloomFilter
+{
+public:
+    CRotatingBloomFilter(const unsigned int nElements, const double nFPRate,
+                         const unsigned int nTweak, unsigned char nFlags);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    void clear();
+
+    //! Both generations as one filter.
+    CBloomFilter GetFilter() const;
+
+private:
+    CBloomFilter current;
+    CBloomFilter previous;
+    unsigned int nEntriesPerGeneration;
+    unsigned int nEntriesThisGeneration;
+};
+
 #endif // BITCOIN_BLOOM_H
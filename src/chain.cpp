@@ -68,6 +68,20 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
+const CBlockIndex* CChainSnapshot::FindFork(const CBlockIndex* pindex) const {
+    if (!pindex || !tip)
+        return nullptr;
+
+    if (pindex->nHeight > tip->nHeight)
+        pindex = pindex->GetAncestor(tip->nHeight);
+    const CBlockIndex* pfork = tip->GetAncestor(pindex->nHeight);
+    while (pindex && pindex != pfork) {
+        pindex = pindex->pprev;
+        pfork = pfork->pprev;
+    }
+    return pindex;
+}
+
 void CChain::OnTipChanged(const CBlockIndex* oldTip, CBlockIndex* newTip) {
     tipMaxBlockSize.store(newTip == nullptr
                           ? MAX_BLOCK_SIZE : newTip->nMaxBlockSize);
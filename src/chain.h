@@ -499,4 +499,48 @@ public:
     }
 };
 
+/**
+ * An immutable view of a chain, identified by its tip. Block index entries
+ * are never deleted and their pprev and nHeight never change, so a snapshot
+ * stays valid while the active chain moves on. Lookups walk the skip list and
+ * are O(log n), unlike the O(1) lookups of CChain.
+ */
+class CChainSnapshot {
+private:
+    CBlockIndex* tip;
+
+public:
+    CChainSnapshot(CBlockIndex* tipIn = nullptr) : tip(tipIn) { }
+    CChainSnapshot(const CChain& chain) : tip(chain.Tip()) { }
+
+    CBlockIndex* Tip() const {
+        return tip;
+    }
+
+    /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
+    CBlockIndex* operator[](int nHeight) const {
+        if (tip == nullptr || nHeight < 0 || nHeight > tip->nHeight)
+            return nullptr;
+        return tip->GetAncestor(nHeight);
+    }
+
+    bool Contains(const CBlockIndex* pindex) const {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in this chain, or NULL if the given index is not found or is the tip. */
+    CBlockIndex* Next(const CBlockIndex* pindex) const {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        return nullptr;
+    }
+
+    int Height() const {
+        return tip ? tip->nHeight : -1;
+    }
+
+    /** Find the last common block between this chain and a block index entry. */
+    const CBlockIndex* FindFork(const CBlockIndex* pindex) const;
+};
+
 #endif // BITCOIN_CHAIN_H
@@ -1,4 +1,5 @@
 // Copyright (c) 2012-2014 The Bitcoin Core developers
+// Copyright (c) 2018 The Bitcoin XT developers
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
@@ -6,9 +7,14 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <vector>
 
-#include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -16,199 +22,318 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
- * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
-  *
-  * One thread (the master) is assumed to push batches of verifications
-  * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
-  */
+/**
+ * Work-stealing pool for verifications that have to be performed.
+ * The verifications are represented by a type T, which must provide an
+ * operator(), returning a bool, and a swap().
+ *
+ * Every worker thread owns a deque. Checks are spread over the deques as
+ * they are added and a worker takes batches from the back of its own deque.
+ * When that runs dry it steals from the front of another one. Checks are
+ * added through a CCheckQueueControl, which tracks its own checks and
+ * result, so several threads can use the pool at the same time. The thread
+ * waiting on a control steals work too until its checks are done.
+ */
 template <typename T>
 class CCheckQueue
 {
+public:
+    struct Stats {
+        uint64_t nChecks;
+        uint64_t nSteals;
+        uint64_t nBatches;
+    };
+
+    //! Upper bound on the number of threads that can call Thread().
+    static const int MAX_WORKERS = 64;
+
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    friend class CCheckQueueControl<T>;
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    //! The checks added through one CCheckQueueControl.
+    struct Group {
+        //! Checks added but not completed yet. Only changed with mutex held,
+        //! so that the waiting thread does not destroy the group while a
+        //! worker is still reporting to it.
+        unsigned int nTodo;
+        std::atomic<bool> fAllOk;
+        std::atomic<uint32_t> nChecks;
+        std::atomic<uint32_t> nSteals;
+        std::mutex mutex;
+        std::condition_variable cond;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+        Group() : nTodo(0), fAllOk(true), nChecks(0), nSteals(0) {}
+    };
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    struct Job {
+        T check;
+        Group* group;
+    };
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        //! Whether a running Thread() owns this deque.
+        std::atomic<bool> fOwned;
+
+        WorkerQueue() : fOwned(false) {}
+    };
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Deque 0 receives checks while no worker has started. Workers own one
+    //! of the others for as long as they run.
+    WorkerQueue queues[MAX_WORKERS + 1];
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Highest deque ever owned by a worker. Checks are spread over deques
+    //! 1 to nWorkers; those of exited workers are drained by stealing.
+    std::atomic<int> nWorkers;
 
-    /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
-     */
-    unsigned int nTodo;
+    //! Checks sitting in a deque. Idle workers sleep while this is zero.
+    std::atomic<unsigned int> nQueued;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Where the next Add() starts spreading its checks.
+    std::atomic<unsigned int> nNext;
+
+    //! Protects the sleep of idle workers
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! The number of workers that are sleeping
+    int nIdle;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    std::atomic<uint64_t> nChecksTotal;
+    std::atomic<uint64_t> nStealsTotal;
+    std::atomic<uint64_t> nBatchesTotal;
+
+    //! Move up to nBatchSize checks from one deque into vBatch. The owner
+    //! takes a quarter from the back, leaving the rest to be stolen if it
+    //! falls behind. Thieves take half from the front.
+    bool Take(int nQueue, bool fSteal, std::vector<Job>& vBatch)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
-            }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+        WorkerQueue& q = queues[nQueue];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.jobs.empty())
+            return false;
+        size_t nNow = fSteal ? (q.jobs.size() + 1) / 2 : (q.jobs.size() + 3) / 4;
+        nNow = std::min<size_t>(nNow, nBatchSize);
+        vBatch.resize(nNow);
+        for (Job& job : vBatch) {
+            Job& from = fSteal ? q.jobs.front() : q.jobs.back();
+            job.check.swap(from.check);
+            job.group = from.group;
+            if (fSteal)
+                q.jobs.pop_front();
+            else
+                q.jobs.pop_back();
+        }
+        nQueued -= nNow;
+        return true;
     }
 
-public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
-
-    //! Worker thread
-    void Thread()
+    //! Fill vBatch from the own deque (nOwn, or -1 for none), or else by
+    //! stealing from the others.
+    bool Find(int nOwn, std::vector<Job>& vBatch)
     {
-        Loop();
+        if (nOwn >= 0 && Take(nOwn, false, vBatch))
+            return true;
+        const int nQueues = nWorkers + 1;
+        const int nStart = nOwn >= 0 ? nOwn : 0;
+        for (int i = 1; i <= nQueues; ++i) {
+            int nVictim = (nStart + i) % nQueues;
+            if (nVictim != nOwn && Take(nVictim, true, vBatch)) {
+                for (Job& job : vBatch)
+                    job.group->nSteals.fetch_add(1, std::memory_order_relaxed);
+                nStealsTotal.fetch_add(vBatch.size(), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
     }
 
-    //! Wait until execution finishes, and return whether all evaluations were successful.
-    bool Wait()
+    void Run(std::vector<Job>& vBatch)
     {
-        return Loop(true);
+        for (Job& job : vBatch) {
+            if (job.group->fAllOk.load(std::memory_order_relaxed) && !job.check())
+                job.group->fAllOk = false;
+            T().swap(job.check);
+        }
+        nChecksTotal.fetch_add(vBatch.size(), std::memory_order_relaxed);
+        nBatchesTotal.fetch_add(1, std::memory_order_relaxed);
+
+        // A batch mostly holds checks of a single group; report in runs.
+        for (size_t i = 0; i < vBatch.size(); ) {
+            Group* group = vBatch[i].group;
+            unsigned int nDone = 0;
+            for (; i < vBatch.size() && vBatch[i].group == group; ++i)
+                ++nDone;
+            group->nChecks.fetch_add(nDone, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(group->mutex);
+            group->nTodo -= nDone;
+            if (group->nTodo == 0)
+                group->cond.notify_all();
+        }
+        vBatch.clear();
     }
 
-    //! Add a batch of checks to the queue
-    void Add(std::vector<T>& vChecks)
+    void Add(Group& group, std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(group.mutex);
+            group.nTodo += vChecks.size();
         }
-        nTodo += vChecks.size();
+
+        // Spread the checks over at most one chunk per worker.
+        const unsigned int nQueues = nWorkers;
+        const size_t nChunks = nQueues ? std::min<size_t>(nQueues, vChecks.size()) : 1;
+        const unsigned int nFirst = nNext.fetch_add(nChunks, std::memory_order_relaxed);
+        nQueued += vChecks.size();
+        size_t nPos = 0;
+        for (size_t c = 0; c < nChunks; ++c) {
+            const size_t nEnd = vChecks.size() * (c + 1) / nChunks;
+            WorkerQueue& q = queues[nQueues ? 1 + (nFirst + c) % nQueues : 0];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            for (; nPos < nEnd; ++nPos) {
+                q.jobs.push_back(Job());
+                q.jobs.back().check.swap(vChecks[nPos]);
+                q.jobs.back().group = &group;
+            }
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nIdle == 0)
+            return;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
-    ~CCheckQueue()
+    //! Help out until all checks of the group are done.
+    bool Wait(Group& group)
     {
+        std::vector<Job> vBatch;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(group.mutex);
+                if (group.nTodo == 0)
+                    break;
+            }
+            if (Find(-1, vBatch)) {
+                Run(vBatch);
+                continue;
+            }
+            // Everything left is being worked on by other threads.
+            std::unique_lock<std::mutex> lock(group.mutex);
+            group.cond.wait(lock, [&group]() { return group.nTodo == 0; });
+            break;
+        }
+        return group.fAllOk;
     }
 
-    bool IsIdle()
+public:
+    //! Create a new check queue
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nQueued(0), nNext(0), nIdle(0),
+        nBatchSize(nBatchSizeIn), nChecksTotal(0), nStealsTotal(0), nBatchesTotal(0) {}
+
+    //! Worker thread. Returns only when the thread is interrupted.
+    void Thread()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        int nOwn = 1;
+        while (nOwn <= MAX_WORKERS && queues[nOwn].fOwned.exchange(true))
+            ++nOwn;
+        assert(nOwn <= MAX_WORKERS);
+        int nHighest = nWorkers;
+        while (nHighest < nOwn && !nWorkers.compare_exchange_weak(nHighest, nOwn)) {}
+
+        struct Release {
+            std::atomic<bool>& fOwned;
+            ~Release() { fOwned = false; }
+        } release{queues[nOwn].fOwned};
+
+        std::vector<Job> vBatch;
+        vBatch.reserve(nBatchSize);
+        while (true) {
+            if (Find(nOwn, vBatch)) {
+                Run(vBatch);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nQueued == 0) {
+                nIdle++;
+                try {
+                    condWorker.wait(lock);
+                } catch (...) {
+                    nIdle--;
+                    throw;
+                }
+                nIdle--;
+            }
+        }
     }
 
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.nChecks = nChecksTotal;
+        stats.nSteals = nStealsTotal;
+        stats.nBatches = nBatchesTotal;
+        return stats;
+    }
 };
 
-/** 
- * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
+/**
+ * RAII-style controller object for a CCheckQueue that guarantees the checks
+ * added through it are finished before continuing.
  */
 template <typename T>
 class CCheckQueueControl
 {
 private:
     CCheckQueue<T>* pqueue;
+    typename CCheckQueue<T>::Group group;
     bool fDone;
+    bool fResult;
 
 public:
-    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
+    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false), fResult(true)
     {
-        // passed queue is supposed to be unused, or NULL
-        if (pqueue != NULL) {
-            bool isIdle = pqueue->IsIdle();
-            assert(isIdle);
-        }
     }
 
+    CCheckQueueControl(const CCheckQueueControl&) = delete;
+    CCheckQueueControl& operator=(const CCheckQueueControl&) = delete;
+
     bool Wait()
     {
-        if (pqueue == NULL)
-            return true;
-        bool fRet = pqueue->Wait();
+        if (fDone)
+            return fResult;
+        if (pqueue != NULL)
+            fResult = pqueue->Wait(group);
         fDone = true;
-        return fRet;
+        return fResult;
     }
 
     void Add(std::vector<T>& vChecks)
     {
+        assert(!fDone);
         if (pqueue != NULL)
-            pqueue->Add(vChecks);
+            pqueue->Add(group, vChecks);
     }
 
+    //! Checks run for this control so far.
+    unsigned int Checks() const { return group.nChecks; }
+
+    //! Checks run by a thread that took them from another thread's deque.
+    unsigned int Steals() const { return group.nSteals; }
+
     ~CCheckQueueControl()
     {
-        if (!fDone)
-            Wait();
+        Wait();
     }
 };
 
@@ -12,6 +12,7 @@
 #include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
+#include "utxocommit.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -151,6 +152,24 @@ private:
     uint256 hashBlock;
 };
 
+/**
+ * Read-only view of the coins at one point in time. Cursors made from it are
+ * independent of each other and of later writes, so they can be used from
+ * several threads at once.
+ */
+class CCoinsViewSnapshot
+{
+public:
+    virtual ~CCoinsViewSnapshot() {}
+
+    //! Best block at the time the snapshot was taken
+    virtual uint256 GetBestBlock() const = 0;
+
+    //! Cursor over the coins whose txid begins with the given byte.
+    //! It must not outlive the snapshot.
+    virtual CCoinsViewCursor *Cursor(uint8_t prefix) const = 0;
+};
+
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
@@ -174,12 +193,20 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. commitDelta is the change the
+    //! coins in mapCoins make to the UTXO commitment.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUtxoCommit &commitDelta);
+
+    //! Retrieve the UTXO commitment of the state this view represents.
+    //! Returns false if the view does not maintain one.
+    virtual bool GetUtxoCommit(CUtxoCommit &commit) const;
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
+    //! Get a snapshot of the state (nullptr if not implemented)
+    virtual CCoinsViewSnapshot *Snapshot() const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 
@@ -201,8 +228,11 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    CCoinsView* GetBackend() const { return base; }
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUtxoCommit &commitDelta) override;
+    bool GetUtxoCommit(CUtxoCommit &commit) const override;
     CCoinsViewCursor *Cursor() const override;
+    CCoinsViewSnapshot *Snapshot() const override;
     size_t EstimateSize() const override;
 };
 
@@ -221,6 +251,9 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Coins added and spent in this cache, as a change to the base's UTXO commitment. */
+    CUtxoCommit commitDelta;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -229,7 +262,8 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUtxoCommit &commitDelta);
+    bool GetUtxoCommit(CUtxoCommit &commit) const;
 
     /**
      * Check if we have the given utxo already loaded in this cache.
@@ -258,6 +292,19 @@ public:
      */
     bool SpendCoin(const COutPoint &outpoint, Coin* moveto = nullptr);
 
+    /**
+     * Insert a coin that was read from the backing view, as if it had been
+     * fetched through a cache miss. Does nothing if the outpoint is already
+     * cached. Used to warm the cache ahead of block connection.
+     */
+    void WarmCoin(const COutPoint &outpoint, Coin&& coin);
+
+    /**
+     * Check if there is any entry (spent or unspent) for the outpoint in
+     * this cache. No calls to the backing CCoinsView are made.
+     */
+    bool IsCached(const COutPoint &outpoint) const;
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "coinsprefetch.h"
+#include "checkqueue.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <unordered_set>
+
+// Number of outpoints each prefetch job reads.
+static const size_t PREFETCH_JOB_SIZE = 16;
+
+static CCheckQueue<CCoinsPrefetchCheck> prefetchqueue(8);
+
+namespace {
+struct TxidHasher {
+    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+};
+} // namespace
+
+bool CCoinsPrefetchCheck::operator()() {
+    for (size_t i = 0; i < count; ++i)
+        found[i] = view->GetCoin(outpoints[i], coins[i]);
+    return true;
+}
+
+void CCoinsPrefetchCheck::swap(CCoinsPrefetchCheck& check) {
+    std::swap(view, check.view);
+    std::swap(outpoints, check.outpoints);
+    std::swap(coins, check.coins);
+    std::swap(found, check.found);
+    std::swap(count, check.count);
+}
+
+std::vector<COutPoint> CollectPrefetchOutpoints(const CBlock& block) {
+    std::unordered_set<uint256, TxidHasher> created;
+    created.reserve(block.vtx.size());
+    for (auto& tx : block.vtx)
+        created.insert(tx->GetHash());
+
+    std::unordered_set<COutPoint, SaltedOutpointHasher> seen;
+    std::vector<COutPoint> outpoints;
+    for (auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (auto& in : tx->vin) {
+            if (created.count(in.prevout.hash))
+                continue;
+            if (!seen.insert(in.prevout).second)
+                continue;
+            outpoints.push_back(in.prevout);
+        }
+    }
+    return outpoints;
+}
+
+CoinsPrefetchStats PrefetchCoins(CCoinsViewCache& cache,
+                                 const std::vector<COutPoint>& outpoints)
+{
+    CoinsPrefetchStats stats;
+    stats.requested = outpoints.size();
+
+    std::vector<COutPoint> toFetch;
+    toFetch.reserve(outpoints.size());
+    for (auto& o : outpoints) {
+        if (cache.IsCached(o))
+            ++stats.cached;
+        else
+            toFetch.push_back(o);
+    }
+    if (toFetch.empty())
+        return stats;
+
+    // Workers write to disjoint slots; vector<bool> is not safe for that.
+    std::vector<Coin> coins(toFetch.size());
+    std::vector<char> found(toFetch.size(), 0);
+    const CCoinsView* backend = cache.GetBackend();
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&prefetchqueue);
+        std::vector<CCoinsPrefetchCheck> jobs;
+        jobs.reserve(toFetch.size() / PREFETCH_JOB_SIZE + 1);
+        for (size_t i = 0; i < toFetch.size(); i += PREFETCH_JOB_SIZE) {
+            size_t n = std::min(PREFETCH_JOB_SIZE, toFetch.size() - i);
+            jobs.emplace_back(backend, &toFetch[i], &coins[i], &found[i], n);
+        }
+        control.Add(jobs);
+        control.Wait();
+    }
+
+    for (size_t i = 0; i < toFetch.size(); ++i) {
+        if (!found[i]) {
+            ++stats.missing;
+            continue;
+        }
+        ++stats.fetched;
+        cache.WarmCoin(toFetch[i], std::move(coins[i]));
+    }
+    return stats;
+}
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    prefetchqueue.Thread();
+}
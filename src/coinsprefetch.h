@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "primitives/transaction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CBlock;
+class CCoinsView;
+class CCoinsViewCache;
+class Coin;
+
+/**
+ * A batch of outpoints to read from a coins view. Results are written to
+ * slots owned by the caller, so batches can be processed in any order by
+ * the prefetch queue.
+ */
+class CCoinsPrefetchCheck
+{
+public:
+    CCoinsPrefetchCheck() : view(nullptr), outpoints(nullptr),
+        coins(nullptr), found(nullptr), count(0) { }
+
+    CCoinsPrefetchCheck(const CCoinsView* viewIn, const COutPoint* outpointsIn,
+                        Coin* coinsIn, char* foundIn, size_t countIn) :
+        view(viewIn), outpoints(outpointsIn), coins(coinsIn),
+        found(foundIn), count(countIn) { }
+
+    bool operator()();
+    void swap(CCoinsPrefetchCheck& check);
+
+private:
+    const CCoinsView* view;
+    const COutPoint* outpoints;
+    Coin* coins;
+    char* found;
+    size_t count;
+};
+
+struct CoinsPrefetchStats {
+    CoinsPrefetchStats() : requested(0), cached(0), fetched(0), missing(0) { }
+
+    //! Outpoints spent by the block that are not created within it.
+    size_t requested;
+    //! Outpoints already present in the cache.
+    size_t cached;
+    //! Outpoints read from the backing view.
+    size_t fetched;
+    //! Outpoints that the backing view did not have.
+    size_t missing;
+};
+
+/**
+ * Returns the outpoints spent by the transactions in a block, without
+ * duplicates and without the outputs created by the block itself.
+ */
+std::vector<COutPoint> CollectPrefetchOutpoints(const CBlock& block);
+
+/**
+ * Read the outpoints not yet in cache from the cache's backing view, using
+ * the prefetch worker threads, and insert them into the cache.
+ *
+ * The backing view must allow concurrent GetCoin calls (such as
+ * CCoinsViewDB), and must not be written to while prefetching.
+ */
+CoinsPrefetchStats PrefetchCoins(CCoinsViewCache& cache,
+                                 const std::vector<COutPoint>& outpoints);
+
+/** Worker thread for the coin prefetch queue. */
+void ThreadCoinsPrefetch();
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "init.h"
+#include "serialize.h"
+#include "util.h"
+
+#include <map>
+#include <thread>
+#include <vector>
+
+struct CCoinsStatsScan::Shard
+{
+    uint256 hashSerialized;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    CUtxoCommit commit;
+    uint8_t prefix;
+
+    Shard() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0), prefix(0) {}
+};
+
+namespace {
+
+template <typename Stats>
+void ApplyStats(Stats& stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << *(const CScriptBase*)(&output.second.out.scriptPubKey);
+        ss << VARINT(output.second.out.nValue);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
+} // namespace
+
+CCoinsStatsScan::CCoinsStatsScan(std::unique_ptr<CCoinsViewSnapshot> snapshotIn) :
+    snapshot(std::move(snapshotIn)), nextShard(0), shardsDone(0), interrupt(false), failed(false)
+{
+}
+
+CCoinsStatsScan::~CCoinsStatsScan() { }
+
+bool CCoinsStatsScan::ScanShard(Shard& shard) const
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(snapshot->Cursor(shard.prefix));
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    size_t n = 0;
+    while (pcursor->Valid()) {
+        if ((++n & 0xfff) == 0 && (interrupt || ShutdownRequested()))
+            return false;
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(shard, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            shard.commit.Add(key, coin);
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(shard, ss, prevkey, outputs);
+    }
+    shard.hashSerialized = ss.GetHash();
+    return true;
+}
+
+void CCoinsStatsScan::Worker(Shard* shards)
+{
+    int i;
+    while (!failed && (i = nextShard++) < SHARDS) {
+        if (interrupt || !ScanShard(shards[i])) {
+            failed = true;
+            return;
+        }
+        ++shardsDone;
+    }
+}
+
+bool CCoinsStatsScan::Run(CCoinsStats& stats, int nThreads)
+{
+    std::vector<Shard> shards(SHARDS);
+    for (int i = 0; i < SHARDS; ++i)
+        shards[i].prefix = i;
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; ++i)
+        threads.emplace_back(&CCoinsStatsScan::Worker, this, shards.data());
+    Worker(shards.data());
+    for (std::thread& t : threads)
+        t.join();
+
+    if (failed)
+        return false;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = snapshot->GetBestBlock();
+    ss << stats.hashBlock;
+    for (const Shard& shard : shards) {
+        ss << shard.hashSerialized;
+        stats.nTransactions += shard.nTransactions;
+        stats.nTransactionOutputs += shard.nTransactionOutputs;
+        stats.nTotalAmount += shard.nTotalAmount;
+        stats.commit.Add(shard.commit);
+    }
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
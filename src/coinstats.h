@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "uint256.h"
+#include "utxocommit.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+class CCoinsViewSnapshot;
+
+/** Statistics about the unspent transaction output set */
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint256 hashSerialized;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+    CUtxoCommit commit;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Calculates CCoinsStats from a snapshot of the coin database.
+ *
+ * The key space is split into shards by the first byte of the txid, so all
+ * outputs of a transaction fall in the same shard. Shards are scanned in
+ * parallel and their hashes and multisets are combined in shard order, which
+ * makes the result independent of the number of threads.
+ *
+ * Progress() and Interrupt() may be called from other threads while Run()
+ * is in progress.
+ */
+class CCoinsStatsScan
+{
+public:
+    static const int SHARDS = 256;
+
+    explicit CCoinsStatsScan(std::unique_ptr<CCoinsViewSnapshot> snapshot);
+    ~CCoinsStatsScan();
+
+    //! Scan all shards on nThreads threads. Returns false on a read error or
+    //! when interrupted. nHeight and nDiskSize are left to the caller.
+    bool Run(CCoinsStats& stats, int nThreads);
+
+    //! Fraction of the shards scanned so far.
+    double Progress() const { return double(shardsDone) / SHARDS; }
+
+    //! Make Run() return early.
+    void Interrupt() { interrupt = true; }
+
+private:
+    struct Shard;
+
+    bool ScanShard(Shard& shard) const;
+    void Worker(Shard* shards);
+
+    std::unique_ptr<CCoinsViewSnapshot> snapshot;
+    std::atomic<int> nextShard;
+    std::atomic<int> shardsDone;
+    std::atomic<bool> interrupt;
+    std::atomic<bool> failed;
+};
+
+#endif // BITCOIN_COINSTATS_H
@@ -25,15 +25,15 @@ std::vector<PrefilledTransaction> InventoryKnownPrefiller::fillFrom(
 
     const unsigned MAX_PREFILLED_SIZE = 10 * 1000; // 10KB
     unsigned int txsSize = ::GetSerializeSize(
-            filled[0].tx, SER_NETWORK, PROTOCOL_VERSION);
+            *filled[0].tx, SER_NETWORK, PROTOCOL_VERSION);
 
     for (size_t i = 1; i < block.vtx.size(); i++) {
-        const CTransaction& tx = block.vtx[i];
+        const CTransactionRef& tx = block.vtx[i];
 
-        if (inventoryKnown->contains(tx.GetHash()))
+        if (inventoryKnown->contains(tx->GetHash()))
             continue;
 
-        txsSize += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        txsSize += ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
         if (txsSize > MAX_PREFILLED_SIZE) {
             // Appending more would exceed MAX_PREFILLED_SIZE,
             // just return what we have.
@@ -78,7 +78,7 @@ std::vector<ThinTx> CompactStub::allTransactions() const {
     for (size_t i = 0; i < block.prefilledtxn.size(); ++i) {
         lastIndex += block.prefilledtxn.at(i).index + 1;
         all.at(lastIndex) = ThinTx(
-            block.prefilledtxn.at(i).tx.GetHash());
+            block.prefilledtxn.at(i).tx->GetHash());
 
     }
 
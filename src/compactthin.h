@@ -42,8 +42,8 @@ struct CompactStub : public StubData {
     std::vector<ThinTx> allTransactions() const override;
 
     // Transactions provided in the stub
-    std::vector<CTransaction> missingProvided() const override {
-        std::vector<CTransaction> txs;
+    std::vector<CTransactionRef> missingProvided() const override {
+        std::vector<CTransactionRef> txs;
 
         for (auto& p : block.prefilledtxn)
             txs.push_back(p.tx);
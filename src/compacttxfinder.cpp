@@ -4,44 +4,62 @@
 #include "compacttxfinder.h"
 #include "util.h"
 #include "txmempool.h"
-#include "blockencodings.h" // GetShortID
+#include "blockencodings.h" // GetShortIDs
 
 CompactTxFinder::CompactTxFinder(const CTxMemPool& m,
-        uint64_t idk0, uint64_t idk1) : mempool(m) {
+        uint64_t idk0, uint64_t idk1) : mask(0), mempool(m) {
     initMapping(idk0, idk1);
 }
 
 void CompactTxFinder::initMapping(uint64_t idk0, uint64_t idk1) {
 
-    std::vector<uint256> hashes;
-    mempool.queryHashes(hashes);
+    mempool.queryHashes(txids);
+    std::vector<uint64_t> shortids;
+    GetShortIDs(idk0, idk1, txids, shortids);
 
-    for (auto& t : hashes) {
-        uint64_t shortID = GetShortID(idk0, idk1, t);
+    // Keep the table at most half full. Short IDs are
+    // SipHash output, so the low bits serve as index.
+    size_t size = 16;
+    while (size < 2 * shortids.size())
+        size *= 2;
+    slots.assign(size, Slot{0, EMPTY});
+    mask = size - 1;
 
-        if (mappedMempool.count(shortID)) {
+    for (size_t pos = 0; pos < shortids.size(); ++pos) {
+        const uint64_t id = shortids[pos];
+        size_t i = id & mask;
+        while (slots[i].pos != EMPTY && slots[i].shortid != id)
+            i = (i + 1) & mask;
 
-            LogPrint(Log::BLOCK, "ShortID hash collision in mempool");
-
-            // Erase, so the tx re-fetched from peer instead.
-            mappedMempool.erase(shortID);
+        if (slots[i].pos == EMPTY) {
+            slots[i].shortid = id;
+            slots[i].pos = pos;
             continue;
         }
-        mappedMempool[shortID] = t;
+
+        LogPrint(Log::BLOCK, "ShortID hash collision in mempool\n");
+
+        // Forget, so the tx re-fetched from peer instead.
+        slots[i].pos = COLLIDED;
     }
 }
 
-CTransaction CompactTxFinder::operator()(const ThinTx& hash) const {
-
-    CTransaction match;
+const CompactTxFinder::Slot* CompactTxFinder::find(uint64_t shortid) const {
+    size_t i = shortid & mask;
+    while (slots[i].pos != EMPTY) {
+        if (slots[i].shortid == shortid)
+            return &slots[i];
+        i = (i + 1) & mask;
+    }
+    return nullptr;
+}
 
-    if (!mappedMempool.count(hash.shortid()))
-        return match;
+CTransactionRef CompactTxFinder::operator()(const ThinTx& hash) const {
 
-    uint256 realHash = mappedMempool.find(hash.shortid())->second;
+    const Slot* s = find(hash.shortid());
+    if (s == nullptr || s->pos == COLLIDED)
+        return nullptr;
 
-    // Tx may not exist anymore in mempool.
-    // Lookup leaves match empty if it does not.
-    mempool.lookup(realHash, match);
-    return match;
+    // Tx may not exist anymore in mempool, in which case this is null.
+    return mempool.get(txids[s->pos]);
 }
@@ -6,10 +6,9 @@
 
 #include "uint256.h"
 #include "thinblock.h" // TxFinder
-#include <unordered_map>
+#include <vector>
 
 class CTxMemPool;
-class CTransaction;
 class ThinTx;
 
 // Specialized tx finder for looking up
@@ -17,6 +16,10 @@ class ThinTx;
 //
 // The generic tx finder is in-efficient for compact blocks
 // due to all mempool txs being hashed for every lookup.
+//
+// Short IDs of the whole mempool are computed in one batch
+// and kept in an open addressing table of positions in
+// the copied txid array.
 class CompactTxFinder : public TxFinder {
     public:
 
@@ -25,10 +28,22 @@ class CompactTxFinder : public TxFinder {
 
         void initMapping(uint64_t idk0, uint64_t idk1);
 
-        CTransaction operator()(const ThinTx& hash) const override;
+        CTransactionRef operator()(const ThinTx& hash) const override;
 
     private:
-        std::unordered_map<uint64_t, uint256> mappedMempool;
+        struct Slot {
+            uint64_t shortid;
+            uint32_t pos;
+        };
+        static const uint32_t EMPTY = 0xffffffff;
+        // More than one mempool tx has this short ID.
+        static const uint32_t COLLIDED = 0xfffffffe;
+
+        const Slot* find(uint64_t shortid) const;
+
+        std::vector<uint256> txids;
+        std::vector<Slot> slots;
+        size_t mask;
         const CTxMemPool& mempool;
 };
 
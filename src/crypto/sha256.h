@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,25 @@ public:
     CSHA256& Reset();
 };
 
+/** SHA-256 backends that SHA256AutoDetect may select. */
+enum SHA256Backend {
+    SHA256_SSE41 = 1 << 0, //!< 4-way SSE4.1 for SHA256D64
+    SHA256_AVX2 = 1 << 1,  //!< 8-way AVX2 for SHA256D64
+    SHA256_SHANI = 1 << 2, //!< SHA extensions for all hashing
+    SHA256_ALL = SHA256_SSE41 | SHA256_AVX2 | SHA256_SHANI,
+};
+
+/**
+ * Select the fastest SHA-256 implementation supported by both this build and
+ * the CPU, limited to the backends in allowed. Returns a description of the
+ * selection. Not thread safe; call before hashing starts.
+ */
+std::string SHA256AutoDetect(unsigned int allowed = SHA256_ALL);
+
+/**
+ * Compute the double SHA-256 of each of the blocks 64-byte inputs at in,
+ * writing the blocks 32-byte results to out. out may equal in.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include "crypto/sha256_multiway.h"
+
+#include <immintrin.h>
+
+namespace sha256d64_avx2
+{
+namespace
+{
+struct Vec8
+{
+    typedef __m256i T;
+    static const int LANES = 8;
+
+    static T Set1(uint32_t x) { return _mm256_set1_epi32(x); }
+    static T Add(T x, T y) { return _mm256_add_epi32(x, y); }
+    static T Xor(T x, T y) { return _mm256_xor_si256(x, y); }
+    static T Or(T x, T y) { return _mm256_or_si256(x, y); }
+    static T And(T x, T y) { return _mm256_and_si256(x, y); }
+    template<int n> static T ShR(T x) { return _mm256_srli_epi32(x, n); }
+    template<int n> static T ShL(T x) { return _mm256_slli_epi32(x, n); }
+    static T Load(const uint32_t* lanes) { return _mm256_loadu_si256((const __m256i*)lanes); }
+    static void Store(uint32_t* lanes, T x) { _mm256_storeu_si256((__m256i*)lanes, x); }
+};
+} // namespace
+
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::TransformD64<Vec8>(out, in);
+}
+
+} // namespace sha256d64_avx2
+
+#endif
@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+#define BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+
+#include "crypto/common.h"
+
+#include <stdint.h>
+
+/**
+ * Lane-parallel double SHA-256 of 64-byte inputs, shared by the SIMD
+ * backends. Each lane of the vector type hashes one input.
+ *
+ * V supplies the vector type T, the lane count LANES and the lane-wise
+ * operations used below. Only include this from a translation unit that is
+ * compiled with the instruction set V needs.
+ */
+namespace sha256_multiway
+{
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+template<typename V, int n>
+inline typename V::T Rotr(typename V::T x) { return V::Or(V::template ShR<n>(x), V::template ShL<32 - n>(x)); }
+
+template<typename V>
+inline typename V::T Ch(typename V::T x, typename V::T y, typename V::T z) { return V::Xor(z, V::And(x, V::Xor(y, z))); }
+template<typename V>
+inline typename V::T Maj(typename V::T x, typename V::T y, typename V::T z) { return V::Or(V::And(x, y), V::And(z, V::Or(x, y))); }
+template<typename V>
+inline typename V::T Sigma0(typename V::T x) { return V::Xor(V::Xor(Rotr<V, 2>(x), Rotr<V, 13>(x)), Rotr<V, 22>(x)); }
+template<typename V>
+inline typename V::T Sigma1(typename V::T x) { return V::Xor(V::Xor(Rotr<V, 6>(x), Rotr<V, 11>(x)), Rotr<V, 25>(x)); }
+template<typename V>
+inline typename V::T sigma0(typename V::T x) { return V::Xor(V::Xor(Rotr<V, 7>(x), Rotr<V, 18>(x)), V::template ShR<3>(x)); }
+template<typename V>
+inline typename V::T sigma1(typename V::T x) { return V::Xor(V::Xor(Rotr<V, 17>(x), Rotr<V, 19>(x)), V::template ShR<10>(x)); }
+
+/** Run the compression function on state s with message w (clobbered). */
+template<typename V>
+void Compress(typename V::T* s, typename V::T* w)
+{
+    typedef typename V::T T;
+    T a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; ++i) {
+        if (i >= 16) {
+            w[i & 15] = V::Add(V::Add(sigma1<V>(w[(i + 14) & 15]), w[(i + 9) & 15]),
+                               V::Add(sigma0<V>(w[(i + 1) & 15]), w[i & 15]));
+        }
+        T t1 = V::Add(V::Add(h, Sigma1<V>(e)), V::Add(V::Add(Ch<V>(e, f, g), V::Set1(K[i])), w[i & 15]));
+        T t2 = V::Add(Sigma0<V>(a), Maj<V>(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = V::Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = V::Add(t1, t2);
+    }
+    s[0] = V::Add(s[0], a);
+    s[1] = V::Add(s[1], b);
+    s[2] = V::Add(s[2], c);
+    s[3] = V::Add(s[3], d);
+    s[4] = V::Add(s[4], e);
+    s[5] = V::Add(s[5], f);
+    s[6] = V::Add(s[6], g);
+    s[7] = V::Add(s[7], h);
+}
+
+/**
+ * Double SHA-256 of V::LANES consecutive 64-byte inputs. All input is read
+ * before any output is written, so out may alias in.
+ */
+template<typename V>
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    typedef typename V::T T;
+    uint32_t lanes[V::LANES];
+    T s[8], w[16];
+
+    for (int i = 0; i < 8; ++i)
+        s[i] = V::Set1(INIT[i]);
+    for (int i = 0; i < 16; ++i) {
+        for (int j = 0; j < V::LANES; ++j)
+            lanes[j] = ReadBE32(in + 64 * j + 4 * i);
+        w[i] = V::Load(lanes);
+    }
+    Compress<V>(s, w);
+
+    // Padding block of the 64-byte message.
+    w[0] = V::Set1(0x80000000);
+    for (int i = 1; i < 15; ++i)
+        w[i] = V::Set1(0);
+    w[15] = V::Set1(64 << 3);
+    Compress<V>(s, w);
+
+    // Second hash, over the 32-byte digest and its padding.
+    for (int i = 0; i < 8; ++i) {
+        w[i] = s[i];
+        s[i] = V::Set1(INIT[i]);
+    }
+    w[8] = V::Set1(0x80000000);
+    for (int i = 9; i < 15; ++i)
+        w[i] = V::Set1(0);
+    w[15] = V::Set1(32 << 3);
+    Compress<V>(s, w);
+
+    for (int i = 0; i < 8; ++i) {
+        V::Store(lanes, s[i]);
+        for (int j = 0; j < V::LANES; ++j)
+            WriteBE32(out + 32 * j + 4 * i, lanes[j]);
+    }
+}
+
+} // namespace sha256_multiway
+
+#endif // BITCOIN_CRYPTO_SHA256_MULTIWAY_H
@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_SSE41
+
+#include "crypto/sha256_multiway.h"
+
+#include <immintrin.h>
+
+namespace sha256d64_sse41
+{
+namespace
+{
+struct Vec4
+{
+    typedef __m128i T;
+    static const int LANES = 4;
+
+    static T Set1(uint32_t x) { return _mm_set1_epi32(x); }
+    static T Add(T x, T y) { return _mm_add_epi32(x, y); }
+    static T Xor(T x, T y) { return _mm_xor_si128(x, y); }
+    static T Or(T x, T y) { return _mm_or_si128(x, y); }
+    static T And(T x, T y) { return _mm_and_si128(x, y); }
+    template<int n> static T ShR(T x) { return _mm_srli_epi32(x, n); }
+    template<int n> static T ShL(T x) { return _mm_slli_epi32(x, n); }
+    static T Load(const uint32_t* lanes) { return _mm_loadu_si128((const __m128i*)lanes); }
+    static void Store(uint32_t* lanes, T x) { _mm_storeu_si128((__m128i*)lanes, x); }
+};
+} // namespace
+
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::TransformD64<Vec4>(out, in);
+}
+
+} // namespace sha256d64_sse41
+
+#endif
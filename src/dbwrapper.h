@@ -268,6 +268,25 @@ public:
         return new CDBIterator(pdb->NewIterator(iteroptions));
     }
 
+    //! Iterate over the database as it was when snapshot was taken.
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(pdb->NewIterator(options));
+    }
+
+    //! Pin the current state of the database. Must be released with ReleaseSnapshot.
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot)
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
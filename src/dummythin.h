@@ -13,7 +13,7 @@ class DummyThinWorker : public ThinBlockWorker {
         DummyThinWorker(ThinBlockManager& mg, NodeId id)
             : ThinBlockWorker(mg, id) { }
 
-        bool addTx(const uint256&, const CTransaction& tx) override { return false; }
+        bool addTx(const uint256&, const CTransactionRef& tx) override { return false; }
 
         void buildStub(const StubData&, const TxFinder&, CConnman&, CNode&) override { }
         void addWork(const uint256& block) override { }
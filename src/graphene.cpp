@@ -0,0 +1,245 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "graphene.h"
+#include "blockencodings.h" // validateNumTxs
+#include "crypto/common.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "protocol.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Bytes per IBLT cell on the wire.
+const double IBLT_CELL_SIZE = 16;
+// Cells per key the IBLT is expected to need, as used when choosing the
+// false positive rate of the filter.
+const double IBLT_OVERHEAD = 2.0;
+
+// Sorts like the txid does in canonical order. The cheap hash holds the
+// first 8 bytes of the txid, which are the most significant in a
+// bytewise comparison.
+uint64_t OrderKey(uint64_t cheap)
+{
+    return ReadBE64(reinterpret_cast<const unsigned char*>(&cheap));
+}
+
+// Bits needed for ranks 0 to n - 1.
+size_t RankBits(size_t n)
+{
+    size_t nBits = 1;
+    while ((uint64_t(1) << nBits) < n)
+        ++nBits;
+    return nBits;
+}
+
+std::vector<unsigned char> PackRanks(const std::vector<uint32_t>& ranks)
+{
+    const size_t nBits = RankBits(ranks.size());
+    std::vector<unsigned char> packed((ranks.size() * nBits + 7) / 8);
+    size_t nPos = 0;
+    for (uint32_t rank : ranks) {
+        for (size_t b = 0; b < nBits; ++b, ++nPos) {
+            if (rank & (uint32_t(1) << b))
+                packed[nPos / 8] |= 1 << (nPos % 8);
+        }
+    }
+    return packed;
+}
+
+std::vector<uint32_t> UnpackRanks(const std::vector<unsigned char>& packed, size_t n)
+{
+    const size_t nBits = RankBits(n);
+    std::vector<uint32_t> ranks(n);
+    size_t nPos = 0;
+    for (uint32_t& rank : ranks) {
+        for (size_t b = 0; b < nBits; ++b, ++nPos) {
+            if (packed[nPos / 8] & (1 << (nPos % 8)))
+                rank |= uint32_t(1) << b;
+        }
+    }
+    return ranks;
+}
+
+// The filter false positive rate that minimizes the size of the filter
+// and the IBLT together, when nOthers transactions that are not in the
+// block are tested against it (Graphene, section 3.2).
+double ChooseFPRate(size_t nBlockTxs, uint64_t nOthers)
+{
+    if (nOthers == 0)
+        return 1.0;
+    const double LN2SQUARED = std::log(2.0) * std::log(2.0);
+    double fpRate = nBlockTxs / (8 * LN2SQUARED * IBLT_OVERHEAD * IBLT_CELL_SIZE * nOthers);
+    // Smallest rate a filter within protocol limits can provide.
+    double fpRateMin = std::exp(-(MAX_BLOOM_FILTER_SIZE * 8.0) * LN2SQUARED / nBlockTxs);
+    return std::min(1.0, std::max(fpRate, fpRateMin));
+}
+
+} // namespace
+
+GrapheneBlock::GrapheneBlock() : numTxs(0) { }
+
+GrapheneBlock::GrapheneBlock(const CBlock& block, uint64_t receiverMempoolTxs) :
+    header(block.GetBlockHeader()), numTxs(block.vtx.size())
+{
+    if (block.vtx.empty())
+        throw std::invalid_argument("block has no transactions");
+    coinbase = block.vtx[0];
+
+    const size_t nBlockTxs = block.vtx.size() - 1;
+    const uint64_t nOthers = receiverMempoolTxs > nBlockTxs
+        ? receiverMempoolTxs - nBlockTxs : 0;
+
+    const unsigned int nFilterElements = std::max<size_t>(1, nBlockTxs);
+    filter = CBloomFilter(nFilterElements, ChooseFPRate(nBlockTxs, nOthers),
+            GetRand(std::numeric_limits<uint32_t>::max()), BLOOM_UPDATE_NONE);
+
+    // Room for the false positives the receiver is likely to get, and for
+    // a few transactions it does not have.
+    const double nFalsePositives = filter.FalsePositiveRate(nFilterElements) * nOthers;
+    const size_t nDiff = std::ceil(nFalsePositives + 2 * std::sqrt(nFalsePositives))
+        + nBlockTxs / 100 + 1;
+    iblt = CIblt(CIblt::CellsFor(nDiff), GetRand(std::numeric_limits<uint64_t>::max()));
+
+    std::vector<uint64_t> keys;
+    keys.reserve(nBlockTxs);
+    std::unordered_set<uint64_t> seen;
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        const uint256& hash = block.vtx[i]->GetHash();
+        const uint64_t cheap = hash.GetCheapHash();
+        if (!seen.insert(cheap).second)
+            throw std::runtime_error("graphene cheap hash collision");
+        filter.insert(hash);
+        iblt.insert(cheap);
+        keys.push_back(OrderKey(cheap));
+    }
+
+    if (std::is_sorted(keys.begin(), keys.end()))
+        return;
+
+    std::vector<uint64_t> sorted(keys);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<uint32_t> ranks;
+    ranks.reserve(keys.size());
+    for (uint64_t key : keys)
+        ranks.push_back(std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin());
+    order = PackRanks(ranks);
+}
+
+void GrapheneBlock::selfValidate(uint64_t currMaxBlockSize) const {
+
+    if (header.GetHash().IsNull())
+        throw std::invalid_argument("graphene block is Null");
+
+    if (!coinbase || !coinbase->IsCoinBase())
+        throw std::invalid_argument("graphene block is missing coinbase");
+
+    if (numTxs == 0)
+        throw std::invalid_argument("graphene block has no transactions");
+
+    validateNumTxs(numTxs, currMaxBlockSize);
+
+    if (!filter.IsWithinSizeConstraints())
+        throw std::invalid_argument("graphene block filter too large");
+
+    if (iblt.size() == 0 || iblt.size() % CIblt::NUM_HASHES != 0)
+        throw std::invalid_argument("graphene block iblt malformed");
+
+    const size_t nBlockTxs = numTxs - 1;
+    if (!order.empty() && order.size() != (nBlockTxs * RankBits(nBlockTxs) + 7) / 8)
+        throw std::invalid_argument("graphene block order malformed");
+}
+
+std::vector<ThinTx> GrapheneBlock::reconcile(const std::vector<uint256>& mempoolTxids) const {
+
+    CBloomFilter received(filter);
+    received.UpdateEmptyFull();
+
+    // Mempool transactions that may be in the block.
+    CIblt ours(iblt.size(), iblt.salt());
+    std::unordered_map<uint64_t, uint256> candidates;
+    for (const uint256& txid : mempoolTxids) {
+        if (!received.contains(txid))
+            continue;
+        const uint64_t cheap = txid.GetCheapHash();
+        if (!candidates.emplace(cheap, txid).second)
+            throw graphene_decode_error("cheap hash collision in mempool");
+        ours.insert(cheap);
+    }
+
+    CIblt diff(iblt);
+    diff -= ours;
+    std::set<uint64_t> notInMempool;
+    std::set<uint64_t> falsePositives;
+    if (!diff.peel(notInMempool, falsePositives))
+        throw graphene_decode_error("could not decode iblt");
+
+    for (uint64_t cheap : falsePositives) {
+        if (!candidates.erase(cheap))
+            throw graphene_decode_error("iblt decoded to unknown transaction");
+    }
+    for (uint64_t cheap : notInMempool) {
+        if (candidates.count(cheap))
+            throw graphene_decode_error("iblt decoded to known transaction");
+    }
+
+    const size_t nBlockTxs = numTxs - 1;
+    if (candidates.size() + notInMempool.size() != nBlockTxs)
+        throw graphene_decode_error("transaction count mismatch");
+
+    std::vector<std::pair<uint64_t, ThinTx> > sorted;
+    sorted.reserve(nBlockTxs);
+    for (auto& c : candidates)
+        sorted.emplace_back(OrderKey(c.first), ThinTx(c.second));
+    for (uint64_t cheap : notInMempool)
+        sorted.emplace_back(OrderKey(cheap), ThinTx(cheap));
+    std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint64_t, ThinTx>& a, const std::pair<uint64_t, ThinTx>& b) {
+                return a.first < b.first;
+            });
+
+    std::vector<ThinTx> txs;
+    txs.reserve(numTxs);
+    txs.push_back(ThinTx(coinbase->GetHash()));
+
+    if (order.empty()) {
+        for (auto& s : sorted)
+            txs.push_back(s.second);
+        return txs;
+    }
+
+    std::vector<bool> used(nBlockTxs, false);
+    for (uint32_t rank : UnpackRanks(order, nBlockTxs)) {
+        if (rank >= nBlockTxs || used[rank])
+            throw std::invalid_argument("graphene block order is not a permutation");
+        used[rank] = true;
+        txs.push_back(sorted[rank].second);
+    }
+    return txs;
+}
+
+GrapheneWorker::GrapheneWorker(ThinBlockManager& m, NodeId n,
+                std::unique_ptr<TxCountProvider> c) :
+    ThinBlockWorker(m, n),
+    CountProvider(c.release())
+{
+}
+
+void GrapheneWorker::requestBlock(const uint256& block,
+                                  std::vector<CInv>& getDataReq,
+                                  CConnman& connman, CNode& node)
+{
+    // The block is sized for how many transactions we have.
+    uint64_t mempoolTxs = (*CountProvider)();
+
+    CInv inv(MSG_GRAPHENEBLOCK, block);
+    connman.PushMessage(&node, NetMsg(&node, NetMsgType::GET_GRAPHENE, inv, mempoolTxs));
+}
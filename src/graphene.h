@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_GRAPHENE_H
+#define BITCOIN_GRAPHENE_H
+
+#include "bloom.h"
+#include "iblt.h"
+#include "primitives/block.h"
+#include "serialize.h"
+#include "thinblock.h"
+#include "util.h"
+
+#include <stdexcept>
+#include <vector>
+
+// Thrown when a receiver cannot work out the transactions of a graphene
+// block from its mempool. This is expected to happen now and then, and is
+// not the sender's fault.
+struct graphene_decode_error : public std::runtime_error {
+    graphene_decode_error(const std::string& e) : std::runtime_error(e) { }
+};
+
+// Graphene block (Ozisik et al, "Graphene: Efficient Interactive Set
+// Reconciliation Applied to Blockchain Propagation").
+//
+// Rather than listing the transactions of a block, the sender provides a
+// bloom filter over them and an IBLT over their cheap hashes. The receiver
+// passes its mempool through the filter and uses the IBLT to remove the
+// false positives and to find the transactions it does not have. The
+// filter and IBLT are sized for the number of transactions the receiver
+// said it has in its mempool, so their combined size grows with the
+// expected number of false positives rather than with the block.
+//
+// Unless the block is in canonical order (coinbase first, then by txid
+// compared byte by byte as serialized), the order of the transactions is
+// sent as well.
+//
+// Always includes coinbase.
+class GrapheneBlock {
+
+    public:
+        GrapheneBlock();
+        GrapheneBlock(const CBlock&, uint64_t receiverMempoolTxs);
+        ADD_SERIALIZE_METHODS;
+
+        CBlockHeader header;
+        uint32_t numTxs; // all transactions in the block, including coinbase
+        CBloomFilter filter; // over all transactions but coinbase
+        CIblt iblt; // over the cheap hashes of all transactions but coinbase
+        // Position of each transaction but coinbase in the block, as its
+        // rank among them by txid, packed in as few bits as needed. Empty
+        // if the block is in canonical order.
+        std::vector<unsigned char> order;
+        CTransactionRef coinbase;
+
+        // primitive check to see if block is valid
+        // throws on error
+        void selfValidate(uint64_t currMaxBlockSize) const;
+
+        // Works out the transactions of the block from the txids of the
+        // transactions receiver has. Transactions receiver has are listed
+        // with their full hash, others with their cheap hash.
+        //
+        // Throws graphene_decode_error if they cannot be worked out, and
+        // std::invalid_argument if the block is malformed.
+        std::vector<ThinTx> reconcile(const std::vector<uint256>& mempoolTxids) const;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s,
+                Operation ser_action)
+        {
+            READWRITE(header);
+            READWRITE(numTxs);
+            READWRITE(filter);
+            READWRITE(iblt);
+            READWRITE(order);
+            READWRITE(coinbase);
+        }
+};
+
+class GrapheneWorker : public ThinBlockWorker {
+
+    public:
+        GrapheneWorker(ThinBlockManager&, NodeId,
+                std::unique_ptr<struct TxCountProvider>);
+
+        void requestBlock(const uint256& block,
+                std::vector<CInv>& getDataReq,
+                          CConnman&, CNode& node) override;
+
+    private:
+        std::unique_ptr<struct TxCountProvider> CountProvider;
+};
+
+// Functor for providing the number of transactions we have, which the
+// sender sizes the graphene block for.
+struct TxCountProvider {
+    virtual uint64_t operator()() = 0;
+    virtual ~TxCountProvider() = 0;
+};
+inline TxCountProvider::~TxCountProvider() { }
+
+struct GrapheneStub : public StubData {
+    GrapheneStub(const GrapheneBlock& b, const std::vector<ThinTx>& txs) :
+        hdr(b.header), coinbase(b.coinbase), txs(txs)
+    {
+        LogPrint(Log::BLOCK, "Created graphene stub for %s, %d transactions.\n",
+                header().GetHash().ToString(), txs.size());
+    }
+
+    CBlockHeader header() const override {
+        return hdr;
+    }
+
+    // List of all transactions in block
+    std::vector<ThinTx> allTransactions() const override {
+        return txs;
+    }
+
+    // Transactions provded in the stub, if any.
+    std::vector<CTransactionRef> missingProvided() const override {
+        return std::vector<CTransactionRef>(1, coinbase);
+    }
+
+    private:
+        CBlockHeader hdr;
+        CTransactionRef coinbase;
+        std::vector<ThinTx> txs;
+};
+
+#endif
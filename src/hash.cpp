@@ -251,3 +251,60 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+/* Number of values SipHashUint256Batch hashes side by side */
+static const size_t SIPHASH_LANES = 4;
+
+static inline void SipRoundLanes(uint64_t* a0, uint64_t* a1, uint64_t* a2, uint64_t* a3)
+{
+    for (size_t l = 0; l < SIPHASH_LANES; ++l) {
+        uint64_t v0 = a0[l], v1 = a1[l], v2 = a2[l], v3 = a3[l];
+        SIPROUND;
+        a0[l] = v0; a1[l] = v1; a2[l] = v2; a3[l] = v3;
+    }
+}
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* vals, size_t n, uint64_t* out)
+{
+    size_t i = 0;
+    for (; i + SIPHASH_LANES <= n; i += SIPHASH_LANES) {
+        uint64_t v0[SIPHASH_LANES], v1[SIPHASH_LANES], v2[SIPHASH_LANES], v3[SIPHASH_LANES];
+        uint64_t d[SIPHASH_LANES];
+        for (size_t l = 0; l < SIPHASH_LANES; ++l) {
+            d[l] = vals[i + l].GetUint64(0);
+            v0[l] = 0x736f6d6570736575ULL ^ k0;
+            v1[l] = 0x646f72616e646f6dULL ^ k1;
+            v2[l] = 0x6c7967656e657261ULL ^ k0;
+            v3[l] = 0x7465646279746573ULL ^ k1 ^ d[l];
+        }
+        SipRoundLanes(v0, v1, v2, v3);
+        SipRoundLanes(v0, v1, v2, v3);
+        for (int w = 1; w < 4; ++w) {
+            for (size_t l = 0; l < SIPHASH_LANES; ++l) {
+                v0[l] ^= d[l];
+                d[l] = vals[i + l].GetUint64(w);
+                v3[l] ^= d[l];
+            }
+            SipRoundLanes(v0, v1, v2, v3);
+            SipRoundLanes(v0, v1, v2, v3);
+        }
+        for (size_t l = 0; l < SIPHASH_LANES; ++l) {
+            v0[l] ^= d[l];
+            v3[l] ^= ((uint64_t)4) << 59;
+        }
+        SipRoundLanes(v0, v1, v2, v3);
+        SipRoundLanes(v0, v1, v2, v3);
+        for (size_t l = 0; l < SIPHASH_LANES; ++l) {
+            v0[l] ^= ((uint64_t)4) << 59;
+            v2[l] ^= 0xFF;
+        }
+        SipRoundLanes(v0, v1, v2, v3);
+        SipRoundLanes(v0, v1, v2, v3);
+        SipRoundLanes(v0, v1, v2, v3);
+        SipRoundLanes(v0, v1, v2, v3);
+        for (size_t l = 0; l < SIPHASH_LANES; ++l)
+            out[i + l] = v0[l] ^ v1[l] ^ v2[l] ^ v3[l];
+    }
+    for (; i < n; ++i)
+        out[i] = SipHashUint256(k0, k1, vals[i]);
+}
@@ -235,4 +235,9 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** SipHashUint256 of n values with the same key into out. Hashes several
+ *  values side by side, round by round, which keeps the CPU busy and lets
+ *  the compiler vectorize the rounds. */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* vals, size_t n, uint64_t* out);
+
 #endif // BITCOIN_HASH_H
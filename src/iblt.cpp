@@ -0,0 +1,126 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "iblt.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// splitmix64 finalizer. Keys are transaction id prefixes, which are
+// already random, so this only needs to spread them differently for each
+// sub-table and salt.
+uint64_t Mix(uint64_t n)
+{
+    n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    n = (n ^ (n >> 27)) * 0x94d049bb133111ebULL;
+    return n ^ (n >> 31);
+}
+
+const uint64_t CHECKSUM_SEED = 0x9e3779b97f4a7c15ULL;
+
+} // namespace
+
+const size_t CIblt::NUM_HASHES;
+
+CIblt::CIblt() : nSalt(0)
+{
+}
+
+CIblt::CIblt(size_t nCells, uint64_t nSaltIn) : nSalt(nSaltIn)
+{
+    nCells = std::max(nCells, NUM_HASHES);
+    vCells.resize((nCells + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES);
+}
+
+size_t CIblt::CellsFor(size_t nDiff)
+{
+    // Large tables decode with 1.3 cells per key. Small ones mostly fail
+    // when a few keys end up sharing all their cells, which takes more
+    // room to make unlikely. This keeps failures below 1 in 200.
+    return 2 * nDiff + 20;
+}
+
+size_t CIblt::cellIndex(size_t nHash, uint64_t nKey) const
+{
+    const size_t nSubTable = vCells.size() / NUM_HASHES;
+    return nHash * nSubTable + Mix(nKey ^ (nSalt + nHash)) % nSubTable;
+}
+
+uint32_t CIblt::checkSum(uint64_t nKey) const
+{
+    return Mix(nKey ^ nSalt ^ CHECKSUM_SEED);
+}
+
+void CIblt::update(uint64_t nKey, int32_t nCountDelta)
+{
+    const uint32_t nCheck = checkSum(nKey);
+    for (size_t i = 0; i < NUM_HASHES; ++i) {
+        Cell& cell = vCells[cellIndex(i, nKey)];
+        cell.nCount += nCountDelta;
+        cell.nKeySum ^= nKey;
+        cell.nCheckSum ^= nCheck;
+    }
+}
+
+void CIblt::insert(uint64_t nKey)
+{
+    update(nKey, 1);
+}
+
+void CIblt::erase(uint64_t nKey)
+{
+    update(nKey, -1);
+}
+
+CIblt& CIblt::operator-=(const CIblt& other)
+{
+    if (vCells.size() != other.vCells.size() || nSalt != other.nSalt)
+        throw std::invalid_argument("iblt size or salt mismatch");
+
+    for (size_t i = 0; i < vCells.size(); ++i) {
+        vCells[i].nCount -= other.vCells[i].nCount;
+        vCells[i].nKeySum ^= other.vCells[i].nKeySum;
+        vCells[i].nCheckSum ^= other.vCells[i].nCheckSum;
+    }
+    return *this;
+}
+
+bool CIblt::peel(std::set<uint64_t>& onlyHere, std::set<uint64_t>& onlyThere) const
+{
+    if (vCells.empty() || vCells.size() % NUM_HASHES != 0)
+        return false;
+
+    CIblt table(*this);
+    std::vector<size_t> pure;
+    auto isPure = [&table](const Cell& c) {
+        return (c.nCount == 1 || c.nCount == -1) && c.nCheckSum == table.checkSum(c.nKeySum);
+    };
+    for (size_t i = 0; i < table.vCells.size(); ++i) {
+        if (isPure(table.vCells[i]))
+            pure.push_back(i);
+    }
+
+    while (!pure.empty()) {
+        const Cell cell = table.vCells[pure.back()];
+        pure.pop_back();
+        if (!isPure(cell))
+            continue; // emptied since it was queued
+
+        std::set<uint64_t>& found = cell.nCount == 1 ? onlyHere : onlyThere;
+        if (!found.insert(cell.nKeySum).second)
+            return false; // a key listed twice; can't be decoded
+        table.update(cell.nKeySum, -cell.nCount);
+
+        for (size_t i = 0; i < NUM_HASHES; ++i) {
+            size_t nIndex = table.cellIndex(i, cell.nKeySum);
+            if (isPure(table.vCells[nIndex]))
+                pure.push_back(nIndex);
+        }
+    }
+
+    return std::all_of(table.vCells.begin(), table.vCells.end(),
+                       [](const Cell& c) { return c.IsEmpty(); });
+}
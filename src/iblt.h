@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_IBLT_H
+#define BITCOIN_IBLT_H
+
+#include "serialize.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+/**
+ * Invertible bloom lookup table over 64 bit keys.
+ *
+ * Two parties with similar sets insert their keys into tables of the same
+ * size and salt. Subtracting one table from the other cancels out the keys
+ * they have in common, and if the remaining difference is small compared
+ * to the number of cells, the keys that are in only one of the sets can be
+ * listed.
+ *
+ * Each key goes to one cell in each of NUM_HASHES sub-tables.
+ */
+class CIblt
+{
+public:
+    static const size_t NUM_HASHES = 4;
+
+    struct Cell {
+        int32_t nCount;
+        uint64_t nKeySum;
+        uint32_t nCheckSum;
+
+        Cell() : nCount(0), nKeySum(0), nCheckSum(0) { }
+        bool IsEmpty() const { return nCount == 0 && nKeySum == 0 && nCheckSum == 0; }
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(nCount);
+            READWRITE(nKeySum);
+            READWRITE(nCheckSum);
+        }
+    };
+
+    CIblt();
+    //! nCells is rounded up to a multiple of NUM_HASHES.
+    CIblt(size_t nCells, uint64_t nSalt);
+
+    //! Number of cells needed to list a difference of nDiff keys with
+    //! high probability.
+    static size_t CellsFor(size_t nDiff);
+
+    void insert(uint64_t nKey);
+    void erase(uint64_t nKey);
+
+    //! Removes the keys of another table of the same size and salt.
+    //! Throws std::invalid_argument if they differ.
+    CIblt& operator-=(const CIblt& other);
+
+    /**
+     * Lists the keys that were inserted, but not erased (onlyHere), and
+     * erased, but not inserted (onlyThere). For a subtracted table those
+     * are the keys only in the first and only in the second set.
+     *
+     * Returns false if the table could not be fully decoded, in which case
+     * the sets hold the keys found so far.
+     */
+    bool peel(std::set<uint64_t>& onlyHere, std::set<uint64_t>& onlyThere) const;
+
+    size_t size() const { return vCells.size(); }
+    uint64_t salt() const { return nSalt; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nSalt);
+        READWRITE(vCells);
+    }
+
+private:
+    void update(uint64_t nKey, int32_t nCountDelta);
+    size_t cellIndex(size_t nHash, uint64_t nKey) const;
+    uint32_t checkSum(uint64_t nKey) const;
+
+    uint64_t nSalt;
+    std::vector<Cell> vCells;
+};
+
+#endif // BITCOIN_IBLT_H
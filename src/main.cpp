@@ -10,22 +10,28 @@
 #include "bip64_getutxo.h"
 #include "blockannounce.h"
 #include "blockencodings.h"
+#include "blockfilemapper.h"
 #include "blockheaderprocessor.h"
+#include "blockwriter.h"
 #include "blocksender.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
 #include "compactblockprocessor.h"
 #include "compactthin.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "graphene.h"
 #include "inflightindex.h"
 #include "init.h"
 #include "maxblocksize.h"
 #include "merkleblock.h"
 #include "mempoolaccepter.h"
+#include "msgstats.h"
 #include "net.h"
 #include "netmessagemaker.h"
 #include "netbase.h"
@@ -34,6 +40,8 @@
 #include "policy/policy.h"
 #include "policy/txpriority.h"
 #include "pow.h"
+#include "rawblockcache.h"
+#include "process_grapheneblock.h"
 #include "process_xthinblock.h"
 #include "respend/respenddetector.h"
 #include "thinblockbuilder.h"
@@ -51,7 +59,10 @@
 #include "xthin.h"
 #include "versionbits.h"
 
+#include <numeric>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 
 #include <boost/dynamic_bitset.hpp>
@@ -76,6 +87,11 @@ CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
 CChain chainActive;
+/** Held together with cs_main when mapBlockIndex gains or loses entries, so
+ * that LookupBlockIndex can read it with only this lock. */
+static CCriticalSection cs_mapBlockIndex;
+/** Published on every tip change, read with std::atomic_load. */
+static std::shared_ptr<const CChainSnapshot> chainSnapshot = std::make_shared<const CChainSnapshot>();
 CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
@@ -97,7 +113,7 @@ CFeeRate minRelayTxFee = CFeeRate(1000);
 CTxMemPool mempool(::minRelayTxFee);
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
 };
 map<uint256, COrphanTx> mapOrphanTransactions;
@@ -585,6 +601,23 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.GetMaxBlockSizeInsecure.disconnect(&GetMaxBlockSizeInsecure);
 }
 
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot()
+{
+    return std::atomic_load(&chainSnapshot);
+}
+
+static void PublishChainSnapshot()
+{
+    std::atomic_store(&chainSnapshot, std::make_shared<const CChainSnapshot>(chainActive));
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_mapBlockIndex);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? nullptr : mi->second;
+}
+
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
 {
     // Find the first block the caller has in the main chain
@@ -600,6 +633,16 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CBlockIndex* FindForkInGlobalIndex(const CChainSnapshot& chain, const CBlockLocator& locator)
+{
+    for (const uint256& hash : locator.vHave) {
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (pindex && chain.Contains(pindex))
+            return pindex;
+    }
+    return chain[0];
+}
+
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
@@ -608,8 +651,9 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer)
 {
+    const CTransaction& tx = *ptx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -628,7 +672,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer)
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
+    mapOrphanTransactions[hash].tx = ptx;
     mapOrphanTransactions[hash].fromPeer = peer;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -643,7 +687,7 @@ void static EraseOrphanTx(uint256 hash)
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx->vin)
     {
         map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -664,7 +708,7 @@ void EraseOrphansFor(NodeId peer)
         map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
+            EraseOrphanTx(maybeErase->second.tx->GetHash());
             ++nErased;
         }
     }
@@ -830,8 +874,42 @@ bool IsCashHFEnabled(const CBlockIndex *pindexPrev) {
     return IsCashHFEnabled(pindexPrev->GetMedianTimePast());
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, CConnman* connman, bool fOverrideMempoolLimit, bool fRejectAbsurdFee)
+/** Shared by block connection and mempool acceptance. */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+/** Writes accepted blocks while the chain is advanced. */
+static BlockWriter blockwriter(BLOCK_WRITER_BUFFER_BYTES);
+
+/** Serves block reads from the block files without a read() per block. */
+static BlockFileMapper blockfilemapper(MAX_MAPPED_BLOCK_FILES);
+
+/** Transactions with fewer inputs are not worth handing to the script check threads. */
+static const unsigned int MIN_PARALLEL_SCRIPT_INPUTS = 4;
+
+/**
+ * CheckInputs for a loose transaction, with the script checks spread over
+ * the script check threads. The serial CheckInputs works out the reject
+ * reason, so it is rerun if a parallel check fails.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs,
+                                unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    if (!Opt().ScriptCheckThreads() || tx.vin.size() < MIN_PARALLEL_SCRIPT_INPUTS)
+        return CheckInputs(tx, state, inputs, true, flags, true, txdata);
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, inputs, true, flags, true, txdata, &vChecks))
+        return false;
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait())
+        return true;
+    return CheckInputs(tx, state, inputs, true, flags, true, txdata);
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, CConnman* connman, bool fOverrideMempoolLimit,
+                                bool fRejectAbsurdFee, int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -953,7 +1031,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), chainActive.Height(), pool.HasNoInputsOf(tx), fSpendsCoinbase, lp, nSigOps);
+        CTxMemPoolEntry entry(MakeTransactionRef(tx), nFees, nAcceptTime, chainActive.Height(), pool.HasNoInputsOf(tx), fSpendsCoinbase, lp, nSigOps);
 
         FeeEvaluator feeEval(Opt().AllowFreeTx(), mempool.GetFeeModifier(),
                              ::minRelayTxFee);
@@ -999,8 +1077,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS | forkVerifyFlags,
-	                    true, txdata))
+        if (!CheckInputsParallel(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS | forkVerifyFlags, txdata))
         {
             return error("AcceptToMemoryPool: ConnectInputs failed %s", hash.ToString());
         }
@@ -1014,8 +1091,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS | forkVerifyFlags,
-	                    true, txdata))
+        if (!CheckInputsParallel(tx, state, view, MANDATORY_SCRIPT_VERIFY_FLAGS | forkVerifyFlags, txdata))
         {
             return error("AcceptToMemoryPool: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
@@ -1050,6 +1126,198 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, CConnman* connman, bool fOverrideMempoolLimit, bool fRejectAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, connman,
+                                      fOverrideMempoolLimit, fRejectAbsurdFee, GetTime());
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const char* MEMPOOL_FILENAME = "mempool.dat";
+/** Transactions loaded from the mempool file per cs_main hold. */
+static const size_t MEMPOOL_LOAD_BATCH = 1000;
+
+/**
+ * Reads the coins spent by a batch of transactions about to be accepted to
+ * the mempool into the coins cache, and runs their script checks on the
+ * script check threads. Accepting them one by one afterwards then finds
+ * their inputs cached and their signatures in the signature cache.
+ * Transactions in the batch may spend each other.
+ */
+static void PrepareMempoolBatch(const std::vector<std::pair<CTransactionRef, int64_t> >& batch)
+{
+    AssertLockHeld(cs_main);
+
+    if (Opt().PrefetchThreads()) {
+        std::unordered_set<uint256, BlockHasher> created;
+        for (auto& b : batch)
+            created.insert(b.first->GetHash());
+        std::vector<COutPoint> outpoints;
+        for (auto& b : batch) {
+            for (const CTxIn& in : b.first->vin) {
+                if (!created.count(in.prevout.hash))
+                    outpoints.push_back(in.prevout);
+            }
+        }
+        PrefetchCoins(*pcoinsTip, outpoints);
+    }
+
+    const int64_t mtpChainTip = chainActive.Tip()->GetMedianTimePast();
+    unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (IsUAHFActive(mtpChainTip))
+        flags |= SCRIPT_ENABLE_SIGHASH_FORKID;
+    if (IsThirdHFActive(mtpChainTip))
+        flags |= SCRIPT_ENABLE_MONOLITH_OPCODES;
+
+    LOCK(mempool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    CCoinsViewCache view(&viewMemPool);
+    // Checks point into txdata, so it must not reallocate.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(batch.size());
+    std::vector<CScriptCheck> vChecks;
+    for (auto& b : batch) {
+        const CTransaction& tx = *b.first;
+        if (!tx.IsCoinBase() && view.HaveInputs(tx)) {
+            txdata.emplace_back(tx);
+            CValidationState state;
+            CheckInputs(tx, state, view, true, flags, true, txdata.back(), &vChecks);
+        }
+        for (size_t o = 0; o < tx.vout.size(); ++o)
+            view.WarmCoin(COutPoint(tx.GetHash(), o), Coin(tx.vout[o], MEMPOOL_HEIGHT, false));
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    // Failures are found again, with a reason, on acceptance.
+    control.Wait();
+}
+
+bool LoadMempool()
+{
+    const int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    boost::filesystem::path path = GetDataDir() / MEMPOOL_FILENAME;
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    const int64_t nStart = GetTimeMicros();
+    const int64_t nNow = GetTime();
+    std::vector<std::pair<CTransactionRef, int64_t> > txs;
+    int64_t nExpired = 0;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
+            return error("%s: unknown mempool file version %d", __func__, version);
+
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransactionRef tx;
+            int64_t nTime;
+            file >> tx >> nTime;
+            if (nTime + nExpiryTimeout > nNow)
+                txs.push_back(std::make_pair(tx, nTime));
+            else
+                ++nExpired;
+        }
+
+        // Before the transactions, so they are accepted with them.
+        std::map<uint256, CAmount> mapDeltas;
+        file >> mapDeltas;
+        for (auto& d : mapDeltas)
+            mempool.GetFeeModifier().AddDelta(d.first, d.second);
+    }
+    catch (const std::exception& e) {
+        return error("%s: failed to deserialize mempool data on disk: %s", __func__, e.what());
+    }
+
+    int64_t nAccepted = 0;
+    int64_t nFailed = 0;
+    int64_t nAlready = 0;
+    for (size_t begin = 0; begin < txs.size(); begin += MEMPOOL_LOAD_BATCH) {
+        if (ShutdownRequested())
+            return false;
+        const size_t end = std::min(txs.size(), begin + MEMPOOL_LOAD_BATCH);
+        std::vector<std::pair<CTransactionRef, int64_t> > batch(txs.begin() + begin, txs.begin() + end);
+
+        LOCK(cs_main);
+        PrepareMempoolBatch(batch);
+        for (auto& b : batch) {
+            if (mempool.exists(b.first->GetHash())) {
+                ++nAlready;
+                continue;
+            }
+            CValidationState state;
+            if (AcceptToMemoryPoolWithTime(mempool, state, *b.first, true, NULL, NULL, true, false, b.second))
+                ++nAccepted;
+            else
+                ++nFailed;
+        }
+    }
+
+    // Limits are applied once, rather than for each transaction.
+    mempool.Expire(GetTime() - nExpiryTimeout);
+    mempool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there (%.2fs)\n",
+              nAccepted, nFailed, nExpired, nAlready, (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+bool DumpMempool()
+{
+    const int64_t nStart = GetTimeMicros();
+
+    // Parents before their children, so they load in order.
+    std::vector<std::pair<CTransactionRef, int64_t> > txs;
+    std::vector<uint64_t> ancestors;
+    {
+        LOCK(mempool.cs);
+        std::vector<CTxMemPool::txiter> entries;
+        entries.reserve(mempool.mapTx.size());
+        for (auto it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            entries.push_back(it);
+        std::sort(entries.begin(), entries.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        });
+        txs.reserve(entries.size());
+        for (CTxMemPool::txiter it : entries)
+            txs.push_back(std::make_pair(it->GetSharedTx(), it->GetTime()));
+    }
+    std::map<uint256, CAmount> mapDeltas = mempool.GetFeeModifier().GetDeltas();
+
+    const int64_t nMid = GetTimeMicros();
+
+    try {
+        boost::filesystem::path path = GetDataDir() / MEMPOOL_FILENAME;
+        boost::filesystem::path pathNew = GetDataDir() / (std::string(MEMPOOL_FILENAME) + ".new");
+        FILE* filestr = fopen(pathNew.string().c_str(), "wb");
+        if (!filestr)
+            return error("%s: failed to open %s", __func__, pathNew.string());
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_DUMP_VERSION;
+        file << (uint64_t)txs.size();
+        for (auto& t : txs)
+            file << t.first << t.second;
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathNew, path))
+            return error("%s: failed to rename %s", __func__, pathNew.string());
+    }
+    catch (const std::exception& e) {
+        return error("%s: failed to dump mempool: %s", __func__, e.what());
+    }
+    LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n",
+              (nMid - nStart) * 0.000001, (GetTimeMicros() - nMid) * 0.000001);
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1066,6 +1334,17 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
+                std::shared_ptr<const CBlock> pblock = blockwriter.Get(postx);
+                if (pblock) {
+                    for (const CTransactionRef& tx : pblock->vtx) {
+                        if (tx->GetHash() == hash) {
+                            txOut = *tx;
+                            hashBlock = pblock->GetHash();
+                            return true;
+                        }
+                    }
+                    return error("%s: txid mismatch", __func__);
+                }
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 if (file.IsNull())
                     return error("%s: OpenBlockFile failed", __func__);
@@ -1093,9 +1372,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow, Params().GetConsensus())) {
-            BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-                if (tx.GetHash() == hash) {
-                    txOut = tx;
+            for (const CTransactionRef& tx : block.vtx) {
+                if (tx->GetHash() == hash) {
+                    txOut = *tx;
                     hashBlock = pindexSlow->GetBlockHash();
                     return true;
                 }
@@ -1116,7 +1395,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1137,10 +1416,52 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::M
     return true;
 }
 
+/**
+ * Map the block file holding the block at pos. nSize is set to the size of
+ * the block as recorded in the index header in front of it.
+ */
+static std::shared_ptr<const BlockFileMapping> MapBlock(const CDiskBlockPos& pos, size_t& nSize)
+{
+    if (pos.IsNull() || pos.nPos < sizeof(uint32_t))
+        return nullptr;
+    std::shared_ptr<const BlockFileMapping> mapping = blockfilemapper.Get(pos.nFile, pos.nPos);
+    if (!mapping)
+        return nullptr;
+    nSize = ReadLE32(mapping->data + pos.nPos - sizeof(uint32_t));
+    if (nSize < 80)
+        return nullptr;
+    if (nSize > mapping->size - pos.nPos) {
+        // The file may have grown since it was mapped.
+        mapping = blockfilemapper.Get(pos.nFile, pos.nPos + nSize);
+    }
+    return mapping;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
+    std::shared_ptr<const CBlock> pblock = blockwriter.Get(pos);
+    if (pblock) {
+        block = *pblock;
+        return true;
+    }
+
     block.SetNull();
 
+    size_t nSize;
+    std::shared_ptr<const BlockFileMapping> mapping = MapBlock(pos, nSize);
+    if (mapping) {
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, mapping->data + pos.nPos, mapping->data + pos.nPos + nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+        if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+            return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
+        return true;
+    }
+
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -1171,6 +1492,50 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& raw, const CBlockIndex* pindex)
+{
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+    if (pos.IsNull())
+        return false;
+
+    std::shared_ptr<const CBlock> pblock = blockwriter.Get(pos);
+    if (pblock) {
+        raw.clear();
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, raw, 0) << *pblock;
+        return true;
+    }
+
+    size_t nSize;
+    std::shared_ptr<const BlockFileMapping> mapping = MapBlock(pos, nSize);
+    if (mapping) {
+        const unsigned char* begin = mapping->data + pos.nPos;
+        raw.assign(begin, begin + nSize);
+    } else {
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        try {
+            if (fseek(filein.Get(), -(long)sizeof(uint32_t), SEEK_CUR))
+                return error("%s: fseek failed for %s", __func__, pos.ToString());
+            uint32_t nBlockSize;
+            filein >> nBlockSize;
+            if (nBlockSize < 80 || uint64_t(pos.nPos) + nBlockSize > boost::filesystem::file_size(GetBlockPosFilename(pos, "blk")))
+                return error("%s: bad block size %u at %s", __func__, nBlockSize, pos.ToString());
+            raw.resize(nBlockSize);
+            filein.read((char*)raw.data(), raw.size());
+        }
+        catch (const std::exception& e) {
+            return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+
+    // The header is the first 80 bytes of the block.
+    if (Hash(raw.begin(), raw.begin() + 80) != pindex->GetBlockHash())
+        return error("%s: hash doesn't match index for %s at %s", __func__,
+                pindex->ToString(), pos.ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1185,6 +1550,13 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 }
 
 bool fForceInitialBlockDownload = false;
+static std::atomic<bool> fIBDOver(false);
+
+bool IsInitialBlockDownloadOver()
+{
+    return fIBDOver && !fImporting && !fReindex;
+}
+
 bool IsInitialBlockDownload()
 {
     if (fForceInitialBlockDownload)
@@ -1196,13 +1568,12 @@ bool IsInitialBlockDownload()
         return true;
     if (fCheckpointsEnabled && chainActive.Height() < Checkpoints::GetTotalBlocksEstimate(chainParams.Checkpoints()))
         return true;
-    static bool lockIBDState = false;
-    if (lockIBDState)
+    if (fIBDOver)
         return false;
     bool state = (chainActive.Height() < pindexBestHeader->nHeight - 24 * 6 ||
             std::max(chainActive.Tip()->GetBlockTime(), pindexBestHeader->GetBlockTime()) < GetTime() - 24 * 60 * 60);
     if (!state) {
-        lockIBDState = true;
+        fIBDOver = true;
         LogPrintf("No longer initial block download\n");
     }
     return state;
@@ -1415,10 +1786,17 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+{
+    if (tx.IsCoinBase())
+        return true;
+    return CheckInputs(tx, state, inputs, GetSpendHeight(inputs), fScriptChecks, flags, cacheStore, txdata, pvChecks);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, int nSpendHeight, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
-        if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs)))
+        if (!Consensus::CheckTxInputs(tx, state, inputs, nSpendHeight))
             return false;
 
         if (pvChecks)
@@ -1634,7 +2012,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         uint256 hash = tx.GetHash();
         bool is_coinbase = tx.IsCoinBase();
 
@@ -1678,12 +2056,17 @@ void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    // Failures are reported by FlushStateToDisk.
+    blockwriter.Flush();
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+            blockfilemapper.Invalidate(nLastBlockFile);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -1699,13 +2082,16 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void ThreadBlockWriter() {
+    RenameThread("bitcoin-blkwrite");
+    blockwriter.Thread();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -1824,6 +2210,307 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+bool ConnectBlockTransactions(const CBlock& block, CValidationState& state, const CBlockIndex& index,
+                              CCoinsViewCache& view, const BlockConnectRules& rules,
+                              CCheckQueueControl<CScriptCheck>* control,
+                              std::vector<PrecomputedTransactionData>& txdata,
+                              CBlockUndo& blockundo, CAmount& nFees)
+{
+    std::vector<int> prevheights;
+    unsigned int nSigOps = 0;
+    blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = *block.vtx[i];
+
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        nSigOps += nTxSigOps;
+        if (nSigOps > rules.nMaxSigOps)
+            return state.DoS(100, error("ConnectBlock(): too many sigops"),
+                             REJECT_INVALID, "bad-blk-sigops");
+
+        if (!tx.IsCoinBase())
+        {
+            if (!view.HaveInputs(tx))
+                return state.DoS(100, error("ConnectBlock(): inputs missing/spent"),
+                                 REJECT_INVALID, "bad-txns-inputs-missingorspent");
+
+            // Check that transaction is BIP68 final
+            // BIP68 lock checks (as opposed to nLockTime checks) must
+            // be in ConnectBlock because they require the UTXO set
+            prevheights.resize(tx.vin.size());
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
+            }
+
+            if (!SequenceLocks(tx, rules.nLockTimeFlags, &prevheights, index)) {
+                return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
+                                 REJECT_INVALID, "bad-txns-nonfinal");
+            }
+
+            if (rules.fStrictPayToScriptHash)
+            {
+                // Add in sigops done by pay-to-script-hash inputs;
+                // this is to prevent a "rogue miner" from creating
+                // an incredibly-expensive-to-validate block.
+                unsigned int nP2SHSigOps = GetP2SHSigOpCount(tx, view);
+                nSigOps += nP2SHSigOps;
+                nTxSigOps += nP2SHSigOps;
+                if (nSigOps > rules.nMaxSigOps)
+                    return state.DoS(100, error("ConnectBlock(): too many sigops"),
+                                     REJECT_INVALID, "bad-blk-sigops");
+            }
+            if (nTxSigOps > MAX_TX_SIGOPS_COUNT) {
+                return state.DoS(100, error("ConnectBlock(): too many sigops in tx"), REJECT_INVALID, "bad-txn-sigops");
+            }
+        }
+        txdata.emplace_back(tx);
+        if (!tx.IsCoinBase())
+        {
+            nFees += view.GetValueIn(tx)-tx.GetValueOut();
+
+            std::vector<CScriptCheck> vChecks;
+            if (!CheckInputs(tx, state, view, index.nHeight, rules.fScriptChecks, rules.nScriptFlags,
+                             rules.fCacheResults, txdata[i], control ? &vChecks : NULL))
+                return false;
+            if (control)
+                control->Add(vChecks);
+        }
+
+        CTxUndo undoDummy;
+        if (i > 0) {
+            blockundo.vtxundo.push_back(CTxUndo());
+        }
+        SpendCoins(view, tx, i == 0 ? undoDummy : blockundo.vtxundo.back(), index.nHeight);
+        AddCoins(view, tx, index.nHeight);
+    }
+    return true;
+}
+
+namespace {
+
+/** What connecting a transaction depends on, worked out without the rest of the block. */
+struct TxConnectResult {
+    TxConnectResult() : fInputsFound(false), fSequenceLocks(false), nSigOps(0),
+        nP2SHSigOps(0), nFee(0), fInputsValid(false) {}
+
+    bool fInputsFound;
+    bool fSequenceLocks;
+    unsigned int nSigOps;
+    unsigned int nP2SHSigOps;
+    CAmount nFee;
+    bool fInputsValid;
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+};
+
+/**
+ * Checks a transaction against the coins it spends, given as one coin per
+ * input (spent if not found). Stops at the first check that fails, as
+ * ConnectBlockTransactions would.
+ */
+class CTxConnectCheck
+{
+private:
+    const CTransaction* ptx;
+    const Coin* pcoins;
+    const CBlockIndex* pindex;
+    const BlockConnectRules* prules;
+    bool fDeferScripts;
+    PrecomputedTransactionData* ptxdata;
+    TxConnectResult* presult;
+
+public:
+    CTxConnectCheck() : ptx(nullptr), pcoins(nullptr), pindex(nullptr), prules(nullptr),
+        fDeferScripts(false), ptxdata(nullptr), presult(nullptr) {}
+    CTxConnectCheck(const CTransaction& tx, const Coin* pcoinsIn, const CBlockIndex& index,
+                    const BlockConnectRules& rules, bool fDeferScriptsIn,
+                    PrecomputedTransactionData& txdata, TxConnectResult& result) :
+        ptx(&tx), pcoins(pcoinsIn), pindex(&index), prules(&rules), fDeferScripts(fDeferScriptsIn),
+        ptxdata(&txdata), presult(&result) {}
+
+    bool operator()()
+    {
+        const CTransaction& tx = *ptx;
+        TxConnectResult& result = *presult;
+        result.nSigOps = GetLegacySigOpCount(tx);
+        *ptxdata = PrecomputedTransactionData(tx);
+        if (tx.IsCoinBase())
+            return true;
+
+        CCoinsView dummy;
+        CCoinsViewCache inputs(&dummy);
+        std::vector<int> prevheights(tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            if (pcoins[j].IsSpent())
+                return true;
+            prevheights[j] = pcoins[j].nHeight;
+            inputs.WarmCoin(tx.vin[j].prevout, Coin(pcoins[j]));
+        }
+        result.fInputsFound = true;
+
+        result.fSequenceLocks = SequenceLocks(tx, prules->nLockTimeFlags, &prevheights, *pindex);
+        if (!result.fSequenceLocks)
+            return true;
+
+        if (prules->fStrictPayToScriptHash)
+            result.nP2SHSigOps = GetP2SHSigOpCount(tx, inputs);
+        result.nFee = inputs.GetValueIn(tx) - tx.GetValueOut();
+        result.fInputsValid = CheckInputs(tx, result.state, inputs, pindex->nHeight,
+                                          prules->fScriptChecks, prules->nScriptFlags, prules->fCacheResults,
+                                          *ptxdata, fDeferScripts ? &result.vChecks : NULL);
+        return true;
+    }
+
+    void swap(CTxConnectCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pindex, check.pindex);
+        std::swap(prules, check.prules);
+        std::swap(fDeferScripts, check.fDeferScripts);
+        std::swap(ptxdata, check.ptxdata);
+        std::swap(presult, check.presult);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CTxConnectCheck> txconnectqueue(16);
+
+/** Blocks with fewer transactions are connected serially. */
+static const size_t MIN_PARALLEL_CONNECT_TXS = 16;
+
+void ThreadTxConnectCheck() {
+    RenameThread("bitcoin-txconn");
+    txconnectqueue.Thread();
+}
+
+bool ConnectBlockTransactionsParallel(const CBlock& block, CValidationState& state, const CBlockIndex& index,
+                                      CCoinsViewCache& view, const BlockConnectRules& rules,
+                                      CCheckQueueControl<CScriptCheck>* control,
+                                      std::vector<PrecomputedTransactionData>& txdata,
+                                      CBlockUndo& blockundo, CAmount& nFees)
+{
+    const size_t nTxs = block.vtx.size();
+
+    // Position of each transaction in the block, for finding the in-block
+    // parents of a transaction.
+    std::unordered_map<uint256, size_t, BlockHasher> mapTxIndex;
+    mapTxIndex.reserve(nTxs);
+    for (size_t i = 0; i < nTxs; ++i) {
+        if (!mapTxIndex.emplace(block.vtx[i]->GetHash(), i).second) {
+            // Repeated txids overwrite each other's outputs. Leave that to
+            // the serial version.
+            return ConnectBlockTransactions(block, state, index, view, rules, control, txdata, blockundo, nFees);
+        }
+    }
+
+    // Look up the coins each transaction spends as they would be when the
+    // transactions before it have been applied: outputs of an earlier
+    // transaction in the block unless spent since, else what the view has
+    // unless spent within the block. Lookups stop at the first transaction
+    // spending a coin that does not exist, as the block fails there at the
+    // latest.
+    std::vector<Coin> vCoins;
+    std::vector<size_t> vFirstCoin(nTxs, 0);
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapSpentBy;
+    size_t nCheckTxs = nTxs;
+    for (size_t i = 0; i < nCheckTxs; ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        vFirstCoin[i] = vCoins.size();
+        if (tx.IsCoinBase())
+            continue;
+
+        for (const CTxIn& in : tx.vin) {
+            const COutPoint& prevout = in.prevout;
+            auto parent = mapTxIndex.find(prevout.hash);
+            auto spender = mapSpentBy.find(prevout);
+            const CTransaction* pparent = nullptr;
+            if (parent != mapTxIndex.end() && parent->second < i) {
+                pparent = block.vtx[parent->second].get();
+                if (prevout.n >= pparent->vout.size() || pparent->vout[prevout.n].scriptPubKey.IsUnspendable())
+                    pparent = nullptr;
+            }
+
+            vCoins.emplace_back();
+            if (pparent && (spender == mapSpentBy.end() || spender->second < parent->second))
+                vCoins.back() = Coin(pparent->vout[prevout.n], index.nHeight, pparent->IsCoinBase());
+            else if (spender == mapSpentBy.end())
+                vCoins.back() = view.AccessCoin(prevout);
+            if (vCoins.back().IsSpent())
+                nCheckTxs = i + 1;
+        }
+        for (const CTxIn& in : tx.vin)
+            mapSpentBy[in.prevout] = i;
+    }
+
+    // The transactions no longer depend on each other.
+    txdata.resize(nCheckTxs);
+    std::vector<TxConnectResult> vResults(nCheckTxs);
+    {
+        std::vector<CTxConnectCheck> vChecks;
+        vChecks.reserve(nCheckTxs);
+        for (size_t i = 0; i < nCheckTxs; ++i) {
+            vChecks.emplace_back(*block.vtx[i], vCoins.data() + vFirstCoin[i], index, rules,
+                                 control != NULL, txdata[i], vResults[i]);
+        }
+        CCheckQueueControl<CTxConnectCheck> txcontrol(&txconnectqueue);
+        txcontrol.Add(vChecks);
+        txcontrol.Wait();
+    }
+
+    // Go through the outcomes in block order, failing on the same check as
+    // the serial version, and apply the transactions to the view.
+    unsigned int nSigOps = 0;
+    blockundo.vtxundo.reserve(nTxs - 1);
+    for (size_t i = 0; i < nCheckTxs; ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        TxConnectResult& result = vResults[i];
+
+        nSigOps += result.nSigOps;
+        if (nSigOps > rules.nMaxSigOps)
+            return state.DoS(100, error("ConnectBlock(): too many sigops"),
+                             REJECT_INVALID, "bad-blk-sigops");
+
+        if (!tx.IsCoinBase())
+        {
+            if (!result.fInputsFound)
+                return state.DoS(100, error("ConnectBlock(): inputs missing/spent"),
+                                 REJECT_INVALID, "bad-txns-inputs-missingorspent");
+
+            if (!result.fSequenceLocks)
+                return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
+                                 REJECT_INVALID, "bad-txns-nonfinal");
+
+            if (rules.fStrictPayToScriptHash) {
+                nSigOps += result.nP2SHSigOps;
+                if (nSigOps > rules.nMaxSigOps)
+                    return state.DoS(100, error("ConnectBlock(): too many sigops"),
+                                     REJECT_INVALID, "bad-blk-sigops");
+            }
+            if (result.nSigOps + result.nP2SHSigOps > MAX_TX_SIGOPS_COUNT)
+                return state.DoS(100, error("ConnectBlock(): too many sigops in tx"), REJECT_INVALID, "bad-txn-sigops");
+
+            nFees += result.nFee;
+            if (!result.fInputsValid) {
+                state = result.state;
+                return false;
+            }
+            if (control)
+                control->Add(result.vChecks);
+        }
+
+        CTxUndo undoDummy;
+        if (i > 0) {
+            blockundo.vtxundo.push_back(CTxUndo());
+        }
+        SpendCoins(view, tx, i == 0 ? undoDummy : blockundo.vtxundo.back(), index.nHeight);
+        AddCoins(view, tx, index.nHeight);
+    }
+    return true;
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -1892,8 +2579,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            for (size_t o = 0; o < tx.vout.size(); o++) {
-                if (view.HaveCoin(COutPoint(tx.GetHash(), o))) {
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
                     return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
                                      REJECT_INVALID, "bad-txns-BIP30");
                 }
@@ -1947,97 +2634,42 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && Opt().ScriptCheckThreads() ? &scriptcheckqueue : NULL);
+    static auto nScriptCheckThreads = Opt().ScriptCheckThreads();
 
-    std::vector<int> prevheights;
+    BlockConnectRules rules;
+    rules.nScriptFlags = flags;
+    rules.nLockTimeFlags = nLockTimeFlags;
+    rules.fStrictPayToScriptHash = fStrictPayToScriptHash;
+    rules.fScriptChecks = fScriptChecks;
+    rules.fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
+    rules.nMaxSigOps = MaxBlockSigops(nBlockSize);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    const bool fParallel = nScriptCheckThreads && block.vtx.size() >= MIN_PARALLEL_CONNECT_TXS;
+    if (!(fParallel ? ConnectBlockTransactionsParallel : ConnectBlockTransactions)(
+            block, state, *pindex, view, rules, nScriptCheckThreads ? &control : NULL, txdata, blockundo, nFees))
+        return false;
+
     int nInputs = 0;
-    unsigned int nSigOps = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
-    blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
-    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
-    for (unsigned int i = 0; i < block.vtx.size(); i++)
-    {
-        const CTransaction &tx = block.vtx[i];
-
-        nInputs += tx.vin.size();
-        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-        nSigOps += nTxSigOps;
-        if (nSigOps > MaxBlockSigops(nBlockSize))
-            return state.DoS(100, error("ConnectBlock(): too many sigops"),
-                             REJECT_INVALID, "bad-blk-sigops");
-
-        if (!tx.IsCoinBase())
-        {
-            if (!view.HaveInputs(tx))
-                return state.DoS(100, error("ConnectBlock(): inputs missing/spent"),
-                                 REJECT_INVALID, "bad-txns-inputs-missingorspent");
-
-            // Check that transaction is BIP68 final
-            // BIP68 lock checks (as opposed to nLockTime checks) must
-            // be in ConnectBlock because they require the UTXO set
-            prevheights.resize(tx.vin.size());
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
-            }
-
-            if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
-                return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
-                                 REJECT_INVALID, "bad-txns-nonfinal");
-            }
-
-            if (fStrictPayToScriptHash)
-            {
-                // Add in sigops done by pay-to-script-hash inputs;
-                // this is to prevent a "rogue miner" from creating
-                // an incredibly-expensive-to-validate block.
-                unsigned int nP2SHSigOps = GetP2SHSigOpCount(tx, view);
-                nSigOps += nP2SHSigOps;
-                nTxSigOps += nP2SHSigOps;
-                if (nSigOps > MaxBlockSigops(nBlockSize))
-                    return state.DoS(100, error("ConnectBlock(): too many sigops"),
-                                     REJECT_INVALID, "bad-blk-sigops");
-            }
-            if (nTxSigOps > MAX_TX_SIGOPS_COUNT) {
-                return state.DoS(100, error("ConnectBlock(): too many sigops in tx"), REJECT_INVALID, "bad-txn-sigops");
-            }
-        }
-        txdata.emplace_back(tx);
-        if (!tx.IsCoinBase())
-        {
-            nFees += view.GetValueIn(tx)-tx.GetValueOut();
-
-            std::vector<CScriptCheck> vChecks;
-            bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            static auto nScriptCheckThreads = Opt().ScriptCheckThreads();
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults,
-                             txdata[i], nScriptCheckThreads ? &vChecks : NULL))
-                return false;
-            control.Add(vChecks);
-        }
-
-        CTxUndo undoDummy;
-        if (i > 0) {
-            blockundo.vtxundo.push_back(CTxUndo());
-        }
-        SpendCoins(view, tx, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
-        AddCoins(view, tx, pindex->nHeight);
-
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    for (const auto& tx : block.vtx) {
+        nInputs += tx->vin.size();
+        vPos.push_back(std::make_pair(tx->GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint(Log::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
-    if (block.vtx[0].GetValueOut() > blockReward)
+    if (block.vtx[0]->GetValueOut() > blockReward)
         return state.DoS(100,
                          error("ConnectBlock(): coinbase pays too much (actual=%d vs limit=%d)",
-                               block.vtx[0].GetValueOut(), blockReward),
+                               block.vtx[0]->GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
     if (!control.Wait()) {
@@ -2046,6 +2678,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint(Log::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
+    LogPrint(Log::BENCH, "      - Script checks: %u run, %u stolen, %.2fms wait\n", control.Checks(), control.Steals(), 0.001 * (nTime2 - nTime1));
 
     if (fJustCheck)
         return true;
@@ -2082,7 +2715,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
     LogPrint(Log::BENCH, "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
@@ -2150,6 +2783,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
         // First make sure all block and undo data is flushed to disk.
+        if (!blockwriter.Flush())
+            return AbortNode(state, "Failed to write block");
         FlushBlockFile();
         // Then update all block file information (which may refer to block and undo files).
         {
@@ -2214,6 +2849,7 @@ void PruneAndFlush() {
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2291,7 +2927,8 @@ bool static DisconnectTip(CValidationState &state) {
         return false;
     // Resurrect mempool transactions from the disconnected block.
     std::vector<uint256> vHashUpdate;
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         // ignore validation errors in resurrected transactions
         list<CTransaction> removed;
         CValidationState stateDummy;
@@ -2306,19 +2943,22 @@ bool static DisconnectTip(CValidationState &state) {
     // previously-confirmed transactions back to the mempool.
     // UpdateTransactionsFromBlock finds descendants of any transactions in this
     // block that were added back and cleans up the mempool state.
-    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+    mempool.UpdateTransactionsFromBlock(vHashUpdate,
+            GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT),
+            GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000);
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-        SyncWithWallets(tx, NULL, false);
+    for (const CTransactionRef& tx : block.vtx) {
+        SyncWithWallets(*tx, NULL, false);
     }
     return true;
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2343,6 +2983,16 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(Log::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    if (Opt().PrefetchThreads()) {
+        // Warm the coins cache with the block inputs, so that the connect
+        // loop does not block on serial database reads.
+        CoinsPrefetchStats prefetch = PrefetchCoins(*pcoinsTip, CollectPrefetchOutpoints(*pblock));
+        int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint(Log::BENCH, "  - Prefetch %u inputs (%u hit, %u fetched, %u miss): %.2fms [%.2fs]\n",
+                 prefetch.requested, prefetch.cached, prefetch.fetched, prefetch.missing,
+                 (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
+        nTime2 = nTimePrefetched;
+    }
     {
         CCoinsViewCache view(pcoinsTip);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
@@ -2375,8 +3025,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew,
         SyncWithWallets(tx, NULL, false);
     }
     // ... and about transactions that got confirmed:
-    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
-        SyncWithWallets(tx, pblock, false);
+    for (const CTransactionRef& tx : pblock->vtx) {
+        SyncWithWallets(*tx, pblock, false);
     }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
@@ -2703,14 +3353,17 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
-    if (miPrev != mapBlockIndex.end())
     {
-        pindexNew->pprev = (*miPrev).second;
-        pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
-        pindexNew->BuildSkip();
+        LOCK(cs_mapBlockIndex);
+        BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+        if (miPrev != mapBlockIndex.end())
+        {
+            pindexNew->pprev = (*miPrev).second;
+            pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+            pindexNew->BuildSkip();
+        }
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
@@ -2730,7 +3383,7 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBl
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
-    pindexNew->nMaxBlockSizeVote = GetMaxBlockSizeVote(block.vtx[0].vin[0].scriptSig, pindexNew->nHeight);
+    pindexNew->nMaxBlockSizeVote = GetMaxBlockSizeVote(block.vtx[0]->vin[0].scriptSig, pindexNew->nHeight);
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
@@ -2869,6 +3522,90 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
+namespace {
+
+/** CheckTransaction and sigop counting for a range of a block's transactions. */
+class CBlockTxCheck
+{
+private:
+    const CBlock* pblock;
+    size_t nBegin;
+    size_t nEnd;
+    unsigned int* pnSigOps;
+
+public:
+    CBlockTxCheck() : pblock(nullptr), nBegin(0), nEnd(0), pnSigOps(nullptr) {}
+    CBlockTxCheck(const CBlock& block, size_t nBeginIn, size_t nEndIn, unsigned int* pnSigOpsIn) :
+        pblock(&block), nBegin(nBeginIn), nEnd(nEndIn), pnSigOps(pnSigOpsIn) {}
+
+    bool operator()()
+    {
+        CValidationState state;
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            if (!CheckTransaction(*pblock->vtx[i], state))
+                return false;
+            *pnSigOps += GetLegacySigOpCount(*pblock->vtx[i]);
+        }
+        return true;
+    }
+
+    void swap(CBlockTxCheck& check)
+    {
+        std::swap(pblock, check.pblock);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CBlockTxCheck> blockcheckqueue(1);
+
+/** Transactions per job when the transactions of a block are checked in parallel. */
+static const size_t BLOCK_CHECK_CHUNK_SIZE = 500;
+
+void ThreadBlockCheck() {
+    RenameThread("bitcoin-blkcheck");
+    blockcheckqueue.Thread();
+}
+
+/**
+ * CheckTransaction for every transaction in the block, spread over the
+ * block check threads for large blocks. The serial loop works out the reject
+ * reason, so it runs again if a parallel check fails.
+ */
+static bool CheckBlockTransactions(const CBlock& block, CValidationState& state, unsigned int& nSigOps)
+{
+    const size_t nChunks = (block.vtx.size() + BLOCK_CHECK_CHUNK_SIZE - 1) / BLOCK_CHECK_CHUNK_SIZE;
+    if (Opt().ScriptCheckThreads() && nChunks > 1) {
+        std::vector<unsigned int> vSigOps(nChunks, 0);
+        std::vector<CBlockTxCheck> vChecks;
+        vChecks.reserve(nChunks);
+        for (size_t i = 0; i < nChunks; ++i) {
+            vChecks.emplace_back(block, i * BLOCK_CHECK_CHUNK_SIZE,
+                                 std::min(block.vtx.size(), (i + 1) * BLOCK_CHECK_CHUNK_SIZE), &vSigOps[i]);
+        }
+        CCheckQueueControl<CBlockTxCheck> control(&blockcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait()) {
+            nSigOps = std::accumulate(vSigOps.begin(), vSigOps.end(), 0u);
+            return true;
+        }
+    }
+
+    nSigOps = 0;
+    for (const CTransactionRef& tx : block.vtx)
+        if (!CheckTransaction(*tx, state))
+            return false;
+
+    for (const CTransactionRef& tx : block.vtx)
+    {
+        nSigOps += GetLegacySigOpCount(*tx);
+    }
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -2903,24 +3640,19 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock(): no transactions"), REJECT_INVALID, "bad-blk-length");
 
     // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase())
         return state.DoS(100, error("CheckBlock(): first tx is not coinbase"),
                          REJECT_INVALID, "bad-cb-missing");
     for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
+        if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
     // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock(): CheckTransaction failed");
-
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
+    if (!CheckBlockTransactions(block, state, nSigOps))
+        return error("CheckBlock(): CheckTransaction failed");
+
     if (nSigOps > MaxBlockSigops(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)))
         return state.DoS(100, error("CheckBlock(): out-of-bounds SigOpCount"), REJECT_INVALID, "bad-blk-sigops", true);
 
@@ -3023,8 +3755,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
                               : block.GetBlockTime();
 
     // Check that all transactions are finalized
-    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-        if (!ContextualCheckTransaction(tx, state, nHeight, nLockTimeCutoff, nMedianTimePastPrev)) {
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!ContextualCheckTransaction(*tx, state, nHeight, nLockTimeCutoff, nMedianTimePastPrev)) {
             // state set by ContextualCheckTransaction.
             return false;
         }
@@ -3034,8 +3766,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     if (nHeight >= consensusParams.BIP34Height)
     {
         CScript expect = CScript() << nHeight;
-        if (block.vtx[0].vin[0].scriptSig.size() < expect.size() ||
-            !std::equal(expect.begin(), expect.end(), block.vtx[0].vin[0].scriptSig.begin())) {
+        if (block.vtx[0]->vin[0].scriptSig.size() < expect.size() ||
+            !std::equal(expect.begin(), expect.end(), block.vtx[0]->vin[0].scriptSig.begin())) {
             return state.DoS(100, error("%s: block height mismatch in coinbase", __func__), REJECT_INVALID, "bad-cb-height");
         }
     }
@@ -3151,8 +3883,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         if (!FindBlockPos(state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos, chainparams.DBMagic()))
-                AbortNode(state, "Failed to write block");
+            blockwriter.Write(std::make_shared<const CBlock>(block), nBlockSize, blockPos, chainparams.DBMagic());
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
     } catch (const std::runtime_error& e) {
@@ -3185,6 +3916,8 @@ bool ProcessNewBlock(CValidationState &state, const BlockSource& from,
         CheckBlockIndex();
         if (!ret)
             return error("%s: AcceptBlock FAILED", __func__);
+        if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA))
+            GetRawBlockCache().Add(std::make_shared<const CBlock>(*pblock));
     }
 
     if (!ActivateBestChain(state, pblock, from, connman))
@@ -3269,6 +4002,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockfilemapper.Invalidate(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3384,6 +4118,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
+    LOCK(cs_mapBlockIndex);
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3503,7 +4238,7 @@ bool static LoadBlockIndexDB(bool* fRebuildRequired)
             if (pindex->nChainTx) {
                 CBlock block;
                 if (ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
-                    pindex->nMaxBlockSizeVote = GetMaxBlockSizeVote(block.vtx[0].vin[0].scriptSig, pindex->nHeight);
+                    pindex->nMaxBlockSizeVote = GetMaxBlockSizeVote(block.vtx[0]->vin[0].scriptSig, pindex->nHeight);
                     pindex->nMaxBlockSize = GetNextMaxBlockSize(pindex->pprev, chainparams.GetConsensus());
                 } else {
                     // Error: Can't reconstruct vote. Rebuild required.
@@ -3534,6 +4269,7 @@ void LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end())
         return;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
 
     PruneBlockIndexCandidates();
 
@@ -3643,16 +4379,16 @@ static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& view, c
         return error("ReplayBlock(): ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
     }
 
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& tx : block.vtx) {
         // pass check = true as every addition may be an override
-        AddCoins(view, tx, pindex->nHeight, true);
+        AddCoins(view, *tx, pindex->nHeight, true);
     }
 
-    for (const CTransaction& tx : block.vtx) {
-        if (tx.IsCoinBase()) {
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->IsCoinBase()) {
             continue;
         }
-        for (const CTxIn& txin : tx.vin) {
+        for (const CTxIn& txin : tx->vin) {
             view.SpendCoin(txin.prevout);
         }
     }
@@ -3729,6 +4465,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
@@ -3738,6 +4475,10 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    blockwriter.Flush();
+    blockwriter.Clear();
+    blockfilemapper.Clear();
+    GetRawBlockCache().Clear();
     nBlockSequenceId = 1;
     blocksInFlight.clear();
     nQueuedValidatedHeaders = 0;
@@ -3751,10 +4492,13 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+    {
+        LOCK(cs_mapBlockIndex);
+        BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
+            delete entry.second;
+        }
+        mapBlockIndex.clear();
     }
-    mapBlockIndex.clear();
     fHavePruned = false;
 }
 
@@ -4206,11 +4950,18 @@ bool static AlreadyHave(const CInv& inv)
     return true;
 }
 
+// Download blocks from this peer as graphene blocks.
+static bool UseGrapheneBlocks(const CNode* n) {
+    return Opt().UsingThinBlocks() && Opt().UsingGrapheneBlocks()
+        && n->SupportsGrapheneBlocks();
+}
+
 // Activate thin blocks only if we're not doing bulk downloads (it's faster to use ordinary block messages when
 // catching up with the block chain).
 bool ThinBlocksActive(CNode* n) {
     return !IsInitialBlockDownload() && Opt().UsingThinBlocks()
-        && (n->SupportsXThinBlocks() || NodeStatePtr(n->id)->supportsCompactBlocks);
+        && (n->SupportsXThinBlocks() || NodeStatePtr(n->id)->supportsCompactBlocks
+            || UseGrapheneBlocks(n));
 }
 
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connman)
@@ -4251,7 +5002,6 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, std::atomic<bool>& i
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     vector<CInv> vNotFound;
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -4267,13 +5017,20 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, std::atomic<bool>& i
             BlockSender blockSender;
             if (blockSender.isBlockType(inv.type))
             {
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                bool haveBlock = mi != mapBlockIndex.end();
-                bool canSend = haveBlock && blockSender.canSend(
-                        chainActive, *(mi->second), pindexBestHeader);
-
-                if (canSend)
-                    blockSender.send(chainActive, *connman, *pfrom, *(mi->second), inv);
+                // Blocks in the active chain are served against a snapshot of
+                // it without cs_main. Anything else needs the fingerprinting
+                // checks against the best header, which require the lock.
+                CBlockIndex* pindex = LookupBlockIndex(inv.hash);
+                std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+                if (pindex && chain->Contains(pindex)) {
+                    if (blockSender.canSend(*chain, *pindex, nullptr))
+                        blockSender.send(*chain, *connman, *pfrom, *pindex, inv);
+                }
+                else if (pindex) {
+                    LOCK(cs_main);
+                    if (blockSender.canSend(chainActive, *pindex, pindexBestHeader))
+                        blockSender.send(chainActive, *connman, *pfrom, *pindex, inv);
+                }
             }
             else if (inv.IsKnownType())
             {
@@ -4281,9 +5038,9 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, std::atomic<bool>& i
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSharedPayloadRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        connman->PushMessage(pfrom, NetMsg(pfrom, inv.GetCommand(), (*mi).second));
+                        connman->PushMessage(pfrom, SharedNetMsg(inv.GetCommand(), mi->second));
                         pushed = true;
                     }
                 }
@@ -4367,57 +5124,57 @@ static std::tuple<std::vector<uint8_t>, std::vector<bip64::CCoin> > ProcessGetUT
 // Used for reconstructing thin blocks.
 struct TxFinderImpl : public TxFinder {
 
-    CTransaction fullLookup(const uint256& h) const {
-        CTransaction tx;
-        if (mempool.lookup(h, tx))
-            return tx;
+    CTransactionRef fullLookup(const uint256& h) const {
+        CTransactionRef ptx = mempool.get(h);
+        if (ptx)
+            return ptx;
 
-        if (mapOrphanTransactions.count(h))
-            return mapOrphanTransactions[h].tx;
+        auto orphan = mapOrphanTransactions.find(h);
+        if (orphan != mapOrphanTransactions.end())
+            return orphan->second.tx;
 
-        // if not found, tx is left alone.
+        CTransaction tx;
         try {
-            FindTransactionInRelayMap(h, tx);
+            if (FindTransactionInRelayMap(h, tx))
+                return MakeTransactionRef(std::move(tx));
         }
         catch (const std::ios_base::failure& e) {
             LogPrintf("Exception '%s' in FindTransactionInRelayMap ignored\n", e.what());
-            return CTransaction();
         }
-
-        return tx;
+        return nullptr;
     }
 
-    CTransaction lookup(const ThinTx& hash) const {
+    CTransactionRef lookup(const ThinTx& hash) const {
 
-        CTransaction match;
+        CTransactionRef match;
         {
             LOCK(mempool.cs);
             for (auto& t : mempool.mapTx) {
                 if (!hash.equals(t.GetTx().GetHash()))
                     continue;
 
-                if (!match.IsNull()) {
+                if (match) {
                     LogPrintf("Info: Hash collision in thin block for tx %s\n",
                             t.GetTx().GetHash().ToString());
-                    // Return empty tx so it is re-requested.
-                    return CTransaction();
+                    // Return null so it is re-requested.
+                    return nullptr;
 
                 }
-                match = t.GetTx();
+                match = t.GetSharedTx();
             }
         }
-        if (!match.IsNull())
+        if (match)
             return match;
 
-        for (auto t : mapOrphanTransactions)
-            if (hash.equals(t.second.tx.GetHash()))
+        for (auto& t : mapOrphanTransactions)
+            if (hash.equals(t.second.tx->GetHash()))
                 return t.second.tx;
 
         // Skip relay map.
-        return CTransaction();
+        return nullptr;
     }
 
-    CTransaction operator()(const ThinTx& hash) const {
+    CTransactionRef operator()(const ThinTx& hash) const {
         AssertLockHeld(cs_main);
 
         if (hash.hasFull())
@@ -4427,10 +5184,17 @@ struct TxFinderImpl : public TxFinder {
     }
 };
 
-// Lists all hashes in mempool
-struct MempoolHashProvider : public TxHashProvider {
-    void operator()(std::vector<uint256>& dst) {
-        mempool.queryHashes(dst);
+// Filter of recent transactions in mempool
+struct MempoolFilterProvider : public TxFilterProvider {
+    CBloomFilter operator()() override {
+        return mempool.GetRecentTxFilter();
+    }
+};
+
+// Number of transactions in mempool
+struct MempoolCountProvider : public TxCountProvider {
+    uint64_t operator()() override {
+        return mempool.size();
     }
 };
 
@@ -4571,11 +5335,17 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             NodeStatePtr ns(pfrom->id);
 
-            if (Opt().UsingThinBlocks() && pfrom->SupportsXThinBlocks())
+            if (UseGrapheneBlocks(pfrom))
+            {
+                ns->thinblock.reset(new GrapheneWorker(
+                    thinblockmg, pfrom->id,
+                    std::unique_ptr<TxCountProvider>(new MempoolCountProvider)));
+            }
+            else if (Opt().UsingThinBlocks() && pfrom->SupportsXThinBlocks())
             {
                 ns->thinblock.reset(new XThinWorker(
                     thinblockmg, pfrom->id,
-                    std::unique_ptr<TxHashProvider>(new MempoolHashProvider)));
+                    std::unique_ptr<TxFilterProvider>(new MempoolFilterProvider)));
             }
             else { /* keep DummyThinWorker */ }
 
@@ -4741,7 +5511,9 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         NodeStatePtr node(pfrom->id);
         node->supportsCompactBlocks = true;
         node->prefersBlocks = highBandwidth;
-        node->thinblock.reset(new CompactWorker(thinblockmg, pfrom->id));
+        // Graphene blocks are preferred over compact blocks.
+        if (!UseGrapheneBlocks(pfrom))
+            node->thinblock.reset(new CompactWorker(thinblockmg, pfrom->id));
     }
 
     else if (strCommand == "sendheaders")
@@ -4907,46 +5679,46 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-
-        if (IsInitialBlockDownload())
+        if (!IsInitialBlockDownloadOver() && IsInitialBlockDownload())
             return true;
 
+        // Served from a snapshot of the active chain, so that header sync
+        // of peers does not contend with block validation for cs_main.
+        std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
         CBlockIndex* pindex = NULL;
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
+            pindex = LookupBlockIndex(hashStop);
+            if (!pindex)
                 return true;
-            pindex = (*mi).second;
         }
         else
         {
             // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
+            pindex = FindForkInGlobalIndex(*chain, locator);
             if (pindex)
-                pindex = chainActive.Next(pindex);
+                pindex = chain->Next(pindex);
         }
 
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
         LogPrint(Log::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex))
+        for (; pindex; pindex = chain->Next(pindex))
         {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
-        // pindex can be NULL either if we sent chainActive.Tip() OR
-        // if our peer has chainActive.Tip() (and thus we are sending an empty
+        // pindex can be NULL either if we sent the tip OR
+        // if our peer has the tip (and thus we are sending an empty
         // headers message). In both cases it's safe to update
         // bestHeaderSent to be our tip.
-        NodeStatePtr(pfrom->id)->bestHeaderSent = pindex ? pindex : chainActive.Tip();
+        NodeStatePtr(pfrom->id)->bestHeaderSent = pindex ? pindex : chain->Tip();
         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
     }
-    else if (strCommand == "getutxos")
+    else if (strCommand == NetMsgType::GETUTXOS)
     {
         bool fCheckMemPool;
         std::vector<COutPoint> vOutPoints;
@@ -4957,13 +5729,18 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             size_t maxBytes = connman->GetSendBufferSize();
             std::vector<unsigned char> bitmap;
             std::vector<bip64::CCoin> outs;
+            uint32_t nHeight;
+            uint256 hashTip;
             {
+                // The coins view has no snapshot, so hold cs_main for the
+                // lookups only and report the tip they were made against.
                 LOCK(cs_main);
                 tie(bitmap, outs) = ProcessGetUTXOs(vOutPoints, fCheckMemPool, maxBytes);
+                nHeight = chainActive.Height();
+                hashTip = chainActive.Tip()->GetBlockHash();
             }
             connman->PushMessage(pfrom, NetMsg(pfrom, NetMsgType::UTXOS,
-                                               static_cast<uint32_t>(chainActive.Height()),
-                                               chainActive.Tip()->GetBlockHash(), bitmap, outs));
+                                               nHeight, hashTip, bitmap, outs));
         }
         catch (const std::exception& e) {
             connman->PushMessage(pfrom, NetMsg(pfrom, NetMsgType::REJECT, strCommand, REJECT_INVALID,
@@ -4977,8 +5754,9 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     {
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
-        vRecv >> tx;
+        CTransactionRef ptx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -5017,7 +5795,7 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                      ++mi)
                 {
                     const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                    const CTransaction& orphanTx = *mapOrphanTransactions[orphanHash].tx;
                     NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -5062,7 +5840,7 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(tx, pfrom->GetId());
+            AddOrphanTx(ptx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -5161,6 +5939,27 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             throw;
         }
     }
+    else if (strCommand == NetMsgType::GRAPHENEBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        if (!Opt().UsingThinBlocks())
+            return true;
+        // We are receiving a graphene block.
+        try {
+            LOCK(cs_main);
+            NodeStatePtr nodestate(pfrom->id);
+            MarkBlockAsInFlight inFlight;
+            DefaultHeaderProcessor headerp(*connman, pfrom, blocksInFlight,
+                                           thinblockmg, inFlight, CheckBlockIndex);
+            GrapheneBlockProcessor blockp(*connman, *pfrom, *(nodestate->thinblock),
+                                          headerp, inFlight);
+            blockp(vRecv, mempool, TxFinderImpl(),
+                    chainActive.Tip()->nMaxBlockSize, chainActive.Height());
+        }
+        catch (const std::exception& e) {
+            unexpectedThinError(strCommand, *connman, *pfrom, e.what());
+            throw;
+        }
+    }
     else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         if (!Opt().UsingThinBlocks())
@@ -5234,6 +6033,22 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
     }
+    else if (strCommand == NetMsgType::GET_GRAPHENE) {
+        if (!Opt().UsingThinBlocks())
+            return true;
+        CInv inv;
+        uint64_t mempoolTxs;
+        vRecv >> inv >> mempoolTxs;
+
+        if (inv.type != MSG_GRAPHENEBLOCK)
+            Misbehaving(pfrom->GetId(), 100, "getgraphene: not a graphene block request");
+        else
+        {
+            pfrom->nGrapheneMempoolTxs = mempoolTxs;
+            pfrom->vRecvGetData.push_back(inv);
+            ProcessGetData(pfrom, connman, interruptMsgProc);
+        }
+    }
     else if (strCommand == "get_xblocktx") {
         if (!Opt().UsingThinBlocks())
             return true;
@@ -5322,7 +6137,8 @@ bool ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "mempool")
     {
-        LOCK2(cs_main, pfrom->cs_filter);
+        // The mempool locks itself; cs_main is not needed.
+        LOCK(pfrom->cs_filter);
 
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
@@ -5562,6 +6378,8 @@ bool ProcessMessages(CNode* pfrom, CConnman* connman, std::atomic<bool>& interru
 
         // Process message
         bool fRet = false;
+        const int64_t nHandlerStart = GetTimeMicros();
+        const int64_t nLockWaitStart = LockWaitMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
@@ -5599,6 +6417,13 @@ bool ProcessMessages(CNode* pfrom, CConnman* connman, std::atomic<bool>& interru
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        const int64_t nHandlerEnd = GetTimeMicros();
+        const int64_t nLockWait = LockWaitMicros() - nLockWaitStart;
+        GetMessageStats().Record(strCommand, nMessageSize, nHandlerEnd - nHandlerStart,
+                                 nLockWait, nHandlerEnd - msg.nTime);
+        pfrom->msgStats.Record(strCommand, nMessageSize, nHandlerEnd - nHandlerStart,
+                               nLockWait, nHandlerEnd - msg.nTime);
+
         if (!fRet) {
             LogPrint(Log::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
         }
@@ -5624,7 +6449,8 @@ bool WillDownloadFromNode(CNode* pto, const ThinBlockWorker& worker) {
 
     // We want to download thin blocks only.
     return pto->SupportsXThinBlocks()
-        || NodeStatePtr(pto->id)->supportsCompactBlocks;
+        || NodeStatePtr(pto->id)->supportsCompactBlocks
+        || UseGrapheneBlocks(pto);
 }
 
 bool SendMessages(CNode* pto, CConnman* connman, std::atomic<bool>& interruptMsgProc)
@@ -5763,9 +6589,7 @@ bool SendMessages(CNode* pto, CConnman* connman, std::atomic<bool>& interruptMsg
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
                     // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
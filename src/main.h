@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -39,6 +40,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CInv;
 class CConnman;
@@ -50,6 +52,8 @@ struct PrecomputedTransactionData;
 struct CNodeStateStats;
 struct LockPoints;
 
+template <typename T> class CCheckQueueControl;
+
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Default for -limitancestorcount, max number of in-mempool ancestors */
@@ -64,6 +68,8 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
@@ -233,11 +239,20 @@ bool ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv,
 bool SendMessages(CNode* pto, CConnman* connman, std::atomic<bool>& interrupt);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block transaction checking thread */
+void ThreadBlockCheck();
+/** Run an instance of the transaction connect thread */
+void ThreadTxConnectCheck();
+/** Run the thread that writes accepted blocks to disk */
+void ThreadBlockWriter();
 /** Try to detect Partition (network isolation) attacks against us */
 int PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 extern bool fForceInitialBlockDownload;
 bool IsInitialBlockDownload();
+/** Lock-free check whether IsInitialBlockDownload() has latched to false and
+ * we're not importing or reindexing. False when in doubt. */
+bool IsInitialBlockDownloadOver();
 /** Format a string that describes several potential problems detected by the core */
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -289,6 +304,20 @@ bool IsCashHFEnabled(const CBlockIndex *pindexPrev);
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, CConnman*, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, CConnman*, bool fOverrideMempoolLimit,
+                                bool fRejectAbsurdFee, int64_t nAcceptTime);
+
+/** Write the mempool, with entry times and fee deltas, to disk */
+bool DumpMempool();
+
+/**
+ * Load the mempool from disk. Transactions are accepted in batches, with
+ * the coins and script checks of each batch done in parallel first.
+ */
+bool LoadMempool();
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -315,6 +344,14 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
                  unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
 
+/**
+ * As above, for a transaction spent at nSpendHeight rather than in the block
+ * after the view's best block. Does not take cs_main.
+ */
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, int nSpendHeight,
+                 bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata,
+                 std::vector<CScriptCheck> *pvChecks);
+
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
 
@@ -389,9 +426,11 @@ public:
 
 
 /** Functions for disk access for blocks */
-bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params&);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params&);
+/** The block serialized as stored, for sending it on without deserializing. */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& raw, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -405,6 +444,43 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false);
 
+/** Rules the transactions of a block are connected under. */
+struct BlockConnectRules {
+    unsigned int nScriptFlags;
+    int nLockTimeFlags;
+    bool fStrictPayToScriptHash;
+    bool fScriptChecks;
+    bool fCacheResults;
+    uint64_t nMaxSigOps;
+};
+
+/**
+ * The transaction part of ConnectBlock: check the transactions of a block
+ * against coins and apply them to it, in block order. Script checks are
+ * handed to control, or run inline if it is NULL; txdata holds what they
+ * refer to and must outlive them.
+ */
+bool ConnectBlockTransactions(const CBlock& block, CValidationState& state, const CBlockIndex& index,
+                              CCoinsViewCache& coins, const BlockConnectRules& rules,
+                              CCheckQueueControl<CScriptCheck>* control,
+                              std::vector<PrecomputedTransactionData>& txdata,
+                              CBlockUndo& blockundo, CAmount& nFees);
+
+/**
+ * Same as ConnectBlockTransactions, with the same result, but checks the
+ * transactions in parallel on the transaction connect threads.
+ *
+ * The coins each transaction spends are looked up first, taking outputs of
+ * earlier transactions in the block from the block itself, so the checks do
+ * not depend on each other. The outcomes are then gone through in block
+ * order, and the coins updated, as the serial version would.
+ */
+bool ConnectBlockTransactionsParallel(const CBlock& block, CValidationState& state, const CBlockIndex& index,
+                                      CCoinsViewCache& coins, const BlockConnectRules& rules,
+                                      CCheckQueueControl<CScriptCheck>* control,
+                                      std::vector<PrecomputedTransactionData>& txdata,
+                                      CBlockUndo& blockundo, CAmount& nFees);
+
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -434,6 +510,7 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
+CBlockIndex* FindForkInGlobalIndex(const CChainSnapshot& chain, const CBlockLocator& locator);
 
 /** Mark a block as invalid. */
 bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex);
@@ -444,6 +521,14 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/** The tip of chainActive as of the last tip change. Can be used without
+ * cs_main; the chain may have moved on by the time the snapshot is used. */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
+/** Find a block index entry by hash without holding cs_main. The entry's
+ * header fields are final; its status may change concurrently. */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -27,6 +27,11 @@ void MempoolFeeModifier::RemoveDelta(const uint256& txid) {
     deltas.erase(txid);
 }
 
+std::map<uint256, CAmount> MempoolFeeModifier::GetDeltas() const {
+    std::unique_lock<std::mutex> lock(cs);
+    return std::map<uint256, CAmount>(begin(deltas), end(deltas));
+}
+
 size_t MempoolFeeModifier::DynamicMemoryUsage() const {
     std::unique_lock<std::mutex> lock(cs);
     return memusage::DynamicUsage(deltas);
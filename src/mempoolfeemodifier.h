@@ -3,6 +3,7 @@
 
 #include "utilhash.h" // Salteduint256Hasher
 
+#include <map>
 #include <mutex>
 #include <unordered_map>
 
@@ -19,6 +20,7 @@ public:
     CAmount GetDelta(const uint256& txid) const;
     void AddDelta(const uint256& txid, const CAmount& amount);
     void RemoveDelta(const uint256& txid);
+    std::map<uint256, CAmount> GetDeltas() const;
 
     size_t DynamicMemoryUsage() const;
 
@@ -0,0 +1,174 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempoolgraph.h"
+#include "memusage.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+// Room for links a list gets the first time it grows.
+const uint32_t MIN_LIST_CAPACITY = 2;
+
+// Arenas smaller than this are not compacted, however much is unused.
+const size_t MIN_COMPACT_SIZE = 4096;
+
+} // namespace
+
+MempoolGraph::MempoolGraph() : nArenaUnused(0), nEpoch(1)
+{
+}
+
+MempoolGraph::Node MempoolGraph::AddNode()
+{
+    NodeLinks links = { {0, 0, 0}, {0, 0, 0}, 0 };
+    if (!freeNodes.empty()) {
+        const Node n = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[n] = links;
+        return n;
+    }
+    nodes.push_back(links);
+    return nodes.size() - 1;
+}
+
+void MempoolGraph::RemoveNode(Node n)
+{
+    assert(!nodes[n].parents.size && !nodes[n].children.size);
+    Release(nodes[n].parents);
+    Release(nodes[n].children);
+    freeNodes.push_back(n);
+    CompactIfWasteful();
+}
+
+bool MempoolGraph::AddLink(Node parent, Node child)
+{
+    // Look in the shorter of the two lists.
+    const Range children = Children(parent);
+    const Range parents = Parents(child);
+    if (children.size() <= parents.size()) {
+        if (std::find(children.begin(), children.end(), child) != children.end())
+            return false;
+    }
+    else if (std::find(parents.begin(), parents.end(), parent) != parents.end()) {
+        return false;
+    }
+    Append(nodes[parent].children, child);
+    Append(nodes[child].parents, parent);
+    CompactIfWasteful();
+    return true;
+}
+
+bool MempoolGraph::RemoveLink(Node parent, Node child)
+{
+    if (!Erase(nodes[parent].children, child))
+        return false;
+    bool erased = Erase(nodes[child].parents, parent);
+    assert(erased);
+    return true;
+}
+
+MempoolGraph::Range MempoolGraph::Parents(Node n) const
+{
+    return GetRange(nodes[n].parents);
+}
+
+MempoolGraph::Range MempoolGraph::Children(Node n) const
+{
+    return GetRange(nodes[n].children);
+}
+
+bool MempoolGraph::Visit(Node n)
+{
+    if (nodes[n].epoch == nEpoch)
+        return false;
+    nodes[n].epoch = nEpoch;
+    return true;
+}
+
+void MempoolGraph::Clear()
+{
+    nodes.clear();
+    freeNodes.clear();
+    arena.clear();
+    nArenaUnused = 0;
+}
+
+size_t MempoolGraph::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(nodes) + memusage::DynamicUsage(freeNodes)
+        + memusage::DynamicUsage(arena);
+}
+
+MempoolGraph::Range MempoolGraph::GetRange(const List& list) const
+{
+    const Node* first = arena.data() + list.offset;
+    Range r = { first, first + list.size };
+    return r;
+}
+
+void MempoolGraph::Append(List& list, Node n)
+{
+    if (list.size == list.capacity) {
+        const uint32_t nGrow = std::max(list.capacity, MIN_LIST_CAPACITY);
+        if (list.capacity && list.offset + list.capacity == arena.size()) {
+            // Last in the arena, so it grows in place.
+            arena.resize(arena.size() + nGrow);
+        }
+        else {
+            const uint32_t offset = arena.size();
+            arena.resize(arena.size() + list.capacity + nGrow);
+            std::copy(arena.begin() + list.offset, arena.begin() + list.offset + list.size,
+                      arena.begin() + offset);
+            nArenaUnused += list.capacity;
+            list.offset = offset;
+        }
+        list.capacity += nGrow;
+    }
+    arena[list.offset + list.size++] = n;
+}
+
+bool MempoolGraph::Erase(List& list, Node n)
+{
+    Node* first = arena.data() + list.offset;
+    Node* last = first + list.size;
+    Node* found = std::find(first, last, n);
+    if (found == last)
+        return false;
+    // Order does not matter.
+    *found = *(last - 1);
+    --list.size;
+    return true;
+}
+
+void MempoolGraph::Release(List& list)
+{
+    if (list.capacity && list.offset + list.capacity == arena.size())
+        arena.resize(list.offset);
+    else
+        nArenaUnused += list.capacity;
+    list.offset = list.size = list.capacity = 0;
+}
+
+void MempoolGraph::CompactIfWasteful()
+{
+    if (arena.size() < MIN_COMPACT_SIZE || nArenaUnused <= arena.size() / 2)
+        return;
+
+    std::vector<Node> compacted;
+    compacted.reserve(arena.size() - nArenaUnused);
+    for (NodeLinks& links : nodes) {
+        for (List* list : { &links.parents, &links.children }) {
+            const uint32_t offset = compacted.size();
+            compacted.insert(compacted.end(), arena.begin() + list->offset,
+                             arena.begin() + list->offset + list->size);
+            list->offset = offset;
+            list->capacity = list->size;
+        }
+    }
+    arena.swap(compacted);
+    nArenaUnused = 0;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_MEMPOOLGRAPH_H
+#define BITCOIN_MEMPOOLGRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Parent and child links between mempool transactions, which ancestor and
+ * descendant packages are walked over.
+ *
+ * Transactions are nodes, numbered from 0. The numbers of removed nodes
+ * are reused. The links of all nodes are kept in one arena, each list in a
+ * block that moves to the end of the arena, at twice the size, when it
+ * fills up. The arena is compacted once more of it is left behind by moves
+ * and removals than is in use.
+ *
+ * A walk marks the nodes it visits with its epoch, rather than collecting
+ * them in a set, so that it allocates nothing and visits a node once.
+ *
+ * Not thread safe. Guarded by the mempool lock.
+ */
+class MempoolGraph {
+public:
+    typedef uint32_t Node;
+
+    // Links of a node. Invalidated when links are added or nodes removed.
+    struct Range {
+        const Node* first;
+        const Node* last;
+
+        const Node* begin() const { return first; }
+        const Node* end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    MempoolGraph();
+
+    Node AddNode();
+    // The node must not have links left.
+    void RemoveNode(Node n);
+    // Return false if the nodes were already linked, or not linked.
+    bool AddLink(Node parent, Node child);
+    bool RemoveLink(Node parent, Node child);
+    Range Parents(Node n) const;
+    Range Children(Node n) const;
+
+    // Starts a new walk, in which no node has been visited yet.
+    void NewEpoch() { ++nEpoch; }
+    // Visits the node in the current walk. Returns false if it was visited
+    // already.
+    bool Visit(Node n);
+    bool IsVisited(Node n) const { return nodes[n].epoch == nEpoch; }
+
+    // Highest node number that has been in use, plus one.
+    size_t Size() const { return nodes.size(); }
+    void Clear();
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct List {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t capacity;
+    };
+    struct NodeLinks {
+        List parents;
+        List children;
+        uint64_t epoch;
+    };
+
+    Range GetRange(const List& list) const;
+    void Append(List& list, Node n);
+    bool Erase(List& list, Node n);
+    void Release(List& list);
+    void CompactIfWasteful();
+
+    std::vector<NodeLinks> nodes;
+    std::vector<Node> freeNodes;
+    std::vector<Node> arena;
+    // Arena entries not in any list.
+    size_t nArenaUnused;
+    uint64_t nEpoch;
+};
+
+#endif
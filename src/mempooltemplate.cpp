@@ -0,0 +1,268 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooltemplate.h"
+#include "consensus/consensus.h"
+#include "consensus/tx_verify.h"
+
+#include <algorithm>
+#include <stack>
+
+namespace {
+
+// Size and sigops reserved for the block header and coinbase.
+const uint64_t BLOCK_RESERVED_SIZE = 1000;
+const uint64_t BLOCK_RESERVED_SIGOPS = 100;
+
+// Selected transactions looked at for dropping, when making room for one
+// that enters the mempool.
+const size_t MAX_DROP_CANDIDATES = 50;
+
+} // namespace
+
+bool MempoolTemplate::CompareByFeeRate::operator()(const txiter& a, const txiter& b) const
+{
+    // Cross multiplied, as CompareTxMemPoolEntryByFee does.
+    double f1 = double(a->GetModifiedFee()) * b->GetTxSize();
+    double f2 = double(b->GetModifiedFee()) * a->GetTxSize();
+    if (f1 == f2)
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    return f1 < f2;
+}
+
+MempoolTemplate::MempoolTemplate(const CTxMemPool& pool) :
+    pool(pool), fActive(false), fStale(true), fChecked(false),
+    nBlockSize(BLOCK_RESERVED_SIZE), nBlockSigOps(BLOCK_RESERVED_SIGOPS),
+    nNextSequence(0), nCheckedSequence(0)
+{
+}
+
+bool MempoolTemplate::Update(const MempoolTemplateParams& p)
+{
+    AssertLockHeld(pool.cs);
+    fActive = true;
+    if (!fStale && p == params)
+        return false;
+    params = p;
+    Rebuild();
+    return true;
+}
+
+std::vector<MempoolTemplate::txiter> MempoolTemplate::GetTransactions() const
+{
+    std::vector<txiter> txs;
+    txs.reserve(bySequence.size());
+    for (auto& s : bySequence)
+        txs.push_back(s.second);
+    return txs;
+}
+
+std::vector<MempoolTemplate::txiter> MempoolTemplate::GetUncheckedTransactions() const
+{
+    std::vector<txiter> txs;
+    for (auto s = bySequence.lower_bound(nCheckedSequence); s != bySequence.end(); ++s)
+        txs.push_back(s->second);
+    return txs;
+}
+
+void MempoolTemplate::Clear()
+{
+    bySequence.clear();
+    selected.clear();
+    byFeeRate.clear();
+    nBlockSize = BLOCK_RESERVED_SIZE;
+    nBlockSigOps = BLOCK_RESERVED_SIGOPS;
+    fStale = true;
+    fChecked = false;
+}
+
+// Whether the transaction may be in the block at all, regardless of room.
+bool MempoolTemplate::MayInclude(txiter it) const
+{
+    const CTransaction& tx = it->GetTx();
+    if (params.fSkipNegativeDelta && pool.GetFeeModifier().GetDelta(tx.GetHash()) < 0)
+        return false;
+    return IsFinalTx(tx, params.nHeight, params.nLockTimeCutoff);
+}
+
+void MempoolTemplate::Select(txiter it)
+{
+    selected.insert(std::make_pair(it, nNextSequence));
+    bySequence.insert(std::make_pair(nNextSequence, it));
+    byFeeRate.insert(it);
+    ++nNextSequence;
+    nBlockSize += it->GetTxSize();
+    nBlockSigOps += it->GetSigOpCount();
+}
+
+void MempoolTemplate::Unselect(txiter it)
+{
+    auto s = selected.find(it);
+    if (s == selected.end())
+        return;
+    bySequence.erase(s->second);
+    byFeeRate.erase(it);
+    selected.erase(s);
+    nBlockSize -= it->GetTxSize();
+    nBlockSigOps -= it->GetSigOpCount();
+}
+
+bool MempoolTemplate::HasSelectedChildren(txiter it) const
+{
+    for (txiter child : pool.GetMemPoolChildren(it)) {
+        if (selected.count(child))
+            return true;
+    }
+    return false;
+}
+
+// Selects like CreateNewBlock always has, by ancestor feerate.
+void MempoolTemplate::Rebuild()
+{
+    Clear();
+    fStale = false;
+
+    CTxMemPool::setEntries gotParents;
+    std::stack<txiter, std::vector<txiter>> clearedTxs;
+    int lastFewTxs = 0;
+
+    auto mi = pool.mapTx.get<3>().begin();
+    txiter iter;
+
+    while (mi != pool.mapTx.get<3>().end() || !clearedTxs.empty())
+    {
+        if (clearedTxs.empty()) { // add tx with next highest score
+            iter = pool.mapTx.project<0>(mi);
+            mi++;
+        }
+        else {  // try to add a previously cleared tx
+            iter = clearedTxs.top();
+            clearedTxs.pop();
+        }
+
+        if (selected.count(iter)) {
+            continue;
+        }
+
+        if (params.fSkipNegativeDelta && pool.GetFeeModifier().GetDelta(iter->GetTx().GetHash()) < 0) {
+            continue;
+        }
+
+        // Our index guarantees that all ancestors are paid for.
+        // If it has parents, push this tx, then its parents, onto the stack.
+        // The second time we process a tx, just make sure all parents are in the block
+        bool fAllParentsInBlock = true;
+        bool fPushedAParent = false;
+        bool fFirstTime = !gotParents.count(iter);
+        gotParents.insert(iter);
+        for (txiter parent : pool.GetMemPoolParents(iter))
+        {
+            if (!selected.count(parent)) {
+                fAllParentsInBlock = false;
+                if (fFirstTime) {
+                    if (!fPushedAParent) {
+                        clearedTxs.push(iter);
+                        fPushedAParent = true;
+                    }
+                    clearedTxs.push(parent);
+                }
+            }
+        }
+        if (fPushedAParent || !fAllParentsInBlock) {
+            continue;
+        }
+
+        unsigned int nTxSize = iter->GetTxSize();
+        if (nBlockSize + nTxSize >= params.nBlockMaxSize) {
+            if (nBlockSize >  params.nBlockMaxSize - 100 || lastFewTxs > 50) {
+                break;
+            }
+            // Once we're within 1000 bytes of a full block, only look at 50 more txs
+            // to try to fill the remaining space.
+            if (nBlockSize > params.nBlockMaxSize - 1000) {
+                lastFewTxs++;
+            }
+            continue;
+        }
+
+        if (!IsFinalTx(iter->GetTx(), params.nHeight, params.nLockTimeCutoff))
+            continue;
+
+        // TODO: with more complexity we could make the block bigger when
+        // sigop-constrained and sigop density in later megabytes is low
+        unsigned int nTxSigOps = iter->GetSigOpCount();
+        if (nBlockSigOps + nTxSigOps >= MaxBlockSigops(nBlockSize)) {
+            if (nBlockSigOps > MaxBlockSigops(nBlockSize) - 2) {
+                break;
+            }
+            continue;
+        }
+
+        Select(iter);
+    }
+}
+
+void MempoolTemplate::AddTx(txiter it, const CTxMemPool::setEntries& ancestors)
+{
+    if (!fActive || fStale)
+        return;
+
+    // The transaction and its ancestors that are not selected, parents
+    // first. An ancestor has fewer ancestors than its descendants.
+    std::vector<txiter> package;
+    uint64_t nPackageSize = 0;
+    uint64_t nPackageSigOps = 0;
+    CAmount nPackageFees = 0;
+    for (txiter a : ancestors) {
+        if (!selected.count(a))
+            package.push_back(a);
+    }
+    std::sort(package.begin(), package.end(), [](const txiter& a, const txiter& b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    package.push_back(it);
+    for (txiter p : package) {
+        if (!MayInclude(p))
+            return;
+        nPackageSize += p->GetTxSize();
+        nPackageSigOps += p->GetSigOpCount();
+        nPackageFees += p->GetModifiedFee();
+    }
+
+    // Drop selected transactions with a lower feerate than the package
+    // until it fits, as long as that does not leave a selected
+    // transaction without its parents.
+    std::vector<txiter> drop;
+    uint64_t nDropSize = 0;
+    uint64_t nDropSigOps = 0;
+    auto fits = [&]() {
+        const uint64_t nSize = nBlockSize - nDropSize;
+        return nSize + nPackageSize < params.nBlockMaxSize
+            && nBlockSigOps - nDropSigOps + nPackageSigOps < MaxBlockSigops(nSize);
+    };
+    size_t nCandidates = 0;
+    for (auto d = byFeeRate.begin(); !fits(); ++d, ++nCandidates) {
+        if (d == byFeeRate.end() || nCandidates == MAX_DROP_CANDIDATES)
+            return;
+        if (double((*d)->GetModifiedFee()) * nPackageSize >= double(nPackageFees) * (*d)->GetTxSize())
+            return;
+        if (ancestors.count(*d) || HasSelectedChildren(*d))
+            continue;
+        drop.push_back(*d);
+        nDropSize += (*d)->GetTxSize();
+        nDropSigOps += (*d)->GetSigOpCount();
+    }
+
+    for (txiter d : drop)
+        Unselect(d);
+    for (txiter p : package)
+        Select(p);
+}
+
+void MempoolTemplate::RemoveTx(txiter it)
+{
+    if (!fActive)
+        return;
+    Unselect(it);
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_MEMPOOLTEMPLATE_H
+#define BITCOIN_MEMPOOLTEMPLATE_H
+
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+// What the transactions of a block template are selected for.
+struct MempoolTemplateParams {
+    uint256 hashPrevBlock;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    uint64_t nBlockMaxSize;
+    bool fSkipNegativeDelta;
+
+    bool operator==(const MempoolTemplateParams& o) const {
+        return hashPrevBlock == o.hashPrevBlock && nHeight == o.nHeight
+            && nLockTimeCutoff == o.nLockTimeCutoff
+            && nBlockMaxSize == o.nBlockMaxSize
+            && fSkipNegativeDelta == o.fSkipNegativeDelta;
+    }
+    bool operator!=(const MempoolTemplateParams& o) const { return !(*this == o); }
+};
+
+/**
+ * The mempool transactions of the next block, kept up to date as
+ * transactions enter and leave the mempool, so that a block template does
+ * not have to be assembled from scratch each time one is requested.
+ *
+ * When built from scratch, transactions are selected by ancestor feerate.
+ * After that, a transaction that enters the mempool is selected along with
+ * its ancestors that are not, if they fit. To make room, selected
+ * transactions with a lower feerate and no selected descendants may be
+ * dropped. A transaction that leaves the mempool leaves the selection.
+ *
+ * Built from scratch again when the tip, or any of the parameters it was
+ * selected for, have changed, or after SetStale.
+ *
+ * Not maintained until first updated. Guarded by the mempool lock.
+ */
+class MempoolTemplate {
+public:
+    typedef CTxMemPool::txiter txiter;
+
+    MempoolTemplate(const CTxMemPool& pool);
+
+    // Brings the selection up to date for params. Returns true if it was
+    // built from scratch.
+    bool Update(const MempoolTemplateParams& params);
+
+    // Selected transactions, in block order.
+    std::vector<txiter> GetTransactions() const;
+    // Block size and sigops with the transactions, including what is
+    // reserved for the header and coinbase.
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    uint64_t GetBlockSigOps() const { return nBlockSigOps; }
+    bool IsSelected(txiter it) const { return selected.count(it); }
+
+    // Whether a block with the selection has passed TestBlockValidity since
+    // it was last built from scratch. After that, only the transactions
+    // selected since the last SetChecked need checking.
+    bool IsChecked() const { return fChecked; }
+    std::vector<txiter> GetUncheckedTransactions() const;
+    void SetChecked() { fChecked = true; nCheckedSequence = nNextSequence; }
+
+    // Mempool hooks.
+    void AddTx(txiter it, const CTxMemPool::setEntries& ancestors);
+    void RemoveTx(txiter it);
+    void SetStale() { fStale = true; }
+    void Clear();
+
+private:
+    // Orders by modified feerate, then by txid.
+    struct CompareByFeeRate {
+        bool operator()(const txiter& a, const txiter& b) const;
+    };
+
+    void Rebuild();
+    bool MayInclude(txiter it) const;
+    void Select(txiter it);
+    void Unselect(txiter it);
+    bool HasSelectedChildren(txiter it) const;
+
+    const CTxMemPool& pool;
+    MempoolTemplateParams params;
+    bool fActive;
+    bool fStale;
+    bool fChecked;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockSigOps;
+    uint64_t nNextSequence;
+    uint64_t nCheckedSequence;
+    // Order selected in, which parents are selected before their children.
+    std::map<uint64_t, txiter> bySequence;
+    std::map<txiter, uint64_t, CTxMemPool::CompareIteratorByHash> selected;
+    std::set<txiter, CompareByFeeRate> byFeeRate;
+};
+
+#endif
@@ -14,19 +14,20 @@
 #include "hash.h"
 #include "main.h"
 #include "maxblocksize.h"
+#include "mempooltemplate.h"
 #include "net.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
 #include "timedata.h"
 #include "util.h"
+#include "utilfork.h"
 #include "utilmoneystr.h"
 #include "options.h"
 #include "validationinterface.h"
 
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
-#include <stack>
 #include <iomanip>
 #include <cmath>
 
@@ -72,6 +73,51 @@ std::vector<unsigned char> BIP100Str(uint64_t hardLimit) {
     return std::vector<unsigned char>(begin(s), end(s));
 }
 
+// Checks the transactions selected since the block template was last
+// checked, the way the mempool did when accepting them: their inputs are
+// in the UTXO set or in the template, their scripts pass and they have no
+// more sigops than accounted for.
+static bool CheckSelectedSince(const MempoolTemplate& selection, const CBlockIndex* pindexPrev,
+                               CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    std::vector<CTxMemPool::txiter> unchecked = selection.GetUncheckedTransactions();
+    if (unchecked.empty())
+        return true;
+
+    unsigned int flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
+    const int64_t mtpChainTip = pindexPrev->GetMedianTimePast();
+    if (IsUAHFActive(mtpChainTip))
+        flags |= SCRIPT_ENABLE_SIGHASH_FORKID;
+    if (IsThirdHFActive(mtpChainTip))
+        flags |= SCRIPT_ENABLE_MONOLITH_OPCODES;
+    const int nHeight = pindexPrev->nHeight + 1;
+
+    CCoinsViewCache view(pcoinsTip);
+    for (CTxMemPool::txiter iter : unchecked) {
+        const CTransaction& tx = iter->GetTx();
+        for (const CTxIn& in : tx.vin) {
+            CTxMemPool::txiter parent = mempool.mapTx.find(in.prevout.hash);
+            if (parent == mempool.mapTx.end() || view.IsCached(in.prevout))
+                continue;
+            if (!selection.IsSelected(parent) || in.prevout.n >= parent->GetTx().vout.size())
+                return state.Invalid(false, REJECT_INVALID, "bad-txns-inputs-missingorspent");
+            view.WarmCoin(in.prevout, Coin(parent->GetTx().vout[in.prevout.n], nHeight, false));
+        }
+        if (!view.HaveInputs(tx))
+            return state.Invalid(false, REJECT_INVALID, "bad-txns-inputs-missingorspent");
+        if (GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, view) > iter->GetSigOpCount())
+            return state.Invalid(false, REJECT_INVALID, "bad-blk-sigops");
+
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, nHeight, true, flags, true, txdata, NULL))
+            return false;
+    }
+    return true;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
 {
     const CChainParams& chainparams = Params();
@@ -89,7 +135,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
     txNew.vout[0].scriptPubKey = scriptPubKeyIn;
 
     // Add dummy coinbase tx as first transaction
-    pblock->vtx.push_back(CTransaction());
+    pblock->vtx.push_back(CTransactionRef());
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
@@ -102,15 +148,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
     // For compatibility with bip68-sequence test, set flag to not mine txs with negative fee delta.
     const bool fSkipNegativeDelta = GetBoolArg("-bip68hack", false);
 
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries gotParents;
-    std::stack<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>> clearedTxs;
-
     uint64_t nBlockSize = 1000;
     uint64_t nBlockTx = 0;
     unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
     CAmount nFees = 0;
 
     {
@@ -131,92 +171,28 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
                                 ? nMedianTimePast
                                 : pblock->GetBlockTime();
 
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-        {
-            if (clearedTxs.empty()) { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else {  // try to add a previously cleared tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
-
-            if (inBlock.count(iter)) {
-                continue;
-            }
-
-            const CTransaction& tx = iter->GetTx();
-
-            if (fSkipNegativeDelta && mempool.GetFeeModifier().GetDelta(tx.GetHash()) < 0) {
-                continue;
-            }
-
-            // Our index guarantees that all ancestors are paid for.
-            // If it has parents, push this tx, then its parents, onto the stack.
-            // The second time we process a tx, just make sure all parents are in the block
-            bool fAllParentsInBlock = true;
-            bool fPushedAParent = false;
-            bool fFirstTime = !gotParents.count(iter);
-            gotParents.insert(iter);
-            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent)) {
-                    fAllParentsInBlock = false;
-                    if (fFirstTime) {
-                        if (!fPushedAParent) {
-                            clearedTxs.push(iter);
-                            fPushedAParent = true;
-                        }
-                        clearedTxs.push(parent);
-                    }
-                }
-            }
-            if (fPushedAParent || !fAllParentsInBlock) {
-                continue;
-            }
-
-            unsigned int nTxSize = iter->GetTxSize();
-            if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000) {
-                    lastFewTxs++;
-                }
-                continue;
-            }
-
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                continue;
-
-            // TODO: with more complexity we could make the block bigger when
-            // sigop-constrained and sigop density in later megabytes is low
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MaxBlockSigops(nBlockSize)) {
-                if (nBlockSigOps > MaxBlockSigops(nBlockSize) - 2) {
-                    break;
-                }
-                continue;
-            }
-
+        // The mempool keeps the selection up to date as transactions come
+        // and go, and only selects from scratch when the tip or limits
+        // changed.
+        MempoolTemplateParams params;
+        params.hashPrevBlock = pindexPrev->GetBlockHash();
+        params.nHeight = nHeight;
+        params.nLockTimeCutoff = nLockTimeCutoff;
+        params.nBlockMaxSize = nBlockMaxSize;
+        params.fSkipNegativeDelta = fSkipNegativeDelta;
+        MempoolTemplate& selection = mempool.GetBlockTemplate();
+        selection.Update(params);
+
+        for (CTxMemPool::txiter iter : selection.GetTransactions()) {
             CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(tx);
+            pblock->vtx.push_back(iter->GetSharedTx());
             pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
+            pblocktemplate->vTxSigOps.push_back(iter->GetSigOpCount());
             ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
             nFees += nTxFees;
-
-            inBlock.insert(iter);
         }
+        nBlockSize = selection.GetBlockSize();
+        nBlockSigOps = selection.GetBlockSigOps();
 
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
@@ -225,7 +201,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
         // Compute final coinbase transaction.
         txNew.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
         txNew.vin[0].scriptSig = CScript() << nHeight << BIP100Str(hardLimit) << OP_0;
-        pblock->vtx[0] = txNew;
+        pblock->vtx[0] = MakeTransactionRef(std::move(txNew));
         pblocktemplate->vTxFees[0] = -nFees;
 
         // Fill in header
@@ -233,12 +209,21 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
         UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
         pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, Params().GetConsensus());
         pblock->nNonce         = 0;
-        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(*pblock->vtx[0]);
 
+        // The whole block is checked when selected from scratch, and after
+        // that only what was selected since.
         CValidationState state;
-        if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
-            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        if (!selection.IsChecked()) {
+            if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
+                throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+            }
+        }
+        else if (!CheckSelectedSince(selection, pindexPrev, state)) {
+            selection.SetStale();
+            throw std::runtime_error(strprintf("%s: selected transaction failed: %s", __func__, FormatStateMessage(state)));
         }
+        selection.SetChecked();
     }
 
     return pblocktemplate.release();
@@ -255,11 +240,11 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     }
     ++nExtraNonce;
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
-    CMutableTransaction txCoinbase(pblock->vtx[0]);
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << BIP100Str(nMaxBlockSize) << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
-    pblock->vtx[0] = txCoinbase;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
@@ -304,7 +289,7 @@ bool static ScanHash(const CBlockHeader *pblock, uint32_t& nNonce, uint256 *phas
 static bool ProcessBlockFound(CBlock* pblock, const CChainParams& chainparams, CConnman* connman)
 {
     LogPrintf("%s\n", pblock->ToString());
-    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0].vout[0].nValue));
+    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0]->vout[0].nValue));
 
     // Found a solution
     {
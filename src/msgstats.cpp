@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "msgstats.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+void AtomicMax(std::atomic<uint64_t>& nMax, uint64_t nValue)
+{
+    uint64_t nPrev = nMax.load(std::memory_order_relaxed);
+    while (nPrev < nValue && !nMax.compare_exchange_weak(nPrev, nValue, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t NonNegative(int64_t n)
+{
+    return n < 0 ? 0 : n;
+}
+
+const std::map<std::string, size_t>& CommandIndex()
+{
+    static const std::map<std::string, size_t> index = [] {
+        std::map<std::string, size_t> m;
+        for (const std::string& cmd : getAllNetMessageTypes())
+            m.emplace(cmd, m.size());
+        return m;
+    }();
+    return index;
+}
+
+} // namespace
+
+const size_t CDurationHistogram::NUM_BUCKETS;
+
+CDurationHistogram::CDurationHistogram()
+{
+    for (std::atomic<uint64_t>& n : vCounts)
+        n = 0;
+}
+
+size_t CDurationHistogram::BucketOf(int64_t nMicros)
+{
+    size_t nBucket = 0;
+    while (nMicros > 0 && nBucket < NUM_BUCKETS - 1) {
+        nMicros >>= 1;
+        ++nBucket;
+    }
+    return nBucket;
+}
+
+void CDurationHistogram::Add(int64_t nMicros)
+{
+    vCounts[BucketOf(nMicros)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> CDurationHistogram::GetCounts() const
+{
+    std::vector<uint64_t> counts;
+    counts.reserve(NUM_BUCKETS);
+    for (const std::atomic<uint64_t>& n : vCounts)
+        counts.push_back(n.load(std::memory_order_relaxed));
+    return counts;
+}
+
+CMessageTypeStats::Snapshot::Snapshot() :
+    nMessages(0), nBytes(0), nHandlerMicros(0), nLockWaitMicros(0),
+    nMaxHandlerMicros(0), nMaxLatencyMicros(0),
+    vHandlerHistogram(CDurationHistogram::NUM_BUCKETS, 0)
+{
+}
+
+CMessageTypeStats::Snapshot& CMessageTypeStats::Snapshot::operator+=(const Snapshot& other)
+{
+    nMessages += other.nMessages;
+    nBytes += other.nBytes;
+    nHandlerMicros += other.nHandlerMicros;
+    nLockWaitMicros += other.nLockWaitMicros;
+    nMaxHandlerMicros = std::max(nMaxHandlerMicros, other.nMaxHandlerMicros);
+    nMaxLatencyMicros = std::max(nMaxLatencyMicros, other.nMaxLatencyMicros);
+    for (size_t i = 0; i < vHandlerHistogram.size(); ++i)
+        vHandlerHistogram[i] += other.vHandlerHistogram[i];
+    return *this;
+}
+
+CMessageTypeStats::CMessageTypeStats() :
+    nMessages(0), nBytes(0), nHandlerMicros(0), nLockWaitMicros(0),
+    nMaxHandlerMicros(0), nMaxLatencyMicros(0)
+{
+}
+
+void CMessageTypeStats::Record(uint64_t nBytesIn, int64_t nHandlerMicrosIn,
+                               int64_t nLockWaitMicrosIn, int64_t nLatencyMicros)
+{
+    nMessages.fetch_add(1, std::memory_order_relaxed);
+    nBytes.fetch_add(nBytesIn, std::memory_order_relaxed);
+    nHandlerMicros.fetch_add(NonNegative(nHandlerMicrosIn), std::memory_order_relaxed);
+    nLockWaitMicros.fetch_add(NonNegative(nLockWaitMicrosIn), std::memory_order_relaxed);
+    AtomicMax(nMaxHandlerMicros, NonNegative(nHandlerMicrosIn));
+    AtomicMax(nMaxLatencyMicros, NonNegative(nLatencyMicros));
+    handlerHistogram.Add(nHandlerMicrosIn);
+}
+
+CMessageTypeStats::Snapshot CMessageTypeStats::GetSnapshot() const
+{
+    Snapshot s;
+    s.nMessages = nMessages.load(std::memory_order_relaxed);
+    s.nBytes = nBytes.load(std::memory_order_relaxed);
+    s.nHandlerMicros = nHandlerMicros.load(std::memory_order_relaxed);
+    s.nLockWaitMicros = nLockWaitMicros.load(std::memory_order_relaxed);
+    s.nMaxHandlerMicros = nMaxHandlerMicros.load(std::memory_order_relaxed);
+    s.nMaxLatencyMicros = nMaxLatencyMicros.load(std::memory_order_relaxed);
+    s.vHandlerHistogram = handlerHistogram.GetCounts();
+    return s;
+}
+
+const char* CMessageStats::OTHER = "*other*";
+
+CMessageStats::CMessageStats() : vStats(CommandIndex().size() + 1)
+{
+}
+
+size_t CMessageStats::IndexOf(const std::string& strCommand)
+{
+    const std::map<std::string, size_t>& index = CommandIndex();
+    auto it = index.find(strCommand);
+    return it == index.end() ? index.size() : it->second;
+}
+
+void CMessageStats::Record(const std::string& strCommand, uint64_t nBytes,
+                           int64_t nHandlerMicros, int64_t nLockWaitMicros,
+                           int64_t nLatencyMicros)
+{
+    vStats[IndexOf(strCommand)].Record(nBytes, nHandlerMicros, nLockWaitMicros, nLatencyMicros);
+}
+
+std::vector<std::pair<std::string, CMessageTypeStats::Snapshot> > CMessageStats::GetSnapshot() const
+{
+    std::vector<std::pair<std::string, CMessageTypeStats::Snapshot> > snapshot;
+    for (const auto& cmd : CommandIndex()) {
+        CMessageTypeStats::Snapshot s = vStats[cmd.second].GetSnapshot();
+        if (s.nMessages > 0)
+            snapshot.emplace_back(cmd.first, std::move(s));
+    }
+    CMessageTypeStats::Snapshot other = vStats.back().GetSnapshot();
+    if (other.nMessages > 0)
+        snapshot.emplace_back(OTHER, std::move(other));
+    return snapshot;
+}
+
+CMessageTypeStats::Snapshot CMessageStats::GetTotals() const
+{
+    CMessageTypeStats::Snapshot totals;
+    for (const CMessageTypeStats& stats : vStats)
+        totals += stats.GetSnapshot();
+    return totals;
+}
+
+CMessageStats& GetMessageStats()
+{
+    static CMessageStats stats;
+    return stats;
+}
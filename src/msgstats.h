@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MSGSTATS_H
+#define BITCOIN_MSGSTATS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Histogram of durations in power of two microsecond buckets. Bucket 0
+ * counts durations under 1us, bucket i durations in [2^(i-1), 2^i) us and
+ * the last bucket everything longer.
+ */
+class CDurationHistogram
+{
+public:
+    static const size_t NUM_BUCKETS = 24; // last bucket starts at ~4.2s
+
+    CDurationHistogram();
+
+    void Add(int64_t nMicros);
+    std::vector<uint64_t> GetCounts() const;
+
+    static size_t BucketOf(int64_t nMicros);
+
+private:
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> vCounts;
+};
+
+/** Counters for one message type. Updated with relaxed atomics, so a
+ * snapshot taken while messages are being processed may be slightly
+ * inconsistent between fields. */
+class CMessageTypeStats
+{
+public:
+    struct Snapshot {
+        uint64_t nMessages;
+        uint64_t nBytes;
+        uint64_t nHandlerMicros;
+        uint64_t nLockWaitMicros;
+        uint64_t nMaxHandlerMicros;
+        uint64_t nMaxLatencyMicros;
+        std::vector<uint64_t> vHandlerHistogram;
+
+        Snapshot();
+        Snapshot& operator+=(const Snapshot& other);
+    };
+
+    CMessageTypeStats();
+
+    /**
+     * @param nHandlerMicros Time spent processing the message
+     * @param nLockWaitMicros Of which blocked waiting on locks
+     * @param nLatencyMicros Time from receipt until processing finished
+     */
+    void Record(uint64_t nBytes, int64_t nHandlerMicros,
+                int64_t nLockWaitMicros, int64_t nLatencyMicros);
+
+    Snapshot GetSnapshot() const;
+
+private:
+    std::atomic<uint64_t> nMessages;
+    std::atomic<uint64_t> nBytes;
+    std::atomic<uint64_t> nHandlerMicros;
+    std::atomic<uint64_t> nLockWaitMicros;
+    std::atomic<uint64_t> nMaxHandlerMicros;
+    std::atomic<uint64_t> nMaxLatencyMicros;
+    CDurationHistogram handlerHistogram;
+};
+
+/** Per command statistics on processed messages. Commands that are not
+ * known message types are counted together as "other". */
+class CMessageStats
+{
+public:
+    static const char* OTHER;
+
+    CMessageStats();
+
+    void Record(const std::string& strCommand, uint64_t nBytes,
+                int64_t nHandlerMicros, int64_t nLockWaitMicros,
+                int64_t nLatencyMicros);
+
+    //! Commands with at least one message recorded.
+    std::vector<std::pair<std::string, CMessageTypeStats::Snapshot> > GetSnapshot() const;
+
+    //! All commands added together.
+    CMessageTypeStats::Snapshot GetTotals() const;
+
+    //! Slot for a command. Known message types have their own, everything
+    //! else shares the last one.
+    static size_t IndexOf(const std::string& strCommand);
+
+private:
+    std::vector<CMessageTypeStats> vStats;
+};
+
+/** Statistics on messages processed from all peers. */
+CMessageStats& GetMessageStats();
+
+#endif // BITCOIN_MSGSTATS_H
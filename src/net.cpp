@@ -25,6 +25,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -58,6 +59,15 @@
 #endif
 #endif
 
+#ifdef WIN32
+struct iovec { void* iov_base; size_t iov_len; };
+// Buffers are sent one at a time.
+static const int MAX_SEND_IOV = 1;
+#else
+// Queued buffers passed to a single sendmsg call.
+static const int MAX_SEND_IOV = 64;
+#endif
+
 using namespace std;
 
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
@@ -71,7 +81,7 @@ map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfReachable[NET_MAX] = {};
 static bool vfLimited[NET_MAX] = {};
 
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSharedPayloadRef> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -354,7 +364,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsServiceableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -563,20 +573,29 @@ int CNode::GetSendVersion() const
 
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    unsigned int nCopy;
+    try {
+        if (nHdrPos == 0 && nBytes >= CMessageHeader::HEADER_SIZE) {
+            // The whole header is at hand, deserialize it in place.
+            CSpanReader(hdrbuf.GetType(), hdrbuf.GetVersion(), (const unsigned char*)pch,
+                        (const unsigned char*)pch + CMessageHeader::HEADER_SIZE) >> hdr;
+            nHdrPos = nCopy = CMessageHeader::HEADER_SIZE;
+        }
+        else {
+            // copy data to temporary parsing buffer
+            unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
+            nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
+            memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+            nHdrPos += nCopy;
 
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+            // if header incomplete, exit
+            if (nHdrPos < CMessageHeader::HEADER_SIZE)
+                return nCopy;
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
+            // deserialize to CMessageHeader
+            hdrbuf >> hdr;
+        }
     }
     catch (const std::exception&) {
         return -1;
@@ -597,13 +616,19 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Take a buffer for the whole message if the pool has one spare.
+        // Otherwise grow as data arrives, to at most 256 KiB beyond it, so
+        // that a peer can't make us allocate by announcing large messages.
+        size_t nReserve = hdr.nMessageSize;
+        if (!RecvBufferPool().HasFree(nReserve))
+            nReserve = std::min<size_t>(nReserve, std::max<size_t>(2 * vRecv.capacity(), nDataPos + nCopy + 256 * 1024));
+        vRecv.reserve(nReserve);
     }
 
+    // The checksum is computed as the data arrives, while it is in cache.
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -626,44 +651,78 @@ const uint256& CNetMessage::GetMessageHash() const
 
 
 // requires LOCK(cs_vSend)
+//! Send the buffers in iov with a single call.
+static int SocketSendv(SOCKET hSocket, struct iovec* iov, int nIov)
+{
+#ifdef WIN32
+    assert(nIov == 1);
+    return send(hSocket, reinterpret_cast<const char*>(iov[0].iov_base), iov[0].iov_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nIov;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-
-        int amt2Send = min((int)(data.size() - pnode->nSendOffset),
-                sendShaper.available(SEND_SHAPER_MIN_FRAG));
-        if (amt2Send == 0) {
-            if (sendShaper.available(SEND_SHAPER_MIN_FRAG) != INT_MAX) //Sleep if traffic shaping is turned on
-                MilliSleep(10);
+    while (!pnode->vSendMsg.empty()) {
+        const int nAllowed = sendShaper.available(SEND_SHAPER_MIN_FRAG);
+        if (nAllowed <= 0) {
+            MilliSleep(10); // traffic shaping is turned on and out of budget
             break;
         }
+
+        // Gather as many queued buffers as the budget allows into one call
+        struct iovec iov[MAX_SEND_IOV];
+        int nIov = 0;
+        size_t nGathered = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (auto it = pnode->vSendMsg.begin(); it != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV
+                 && nGathered < (size_t)nAllowed; ++it) {
+            assert(it->size() > nOffset);
+            size_t nLen = std::min(it->size() - nOffset, (size_t)nAllowed - nGathered);
+            iov[nIov].iov_base = const_cast<unsigned char*>(it->data()) + nOffset;
+            iov[nIov].iov_len = nLen;
+            nGathered += nLen;
+            nOffset = 0;
+            ++nIov;
+        }
+
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, amt2Send, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SocketSendv(pnode->hSocket, iov, nIov);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             bool empty = !sendShaper.consume(nBytes);
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+
+            // Drop the buffers that were sent completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nRemaining = pnode->vSendMsg.front().size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
-                break;
+                pnode->nSendSize -= pnode->vSendMsg.front().size();
+                pnode->vSendMsg.pop_front();
             }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+
+            if ((size_t)nBytes < nGathered)
+                break; // could not send everything; socket buffer is full
             if (empty) break;  // Exceeded our send budget, stop sending more
         } else {
             if (nBytes < 0) {
@@ -680,11 +739,10 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -715,7 +773,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
             LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
         return;
     }
-    else if (!IsSelectableSocket(hSocket))
+    else if (!IsServiceableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -767,90 +825,229 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
     GetNodeSignals().InitializeNode(pnode, *this);
+    AddNodeToList(pnode);
+}
 
+void CConnman::AddNodeToList(CNode* pnode)
+{
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+#ifdef USE_EPOLL
+    if (socketEvents == SocketEventsMode::EPOLL) {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket != INVALID_SOCKET && !epollSet->Add(pnode->hSocket, pnode, true)) {
+            LogPrintf("socket epoll error: cannot watch peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+            pnode->fDisconnect = true;
+        }
+    }
+#endif
 }
 
-void CConnman::ThreadSocketHandler()
+void CConnman::DisconnectNodes()
 {
-    unsigned int nPrevNodeCount = 0;
-
-
-    /*
-     * int progress is incremented if something happens.  If it is zero at the bottom
-     * of the loop, we delay.  This solves spin loop issues where the select does not
-     * block but no bytes can be transferred (traffic shaping limited, for example).
-     */
-    int progress;
-    while (!interruptNet)
     {
-        progress = 0;
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            if (pnode->fDisconnect)
             {
-                if (pnode->fDisconnect)
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
+                // forget about readiness of the socket
+                if (pnode->fSocketPending) {
+                    vSocketReady.erase(remove(vSocketReady.begin(), vSocketReady.end(), pnode), vSocketReady.end());
+                    pnode->fSocketPending = false;
                 }
+
+                // hold in disconnected pool until all refs are released
+                pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_inventory, lockInv);
+                    if (lockInv)
                     {
-                        TRY_LOCK(pnode->cs_inventory, lockInv);
-                        if (lockInv)
-                        {
-                            TRY_LOCK(pnode->cs_vSend, lockSend);
-                            if (lockSend) {
-                                fDelete = true;
-                            }
+                        TRY_LOCK(pnode->cs_vSend, lockSend);
+                        if (lockSend) {
+                            fDelete = true;
                         }
                     }
-                    if (fDelete)
-                    {
-                        vNodesDisconnected.remove(pnode);
-                        DeleteNode(pnode);
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    if (pnode->fSocketWakeQueued) {
+                        std::lock_guard<std::mutex> lock(mutexSocketWake);
+                        vSocketWake.erase(remove(vSocketWake.begin(), vSocketWake.end(), pnode), vSocketWake.end());
                     }
+                    DeleteNode(pnode);
                 }
             }
         }
-        size_t vNodesSize;
+    }
+}
+
+void CConnman::NotifyNumConnectionsChanged()
+{
+    size_t vNodesSize;
+    {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+    }
+    if(vNodesSize != nPrevNodeCount) {
+        nPrevNodeCount = vNodesSize;
+        if(clientInterface)
+            clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+bool CConnman::ReceiveFromNode(CNode* pnode)
+{
+    const int amt2Recv = receiveShaper.available(RECV_SHAPER_MIN_FRAG);
+    if (amt2Recv <= 0)
+        return false;
+
+    // max of min makes sure amt is in a range reasonable for buffer allocation
+    const int amt = max(1, min(amt2Recv, MAX_RECV_CHUNK));
+    std::unique_ptr<char[]> pchBuf(new char[amt]);
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pchBuf.get(), amt, MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        receiveShaper.consume(nBytes);
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf.get(), nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                if (!it->complete())
+                    break;
+                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler();
+        }
+        return true;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(Log::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
         {
-            LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+void CConnman::InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetSystemTimeInSeconds();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint(Log::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
         }
-        if(vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            if(clientInterface)
-                clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+        else if (!pnode->fSuccessfullyConnected)
+        {
+            LogPrintf("version handshake timeout from %d\n", pnode->id);
+            pnode->fDisconnect = true;
         }
+    }
+}
+
+bool CConnman::IsServiceableSocket(SOCKET s) const
+{
+    return socketEvents == SocketEventsMode::EPOLL || IsSelectableSocket(s);
+}
+
+void CConnman::ThreadSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (socketEvents == SocketEventsMode::EPOLL) {
+        SocketHandlerEpoll();
+        return;
+    }
+#endif
+    SocketHandlerSelect();
+}
+
+void CConnman::SocketHandlerSelect()
+{
+    /*
+     * int progress is incremented if something happens.  If it is zero at the bottom
+     * of the loop, we delay.  This solves spin loop issues where the select does not
+     * block but no bytes can be transferred (traffic shaping limited, for example).
+     */
+    int progress;
+    while (!interruptNet)
+    {
+        progress = 0;
+        DisconnectNodes();
+        NotifyNumConnectionsChanged();
 
         //
         // Find which sockets have data to receive
@@ -974,67 +1171,10 @@ void CConnman::ThreadSocketHandler()
             }
             if (recvSet || errorSet)
             {
-                const int amt2Recv = receiveShaper.available(RECV_SHAPER_MIN_FRAG);
-                if (amt2Recv > 0)
+                if (receiveShaper.available(RECV_SHAPER_MIN_FRAG) > 0)
                 {
-                    {
-                        progress++;
-                        // max of min makes sure amt is in a range reasonable for buffer allocation
-                        const int amt = max(1, min(amt2Recv, MAX_RECV_CHUNK));
-                        char *pchBuf = new char[amt];
-                        int nBytes = 0;
-                        {
-                            LOCK(pnode->cs_hSocket);
-                            if (pnode->hSocket == INVALID_SOCKET)
-                                continue;
-                            nBytes = recv(pnode->hSocket, pchBuf, amt, MSG_DONTWAIT);
-                        }
-                        if (nBytes > 0)
-                        {
-                            receiveShaper.consume(nBytes);
-                            bool notify = false;
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                                pnode->CloseSocketDisconnect();
-                            RecordBytesRecv(nBytes);
-                            if (notify) {
-                                size_t nSizeAdded = 0;
-                                auto it(pnode->vRecvMsg.begin());
-                                for (; it != pnode->vRecvMsg.end(); ++it) {
-                                    if (!it->complete())
-                                        break;
-                                    nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                                }
-                                {
-                                    LOCK(pnode->cs_vProcessMsg);
-                                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                                    pnode->nProcessQueueSize += nSizeAdded;
-                                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                                }
-                                WakeMessageHandler();
-                            }
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect) {
-                                LogPrint(Log::NET, "socket closed\n");
-                            }
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-
-                        delete[] pchBuf;
-                    }
+                    progress++;
+                    ReceiveFromNode(pnode);
                 }
             }
 
@@ -1054,38 +1194,7 @@ void CConnman::ThreadSocketHandler()
                 }
             }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint(Log::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-                else if (!pnode->fSuccessfullyConnected)
-                {
-                    LogPrintf("version handshake timeout from %d\n", pnode->id);
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1098,6 +1207,148 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+/** Chunks read from one socket before moving on to the next. */
+static const int MAX_RECV_CHUNKS_PER_PASS = 4;
+/** Longest wait for events while no socket has readiness left to act on. */
+static const int SOCKET_IDLE_WAIT_MS = 100;
+/** Wait for events while sockets have readiness left, e.g. due to traffic shaping. */
+static const int SOCKET_BUSY_WAIT_MS = 50;
+
+void CConnman::ServiceReadyNode(CNode* pnode)
+{
+    int nChunks = 0;
+    while (pnode->fSocketRecvReady && !pnode->fPauseRecv && !pnode->fDisconnect
+           && nChunks < MAX_RECV_CHUNKS_PER_PASS
+           && receiveShaper.available(RECV_SHAPER_MIN_FRAG) > 0)
+    {
+        if (!ReceiveFromNode(pnode))
+            pnode->fSocketRecvReady = false;
+        ++nChunks;
+    }
+
+    if (pnode->fSocketSendReady) {
+        size_t nBytes = 0;
+        bool fQueued;
+        {
+            LOCK(pnode->cs_vSend);
+            if (!pnode->vSendMsg.empty() && sendShaper.try_consume(0))
+                nBytes = SocketSendData(pnode);
+            fQueued = !pnode->vSendMsg.empty();
+        }
+        if (nBytes)
+            RecordBytesSent(nBytes);
+        // Unless traffic shaping held it back, data is left because the
+        // socket buffer is full. The socket is reported when it drains.
+        if (fQueued && sendShaper.available(SEND_SHAPER_MIN_FRAG) > 0)
+            pnode->fSocketSendReady = false;
+    }
+}
+
+void CConnman::SocketHandlerEpoll()
+{
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && !epollSet->Add(hListenSocket.socket, &hListenSocket, false))
+            LogPrintf("socket epoll error: cannot watch listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+    }
+
+    std::vector<epoll_event> events(256);
+    std::vector<CNode*> vWake;
+    int64_t nLastInactivityCheck = 0;
+    while (!interruptNet)
+    {
+        DisconnectNodes();
+        NotifyNumConnectionsChanged();
+
+        int nEvents = epollSet->Wait(events, vSocketReady.empty() ? SOCKET_IDLE_WAIT_MS : SOCKET_BUSY_WAIT_MS);
+        if (interruptNet)
+            return;
+        if (nEvents < 0) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(WSAGetLastError()));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_BUSY_WAIT_MS)))
+                return;
+            continue;
+        }
+
+        auto markReady = [this](CNode* pnode) {
+            if (!pnode->fSocketPending) {
+                pnode->fSocketPending = true;
+                vSocketReady.push_back(pnode);
+            }
+        };
+
+        for (int i = 0; i < nEvents; ++i) {
+            void* ctx = events[i].data.ptr;
+            auto listen = std::find_if(vhListenSocket.begin(), vhListenSocket.end(),
+                                       [ctx](const ListenSocket& ls) { return &ls == ctx; });
+            if (listen != vhListenSocket.end()) {
+                AcceptConnection(*listen);
+                continue;
+            }
+            CNode* pnode = static_cast<CNode*>(ctx);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fSocketRecvReady = true;
+            if (events[i].events & EPOLLOUT)
+                pnode->fSocketSendReady = true;
+            markReady(pnode);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutexSocketWake);
+            vWake.swap(vSocketWake);
+        }
+        for (CNode* pnode : vWake) {
+            pnode->fSocketWakeQueued = false;
+            if (pnode->fSocketSendReady && !pnode->fDisconnect)
+                markReady(pnode);
+        }
+        vWake.clear();
+
+        // Service the nodes in the order they became ready. Those with
+        // readiness left over stay in the list for the next pass.
+        size_t nKeep = 0;
+        for (size_t i = 0; i < vSocketReady.size(); ++i) {
+            CNode* pnode = vSocketReady[i];
+            if (interruptNet)
+                return;
+            if (!pnode->fDisconnect)
+                ServiceReadyNode(pnode);
+            bool fSendLeft = false;
+            if (pnode->fSocketSendReady) {
+                LOCK(pnode->cs_vSend);
+                fSendLeft = !pnode->vSendMsg.empty();
+            }
+            if (!pnode->fDisconnect && (pnode->fSocketRecvReady || fSendLeft))
+                vSocketReady[nKeep++] = pnode;
+            else
+                pnode->fSocketPending = false;
+        }
+        vSocketReady.resize(nKeep);
+
+        int64_t nNow = GetTimeMillis();
+        if (nNow - nLastInactivityCheck >= 1000) {
+            nLastInactivityCheck = nNow;
+            LOCK(cs_vNodes);
+            for (CNode* pnode : vNodes)
+                InactivityCheck(pnode);
+        }
+    }
+}
+#endif
+
+void CConnman::WakeSocketHandler(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEvents != SocketEventsMode::EPOLL || pnode->fSocketWakeQueued.exchange(true))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutexSocketWake);
+        vSocketWake.push_back(pnode);
+    }
+    epollSet->Wake();
+#endif
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
@@ -1565,15 +1816,12 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->fFeeler = true;
 
     GetNodeSignals().InitializeNode(pnode, *this);
-    {
-        LOCK(cs_vNodes);
-        vNodes.push_back(pnode);
-    }
+    AddNodeToList(pnode);
 
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread, int nThreads)
 {
     while (!flagInterruptMsgProc)
     {
@@ -1588,24 +1836,37 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Threads start their pass at different nodes, so that they rarely
+        // compete for the same one.
+        const size_t nStart = vNodesCopy.empty() ? 0 : nThread * vNodesCopy.size() / nThreads;
+        for (size_t i = 0; i < vNodesCopy.size(); ++i)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            if (pnode->fInMessageHandler.exchange(true)) {
+                pnode->fMessageHandlerRetry = true;
+                // Check again in case the owner left before seeing the flag.
+                if (pnode->fInMessageHandler.exchange(true))
+                    continue;
+            }
+
             // Receive messages
             bool fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, this, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
 
             // Send messages
-            {
+            if (!flagInterruptMsgProc) {
                 LOCK(pnode->cs_sendProcessing);
                 GetNodeSignals().SendMessages(pnode, this, flagInterruptMsgProc);
             }
+
+            pnode->fInMessageHandler = false;
+            if (pnode->fMessageHandlerRetry.exchange(false))
+                fMoreWork = true;
             if (flagInterruptMsgProc)
-                return;
+                break;
         }
 
         {
@@ -1614,6 +1875,9 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
+        if (flagInterruptMsgProc)
+            return;
+
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
             condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
@@ -1649,7 +1913,7 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, b
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!IsServiceableSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -1777,7 +2041,8 @@ void InitNetworkShapers() {
 }
 
 CConnman::CConnman(uint64_t seed0, uint64_t seed1) : nSendBufferMaxSize(0), nReceiveFloodSize(0),
-                       fAddressesInitialized(false),  nLastNodeId(0), semOutbound(nullptr),
+                       fAddressesInitialized(false), nPrevNodeCount(0),
+                       socketEvents(SocketEventsMode::SELECT), nLastNodeId(0), semOutbound(nullptr),
                        nMaxConnections(0), nMaxOutbound(0), nBestHeight(0), clientInterface(nullptr),
                        nSeed0(seed0), nSeed1(seed1), flagInterruptMsgProc(false)
 {
@@ -1842,6 +2107,19 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         fMsgProcWake = false;
     }
 
+    socketEvents = connOptions.socketEvents;
+#ifdef USE_EPOLL
+    if (socketEvents == SocketEventsMode::EPOLL && !epollSet) {
+        epollSet.reset(new EpollSet());
+        if (!epollSet->IsValid()) {
+            LogPrintf("Unable to set up epoll (%s), falling back to select\n", NetworkErrorString(WSAGetLastError()));
+            epollSet.reset();
+            socketEvents = SocketEventsMode::SELECT;
+        }
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", SocketEventsModeName(socketEvents));
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -1856,8 +2134,16 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     // Initiate outbound connections
     threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
-    // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    // Process messages. Each thread takes one node at a time, so messages
+    // of a node are still processed in order.
+    const int nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
+    threadMessageHandlers.reserve(nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; ++i) {
+        const std::string name = i == 0 ? std::string("msghand") : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, name, i, nMessageHandlerThreads]() {
+            TraceThread(name.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, i, nMessageHandlerThreads));
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpAddresses, this), DUMP_ADDRESSES_INTERVAL);
@@ -1890,6 +2176,10 @@ void CConnman::Interrupt()
 
     interruptNet();
     InterruptSocks5(true);
+#ifdef USE_EPOLL
+    if (epollSet)
+        epollSet->Wake();
+#endif
 
     if (semOutbound)
         for (int i=0; i<(nMaxOutbound + nMaxFeeler); i++)
@@ -1898,8 +2188,10 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers)
+        if (thread.joinable())
+            thread.join();
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -1933,6 +2225,11 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    vSocketReady.clear();
+    vSocketWake.clear();
+#ifdef USE_EPOLL
+    epollSet.reset();
+#endif
     delete semOutbound;
     semOutbound = NULL;
 }
@@ -2041,8 +2338,10 @@ void CConnman::RelayTransaction(const CTransaction& tx, const CDataStream& ss, s
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved.
+        // It is sent as is to every peer that asks for it.
+        if (!mapRelay.count(inv))
+            mapRelay.emplace(inv, std::make_shared<const CSharedPayload>(std::vector<unsigned char>(ss.begin(), ss.end())));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2078,9 +2377,10 @@ void CConnman::RelayTransaction(const CTransaction& tx, const CDataStream& ss, s
 bool FindTransactionInRelayMap(uint256 hash, CTransaction &out) {
     LOCK(cs_mapRelay);
     CInv inv(MSG_TX, hash);
-    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+    map<CInv, CSharedPayloadRef>::iterator mi = mapRelay.find(inv);
     if (mi != mapRelay.end()) {
-        (*mi).second >> out;
+        const std::vector<unsigned char>& data = mi->second->data;
+        CSpanReader(SER_NETWORK, PROTOCOL_VERSION, data.data(), data.data() + data.size()) >> out;
         return true;
     }
     return false;
@@ -2179,6 +2479,7 @@ CNode::CNode(NodeId idIn, uint64_t nLocalServicesIn, int nMyStartingHeightIn, SO
     fSentAddr = false;
     pfilter.reset(new CBloomFilter);
     xthinFilter.reset(new CBloomFilter());
+    nGrapheneMempoolTxs = 0;
     nPingNonceSent = 0;
     nPingUsecStart = 0;
     nPingUsecTime = 0;
@@ -2189,6 +2490,12 @@ CNode::CNode(NodeId idIn, uint64_t nLocalServicesIn, int nMyStartingHeightIn, SO
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
+    fSocketPending = false;
+    fSocketWakeQueued = false;
+    fInMessageHandler = false;
+    fMessageHandlerRetry = false;
 
     if (fLogIPs)
         LogPrint(Log::NET, "Added connection to %s peer=%d %s\n", addrName, id, strIpGroup);
@@ -2240,19 +2547,24 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.shared ? msg.shared->data.size() : msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(Log::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().NetworkMagic(), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    if (msg.shared) {
+        memcpy(hdr.pchChecksum, msg.shared->pchChecksum, CMessageHeader::CHECKSUM_SIZE);
+    } else {
+        uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    }
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWake = false;
     {
         LOCK(pnode->cs_vSend);
         if(pnode->hSocket == INVALID_SOCKET) {
@@ -2264,16 +2576,25 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
+        if (nMessageSize) {
+            if (msg.shared)
+                pnode->vSendMsg.emplace_back(std::move(msg.shared));
+            else
+                pnode->vSendMsg.emplace_back(std::move(msg.data));
+        }
 
         // If write queue empty, attempt "optimistic write"
-        if (optimisticSend == true)
+        if (optimisticSend == true) {
             nBytesSent = SocketSendData(pnode);
+            // The socket handler needs to know about what's left over
+            fWake = !pnode->vSendMsg.empty();
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    if (fWake)
+        WakeSocketHandler(pnode);
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -2307,6 +2628,10 @@ bool CNode::SupportsCompactBlocks() const {
     return nVersion >= SHORT_IDS_BLOCKS_VERSION;
 }
 
+bool CNode::SupportsGrapheneBlocks() const {
+    return nServices & NODE_GRAPHENE;
+}
+
 bool CNode::IsSPVClient() {
     // We assume node is an SPV node if it has sent us a bloom filter. "IsFull"
     // returns true for nodes that have not sent a filter (default constructed).
@@ -14,10 +14,13 @@
 #include "leakybucket.h"
 #include "ipgroups.h"
 #include "limitedmap.h"
+#include "msgstats.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
+#include "socketevents.h"
 #include "streams.h"
+#include "support/bufferpool.h"
 #include "sync.h"
 #include "threadinterrupt.h"
 #include "uint256.h"
@@ -76,6 +79,10 @@ static const bool DEFAULT_UPNP = false;
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** -msghandlerthreads default */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Upper limit for -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 64;
 
 typedef int NodeId;
 
@@ -102,6 +109,26 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+    //! Sent instead of data when set.
+    CSharedPayloadRef shared;
+};
+
+/**
+ * An entry in the send queue of a peer, either owned by the queue or a
+ * payload that is shared with the queues of other peers.
+ */
+class CSendBuffer
+{
+public:
+    explicit CSendBuffer(std::vector<unsigned char>&& ownedIn) : owned(std::move(ownedIn)) {}
+    explicit CSendBuffer(CSharedPayloadRef sharedIn) : shared(std::move(sharedIn)) {}
+
+    const unsigned char* data() const { return shared ? shared->data.data() : owned.data(); }
+    size_t size() const { return shared ? shared->data.size() : owned.size(); }
+
+private:
+    std::vector<unsigned char> owned;
+    CSharedPayloadRef shared;
 };
 
 
@@ -126,6 +153,8 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        SocketEventsMode socketEvents = SocketEventsMode::SELECT;
+        int nMessageHandlerThreads = 1;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     virtual ~CConnman();
@@ -252,9 +281,23 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread, int nThreads);
     void AcceptConnection(const ListenSocket& hListenSocket);
+    void AddNodeToList(CNode* pnode);
     void ThreadSocketHandler();
+    void SocketHandlerSelect();
+    void DisconnectNodes();
+    void NotifyNumConnectionsChanged();
+    bool ReceiveFromNode(CNode* pnode);
+    void InactivityCheck(CNode* pnode);
+    //! Whether the socket handler can wait on s.
+    bool IsServiceableSocket(SOCKET s) const;
+#ifdef USE_EPOLL
+    void SocketHandlerEpoll();
+    void ServiceReadyNode(CNode* pnode);
+#endif
+    //! Let the socket handler know pnode has data queued that it may have to send.
+    void WakeSocketHandler(CNode* pnode);
     void ThreadDNSAddressSeed();
 
     CNode* FindNode(const CNetAddr& ip);
@@ -308,6 +351,17 @@ private:
     std::vector<CNode*> vNodes;
     std::list<CNode*> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
+    unsigned int nPrevNodeCount;
+
+    SocketEventsMode socketEvents;
+#ifdef USE_EPOLL
+    std::unique_ptr<EpollSet> epollSet;
+#endif
+    //! Nodes with socket readiness left to act on. Socket handler only.
+    std::vector<CNode*> vSocketReady;
+    //! Nodes that had data queued while the socket handler may be waiting.
+    std::vector<CNode*> vSocketWake;
+    std::mutex mutexSocketWake;
     std::atomic<NodeId> nLastNodeId;
 
     /** Services this instance offers */
@@ -336,7 +390,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
@@ -409,7 +463,7 @@ CAddress GetLocalAddress(const CNetAddr *paddrPeer, uint64_t nLocalServices);
 extern bool fDiscover;
 extern bool fListen;
 
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSharedPayloadRef> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -458,12 +512,12 @@ public:
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CDataStream vRecv;              // received message data, in a buffer from RecvBufferPool()
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(CDataStream::allocator_type(&RecvBufferPool()), nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
@@ -502,7 +556,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
 
@@ -546,13 +600,31 @@ public:
     CCriticalSection cs_filter, cs_xfilter;
     std::unique_ptr<CBloomFilter> pfilter;
     std::unique_ptr<CBloomFilter> xthinFilter;
+    // Mempool size the peer sent with its last graphene block request.
+    std::atomic<uint64_t> nGrapheneMempoolTxs;
     int nRefCount;
     const NodeId id;
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
 
+    // Readiness of the socket as last reported by edge-triggered events.
+    // Only used by the socket handler thread.
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
+    bool fSocketPending; // in CConnman::vSocketReady
+    std::atomic_bool fSocketWakeQueued; // in CConnman::vSocketWake
+
+    // Set while a message handler thread processes this node, which keeps
+    // the node's messages in order. A thread that finds the node taken
+    // sets fMessageHandlerRetry so that the owner has another look.
+    std::atomic_bool fInMessageHandler;
+    std::atomic_bool fMessageHandlerRetry;
+
 public:
+    // Messages processed from this peer, by command.
+    CMessageStats msgStats;
+
     uint256 hashContinue;
     int nStartingHeight;
 
@@ -706,6 +778,7 @@ public:
 
     bool SupportsXThinBlocks() const;
     bool SupportsCompactBlocks() const;
+    bool SupportsGrapheneBlocks() const;
 
     // Best effort determination if node is an SPV client.
     bool IsSPVClient();
@@ -41,4 +41,13 @@ CSerializedNetMsg NetMsg(CNode* to, Args&&... args) {
     return CNetMsgMaker(to->GetSendVersion()).Make(std::forward<Args>(args)...);
 }
 
+//! A message with a payload that is already serialized, and can be shared
+//! with other peers.
+inline CSerializedNetMsg SharedNetMsg(std::string sCommand, CSharedPayloadRef payload) {
+    CSerializedNetMsg msg;
+    msg.command = std::move(sCommand);
+    msg.shared = std::move(payload);
+    return msg;
+}
+
 #endif // BITCOIN_NETMESSAGEMAKER_H
@@ -60,6 +60,11 @@ int Opt::ScriptCheckThreads() {
     return nScriptCheckThreads;
 }
 
+int Opt::PrefetchThreads() {
+    int64_t n = Args->GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS);
+    return std::max(int64_t(0), std::min(int64_t(MAX_PREFETCH_THREADS), n));
+}
+
 int64_t Opt::CheckpointDays() {
     int64_t def = DEFAULT_CHECKPOINT_DAYS * std::max(1, ScriptCheckThreads());
     return std::max(int64_t(1), Args->GetArg("-checkpoint-days", def));
@@ -132,6 +137,12 @@ bool Opt::PreferXThinBlocks() const {
     return Args->GetBool("-prefer-xthin-blocks", false);
 }
 
+/// Download blocks as graphene blocks from peers that support them.
+/// Requires thin blocks to be enabled.
+bool Opt::UsingGrapheneBlocks() const {
+    return Args->GetBool("-use-graphene-blocks", DEFAULT_USE_GRAPHENE_BLOCKS);
+}
+
 bool Opt::AllowFreeTx() const {
     return Args->GetBool("-allowfreetx", true);
 }
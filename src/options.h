@@ -17,6 +17,7 @@ public:
     std::vector<std::string> UAComment(bool validate = false) const;
 
         int ScriptCheckThreads();
+        int PrefetchThreads();
         int64_t CheckpointDays();
         uint64_t MaxBlockSizeVote();
         int64_t RespendRelayLimit() const;
@@ -33,6 +34,7 @@ public:
         bool AvoidFullBlocks();
         int ThinBlocksMaxParallel();
         bool PreferXThinBlocks() const;
+        bool UsingGrapheneBlocks() const;
 
     // Policy
     bool AllowFreeTx() const;
@@ -41,10 +43,16 @@ public:
     void CheckRemovedOptions() const;
 };
 
+/** -use-graphene-blocks default */
+static const bool DEFAULT_USE_GRAPHENE_BLOCKS = false;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of coin prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (0 = disable prefetching) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
 // Blocks newer than n days will have their script validated during sync.
 static const int DEFAULT_CHECKPOINT_DAYS = 30;
 /** User-activated hard fork default activation time */
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "process_grapheneblock.h"
+#include "chainparams.h"
+#include "graphene.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "streams.h"
+#include "thinblock.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilprocessmsg.h"
+#include "xthin.h" // XThinReRequest
+
+void GrapheneBlockProcessor::operator()(
+        CDataStream& vRecv, const CTxMemPool& mempool, const TxFinder& txfinder,
+        uint64_t currMaxBlockSize, int activeChainHeight)
+{
+    GrapheneBlock block;
+    vRecv >> block;
+
+    const uint256 hash = block.header.GetHash();
+
+    LogPrintf("received graphene block %s from peer=%d\n",
+            hash.ToString(), worker.nodeID());
+
+    try {
+        block.selfValidate(currMaxBlockSize);
+    }
+    catch (const std::invalid_argument& e) {
+        LogPrint(Log::BLOCK, "Invalid graphene block %s\n", e.what());
+        rejectBlock(hash, e.what(), 20);
+        return;
+    }
+
+    if (requestConnectHeaders(block.header, true)) {
+        worker.stopWork(hash);
+        return;
+    }
+
+    if (!setToWork(block.header, activeChainHeight))
+        return;
+
+    from.AddInventoryKnown(CInv(MSG_GRAPHENEBLOCK, hash));
+
+    std::vector<ThinTx> txs;
+    try {
+        std::vector<uint256> mempoolTxids;
+        mempool.queryHashes(mempoolTxids);
+        txs = block.reconcile(mempoolTxids);
+    }
+    catch (const graphene_decode_error& e) {
+        // Our mempool differs more from the block than the sender sized it
+        // for. Not the sender's fault, get the full block instead.
+        LogPrint(Log::BLOCK, "Could not decode graphene block %s (%s), "
+                "falling back on full block download peer=%d\n",
+                hash.ToString(), e.what(), from.id);
+
+        worker.stopWork(hash);
+        CInv req(MSG_BLOCK, hash);
+        connman.PushMessage(&from, NetMsg(&from, NetMsgType::GETDATA, std::vector<CInv>(1, req)));
+        markInFlight(from.id, hash, Params().GetConsensus(), NULL);
+        return;
+    }
+    catch (const std::invalid_argument& e) {
+        rejectBlock(hash, e.what(), 20);
+        return;
+    }
+
+    try {
+        GrapheneStub stub(block, txs);
+        worker.buildStub(stub, txfinder, connman, from);
+    }
+    catch (const thinblock_error& e) {
+        rejectBlock(hash, e.what(), 10);
+        return;
+    }
+
+    if (!worker.isWorkingOn(hash)) {
+        // Stub had enough data to finish
+        // the block.
+        return;
+    }
+
+    // Transactions we don't have are known by their cheap hash, so
+    // they are requested the same way as for xthin blocks.
+    std::vector<std::pair<int, ThinTx> > missing = worker.getTxsMissing(hash);
+
+    XThinReRequest req;
+    req.block = hash;
+
+    for (auto& t : missing)
+        req.txRequesting.insert(t.second.cheap());
+
+    LogPrint(Log::BLOCK, "re-requesting %d graphene txs for %s peer=%d\n",
+            missing.size(), hash.ToString(), from.id);
+
+    connman.PushMessage(&from, NetMsg(&from, NetMsgType::GET_XBLOCKTX, req));
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef PROCESS_GRAPHENEBLOCK_H
+#define PROCESS_GRAPHENEBLOCK_H
+
+#include "blockprocessor.h"
+
+class BlockInFlightMarker;
+class CDataStream;
+class CTxMemPool;
+class TxFinder;
+
+class GrapheneBlockProcessor : public BlockProcessor {
+    public:
+        GrapheneBlockProcessor(CConnman& c, CNode& f, ThinBlockWorker& w,
+                BlockHeaderProcessor& h, BlockInFlightMarker& m) :
+            BlockProcessor(c, f, w, "graphene", h), markInFlight(m)
+        {
+        }
+
+        void operator()(CDataStream& vRecv, const CTxMemPool& mempool,
+                const TxFinder& txfinder, uint64_t currMaxBlockSize,
+                int activeChainHeight);
+
+    private:
+        BlockInFlightMarker& markInFlight;
+};
+
+#endif
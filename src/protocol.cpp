@@ -5,6 +5,7 @@
 
 #include "protocol.h"
 
+#include "hash.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
@@ -43,7 +44,10 @@ const char *GET_XBLOCKTX="get_xblocktx";
 const char *CMPCTBLOCK="cmpctblock";
 const char *XBLOCKTX="xblocktx";
 const char *BLOCKTXN="blocktxn";
+const char *GETUTXOS="getutxos";
 const char *UTXOS="utxos";
+const char *GET_GRAPHENE="getgraphene";
+const char *GRAPHENEBLOCK="graphene";
 };
 
 static const char* ppszTypeName[] =
@@ -53,7 +57,8 @@ static const char* ppszTypeName[] =
     NetMsgType::BLOCK,
     "filtered block", // Should never occur
     "cmpctblock", // or thinblock
-    "xthinblock"
+    "xthinblock",
+    NetMsgType::GRAPHENEBLOCK
 };
 
 /** All known message types. Keep this in the same order as the list of
@@ -90,7 +95,10 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::CMPCTBLOCK,
     NetMsgType::XBLOCKTX,
     NetMsgType::BLOCKTXN,
-    NetMsgType::UTXOS
+    NetMsgType::GETUTXOS,
+    NetMsgType::UTXOS,
+    NetMsgType::GET_GRAPHENE,
+    NetMsgType::GRAPHENEBLOCK
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
 
@@ -146,6 +154,12 @@ bool CMessageHeader::IsValid(const MessageStartChars& pchMessageStartIn) const
     return true;
 }
 
+CSharedPayload::CSharedPayload(std::vector<unsigned char>&& dataIn) : data(std::move(dataIn))
+{
+    uint256 hash = Hash(data.begin(), data.end());
+    memcpy(pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+}
+
 
 
 CAddress::CAddress() : CService()
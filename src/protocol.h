@@ -15,8 +15,10 @@
 #include "uint256.h"
 #include "version.h"
 
+#include <memory>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #define MESSAGE_START_SIZE 4
 
@@ -65,6 +67,21 @@ public:
     uint8_t pchChecksum[CHECKSUM_SIZE];
 };
 
+/**
+ * A serialized message payload that is not modified after it is created, so
+ * the same bytes can be queued for any number of peers without copying them.
+ * The checksum for the message header is computed once, on creation.
+ */
+class CSharedPayload
+{
+public:
+    explicit CSharedPayload(std::vector<unsigned char>&& dataIn);
+
+    const std::vector<unsigned char> data;
+    uint8_t pchChecksum[CMessageHeader::CHECKSUM_SIZE];
+};
+typedef std::shared_ptr<const CSharedPayload> CSharedPayloadRef;
+
 /**
  * Bitcoin protocol message types. When adding new message types, don't forget
  * to update allNetMessageTypes in protocol.cpp.
@@ -226,7 +243,17 @@ extern const char *GET_XBLOCKTX;
 extern const char *CMPCTBLOCK;
 extern const char *XBLOCKTX;
 extern const char *BLOCKTXN;
+extern const char *GETUTXOS;
 extern const char *UTXOS;
+/**
+ * Requests a block as a graphene block, sized for the number of
+ * transactions the requester has in its mempool.
+ */
+extern const char *GET_GRAPHENE;
+/**
+ * A graphene block, see graphene.h.
+ */
+extern const char *GRAPHENEBLOCK;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -255,7 +282,12 @@ enum {
     NODE_THIN = (1 << 4),
 
     // Node supports the Bitcoin Cash fork rules
-    NODE_BITCOIN_CASH = (1 << 5)
+    NODE_BITCOIN_CASH = (1 << 5),
+
+    // Node supports graphene blocks as implemented by XT. Experimental, so
+    // it uses a bit reserved for experiments; the encoding is not
+    // compatible with other graphene implementations.
+    NODE_GRAPHENE = (1 << 24)
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -347,7 +379,10 @@ enum {
     // BUIP010 xthin block. An xthin block contains the first 8 bytes of all
     // tx hashes in a block + transactions node is missing to reconstruct the
     // block.
-    MSG_XTHINBLOCK
+    MSG_XTHINBLOCK,
+
+    // Graphene block. Only requested with the 'getgraphene' message.
+    MSG_GRAPHENEBLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -0,0 +1,129 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "rawblockcache.h"
+
+#include "blockencodings.h"
+#include "compactprefiller.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+#include "version.h"
+
+#include <algorithm>
+
+static RawBlockCache::Payload Encode(const CBlock& block, RawBlockCache::Encoding encoding)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, data, 0);
+    if (encoding == RawBlockCache::FULL_BLOCK)
+        writer << block;
+    else
+        writer << CompactBlock(block, CoinbaseOnlyPrefiller());
+    return std::make_shared<const CSharedPayload>(std::move(data));
+}
+
+RawBlockCache::RawBlockCache(size_t nMaxBlocksIn) :
+    nMaxBlocks(nMaxBlocksIn), nBytes(0), nHits(0), nMisses(0), nBytesServed(0)
+{
+}
+
+bool RawBlockCache::Touch(const uint256& hash)
+{
+    auto it = std::find_if(entries.begin(), entries.end(), [&hash](const Entry& e) {
+        return e.hash == hash;
+    });
+    if (it == entries.end())
+        return false;
+    entries.splice(entries.begin(), entries, it);
+    return true;
+}
+
+void RawBlockCache::Add(std::shared_ptr<const CBlock> block)
+{
+    if (nMaxBlocks == 0)
+        return;
+    const uint256 hash = block->GetHash();
+    std::lock_guard<std::mutex> lock(cs);
+    if (Touch(hash))
+        return;
+    entries.push_front(Entry());
+    entries.front().hash = hash;
+    entries.front().block = std::move(block);
+    while (entries.size() > nMaxBlocks) {
+        for (const Payload& payload : entries.back().encodings)
+            if (payload)
+                nBytes -= payload->data.size();
+        entries.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> RawBlockCache::GetBlock(const uint256& hash)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!Touch(hash)) {
+        ++nMisses;
+        return nullptr;
+    }
+    ++nHits;
+    return entries.front().block;
+}
+
+RawBlockCache::Payload RawBlockCache::Get(const uint256& hash, Encoding encoding)
+{
+    std::shared_ptr<const CBlock> block;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!Touch(hash)) {
+            ++nMisses;
+            return nullptr;
+        }
+        const Payload& payload = entries.front().encodings[encoding];
+        if (payload) {
+            ++nHits;
+            nBytesServed += payload->data.size();
+            return payload;
+        }
+        ++nMisses;
+        block = entries.front().block;
+    }
+
+    // Serialize without holding the lock. If two threads race to do so,
+    // the first one to finish is kept.
+    Payload encoded = Encode(*block, encoding);
+
+    std::lock_guard<std::mutex> lock(cs);
+    if (Touch(hash)) {
+        Payload& payload = entries.front().encodings[encoding];
+        if (!payload) {
+            payload = encoded;
+            nBytes += payload->data.size();
+        }
+    }
+    return encoded;
+}
+
+void RawBlockCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    entries.clear();
+    nBytes = 0;
+}
+
+RawBlockCache::Stats RawBlockCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Stats stats;
+    stats.nBlocks = entries.size();
+    stats.nBytes = nBytes;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nBytesServed = nBytesServed;
+    return stats;
+}
+
+RawBlockCache& GetRawBlockCache()
+{
+    static RawBlockCache cache(std::max<int64_t>(0, GetArg("-blockservecache", DEFAULT_BLOCK_SERVE_CACHE)));
+    return cache;
+}
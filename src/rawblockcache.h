@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_RAWBLOCKCACHE_H
+#define BITCOIN_RAWBLOCKCACHE_H
+
+#include "protocol.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CBlock;
+
+/** -blockservecache default (number of blocks) */
+static const unsigned int DEFAULT_BLOCK_SERVE_CACHE = 8;
+
+/**
+ * The most recently received blocks, kept ready to be sent to peers.
+ *
+ * A new tip is requested by many peers within seconds. Blocks are added as
+ * they are received, and the encodings that are the same for every peer are
+ * serialized on first request and shared by all following ones. Encodings
+ * that depend on the peer are built from the cached block, which saves the
+ * disk read.
+ */
+class RawBlockCache
+{
+public:
+    enum Encoding {
+        //! A block message.
+        FULL_BLOCK,
+        //! A cmpctblock message with only the coinbase prefilled.
+        CMPCT_BLOCK,
+        NUM_ENCODINGS
+    };
+
+    typedef CSharedPayloadRef Payload;
+
+    struct Stats {
+        size_t nBlocks;
+        //! Bytes of serialized encodings held.
+        size_t nBytes;
+        uint64_t nHits;
+        uint64_t nMisses;
+        //! Bytes of serialized encodings handed out.
+        uint64_t nBytesServed;
+    };
+
+    explicit RawBlockCache(size_t nMaxBlocks);
+
+    void Add(std::shared_ptr<const CBlock> block);
+
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash);
+
+    //! The block serialized as encoding, or null if the block is not cached.
+    Payload Get(const uint256& hash, Encoding encoding);
+
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        Payload encodings[NUM_ENCODINGS];
+    };
+
+    //! Move the entry for hash to the front. Returns false if there is none.
+    bool Touch(const uint256& hash);
+
+    const size_t nMaxBlocks;
+    mutable std::mutex cs;
+    //! Most recently used first.
+    std::list<Entry> entries;
+    size_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nBytesServed;
+};
+
+//! The cache of blocks served to peers, sized by -blockservecache.
+RawBlockCache& GetRawBlockCache();
+
+#endif // BITCOIN_RAWBLOCKCACHE_H
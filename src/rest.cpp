@@ -277,6 +277,35 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+UniValue gettxoutsetinfo(const JSONRPCRequest& request);
+
+static bool rest_utxocommitment(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    switch (rf) {
+    case RF_JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        jsonRequest.params.push_back(UniValue(false));
+        UniValue commitObject = gettxoutsetinfo(jsonRequest);
+        string strJSON = commitObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -556,6 +585,48 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// Defined in rpc/net.cpp
+UniValue getmessagestats(const JSONRPCRequest& request);
+
+static bool rest_messagestats(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    // Optional peer id: /rest/messagestats/<peerid>.json
+    JSONRPCRequest jsonRequest;
+    jsonRequest.params = UniValue(UniValue::VARR);
+    if (!params[0].empty()) {
+        int32_t nPeerId;
+        if (params[0][0] != '/' || !ParseInt32(params[0].substr(1), &nPeerId))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid peer id: " + params[0]);
+        jsonRequest.params.push_back(nPeerId);
+    }
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue statsObject;
+        try {
+            statsObject = getmessagestats(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_NOT_FOUND, find_value(objError, "message").get_str());
+        }
+        string strJSON = statsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -564,6 +635,8 @@ static const struct {
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
       {"/rest/chaininfo", rest_chaininfo},
+      {"/rest/messagestats", rest_messagestats},
+      {"/rest/utxocommitment", rest_utxocommitment},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
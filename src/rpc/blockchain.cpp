@@ -4,15 +4,20 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "coinstats.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "options.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "sync.h"
 #include "util.h"
 #include "hash.h"
 
+#include <atomic>
+#include <memory>
 #include <stdint.h>
+#include <thread>
 
 #include <univalue.h>
 
@@ -99,8 +104,9 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    for (const auto& ptx : block.vtx)
     {
+        const CTransaction& tx = *ptx;
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
@@ -429,111 +435,157 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex);
 }
 
-struct CCoinsStats
+namespace {
+
+UniValue CoinsStatsToJSON(const CCoinsStats& stats)
 {
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
-};
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("utxo_commitment", stats.commit.GetHash().GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("hash_serialized_3", stats.hashSerialized.GetHex()));
+    ret.push_back(Pair("disk_size", stats.nDiskSize));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    return ret;
+}
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+//! Flush the coins cache and start a scan of the UTXO set as it is now.
+std::unique_ptr<CCoinsStatsScan> PrepareCoinsStats(CCoinsStats& stats)
 {
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << *(const CScriptBase*)(&output.second.out.scriptPubKey);
-        ss << VARINT(output.second.out.nValue);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-    }
-    ss << VARINT(0);
+    LOCK(cs_main);
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewSnapshot> snapshot(pcoinsTip->Snapshot());
+    if (!snapshot)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    stats.nHeight = mapBlockIndex.find(snapshot->GetBestBlock())->second->nHeight;
+    stats.nDiskSize = pcoinsTip->EstimateSize();
+    return std::unique_ptr<CCoinsStatsScan>(new CCoinsStatsScan(std::move(snapshot)));
 }
 
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+int CoinsStatsThreads()
 {
-    boost::scoped_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    return std::max(1, Opt().ScriptCheckThreads());
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
+/** A gettxoutsetinfo scan running in the background, polled by later calls. */
+struct BackgroundCoinsStats
+{
+    std::unique_ptr<CCoinsStatsScan> scan;
+    CCoinsStats stats;
+    std::thread thread;
+    std::atomic<bool> done;
+    bool ok;
+
+    BackgroundCoinsStats() : done(false), ok(false) {}
+};
+
+CCriticalSection cs_backgroundCoinsStats;
+std::unique_ptr<BackgroundCoinsStats> backgroundCoinsStats;
+
+void StopBackgroundCoinsStats()
+{
+    std::unique_ptr<BackgroundCoinsStats> job;
     {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+        LOCK(cs_backgroundCoinsStats);
+        job = std::move(backgroundCoinsStats);
     }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
+    if (job) {
+        job->scan->Interrupt();
+        job->thread.join();
+    }
+}
+
+UniValue PollBackgroundCoinsStats()
+{
+    LOCK(cs_backgroundCoinsStats);
+    UniValue ret(UniValue::VOBJ);
+    if (!backgroundCoinsStats) {
+        BackgroundCoinsStats* job = new BackgroundCoinsStats;
+        backgroundCoinsStats.reset(job);
+        job->scan = PrepareCoinsStats(job->stats);
+        job->thread = std::thread([job]() {
+            RenameThread("bitcoin-coinstats");
+            job->ok = job->scan->Run(job->stats, CoinsStatsThreads());
+            job->done = true;
+        });
+        ret.push_back(Pair("status", "started"));
+        ret.push_back(Pair("progress", 0.0));
+        return ret;
     }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+    if (!backgroundCoinsStats->done) {
+        ret.push_back(Pair("status", "running"));
+        ret.push_back(Pair("progress", backgroundCoinsStats->scan->Progress()));
+        return ret;
     }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
+    std::unique_ptr<BackgroundCoinsStats> job = std::move(backgroundCoinsStats);
+    job->thread.join();
+    if (!job->ok)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    ret = CoinsStatsToJSON(job->stats);
+    ret.push_back(Pair("status", "done"));
+    ret.push_back(Pair("progress", 1.0));
+    return ret;
 }
 
+} // namespace
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( scan background )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless scan is false.\n"
+            "\nArguments:\n"
+            "1. scan        (boolean, optional, default=true) Scan the full set for statistics. If false, only the\n"
+            "               height, best block and the incrementally maintained UTXO commitment are returned.\n"
+            "2. background  (boolean, optional, default=false) Scan in the background. The first call starts the\n"
+            "               scan, later calls report its progress until it is done and then return the result.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"utxo_commitment\": \"hash\", (string) The ECMH multiset hash of the UTXO set\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized_3\": \"hash\", (string) The serialized hash, combined over txid prefix shards\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"status\": \"xxx\",      (string, background only) \"started\", \"running\" or \"done\"\n"
+            "  \"progress\": x.xxx,      (numeric, background only) Fraction of the set scanned\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "false")
+            + HelpExampleCli("gettxoutsetinfo", "true true")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
-    LOCK(cs_main);
+    const bool fScan = request.params.size() > 0 ? request.params[0].get_bool() : true;
+    const bool fBackground = request.params.size() > 1 ? request.params[1].get_bool() : false;
 
-    UniValue ret(UniValue::VOBJ);
+    if (!fScan) {
+        LOCK(cs_main);
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("height", (int64_t)chainActive.Height()));
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        CUtxoCommit commit;
+        if (pcoinsTip->GetUtxoCommit(commit))
+            ret.push_back(Pair("utxo_commitment", commit.GetHash().GetHex()));
+        return ret;
+    }
 
+    if (fBackground)
+        return PollBackgroundCoinsStats();
+
+    // Only taking the snapshot needs cs_main; the scan itself runs without it.
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("disk_size", stats.nDiskSize));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
-    }
-    return ret;
+    std::unique_ptr<CCoinsStatsScan> scan = PrepareCoinsStats(stats);
+    if (!scan->Run(stats, CoinsStatsThreads()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    return CoinsStatsToJSON(stats);
 }
 
 UniValue gettxout(const JSONRPCRequest& request)
@@ -1010,7 +1062,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"scan","background"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
     /* Not shown in help */
@@ -1022,4 +1074,5 @@ void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
 {
     for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
         tableRPC.appendCommand(commands[vcidx].name, &commands[vcidx]);
+    RPCServer::OnStopped(&StopBackgroundCoinsStats);
 }
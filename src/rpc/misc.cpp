@@ -11,6 +11,8 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
+#include "sync.h"
 #include "timedata.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
@@ -18,6 +20,8 @@
 #include "wallet/walletdb.h"
 #endif
 
+#include <algorithm>
+#include <map>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -396,6 +400,126 @@ UniValue setmocktime(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns details on the signature cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bytes\": xxxxx               (numeric) Memory allocated for the cache\n"
+            "  \"capacity\": xxxxx            (numeric) Maximum number of entries\n"
+            "  \"size\": xxxxx                (numeric) Current number of entries\n"
+            "  \"lookups\": xxxxx             (numeric) Signature checks that consulted the cache\n"
+            "  \"hits\": xxxxx                (numeric) Lookups that found the signature\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / lookups\n"
+            "  \"inserts\": xxxxx             (numeric) Entries added\n"
+            "  \"evictions\": xxxxx           (numeric) Entries replaced to make room\n"
+            "  \"contended\": xxxxx           (numeric) Operations skipped because another thread was writing the same bucket\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    CSignatureCache::Stats stats = GetSignatureCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    ret.push_back(Pair("capacity", (uint64_t)(stats.nBuckets * CSignatureCache::BUCKET_ENTRIES)));
+    ret.push_back(Pair("size", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("lookups", stats.nLookups));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("hitrate", stats.nLookups ? double(stats.nHits) / stats.nLookups : 0.0));
+    ret.push_back(Pair("inserts", stats.nInserts));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    ret.push_back(Pair("contended", stats.nContended));
+    return ret;
+}
+
+static UniValue LockSiteStatsToJSON(const LockSiteStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("name", stats.strName));
+    if (!stats.strSite.empty())
+        obj.push_back(Pair("site", stats.strSite));
+    obj.push_back(Pair("count", stats.nAcquired));
+    obj.push_back(Pair("contended", stats.nContended));
+    obj.push_back(Pair("wait_us", stats.nWaitNanos / 1000));
+    obj.push_back(Pair("max_wait_us", stats.nMaxWaitNanos / 1000));
+    obj.push_back(Pair("hold_us", stats.nHoldNanos / 1000));
+    obj.push_back(Pair("max_hold_us", stats.nMaxHoldNanos / 1000));
+    return obj;
+}
+
+static bool ByWaitDescending(const LockSiteStats& a, const LockSiteStats& b)
+{
+    return a.nWaitNanos != b.nWaitNanos ? a.nWaitNanos > b.nWaitNanos : a.nHoldNanos > b.nHoldNanos;
+}
+
+UniValue getlockprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getlockprofile ( reset )\n"
+            "\nReturns time spent waiting for and holding locks, by lock and by the source\n"
+            "location taking it. Only recorded while running with -lockprofile.\n"
+            "\nArguments:\n"
+            "1. reset      (boolean, optional, default=false) Clear the counters after reading them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) Whether locks are being profiled\n"
+            "  \"locks\": [                  (array) Totals by lock, most waited on first\n"
+            "    {\n"
+            "      \"name\": \"cs_main\",       (string) The locked expression\n"
+            "      \"count\": n,              (numeric) Times the lock was taken\n"
+            "      \"contended\": n,          (numeric) Of which had to wait for another thread\n"
+            "      \"wait_us\": n,            (numeric) Microseconds spent waiting for the lock\n"
+            "      \"max_wait_us\": n,        (numeric) Longest single wait\n"
+            "      \"hold_us\": n,            (numeric) Microseconds the lock was held\n"
+            "      \"max_hold_us\": n         (numeric) Longest single hold\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"sites\": [                  (array) The same by location, with \"site\": \"file:line\"\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockprofile", "")
+            + HelpExampleCli("getlockprofile", "true")
+            + HelpExampleRpc("getlockprofile", "true")
+        );
+
+    std::vector<LockSiteStats> sites = GetLockProfile();
+    if (request.params.size() > 0 && request.params[0].get_bool())
+        ResetLockProfile();
+
+    std::map<std::string, LockSiteStats> byName;
+    for (const LockSiteStats& site : sites) {
+        LockSiteStats& lock = byName[site.strName];
+        lock.strName = site.strName;
+        lock.Add(site);
+    }
+    std::vector<LockSiteStats> locks;
+    for (const auto& lock : byName)
+        locks.push_back(lock.second);
+
+    std::sort(locks.begin(), locks.end(), ByWaitDescending);
+    std::sort(sites.begin(), sites.end(), ByWaitDescending);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", fLockProfiling.load()));
+    UniValue locksArr(UniValue::VARR);
+    for (const LockSiteStats& lock : locks)
+        locksArr.push_back(LockSiteStatsToJSON(lock));
+    ret.push_back(Pair("locks", locksArr));
+    UniValue sitesArr(UniValue::VARR);
+    for (const LockSiteStats& site : sites)
+        sitesArr.push_back(LockSiteStatsToJSON(site));
+    ret.push_back(Pair("sites", sitesArr));
+    return ret;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -416,6 +540,8 @@ static const CRPCCommand commands[] =
     { "util",               "validateaddress",        &validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          true,  {"address","signature","message"} },
+    { "util",               "getsigcacheinfo",        &getsigcacheinfo,        true,  {} },
+    { "control",            "getlockprofile",         &getlockprofile,         true,  {"reset"} },
 
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            true,  {"timestamp"}},
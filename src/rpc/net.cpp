@@ -6,9 +6,11 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "msgstats.h"
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
+#include "rawblockcache.h"
 #include "sync.h"
 #include "timedata.h"
 #include "util.h"
@@ -384,7 +386,14 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"blockservecache\": {   (json object) recent blocks kept for serving to peers\n"
+            "    \"blocks\": n,         (numeric) Blocks in the cache\n"
+            "    \"bytes\": n,          (numeric) Bytes of serialized blocks held\n"
+            "    \"hits\": n,           (numeric) Requests served from the cache\n"
+            "    \"misses\": n,         (numeric) Requests that were not\n"
+            "    \"bytesserved\": n     (numeric) Bytes of serialized blocks served from the cache\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getnettotals", "")
@@ -400,6 +409,108 @@ UniValue getnettotals(const JSONRPCRequest& request)
     obj.push_back(Pair("totalbytesrecv", g_connman->GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", g_connman->GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    RawBlockCache::Stats stats = GetRawBlockCache().GetStats();
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("blocks", (uint64_t)stats.nBlocks));
+    cache.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    cache.push_back(Pair("hits", stats.nHits));
+    cache.push_back(Pair("misses", stats.nMisses));
+    cache.push_back(Pair("bytesserved", stats.nBytesServed));
+    obj.push_back(Pair("blockservecache", cache));
+    return obj;
+}
+
+static UniValue MessageTypeStatsToJSON(const CMessageTypeStats::Snapshot& stats, bool fHistogram)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", stats.nMessages));
+    obj.push_back(Pair("bytes", stats.nBytes));
+    obj.push_back(Pair("handler_us", stats.nHandlerMicros));
+    obj.push_back(Pair("lockwait_us", stats.nLockWaitMicros));
+    obj.push_back(Pair("max_handler_us", stats.nMaxHandlerMicros));
+    obj.push_back(Pair("max_latency_us", stats.nMaxLatencyMicros));
+    if (fHistogram) {
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t n : stats.vHandlerHistogram)
+            histogram.push_back(n);
+        obj.push_back(Pair("histogram", histogram));
+    }
+    return obj;
+}
+
+static UniValue MessageStatsToJSON(const CMessageStats& stats)
+{
+    UniValue commands(UniValue::VOBJ);
+    for (const auto& cmd : stats.GetSnapshot())
+        commands.push_back(Pair(cmd.first, MessageTypeStatsToJSON(cmd.second, true)));
+    return commands;
+}
+
+UniValue getmessagestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getmessagestats ( peerid )\n"
+            "\nReturns statistics on processing of messages received from peers, by command.\n"
+            "Without arguments, covers all peers since startup and lists totals for each\n"
+            "connected peer. With a peer id, covers only that peer.\n"
+            "\nArguments:\n"
+            "1. peerid         (numeric, optional) The peer id as listed by getpeerinfo\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"commands\": {               (json object) commands with at least one message\n"
+            "    \"command\": {\n"
+            "      \"count\": n,              (numeric) Messages processed\n"
+            "      \"bytes\": n,              (numeric) Payload bytes of those messages\n"
+            "      \"handler_us\": n,         (numeric) Microseconds spent processing them\n"
+            "      \"lockwait_us\": n,        (numeric) Of which blocked waiting on locks such as cs_main\n"
+            "      \"max_handler_us\": n,     (numeric) Longest processing time of a single message\n"
+            "      \"max_latency_us\": n,     (numeric) Longest time from receipt until processed\n"
+            "      \"histogram\": [ n, ... ]  (array) Messages by processing time. Entry 0 counts times\n"
+            "                                under 1us, entry i times in [2^(i-1), 2^i) us\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"peers\": [                  (array) connected peers, omitted when a peer id is given\n"
+            "    {\n"
+            "      \"id\": n,                 (numeric) Peer id\n"
+            "      \"count\": n, ...          Totals over all commands, as above without histogram\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagestats", "")
+            + HelpExampleCli("getmessagestats", "3")
+            + HelpExampleRpc("getmessagestats", "3")
+        );
+
+    if (!g_connman) {
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer "
+                           "functionality missing or disabled");
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    if (request.params.size() == 1) {
+        NodeId id = request.params[0].get_int();
+        obj.push_back(Pair("id", id));
+        bool fFound = g_connman->ForNode(id, [&obj](CNode* pnode) {
+            obj.push_back(Pair("commands", MessageStatsToJSON(pnode->msgStats)));
+            return true;
+        });
+        if (!fFound)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Error: Peer not connected");
+        return obj;
+    }
+
+    obj.push_back(Pair("commands", MessageStatsToJSON(GetMessageStats())));
+    UniValue peers(UniValue::VARR);
+    g_connman->ForEachNode([&peers](CNode* pnode) {
+        UniValue peer(UniValue::VOBJ);
+        peer.push_back(Pair("id", pnode->GetId()));
+        peer.pushKVs(MessageTypeStatsToJSON(pnode->msgStats.GetTotals(), false));
+        peers.push_back(peer);
+    });
+    obj.push_back(Pair("peers", peers));
     return obj;
 }
 
@@ -502,6 +613,7 @@ static const CRPCCommand commands[] =
     { "network",            "addnode",                &addnode,                true,  {"node","command"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           &getnettotals,           true,  {} },
+    { "network",            "getmessagestats",        &getmessagestats,        true,  {"peerid"} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
     { "network",            "settrafficshaping",      &settrafficshaping,      true, {"direction", "burst", "average"  } },
     { "network",            "gettrafficshaping",      &gettrafficshaping,      true, { }  },
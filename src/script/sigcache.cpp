@@ -5,95 +5,258 @@
 
 #include "sigcache.h"
 
-#include "memusage.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
-#include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
+#include <algorithm>
+#include <limits>
+#include <new>
 
-namespace {
-
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- */
-class CSignatureCacheHasher
-{
-public:
-    size_t operator()(const uint256& key) const {
-        return key.GetCheapHash();
-    }
-};
-
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+struct CSignatureCache::Bucket
 {
-private:
-     //! Entries are SHA256(nonce || signature hash || public key || signature):
-    uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    //! Odd while a writer is modifying the bucket.
+    std::atomic<uint32_t> seq;
+    //! Next slot to replace when the bucket is full. Only touched by the
+    //! writer holding the bucket.
+    uint32_t next;
+    std::atomic<uint64_t> slots[BUCKET_ENTRIES][2];
 
+    Bucket() : seq(0), next(0)
+    {
+        for (auto& slot : slots) {
+            slot[0].store(0, std::memory_order_relaxed);
+            slot[1].store(0, std::memory_order_relaxed);
+        }
+    }
 
-public:
-    CSignatureCache()
+    bool Matches(size_t i, const Entry& entry) const
     {
-        GetRandBytes(nonce.begin(), 32);
+        return slots[i][0].load(std::memory_order_relaxed) == entry.a &&
+               slots[i][1].load(std::memory_order_relaxed) == entry.b;
     }
 
-    void
-    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+    bool Empty(size_t i) const
     {
-        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+        return slots[i][0].load(std::memory_order_relaxed) == 0 &&
+               slots[i][1].load(std::memory_order_relaxed) == 0;
     }
 
-    bool
-    Get(const uint256& entry)
+    void Store(size_t i, uint64_t a, uint64_t b)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        slots[i][0].store(a, std::memory_order_relaxed);
+        slots[i][1].store(b, std::memory_order_relaxed);
     }
 
-    void Erase(const uint256& entry)
+    bool TryLock(uint32_t& s)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        s = seq.load(std::memory_order_relaxed);
+        if ((s & 1) || !seq.compare_exchange_strong(s, s + 1, std::memory_order_acquire))
+            return false;
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
     }
 
-    void Set(const uint256& entry)
+    void Unlock(uint32_t s)
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
-            }
+        seq.store(s + 2, std::memory_order_release);
+    }
+};
+
+static_assert(sizeof(CSignatureCache::Entry) == 16, "unexpected entry size");
+
+struct CSignatureCache::Counters
+{
+    std::atomic<uint64_t> nLookups;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+    std::atomic<uint64_t> nContended;
+
+    Counters() : nLookups(0), nHits(0), nInserts(0), nEvictions(0), nContended(0) {}
+};
+
+namespace {
+
+//! Carve an array of n objects of type T out of storage, starting each
+//! object on a cache line so threads working on different ones never share
+//! a line.
+template <typename T>
+T* AllocateLines(std::unique_ptr<char[]>& storage, size_t n)
+{
+    static_assert(sizeof(T) <= CSignatureCache::BUCKET_SIZE, "object does not fit a cache line");
+    const size_t line = CSignatureCache::BUCKET_SIZE;
+    storage.reset(new char[n * line + line]);
+    uintptr_t p = reinterpret_cast<uintptr_t>(storage.get());
+    char* base = storage.get() + (line - p % line) % line;
+    for (size_t i = 0; i < n; ++i)
+        new (base + i * line) T();
+    return reinterpret_cast<T*>(base);
+}
+
+template <typename T>
+T& LineAt(T* base, size_t i)
+{
+    return *reinterpret_cast<T*>(reinterpret_cast<char*>(base) + i * CSignatureCache::BUCKET_SIZE);
+}
+
+} // namespace
+
+CSignatureCache::CSignatureCache(size_t nMaxBytes) : nBuckets(0), table(nullptr)
+{
+    GetRandBytes(nonce.begin(), 32);
+
+    // Bucket indexes are mapped from 32 bits of the entry.
+    nBuckets = std::min<size_t>(nMaxBytes / BUCKET_SIZE, std::numeric_limits<uint32_t>::max());
+    if (nBuckets)
+        table = AllocateLines<Bucket>(storage, nBuckets);
+    counters = AllocateLines<Counters>(counterStorage, COUNTER_STRIPES);
+}
+
+CSignatureCache::~CSignatureCache() { }
+
+CSignatureCache::Bucket& CSignatureCache::BucketFor(const Entry& entry) const
+{
+    return LineAt(table, ((entry.b & 0xffffffff) * nBuckets) >> 32);
+}
+
+CSignatureCache::Counters& CSignatureCache::CountersFor(const Entry& entry) const
+{
+    return LineAt(counters, entry.a % COUNTER_STRIPES);
+}
+
+void CSignatureCache::ComputeEntry(Entry& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    unsigned char digest[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(digest);
+    entry.a = ReadLE64(digest);
+    entry.b = ReadLE64(digest + 8);
+    // All zero marks an empty slot.
+    if (entry.a == 0 && entry.b == 0)
+        entry.b = 1;
+}
+
+bool CSignatureCache::Get(const Entry& entry)
+{
+    Counters& stats = CountersFor(entry);
+    stats.nLookups.fetch_add(1, std::memory_order_relaxed);
+    if (!nBuckets)
+        return false;
+
+    const Bucket& bucket = BucketFor(entry);
+    uint32_t s = bucket.seq.load(std::memory_order_acquire);
+    if (s & 1) {
+        stats.nContended.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bool found = false;
+    for (size_t i = 0; i < BUCKET_ENTRIES; ++i)
+        found |= bucket.Matches(i, entry);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (bucket.seq.load(std::memory_order_relaxed) != s) {
+        stats.nContended.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (found)
+        stats.nHits.fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+void CSignatureCache::Erase(const Entry& entry)
+{
+    if (!nBuckets)
+        return;
+
+    Bucket& bucket = BucketFor(entry);
+    uint32_t s;
+    if (!bucket.TryLock(s)) {
+        CountersFor(entry).nContended.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (size_t i = 0; i < BUCKET_ENTRIES; ++i) {
+        if (bucket.Matches(i, entry))
+            bucket.Store(i, 0, 0);
+    }
+    bucket.Unlock(s);
+}
+
+void CSignatureCache::Set(const Entry& entry)
+{
+    if (!nBuckets)
+        return;
+
+    Counters& stats = CountersFor(entry);
+    Bucket& bucket = BucketFor(entry);
+    uint32_t s;
+    if (!bucket.TryLock(s)) {
+        stats.nContended.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    size_t slot = BUCKET_ENTRIES;
+    for (size_t i = 0; i < BUCKET_ENTRIES; ++i) {
+        if (bucket.Matches(i, entry)) {
+            bucket.Unlock(s);
+            return;
         }
+        if (slot == BUCKET_ENTRIES && bucket.Empty(i))
+            slot = i;
+    }
+    if (slot == BUCKET_ENTRIES) {
+        slot = bucket.next;
+        bucket.next = (bucket.next + 1) % BUCKET_ENTRIES;
+        stats.nEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    bucket.Store(slot, entry.a, entry.b);
+    bucket.Unlock(s);
+    stats.nInserts.fetch_add(1, std::memory_order_relaxed);
+}
 
-        setValid.insert(entry);
+CSignatureCache::Stats CSignatureCache::GetStats() const
+{
+    Stats result = Stats();
+    result.nBytes = nBuckets * BUCKET_SIZE;
+    result.nBuckets = nBuckets;
+    for (size_t i = 0; i < nBuckets; ++i) {
+        const Bucket& bucket = LineAt(table, i);
+        for (size_t j = 0; j < BUCKET_ENTRIES; ++j)
+            result.nEntries += !bucket.Empty(j);
     }
-};
+    for (size_t i = 0; i < COUNTER_STRIPES; ++i) {
+        const Counters& stripe = LineAt(counters, i);
+        result.nLookups += stripe.nLookups.load(std::memory_order_relaxed);
+        result.nHits += stripe.nHits.load(std::memory_order_relaxed);
+        result.nInserts += stripe.nInserts.load(std::memory_order_relaxed);
+        result.nEvictions += stripe.nEvictions.load(std::memory_order_relaxed);
+        result.nContended += stripe.nContended.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+static CSignatureCache& SignatureCache()
+{
+    static CSignatureCache cache(std::max<int64_t>(0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)) * ((size_t) 1 << 20));
+    return cache;
+}
 
+void InitSignatureCache()
+{
+    CSignatureCache::Stats stats = SignatureCache().GetStats();
+    LogPrintf("Using %zu MiB for the signature cache, able to store %zu entries\n",
+              stats.nBytes >> 20, stats.nBuckets * CSignatureCache::BUCKET_ENTRIES);
+}
+
+CSignatureCache::Stats GetSignatureCacheStats()
+{
+    return SignatureCache().GetStats();
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = SignatureCache();
 
-    uint256 entry;
+    CSignatureCache::Entry entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
     if (signatureCache.Get(entry)) {
@@ -7,15 +7,88 @@
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
-// DoS prevention: limit cache size to less than 40MB (over 500000
-// entries on 64-bit systems).
+// DoS prevention: limit cache size to less than 40MB (over 1900000
+// entries).
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 40;
 
 class CPubKey;
 
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * The cache is a fixed table of 64 byte buckets allocated up front from the
+ * byte budget. A bucket holds three entries and a sequence counter. Lookups
+ * take no lock: they read the bucket and treat a concurrent write as a miss.
+ * Writers claim a bucket by making its counter odd and give up if another
+ * writer holds it. Either way the worst outcome is one extra signature check.
+ */
+class CSignatureCache
+{
+public:
+    //! First 128 bits of SHA256(nonce || signature hash || public key || signature).
+    //! The nonce is secret, so the truncation gives no way to aim for a collision.
+    struct Entry {
+        uint64_t a;
+        uint64_t b;
+    };
+
+    struct Stats {
+        size_t nBytes;
+        size_t nBuckets;
+        size_t nEntries;
+        uint64_t nLookups;
+        uint64_t nHits;
+        uint64_t nInserts;
+        uint64_t nEvictions;
+        uint64_t nContended;
+    };
+
+    static const size_t BUCKET_SIZE = 64;
+    static const size_t BUCKET_ENTRIES = 3;
+
+    //! A zero budget disables the cache.
+    explicit CSignatureCache(size_t nMaxBytes);
+    ~CSignatureCache();
+
+    void ComputeEntry(Entry& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    bool Get(const Entry& entry);
+    void Erase(const Entry& entry);
+    void Set(const Entry& entry);
+
+    //! Counters since startup. nEntries is counted by walking the table.
+    Stats GetStats() const;
+
+private:
+    struct Bucket;
+    struct Counters;
+    static const size_t COUNTER_STRIPES = 16;
+
+    Bucket& BucketFor(const Entry& entry) const;
+    Counters& CountersFor(const Entry& entry) const;
+
+    uint256 nonce;
+    size_t nBuckets;
+    std::unique_ptr<char[]> storage;
+    Bucket* table;
+    std::unique_ptr<char[]> counterStorage;
+    Counters* counters;
+};
+
+//! Size the shared cache from -maxsigcachesize. Called at startup; the cache
+//! is otherwise created on first use.
+void InitSignatureCache();
+
+CSignatureCache::Stats GetSignatureCacheStats();
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
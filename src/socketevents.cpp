@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "socketevents.h"
+
+#ifdef USE_EPOLL
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+SocketEventsMode DefaultSocketEventsMode()
+{
+#ifdef USE_EPOLL
+    return SocketEventsMode::EPOLL;
+#else
+    return SocketEventsMode::SELECT;
+#endif
+}
+
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModeName(SocketEventsMode mode)
+{
+    return mode == SocketEventsMode::EPOLL ? "epoll" : "select";
+}
+
+#ifdef USE_EPOLL
+EpollSet::EpollSet()
+{
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollfd >= 0 && wakefd >= 0) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = this;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &event) != 0) {
+            close(wakefd);
+            wakefd = -1;
+        }
+    }
+}
+
+EpollSet::~EpollSet()
+{
+    if (wakefd >= 0)
+        close(wakefd);
+    if (epollfd >= 0)
+        close(epollfd);
+}
+
+bool EpollSet::Add(SOCKET s, void* ctx, bool fEdgeTriggered)
+{
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    if (fEdgeTriggered)
+        event.events |= EPOLLET;
+    event.data.ptr = ctx;
+    return epoll_ctl(epollfd, EPOLL_CTL_ADD, s, &event) == 0;
+}
+
+int EpollSet::Wait(std::vector<epoll_event>& events, int nTimeoutMs)
+{
+    int n = epoll_wait(epollfd, events.data(), events.size(), nTimeoutMs);
+    if (n < 0)
+        return errno == EINTR ? 0 : -1;
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.ptr != this)
+            continue;
+        uint64_t nCount;
+        while (read(wakefd, &nCount, sizeof(nCount)) > 0) {}
+        events[i--] = events[--n];
+    }
+    return n;
+}
+
+void EpollSet::Wake()
+{
+    uint64_t nOne = 1;
+    ssize_t ret = write(wakefd, &nOne, sizeof(nOne));
+    (void)ret; // Fails only if the counter is about to overflow, in which case a wakeup is pending.
+}
+#endif
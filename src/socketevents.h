@@ -0,0 +1,62 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+
+#include <string>
+#include <vector>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+/** How the network thread waits for its sockets to become ready. */
+enum class SocketEventsMode {
+    //! Poll all sockets with select() every pass. Limited to FD_SETSIZE sockets.
+    SELECT,
+    //! Edge-triggered epoll. Only available on Linux.
+    EPOLL
+};
+
+SocketEventsMode DefaultSocketEventsMode();
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode);
+std::string SocketEventsModeName(SocketEventsMode mode);
+
+#ifdef USE_EPOLL
+/**
+ * An epoll instance, with an eventfd so that other threads can interrupt a
+ * thread waiting on it.
+ */
+class EpollSet
+{
+public:
+    EpollSet();
+    ~EpollSet();
+
+    EpollSet(const EpollSet&) = delete;
+    EpollSet& operator=(const EpollSet&) = delete;
+
+    bool IsValid() const { return epollfd >= 0 && wakefd >= 0; }
+
+    //! Watch s for reading and writing. ctx is passed back in the events of
+    //! the socket. The socket is dropped from the set when it is closed.
+    bool Add(SOCKET s, void* ctx, bool fEdgeTriggered);
+
+    //! Wait for events for up to nTimeoutMs milliseconds. Returns the number
+    //! of events put in events, which does not include wakeups, or -1 on
+    //! error.
+    int Wait(std::vector<epoll_event>& events, int nTimeoutMs);
+
+    //! Make a call to Wait() return.
+    void Wake();
+
+private:
+    int epollfd;
+    int wakefd;
+};
+#endif
+
+#endif // BITCOIN_SOCKETEVENTS_H
@@ -6,9 +6,11 @@
 #ifndef BITCOIN_SUPPORT_ALLOCATORS_ZEROAFTERFREE_H
 #define BITCOIN_SUPPORT_ALLOCATORS_ZEROAFTERFREE_H
 
+#include "support/bufferpool.h"
 #include "support/cleanse.h"
 
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 template <typename T>
@@ -42,7 +44,64 @@ struct zero_after_free_allocator : public std::allocator<T> {
     }
 };
 
-// Byte-vector that clears its contents before deletion.
-typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
+/**
+ * Clears memory before freeing it, like zero_after_free_allocator, unless it
+ * is given a CBufferPool. Memory from a pool holds no secrets, so it goes
+ * back to the pool without being cleared. A copy of a container does not
+ * inherit the pool.
+ */
+template <typename T>
+struct zero_after_free_or_pooled_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+
+    CBufferPool* pool;
+
+    zero_after_free_or_pooled_allocator() noexcept : pool(nullptr) {}
+    explicit zero_after_free_or_pooled_allocator(CBufferPool* poolIn) noexcept : pool(poolIn) {}
+    template <typename U>
+    zero_after_free_or_pooled_allocator(const zero_after_free_or_pooled_allocator<U>& a) noexcept : pool(a.pool) {}
+
+    zero_after_free_or_pooled_allocator select_on_container_copy_construction() const
+    {
+        return zero_after_free_or_pooled_allocator();
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (pool)
+            return static_cast<T*>(pool->Allocate(sizeof(T) * n));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (pool) {
+            pool->Free(p, sizeof(T) * n);
+            return;
+        }
+        if (p != NULL)
+            memory_cleanse(p, sizeof(T) * n);
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const zero_after_free_or_pooled_allocator<T>& a, const zero_after_free_or_pooled_allocator<U>& b)
+{
+    return a.pool == b.pool;
+}
+
+template <typename T, typename U>
+bool operator!=(const zero_after_free_or_pooled_allocator<T>& a, const zero_after_free_or_pooled_allocator<U>& b)
+{
+    return a.pool != b.pool;
+}
+
+// Byte-vector that clears its contents before deletion, unless it
+// allocates from a CBufferPool.
+typedef std::vector<char, zero_after_free_or_pooled_allocator<char> > CSerializeData;
 
 #endif // BITCOIN_SUPPORT_ALLOCATORS_ZEROAFTERFREE_H
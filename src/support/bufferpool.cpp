@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/bufferpool.h"
+
+#include <new>
+
+/** Upper limit on bytes kept in recycled receive buffers. Enough for a
+ * maximum sized block message and a good number of smaller messages. */
+static const size_t MAX_RECV_POOL_BYTES = 64 * 1024 * 1024;
+
+CBufferPool::CBufferPool(size_t nMaxFreeBytesIn) :
+    nMaxFreeBytes(nMaxFreeBytesIn), nFreeBytes(0), nAllocs(0), nReused(0)
+{
+}
+
+CBufferPool::~CBufferPool()
+{
+    Clear();
+}
+
+int CBufferPool::ClassOf(size_t nSize)
+{
+    if (nSize < (size_t(1) << MIN_CLASS_BITS) || nSize > (size_t(1) << MAX_CLASS_BITS))
+        return -1;
+    size_t nBits = MIN_CLASS_BITS;
+    while ((size_t(1) << nBits) < nSize)
+        ++nBits;
+    return nBits - MIN_CLASS_BITS;
+}
+
+void* CBufferPool::Allocate(size_t nSize)
+{
+    const int nClass = ClassOf(nSize);
+    if (nClass < 0)
+        return ::operator new(nSize);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        ++nAllocs;
+        std::vector<void*>& free = vFree[nClass];
+        if (!free.empty()) {
+            void* p = free.back();
+            free.pop_back();
+            nFreeBytes -= size_t(1) << (nClass + MIN_CLASS_BITS);
+            ++nReused;
+            return p;
+        }
+    }
+    return ::operator new(size_t(1) << (nClass + MIN_CLASS_BITS));
+}
+
+void CBufferPool::Free(void* p, size_t nSize)
+{
+    if (p == nullptr)
+        return;
+    const int nClass = ClassOf(nSize);
+    if (nClass >= 0) {
+        const size_t nClassSize = size_t(1) << (nClass + MIN_CLASS_BITS);
+        std::lock_guard<std::mutex> lock(cs);
+        std::vector<void*>& free = vFree[nClass];
+        if (free.size() < MAX_FREE_PER_CLASS && nFreeBytes + nClassSize <= nMaxFreeBytes) {
+            free.push_back(p);
+            nFreeBytes += nClassSize;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+bool CBufferPool::HasFree(size_t nSize) const
+{
+    const int nClass = ClassOf(nSize);
+    if (nClass < 0)
+        return false;
+    std::lock_guard<std::mutex> lock(cs);
+    return !vFree[nClass].empty();
+}
+
+void CBufferPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    for (std::vector<void*>& free : vFree) {
+        for (void* p : free)
+            ::operator delete(p);
+        free.clear();
+    }
+    nFreeBytes = 0;
+}
+
+CBufferPool::Stats CBufferPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Stats stats;
+    stats.nAllocs = nAllocs;
+    stats.nReused = nReused;
+    stats.nFreeBytes = nFreeBytes;
+    return stats;
+}
+
+CBufferPool& RecvBufferPool()
+{
+    static CBufferPool pool(MAX_RECV_POOL_BYTES);
+    return pool;
+}
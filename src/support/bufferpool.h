@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_BUFFERPOOL_H
+#define BITCOIN_SUPPORT_BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Recycles byte buffers in power of two size classes.
+ *
+ * Meant for data that holds no secrets, such as messages received from the
+ * network, so freed buffers are kept for reuse without being cleared.
+ * Requests smaller than the smallest class go to the heap, as do buffers
+ * that don't fit within the pool's byte limit once freed.
+ */
+class CBufferPool
+{
+public:
+    static const size_t MIN_CLASS_BITS = 10; // 1 KiB
+    static const size_t MAX_CLASS_BITS = 25; // 32 MiB
+    static const size_t MAX_FREE_PER_CLASS = 64;
+
+    struct Stats {
+        uint64_t nAllocs;  //!< Pooled allocations
+        uint64_t nReused;  //!< Of which served by a recycled buffer
+        size_t nFreeBytes; //!< Bytes held in recycled buffers
+    };
+
+    explicit CBufferPool(size_t nMaxFreeBytesIn);
+    ~CBufferPool();
+
+    CBufferPool(const CBufferPool&) = delete;
+    CBufferPool& operator=(const CBufferPool&) = delete;
+
+    void* Allocate(size_t nSize);
+    //! Must be called with the size that was passed to Allocate.
+    void Free(void* p, size_t nSize);
+
+    //! Whether a recycled buffer is available for nSize bytes.
+    bool HasFree(size_t nSize) const;
+
+    //! Return all recycled buffers to the heap.
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    static const size_t NUM_CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+    //! Size class for nSize, or -1 if the pool does not handle that size.
+    static int ClassOf(size_t nSize);
+
+    mutable std::mutex cs;
+    std::vector<void*> vFree[NUM_CLASSES];
+    const size_t nMaxFreeBytes;
+    size_t nFreeBytes;
+    uint64_t nAllocs;
+    uint64_t nReused;
+};
+
+/** Pool for buffers of messages received from peers. */
+CBufferPool& RecvBufferPool();
+
+#endif // BITCOIN_SUPPORT_BUFFERPOOL_H
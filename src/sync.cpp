@@ -7,7 +7,16 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <stdio.h>
+#include <string.h>
+#include <tuple>
+#include <utility>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
@@ -20,6 +29,183 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static thread_local int64_t nLockWaitNanos = 0;
+
+int64_t LockWaitMicros()
+{
+    return nLockWaitNanos / 1000;
+}
+
+void AddLockWait(int64_t nNanos)
+{
+    nLockWaitNanos += nNanos;
+}
+
+int64_t LockClockNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Lock profiling.
+// Each thread counts its acquisitions by LOCK site in its own map, guarded
+// by a mutex that only GetLockProfile and ResetLockProfile contend for.
+// Sites are keyed by the __FILE__ and #cs pointers, which are string
+// literals and outlive every thread. When a thread exits, its counters are
+// moved to the registry so they aren't lost.
+//
+
+std::atomic<bool> fLockProfiling(false);
+
+LockSiteStats::LockSiteStats() :
+    nAcquired(0), nContended(0), nWaitNanos(0), nMaxWaitNanos(0),
+    nHoldNanos(0), nMaxHoldNanos(0)
+{
+}
+
+void LockSiteStats::Add(const LockSiteStats& other)
+{
+    nAcquired += other.nAcquired;
+    nContended += other.nContended;
+    nWaitNanos += other.nWaitNanos;
+    nMaxWaitNanos = std::max(nMaxWaitNanos, other.nMaxWaitNanos);
+    nHoldNanos += other.nHoldNanos;
+    nMaxHoldNanos = std::max(nMaxHoldNanos, other.nMaxHoldNanos);
+}
+
+namespace {
+
+struct LockSiteKey {
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    bool operator<(const LockSiteKey& other) const
+    {
+        return std::tie(pszFile, nLine, pszName) < std::tie(other.pszFile, other.nLine, other.pszName);
+    }
+};
+
+typedef std::map<LockSiteKey, LockSiteStats> LockSiteMap;
+
+void MergeSites(LockSiteMap& to, const LockSiteMap& from)
+{
+    for (const auto& site : from)
+        to[site.first].Add(site.second);
+}
+
+struct LockProfileThread {
+    std::mutex cs;
+    LockSiteMap sites;
+};
+
+struct LockProfileRegistry {
+    std::mutex cs;
+    std::set<LockProfileThread*> threads;
+    LockSiteMap exited;
+};
+
+LockProfileRegistry& ProfileRegistry()
+{
+    // Never destroyed, threads may exit after static destructors run.
+    static LockProfileRegistry* registry = new LockProfileRegistry();
+    return *registry;
+}
+
+struct LockProfileThreadHolder {
+    std::unique_ptr<LockProfileThread> thread;
+
+    LockProfileThread* Get()
+    {
+        if (!thread) {
+            thread.reset(new LockProfileThread());
+            LockProfileRegistry& registry = ProfileRegistry();
+            std::lock_guard<std::mutex> lock(registry.cs);
+            registry.threads.insert(thread.get());
+        }
+        return thread.get();
+    }
+
+    ~LockProfileThreadHolder();
+};
+
+thread_local LockProfileThreadHolder threadProfile;
+// Set once threadProfile is destroyed, locks may still be taken after.
+thread_local bool fThreadProfileGone = false;
+
+LockProfileThreadHolder::~LockProfileThreadHolder()
+{
+    fThreadProfileGone = true;
+    if (!thread)
+        return;
+    LockProfileRegistry& registry = ProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    registry.threads.erase(thread.get());
+    MergeSites(registry.exited, thread->sites);
+}
+
+} // namespace
+
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine,
+                       bool fContended, int64_t nWaitNanos, int64_t nHoldNanos)
+{
+    if (fThreadProfileGone)
+        return;
+    LockProfileThread* thread = threadProfile.Get();
+    std::lock_guard<std::mutex> lock(thread->cs);
+    LockSiteStats& stats = thread->sites[LockSiteKey{pszName, pszFile, nLine}];
+    ++stats.nAcquired;
+    if (fContended)
+        ++stats.nContended;
+    stats.nWaitNanos += nWaitNanos;
+    stats.nMaxWaitNanos = std::max(stats.nMaxWaitNanos, nWaitNanos);
+    stats.nHoldNanos += nHoldNanos;
+    stats.nMaxHoldNanos = std::max(stats.nMaxHoldNanos, nHoldNanos);
+}
+
+std::vector<LockSiteStats> GetLockProfile()
+{
+    LockProfileRegistry& registry = ProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    LockSiteMap sites = registry.exited;
+    for (LockProfileThread* thread : registry.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->cs);
+        MergeSites(sites, thread->sites);
+    }
+
+    // Sites in headers have a __FILE__ pointer per translation unit.
+    std::map<std::pair<std::string, std::string>, LockSiteStats> bySite;
+    for (const auto& site : sites) {
+        // Drop the relative path of out of tree builds
+        const char* pszFile = site.first.pszFile;
+        while (strncmp(pszFile, "../", 3) == 0)
+            pszFile += 3;
+        std::string strSite = strprintf("%s:%d", pszFile, site.first.nLine);
+        bySite[std::make_pair(strSite, std::string(site.first.pszName))].Add(site.second);
+    }
+
+    std::vector<LockSiteStats> profile;
+    profile.reserve(bySite.size());
+    for (const auto& site : bySite) {
+        profile.push_back(site.second);
+        profile.back().strSite = site.first.first;
+        profile.back().strName = site.first.second;
+    }
+    return profile;
+}
+
+void ResetLockProfile()
+{
+    LockProfileRegistry& registry = ProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    registry.exited.clear();
+    for (LockProfileThread* thread : registry.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->cs);
+        thread->sites.clear();
+    }
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,6 +8,11 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -99,6 +104,43 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Total time the calling thread has spent blocked on contended locks, in
+ * microseconds. Callers take the difference around a piece of work. */
+int64_t LockWaitMicros();
+void AddLockWait(int64_t nNanos);
+
+/** Monotonic clock for lock timings, in nanoseconds. */
+int64_t LockClockNanos();
+
+static const bool DEFAULT_LOCKPROFILE = false;
+
+/** Whether LOCK sites record wait and hold times (-lockprofile). */
+extern std::atomic<bool> fLockProfiling;
+
+/** Lock profile of one LOCK site, or of all sites of a lock. */
+struct LockSiteStats {
+    std::string strName; //!< The locked expression, such as cs_main
+    std::string strSite; //!< file:line, empty when summed over sites
+    uint64_t nAcquired;
+    uint64_t nContended; //!< Acquisitions that had to wait
+    int64_t nWaitNanos;
+    int64_t nMaxWaitNanos;
+    int64_t nHoldNanos;
+    int64_t nMaxHoldNanos;
+
+    LockSiteStats();
+    void Add(const LockSiteStats& other);
+};
+
+/** Record one acquisition while profiling. Counters are kept per thread
+ * and only summed by GetLockProfile. */
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine,
+                       bool fContended, int64_t nWaitNanos, int64_t nHoldNanos);
+
+/** Counters of all sites recorded so far, by site. */
+std::vector<LockSiteStats> GetLockProfile();
+void ResetLockProfile();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class CMutexLock
@@ -106,17 +148,42 @@ class CMutexLock
 private:
     boost::unique_lock<Mutex> lock;
 
+    // Set when the lock is held and profiled.
+    const char* pszProfileName = nullptr;
+    const char* pszProfileFile;
+    int nProfileLine;
+    bool fProfileContended;
+    int64_t nProfileWait;
+    int64_t nProfileLocked;
+
+    void StartProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWait)
+    {
+        pszProfileName = pszName;
+        pszProfileFile = pszFile;
+        nProfileLine = nLine;
+        fProfileContended = fContended;
+        nProfileWait = nWait;
+        nProfileLocked = LockClockNanos();
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
-        if (!lock.try_lock()) {
-            PrintLockContention(pszName, pszFile, nLine);
-#endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+        const bool fProfile = fLockProfiling.load(std::memory_order_relaxed);
+        if (lock.try_lock()) {
+            if (fProfile)
+                StartProfile(pszName, pszFile, nLine, false, 0);
+            return;
         }
+#ifdef DEBUG_LOCKCONTENTION
+        PrintLockContention(pszName, pszFile, nLine);
 #endif
+        const int64_t nStart = LockClockNanos();
+        lock.lock();
+        const int64_t nWait = LockClockNanos() - nStart;
+        AddLockWait(nWait);
+        if (fProfile)
+            StartProfile(pszName, pszFile, nLine, true, nWait);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -125,6 +192,8 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockProfiling.load(std::memory_order_relaxed))
+            StartProfile(pszName, pszFile, nLine, false, 0);
         return lock.owns_lock();
     }
 
@@ -150,8 +219,12 @@ public:
 
     ~CMutexLock()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (pszProfileName)
+                LockProfileRecord(pszProfileName, pszProfileFile, nProfileLine, fProfileContended,
+                                  nProfileWait, LockClockNanos() - nProfileLocked);
             LeaveCritical();
+        }
     }
 
     operator bool()
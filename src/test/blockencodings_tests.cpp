@@ -58,7 +58,7 @@ BOOST_AUTO_TEST_CASE(validate_compact_block) {
 
     // null tx in prefilled
     CompactBlock c = a;
-    c.prefilledtxn.at(0).tx = CTransaction();
+    c.prefilledtxn.at(0).tx = MakeTransactionRef();
     BOOST_CHECK_THROW(validateCompactBlock(c, currMaxBlockSize), std::invalid_argument);
 
     // overflowing index
@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemapper.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemapper_tests, TestingSetup)
+
+static CDiskBlockPos WriteBlock(const CBlock& block, int nFile, unsigned int nPos)
+{
+    CDiskBlockPos pos(nFile, nPos);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, Params().DBMagic()));
+    return pos;
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(blockfilemapper_remaps_grown_file)
+{
+    const CBlock& block = Params().GenesisBlock();
+    const size_t nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    BlockFileMapper mapper(2);
+
+    BOOST_CHECK(!mapper.Get(110, 1));
+
+    CDiskBlockPos pos1 = WriteBlock(block, 110, 0);
+    auto mapping = mapper.Get(110, pos1.nPos + nSize);
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(mapping->size, pos1.nPos + nSize);
+    BOOST_CHECK(mapper.Get(110, pos1.nPos + nSize) == mapping);
+
+    // Reading past the end maps the file again. The old mapping stays
+    // usable for as long as it is held.
+    CDiskBlockPos pos2 = WriteBlock(block, 110, pos1.nPos + nSize);
+    BOOST_CHECK(!mapper.Get(110, pos2.nPos + nSize + 1));
+    auto grown = mapper.Get(110, pos2.nPos + nSize);
+    BOOST_REQUIRE(grown);
+    BOOST_CHECK(grown != mapping);
+    BOOST_CHECK(std::equal(mapping->data, mapping->data + mapping->size, grown->data));
+
+    // Least recently used files are unmapped first.
+    WriteBlock(block, 111, 0);
+    WriteBlock(block, 112, 0);
+    BOOST_CHECK(mapper.Get(111, 1));
+    BOOST_CHECK(mapper.Get(112, 1));
+    BOOST_CHECK(mapper.Get(110, 1) != grown);
+
+    auto invalidated = mapper.Get(112, 1);
+    mapper.Invalidate(112);
+    BOOST_CHECK(mapper.Get(112, 1) != invalidated);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk)
+{
+    const CBlock& block = Params().GenesisBlock();
+    CDiskBlockPos pos = WriteBlock(block, 113, 0);
+
+    const uint256 hash = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hash;
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus = BLOCK_HAVE_DATA;
+
+    std::vector<unsigned char> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, &index));
+    std::vector<unsigned char> expected;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, expected, 0) << block;
+    BOOST_CHECK(raw == expected);
+
+    CBlock read;
+    BOOST_CHECK(ReadBlockFromDisk(read, &index, Params().GetConsensus()));
+    BOOST_CHECK(read.GetHash() == hash);
+
+    // The header read has to match the index.
+    const uint256 other = GetRandHash();
+    index.phashBlock = &other;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &index));
+
+    index.nStatus = 0;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &index));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "net.h"
 #include "uint256.h"
 #include "protocol.h"
+#include "streams.h"
 #include "chain.h"
 #include "xthin.h"
 #include <string>
@@ -24,6 +25,7 @@ BOOST_AUTO_TEST_CASE(inv_type_check) {
     BOOST_CHECK(b.isBlockType(MSG_THINBLOCK));
     BOOST_CHECK(b.isBlockType(MSG_XTHINBLOCK));
     BOOST_CHECK(b.isBlockType(MSG_CMPCT_BLOCK));
+    BOOST_CHECK(b.isBlockType(MSG_GRAPHENEBLOCK));
     BOOST_CHECK(!b.isBlockType(MSG_TX));
 }
 
@@ -34,7 +36,7 @@ BOOST_AUTO_TEST_CASE(trigger_next_request) {
 
     struct BS : public BlockSender {
         // inherited to make method public
-        void triggerNextRequest(const CChain& active, const CInv& inv,
+        void triggerNextRequest(const CChainSnapshot& active, const CInv& inv,
                                 CConnman& connman, CNode& node) override {
             BlockSender::triggerNextRequest(active, inv, connman, node);
         }
@@ -115,6 +117,38 @@ BOOST_AUTO_TEST_CASE(send_msg_block) {
     BOOST_CHECK(connman.MsgWasSent(node, "block", 0));
 }
 
+struct BlockSenderRawDummy : public BlockSenderDummy {
+    BlockSenderRawDummy() : BlockSenderDummy(), blocksRead(0)
+    {
+    }
+
+    virtual bool readBlockFromDisk(CBlock& block, const CBlockIndex* pindex) {
+        ++blocksRead;
+        return BlockSenderDummy::readBlockFromDisk(block, pindex);
+    }
+    virtual bool readRawBlockFromDisk(std::vector<unsigned char>& raw, const CBlockIndex*) {
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, raw, 0) << readBlock;
+        return true;
+    }
+    int blocksRead;
+};
+
+// Full blocks are sent as stored, without deserializing them.
+BOOST_AUTO_TEST_CASE(send_msg_block_raw) {
+    CBlockIndex index;
+    BlockSenderRawDummy bs;
+    DummyConnman connman;
+    DummyNode node;
+
+    bs.sendBlock(connman, node, index, MSG_BLOCK, index.nHeight);
+    BOOST_CHECK(connman.MsgWasSent(node, "block", 0));
+    BOOST_CHECK_EQUAL(0, bs.blocksRead);
+
+    // Other encodings need the block.
+    bs.sendBlock(connman, node, index, MSG_XTHINBLOCK, index.nHeight);
+    BOOST_CHECK_EQUAL(1, bs.blocksRead);
+}
+
 // We don't support this message, so we fallback to sending
 // full block instead.
 BOOST_AUTO_TEST_CASE(send_msg_thinblock) {
@@ -145,14 +179,31 @@ BOOST_AUTO_TEST_CASE(send_msg_xthinblock) {
     DummyNode node2;
     bs.readBlock = TestBlock2();
     CBloomFilter* filter = new CBloomFilter(3, 0.01, 2147483649UL, BLOOM_UPDATE_ALL);
-    filter->insert(bs.readBlock.vtx[0].GetHash());
-    filter->insert(bs.readBlock.vtx[1].GetHash());
-    filter->insert(bs.readBlock.vtx[2].GetHash());
+    filter->insert(bs.readBlock.vtx[0]->GetHash());
+    filter->insert(bs.readBlock.vtx[1]->GetHash());
+    filter->insert(bs.readBlock.vtx[2]->GetHash());
     node2.xthinFilter.reset(filter);
     bs.sendBlock(connman, node2, index, MSG_XTHINBLOCK, index.nHeight);
     BOOST_CHECK(connman.MsgWasSent(node2, "xthinblock", 0));
 }
 
+BOOST_AUTO_TEST_CASE(send_msg_grapheneblock) {
+    CBlockIndex index;
+    index.nHeight = 100;
+    BlockSenderDummy bs;
+    DummyConnman connman;
+
+    DummyNode node;
+    node.nGrapheneMempoolTxs = 100;
+    bs.sendBlock(connman, node, index, MSG_GRAPHENEBLOCK, index.nHeight);
+    BOOST_CHECK(connman.MsgWasSent(node, "graphene", 0));
+
+    // Too deep, send full block.
+    DummyNode node2;
+    bs.sendBlock(connman, node2, index, MSG_GRAPHENEBLOCK, index.nHeight + 10);
+    BOOST_CHECK(connman.MsgWasSent(node2, "block", 0));
+}
+
 BOOST_AUTO_TEST_CASE(send_msg_filteredblock) {
     CBlockIndex index;
     BlockSenderDummy bs;
@@ -170,8 +221,8 @@ BOOST_AUTO_TEST_CASE(send_msg_xblocktx) {
     CBlock block = TestBlock1();
 
     std::set<uint64_t> requesting;
-    requesting.insert(block.vtx[1].GetHash().GetCheapHash());
-    requesting.insert(block.vtx[2].GetHash().GetCheapHash());
+    requesting.insert(block.vtx[1]->GetHash().GetCheapHash());
+    requesting.insert(block.vtx[2]->GetHash().GetCheapHash());
     XThinReRequest req;
     req.txRequesting = requesting;
     bs.sendReReqReponse(connman, node, index, req, 1);
@@ -270,7 +321,7 @@ BOOST_AUTO_TEST_CASE(msg_blocktxn_depth) {
 
 BOOST_AUTO_TEST_CASE(msg_xblocktx_depth) {
     XThinReRequest req;
-    req.txRequesting = { TestBlock1().vtx[1].GetHash().GetCheapHash() };
+    req.txRequesting = { TestBlock1().vtx[1]->GetHash().GetCheapHash() };
 
     checkReReq(req, "xblocktx");
 }
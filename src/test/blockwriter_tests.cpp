@@ -0,0 +1,115 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockwriter.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockwriter_tests, TestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    auto block = std::make_shared<CBlock>();
+    block->nNonce = nNonce;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nNonce;
+    tx.vout.resize(1);
+    block->vtx.push_back(MakeTransactionRef(tx));
+    return block;
+}
+
+static CBlock ReadFromFile(const CDiskBlockPos& pos)
+{
+    CBlock block;
+    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    file >> block;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockwriter_write_and_flush)
+{
+    // Without a writer thread, blocks are written by Flush().
+    const size_t nSize = ::GetSerializeSize(*MakeBlock(0), SER_DISK, CLIENT_VERSION);
+    BlockWriter writer(100 * nSize);
+
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    std::vector<CDiskBlockPos> positions;
+    CDiskBlockPos pos(100, 0);
+    for (uint32_t i = 0; i < 10; ++i) {
+        blocks.push_back(MakeBlock(i));
+        CDiskBlockPos blockPos = pos;
+        writer.Write(blocks.back(), nSize, blockPos, Params().DBMagic());
+        BOOST_CHECK_EQUAL(blockPos.nPos, pos.nPos + 8);
+        positions.push_back(blockPos);
+        pos.nPos += nSize + 8;
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+        BOOST_CHECK(writer.Get(positions[i]) == blocks[i]);
+    BOOST_CHECK(!writer.Get(CDiskBlockPos(100, 0)));
+
+    BOOST_CHECK(writer.Flush());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        BOOST_CHECK(ReadFromFile(positions[i]).GetHash() == blocks[i]->GetHash());
+
+    // Written blocks stay available from memory within the budget.
+    BOOST_CHECK(writer.Get(positions[0]) == blocks[0]);
+    writer.Clear();
+    BOOST_CHECK(!writer.Get(positions[0]));
+}
+
+BOOST_AUTO_TEST_CASE(blockwriter_budget)
+{
+    // A full queue makes Write() write on the calling thread, and written
+    // blocks beyond the budget are dropped from memory, oldest first.
+    const size_t nSize = ::GetSerializeSize(*MakeBlock(0), SER_DISK, CLIENT_VERSION);
+    BlockWriter writer(3 * nSize);
+
+    std::vector<CDiskBlockPos> positions;
+    CDiskBlockPos pos(101, 0);
+    for (uint32_t i = 0; i < 10; ++i) {
+        CDiskBlockPos blockPos = pos;
+        writer.Write(MakeBlock(i), nSize, blockPos, Params().DBMagic());
+        positions.push_back(blockPos);
+        pos.nPos += nSize + 8;
+    }
+    BOOST_CHECK(!writer.Get(positions[0]));
+    BOOST_CHECK(writer.Get(positions[9]));
+    BOOST_CHECK_EQUAL(ReadFromFile(positions[0]).nNonce, 0);
+    BOOST_CHECK(writer.Flush());
+    BOOST_CHECK_EQUAL(ReadFromFile(positions[9]).nNonce, 9);
+}
+
+BOOST_AUTO_TEST_CASE(blockwriter_thread)
+{
+    const size_t nSize = ::GetSerializeSize(*MakeBlock(0), SER_DISK, CLIENT_VERSION);
+    BlockWriter writer(100 * nSize);
+    boost::thread thread(&BlockWriter::Thread, &writer);
+
+    std::vector<CDiskBlockPos> positions;
+    CDiskBlockPos pos(102, 0);
+    for (uint32_t i = 0; i < 20; ++i) {
+        CDiskBlockPos blockPos = pos;
+        writer.Write(MakeBlock(i), nSize, blockPos, Params().DBMagic());
+        positions.push_back(blockPos);
+        pos.nPos += nSize + 8;
+    }
+    BOOST_CHECK(writer.Flush());
+    for (uint32_t i = 0; i < positions.size(); ++i)
+        BOOST_CHECK_EQUAL(ReadFromFile(positions[i]).nNonce, i);
+
+    thread.interrupt();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
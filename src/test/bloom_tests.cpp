@@ -541,4 +541,44 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rotating_bloom)
+{
+    // 100 entries in two generations of 50, 1% false positive:
+    CRotatingBloomFilter rb(100, 0.01, 0, BLOOM_UPDATE_ALL);
+    BOOST_CHECK(rb.GetFilter().IsEmpty());
+
+    std::vector<uint256> data;
+    for (int i = 0; i < 175; i++) {
+        data.push_back(GetRandHash());
+        rb.insert(data.back());
+    }
+    // The last 75 are in the current and previous generation, and so is
+    // the filter sent to peers.
+    CBloomFilter filter = rb.GetFilter();
+    for (int i = 100; i < 175; i++) {
+        BOOST_CHECK(rb.contains(data[i]));
+        BOOST_CHECK(filter.contains(data[i]));
+    }
+    // The first 50 were rotated out:
+    unsigned int nHits = 0;
+    for (int i = 0; i < 50; i++) {
+        if (filter.contains(data[i]))
+            ++nHits;
+    }
+    BOOST_CHECK(nHits < 10);
+
+    // Sent as a plain CBloomFilter, within protocol limits
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << filter;
+    CBloomFilter received;
+    stream >> received;
+    received.UpdateEmptyFull();
+    BOOST_CHECK(received.IsWithinSizeConstraints());
+    BOOST_CHECK(received.contains(data[174]));
+
+    rb.clear();
+    BOOST_CHECK(!rb.contains(data[174]));
+    BOOST_CHECK(rb.GetFilter().IsEmpty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
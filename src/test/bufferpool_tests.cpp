@@ -0,0 +1,138 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/bufferpool.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "protocol.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(bufferpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(bufferpool_recycles_by_size_class)
+{
+    CBufferPool pool(1024 * 1024);
+
+    void* a = pool.Allocate(3000);
+    BOOST_CHECK(!pool.HasFree(3000));
+    pool.Free(a, 3000);
+    // 3000 and 4096 bytes share a size class, 5000 bytes don't.
+    BOOST_CHECK(pool.HasFree(4096));
+    BOOST_CHECK(!pool.HasFree(5000));
+
+    void* b = pool.Allocate(4096);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(!pool.HasFree(4096));
+    pool.Free(b, 4096);
+
+    CBufferPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAllocs, 2u);
+    BOOST_CHECK_EQUAL(stats.nReused, 1u);
+    BOOST_CHECK_EQUAL(stats.nFreeBytes, 4096u);
+
+    // Small requests bypass the pool.
+    void* c = pool.Allocate(100);
+    pool.Free(c, 100);
+    BOOST_CHECK_EQUAL(pool.GetStats().nAllocs, 2u);
+    BOOST_CHECK(!pool.HasFree(100));
+
+    pool.Clear();
+    BOOST_CHECK_EQUAL(pool.GetStats().nFreeBytes, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(bufferpool_byte_limit)
+{
+    CBufferPool pool(64 * 1024);
+
+    void* a = pool.Allocate(64 * 1024);
+    void* b = pool.Allocate(64 * 1024);
+    pool.Free(a, 64 * 1024);
+    pool.Free(b, 64 * 1024);
+    // Only one of them fits within the limit.
+    BOOST_CHECK_EQUAL(pool.GetStats().nFreeBytes, 64u * 1024);
+
+    void* c = pool.Allocate(2 * 64 * 1024);
+    pool.Free(c, 2 * 64 * 1024);
+    BOOST_CHECK(!pool.HasFree(2 * 64 * 1024));
+}
+
+BOOST_AUTO_TEST_CASE(pooled_datastream)
+{
+    CBufferPool pool(1024 * 1024);
+    CDataStream::allocator_type alloc(&pool);
+    {
+        CDataStream ss(alloc, SER_NETWORK, PROTOCOL_VERSION);
+        ss.reserve(10000);
+        ss << uint32_t(42);
+
+        // Copies don't take memory from the pool.
+        CDataStream copy(ss);
+        BOOST_CHECK(copy.begin() != ss.begin());
+        uint32_t n;
+        copy >> n;
+        BOOST_CHECK_EQUAL(n, 42u);
+
+        // Moving streams hands over their buffers, pool included.
+        CDataStream other(SER_NETWORK, PROTOCOL_VERSION);
+        other << uint8_t(1);
+        const char* pData = &ss[0];
+        std::swap(ss, other);
+        BOOST_CHECK(&other[0] == pData);
+        BOOST_CHECK_EQUAL(ss.size(), 1u);
+    }
+    BOOST_CHECK(pool.HasFree(10000));
+    BOOST_CHECK_EQUAL(pool.GetStats().nAllocs, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(receive_into_pooled_buffer)
+{
+    std::vector<unsigned char> payload(300 * 1000);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload[i] = i * 7;
+
+    CMessageHeader hdr(Params().NetworkMagic(), NetMsgType::BLOCK, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream wire(SER_NETWORK, PROTOCOL_VERSION);
+    wire << hdr;
+    wire.write((const char*)payload.data(), payload.size());
+
+    CAddress addr(CService("127.0.0.1", 8333));
+    std::unique_ptr<CNode> node(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0));
+
+    // Arrives in uneven pieces, splitting the header.
+    bool fComplete = false;
+    const size_t vSplits[] = {10, 24, 1000, 100 * 1000, wire.size()};
+    size_t nPos = 0;
+    for (size_t nEnd : vSplits) {
+        BOOST_CHECK(!fComplete);
+        BOOST_CHECK(node->ReceiveMsgBytes(&wire[nPos], nEnd - nPos, fComplete));
+        nPos = nEnd;
+    }
+    BOOST_CHECK(fComplete);
+    BOOST_REQUIRE_EQUAL(node->vRecvMsg.size(), 1u);
+
+    const CNetMessage& msg = node->vRecvMsg.front();
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK_EQUAL(msg.vRecv.size(), payload.size());
+    BOOST_CHECK(memcmp(&msg.vRecv[0], payload.data(), payload.size()) == 0);
+
+    // Dropping the message returns its buffer for the next one.
+    node->vRecvMsg.clear();
+    BOOST_CHECK(RecvBufferPool().HasFree(payload.size()));
+    BOOST_CHECK(node->ReceiveMsgBytes(&wire[0], wire.size(), fComplete));
+    BOOST_CHECK(fComplete);
+    BOOST_CHECK(node->vRecvMsg.front().GetMessageHash() == hash);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
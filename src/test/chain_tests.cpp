@@ -7,6 +7,7 @@
 #include "consensus/consensus.h" // for MAX_BLOCK_SIZE
 
 #include <boost/test/unit_test.hpp>
+#include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(cchain_tests, BasicTestingSetup);
 
@@ -73,4 +74,47 @@ BOOST_AUTO_TEST_CASE(tip_max_blocksize) {
     BOOST_CHECK_EQUAL(3 * MAX_BLOCK_SIZE, chain.MaxBlockSizeInsecure());
 }
 
+BOOST_AUTO_TEST_CASE(snapshot_matches_chain) {
+    // A main chain of 100 blocks and a fork off height 50.
+    std::vector<CBlockIndex> main(100);
+    std::vector<CBlockIndex> fork(20);
+    for (size_t i = 0; i < main.size(); ++i) {
+        main[i].nHeight = i;
+        main[i].pprev = i ? &main[i - 1] : nullptr;
+        main[i].BuildSkip();
+    }
+    for (size_t i = 0; i < fork.size(); ++i) {
+        fork[i].nHeight = 51 + i;
+        fork[i].pprev = i ? &fork[i - 1] : &main[50];
+        fork[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&main.back());
+    CChainSnapshot snapshot(chain);
+
+    BOOST_CHECK(snapshot.Tip() == chain.Tip());
+    BOOST_CHECK_EQUAL(snapshot.Height(), chain.Height());
+    for (int h = -1; h <= chain.Height() + 1; ++h)
+        BOOST_CHECK(snapshot[h] == chain[h]);
+    BOOST_CHECK(snapshot.Contains(&main[70]));
+    BOOST_CHECK(!snapshot.Contains(&fork[5]));
+    BOOST_CHECK(snapshot.Next(&main[70]) == &main[71]);
+    BOOST_CHECK(snapshot.Next(&main.back()) == nullptr);
+    BOOST_CHECK(snapshot.Next(&fork[5]) == nullptr);
+    BOOST_CHECK(snapshot.FindFork(&fork.back()) == chain.FindFork(&fork.back()));
+    BOOST_CHECK(snapshot.FindFork(&fork.back()) == &main[50]);
+    BOOST_CHECK(snapshot.FindFork(&main[30]) == &main[30]);
+
+    // The snapshot keeps its view when the chain switches to the fork.
+    chain.SetTip(&fork.back());
+    BOOST_CHECK(snapshot.Contains(&main[70]));
+    BOOST_CHECK(snapshot.Tip() == &main.back());
+
+    CChainSnapshot empty;
+    BOOST_CHECK_EQUAL(-1, empty.Height());
+    BOOST_CHECK(empty[0] == nullptr);
+    BOOST_CHECK(empty.FindFork(&main[10]) == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -5,6 +5,7 @@
 #include "clientversion.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "random.h"
 #include "test/test_bitcoin.h"
 #include "utiltime.h"
 
@@ -62,4 +63,40 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(parallel_transaction_checks)
+{
+    // Large blocks have their transactions checked in parallel chunks. A
+    // failure must still come with the reject reason of the serial check.
+    mapArgs["-par"] = "3";
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < 1200; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, false, false));
+
+    CMutableTransaction bad(*block.vtx[900]);
+    bad.vin.push_back(bad.vin[0]);
+    block.vtx[900] = MakeTransactionRef(bad);
+    BOOST_CHECK(!CheckBlock(block, state, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    mapArgs.erase("-par");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
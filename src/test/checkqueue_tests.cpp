@@ -0,0 +1,148 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace {
+
+struct CountingCheck
+{
+    std::atomic<int>* counter;
+    bool fOk;
+
+    CountingCheck() : counter(nullptr), fOk(true) {}
+    CountingCheck(std::atomic<int>* counterIn, bool fOkIn) : counter(counterIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        ++*counter;
+        return fOk;
+    }
+
+    void swap(CountingCheck& check)
+    {
+        std::swap(counter, check.counter);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+typedef CCheckQueue<CountingCheck> CountingQueue;
+
+std::vector<CountingCheck> MakeChecks(std::atomic<int>& counter, size_t n, size_t nFail = -1)
+{
+    std::vector<CountingCheck> vChecks;
+    for (size_t i = 0; i < n; ++i)
+        vChecks.emplace_back(&counter, i != nFail);
+    return vChecks;
+}
+
+struct Workers
+{
+    boost::thread_group threads;
+
+    Workers(CountingQueue& queue, int n)
+    {
+        for (int i = 0; i < n; ++i)
+            threads.create_thread(boost::bind(&CountingQueue::Thread, boost::ref(queue)));
+    }
+
+    ~Workers()
+    {
+        threads.interrupt_all();
+        threads.join_all();
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers)
+{
+    // Without worker threads the waiting thread runs everything.
+    CountingQueue queue(16);
+    std::atomic<int> counter(0);
+    CCheckQueueControl<CountingCheck> control(&queue);
+    std::vector<CountingCheck> vChecks = MakeChecks(counter, 100);
+    control.Add(vChecks);
+    BOOST_CHECK(control.Wait());
+    BOOST_CHECK_EQUAL(counter, 100);
+    BOOST_CHECK_EQUAL(control.Checks(), 100);
+    BOOST_CHECK_EQUAL(control.Steals(), 100);
+    BOOST_CHECK_EQUAL(queue.GetStats().nChecks, 100);
+
+    // A null queue ignores the checks, as callers ran them already.
+    CCheckQueueControl<CountingCheck> none(nullptr);
+    vChecks = MakeChecks(counter, 10);
+    none.Add(vChecks);
+    BOOST_CHECK(none.Wait());
+    BOOST_CHECK_EQUAL(counter, 100);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CountingQueue queue(16);
+    Workers workers(queue, 3);
+    for (size_t nFail : {size_t(0), size_t(500), size_t(999)}) {
+        std::atomic<int> counter(0);
+        CCheckQueueControl<CountingCheck> control(&queue);
+        for (size_t i = 0; i < 1000; i += 100) {
+            std::vector<CountingCheck> vChecks = MakeChecks(counter, 100, nFail - i);
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+        // Checks after a failure may be skipped, but all are accounted for.
+        BOOST_CHECK(counter <= 1000);
+        BOOST_CHECK_EQUAL(control.Checks(), 1000);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_concurrent_controls)
+{
+    // Several threads share the pool; every control only waits for and
+    // reports on its own checks.
+    CountingQueue queue(16);
+    Workers workers(queue, 4);
+    const int nThreads = 4;
+    std::vector<std::atomic<int>> counters(nThreads);
+    std::vector<char> results(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            bool fOk = true;
+            for (int round = 0; round < 50; ++round) {
+                CCheckQueueControl<CountingCheck> control(&queue);
+                for (int i = 0; i < 10; ++i) {
+                    std::vector<CountingCheck> vChecks = MakeChecks(counters[t], 20, t == 0 && round == 25 ? 7 : -1);
+                    control.Add(vChecks);
+                }
+                bool fExpected = !(t == 0 && round == 25);
+                fOk &= control.Wait() == fExpected && control.Checks() == 200;
+            }
+            results[t] = fOk;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (int t = 0; t < nThreads; ++t) {
+        BOOST_CHECK(results[t]);
+        if (t != 0)
+            BOOST_CHECK_EQUAL(counters[t], 50 * 200);
+    }
+    CountingQueue::Stats stats = queue.GetStats();
+    BOOST_CHECK(stats.nChecks == uint64_t(nThreads * 50 * 200));
+    BOOST_CHECK(stats.nBatches > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
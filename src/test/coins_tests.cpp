@@ -35,6 +35,7 @@ class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
     std::map<COutPoint, Coin> map_;
+    CUtxoCommit commit_;
 
 public:
     bool GetCoin(const COutPoint& outpoint, Coin& coin) const
@@ -53,7 +54,13 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool GetUtxoCommit(CUtxoCommit& commit) const override
+    {
+        commit = commit_;
+        return true;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUtxoCommit& commitDelta)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -68,6 +75,7 @@ public:
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
+        commit_.Add(commitDelta);
         return true;
     }
 };
@@ -98,6 +106,18 @@ public:
 
 BOOST_FIXTURE_TEST_SUITE(coins_tests, BasicTestingSetup)
 
+// Check the commitment maintained by the view against one computed from scratch.
+static void CheckUtxoCommit(const CCoinsView& view, const std::map<COutPoint, Coin>& result)
+{
+    CUtxoCommit expected, commit;
+    for (const auto& entry : result) {
+        if (!entry.second.IsSpent())
+            expected.Add(entry.first, entry.second);
+    }
+    BOOST_CHECK(view.GetUtxoCommit(commit));
+    BOOST_CHECK(commit == expected);
+}
+
 static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 
 // This is a large randomized insert/remove simulation test on a variable-size
@@ -207,6 +227,11 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             }
         }
 
+        // At the end, verify that the UTXO commitment was kept up to date.
+        if (i == NUM_SIMULATION_ITERATIONS - 1) {
+            CheckUtxoCommit(*stack.back(), result);
+        }
+
         if (insecure_rand() % 100 == 0) {
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && insecure_rand() % 2 == 0) {
@@ -429,6 +454,12 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             }
         }
 
+        // At the end, also verify the UTXO commitment, which overwritten
+        // duplicate coinbases must have left.
+        if (i == NUM_SIMULATION_ITERATIONS - 1) {
+            CheckUtxoCommit(*stack.back(), result);
+        }
+
         // One every 10 iterations, remove a random entry from the cache
         if (utxoset.size() > 1 && insecure_rand() % 30 == 0) {
             stack[insecure_rand() % stack.size()]->Uncache(FindRandomFrom(utxoset)->first);
@@ -589,7 +620,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    view.BatchWrite(map, {});
+    view.BatchWrite(map, {}, CUtxoCommit());
 }
 
 class SingleEntryCacheTest
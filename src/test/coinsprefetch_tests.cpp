@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "coins.h"
+#include "coinsprefetch.h"
+#include "primitives/block.h"
+#include "test/test_bitcoin.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+class CCoinsViewDummy : public CCoinsView {
+public:
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override {
+        auto it = coins.find(outpoint);
+        if (it == coins.end())
+            return false;
+        coin = it->second;
+        return true;
+    }
+    std::map<COutPoint, Coin> coins;
+};
+
+CMutableTransaction Spending(const std::vector<COutPoint>& prevouts) {
+    CMutableTransaction tx;
+    for (auto& p : prevouts)
+        tx.vin.push_back(CTxIn(p));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    return tx;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(collect_outpoints) {
+    COutPoint a(uint256S("0xaa"), 0);
+    COutPoint b(uint256S("0xbb"), 1);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(Spending({a, b})));
+    // Spends an output created in the same block, and a duplicate.
+    block.vtx.push_back(MakeTransactionRef(Spending({COutPoint(block.vtx[1]->GetHash(), 0), a})));
+
+    std::vector<COutPoint> outpoints = CollectPrefetchOutpoints(block);
+    BOOST_CHECK_EQUAL(2u, outpoints.size());
+    BOOST_CHECK(outpoints[0] == a);
+    BOOST_CHECK(outpoints[1] == b);
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_warms_cache) {
+    COutPoint a(uint256S("0xaa"), 0);
+    COutPoint b(uint256S("0xbb"), 0);
+
+    CCoinsViewDummy base;
+    CTxOut out(42, CScript() << OP_TRUE);
+    base.coins[a] = Coin(out, 100, false);
+
+    CCoinsViewCache cache(&base);
+    CoinsPrefetchStats stats = PrefetchCoins(cache, {a, b});
+    BOOST_CHECK_EQUAL(2u, stats.requested);
+    BOOST_CHECK_EQUAL(0u, stats.cached);
+    BOOST_CHECK_EQUAL(1u, stats.fetched);
+    BOOST_CHECK_EQUAL(1u, stats.missing);
+
+    BOOST_CHECK(cache.HaveCoinInCache(a));
+    BOOST_CHECK(!cache.HaveCoinInCache(b));
+    BOOST_CHECK_EQUAL(100u, cache.AccessCoin(a).nHeight);
+    BOOST_CHECK(cache.AccessCoin(a).out == out);
+
+    // Already cached outpoints are not fetched again.
+    stats = PrefetchCoins(cache, {a});
+    BOOST_CHECK_EQUAL(1u, stats.cached);
+    BOOST_CHECK_EQUAL(0u, stats.fetched);
+
+    // Warmed coins can be spent like any other cached coin.
+    BOOST_CHECK(cache.SpendCoin(a));
+    BOOST_CHECK(!cache.HaveCoin(a));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "coinstats.h"
+#include "main.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinstats_tests, TestingSetup)
+
+static void AddRandomCoins(CCoinsViewCache& cache, int count, CAmount& total)
+{
+    for (int n = 0; n < count; n++) {
+        const uint256 txid = GetRandHash();
+        // A few transactions with several outputs, to check that they are
+        // counted once.
+        const uint32_t outputs = n % 10 == 0 ? 3 : 1;
+        for (uint32_t i = 0; i < outputs; i++) {
+            CAmount value = 1 + GetRand(1000);
+            total += value;
+            cache.AddCoin(COutPoint(txid, i), Coin(CTxOut(value, CScript() << OP_TRUE), 1, false), false);
+        }
+    }
+}
+
+static bool Scan(CCoinsStats& stats, int threads)
+{
+    std::unique_ptr<CCoinsViewSnapshot> snapshot(pcoinsTip->Snapshot());
+    CCoinsStatsScan scan(std::move(snapshot));
+    bool ok = scan.Run(stats, threads);
+    BOOST_CHECK(!ok || scan.Progress() == 1.0);
+    return ok;
+}
+
+BOOST_AUTO_TEST_CASE(coinstats_sharded_scan)
+{
+    CAmount total = 0;
+    AddRandomCoins(*pcoinsTip, 1000, total);
+    pcoinsTip->SetBestBlock(GetRandHash());
+    BOOST_CHECK(pcoinsTip->Flush());
+
+    CCoinsStats single, parallel;
+    BOOST_CHECK(Scan(single, 1));
+    BOOST_CHECK(Scan(parallel, 4));
+
+    BOOST_CHECK_EQUAL(single.nTransactions, 1000U);
+    BOOST_CHECK_EQUAL(single.nTransactionOutputs, 1200U);
+    BOOST_CHECK_EQUAL(single.nTotalAmount, total);
+    BOOST_CHECK(single.hashBlock == pcoinsTip->GetBestBlock());
+
+    // The result does not depend on how shards are spread over threads.
+    BOOST_CHECK(single.hashSerialized == parallel.hashSerialized);
+    BOOST_CHECK(single.commit == parallel.commit);
+    BOOST_CHECK_EQUAL(single.nTotalAmount, parallel.nTotalAmount);
+
+    // The combined multisets equal the incrementally maintained commitment.
+    CUtxoCommit commit;
+    BOOST_CHECK(pcoinsTip->GetUtxoCommit(commit));
+    BOOST_CHECK(single.commit == commit);
+}
+
+BOOST_AUTO_TEST_CASE(coinstats_snapshot_isolation)
+{
+    CAmount total = 0;
+    AddRandomCoins(*pcoinsTip, 100, total);
+    pcoinsTip->SetBestBlock(GetRandHash());
+    BOOST_CHECK(pcoinsTip->Flush());
+    const uint256 hashBlock = pcoinsTip->GetBestBlock();
+
+    CCoinsStatsScan scan(std::unique_ptr<CCoinsViewSnapshot>(pcoinsTip->Snapshot()));
+
+    // Writes after the snapshot was taken are not seen by the scan.
+    CAmount ignored = 0;
+    AddRandomCoins(*pcoinsTip, 100, ignored);
+    pcoinsTip->SetBestBlock(GetRandHash());
+    BOOST_CHECK(pcoinsTip->Flush());
+
+    CCoinsStats stats;
+    BOOST_CHECK(scan.Run(stats, 2));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 100U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, total);
+    BOOST_CHECK(stats.hashBlock == hashBlock);
+}
+
+BOOST_AUTO_TEST_CASE(coinstats_interrupt)
+{
+    CAmount total = 0;
+    AddRandomCoins(*pcoinsTip, 10, total);
+    pcoinsTip->SetBestBlock(GetRandHash());
+    BOOST_CHECK(pcoinsTip->Flush());
+
+    CCoinsStatsScan scan(std::unique_ptr<CCoinsViewSnapshot>(pcoinsTip->Snapshot()));
+    scan.Interrupt();
+    CCoinsStats stats;
+    BOOST_CHECK(!scan.Run(stats, 2));
+    BOOST_CHECK(scan.Progress() < 1.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
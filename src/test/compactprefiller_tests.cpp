@@ -15,8 +15,8 @@ BOOST_AUTO_TEST_CASE(coinbase_only_test) {
     std::vector<PrefilledTransaction> prefilled = filler.fillFrom(block);
     BOOST_CHECK_EQUAL(size_t(1), prefilled.size());
     BOOST_CHECK_EQUAL(
-            block.vtx.at(0).GetHash().ToString(),
-            prefilled.at(0).tx.GetHash().ToString());
+            block.vtx.at(0)->GetHash().ToString(),
+            prefilled.at(0).tx->GetHash().ToString());
 }
 
 BOOST_AUTO_TEST_CASE(inventory_known_test) {
@@ -24,9 +24,9 @@ BOOST_AUTO_TEST_CASE(inventory_known_test) {
     CBlock block = TestBlock1();
 
     // Transactions that we know that peer knows about.
-    uint256 known1 = block.vtx[2].GetHash();
-    uint256 known2 = block.vtx[3].GetHash();
-    uint256 known3 = block.vtx[5].GetHash();
+    uint256 known1 = block.vtx[2]->GetHash();
+    uint256 known2 = block.vtx[3]->GetHash();
+    uint256 known3 = block.vtx[5]->GetHash();
 
     std::unique_ptr<CRollingBloomFilter> inventoryKnown(new CRollingBloomFilter(100, 0.000001));
 
@@ -42,9 +42,9 @@ BOOST_AUTO_TEST_CASE(inventory_known_test) {
 
     // inventoryKnown should not be included
     auto findFunc = [&known1, &known2, &known3](const PrefilledTransaction& tx) {
-        return tx.tx.GetHash() == known1
-            || tx.tx.GetHash() == known2
-            || tx.tx.GetHash() == known3;
+        return tx.tx->GetHash() == known1
+            || tx.tx->GetHash() == known2
+            || tx.tx->GetHash() == known3;
     };
     auto res = std::find_if(
             begin(prefilled), end(prefilled), findFunc);
@@ -57,17 +57,17 @@ BOOST_AUTO_TEST_CASE(inventory_known_test) {
     BOOST_CHECK_EQUAL(prefilled.at(3).index, 1);
 }
 
-unsigned int sumTx(std::vector<CTransaction>& txs) {
+unsigned int sumTx(std::vector<CTransactionRef>& txs) {
     unsigned int sum = 0;
     for (auto& t : txs)
-        sum += ::GetSerializeSize(t, SER_NETWORK, PROTOCOL_VERSION);
+        sum += ::GetSerializeSize(*t, SER_NETWORK, PROTOCOL_VERSION);
     return sum;
 }
 
 unsigned int sumTx(std::vector<PrefilledTransaction>& txs) {
     unsigned int sum = 0;
     for (auto& t : txs)
-        sum += ::GetSerializeSize(t.tx, SER_NETWORK, PROTOCOL_VERSION);
+        sum += ::GetSerializeSize(*t.tx, SER_NETWORK, PROTOCOL_VERSION);
     return sum;
 }
 
@@ -79,9 +79,9 @@ BOOST_AUTO_TEST_CASE(prefill_dont_exceed_10kb) {
 
     // Block with ~20KB tx
     while (sumTx(block.vtx) < 20 * 1000 /* 20 KB */) {
-        CMutableTransaction newTx(block.vtx.back());
+        CMutableTransaction newTx(*block.vtx.back());
         newTx.vin[0].prevout.hash = GetRandHash();
-        block.vtx.push_back(CTransaction(newTx));
+        block.vtx.push_back(MakeTransactionRef(std::move(newTx)));
     }
 
     // Filter matches nothing, should prefill as much as possible.
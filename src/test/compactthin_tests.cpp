@@ -34,7 +34,7 @@ BOOST_AUTO_TEST_CASE(stub_tx_hashtypes) {
     // Coinbase should have full hash.
     BOOST_CHECK(all.at(0).hasFull());
     BOOST_CHECK_EQUAL(
-            block.vtx.at(0).GetHash().ToString(),
+            block.vtx.at(0)->GetHash().ToString(),
             all.at(0).full().ToString());
 
     // All others should only have an obfuscated "short id" (we
@@ -44,7 +44,7 @@ BOOST_AUTO_TEST_CASE(stub_tx_hashtypes) {
         if (all.at(i).hasFull())
             std::cerr << all.at(i).full().ToString() << std::endl;
         BOOST_CHECK(!all.at(i).hasCheap());
-        BOOST_CHECK(all.at(i).equals(block.vtx.at(i).GetHash()));
+        BOOST_CHECK(all.at(i).equals(block.vtx.at(i)->GetHash()));
     }
 }
 
@@ -57,7 +57,7 @@ BOOST_AUTO_TEST_CASE(ids_are_correct) {
         if (i == 3 || i == 5)
             continue;
 
-        inventoryKnown->insert(testblock.vtx[i].GetHash());
+        inventoryKnown->insert(testblock.vtx[i]->GetHash());
     }
 
     CompactBlock thin(testblock, InventoryKnownPrefiller(std::move(inventoryKnown)));
@@ -70,13 +70,13 @@ BOOST_AUTO_TEST_CASE(ids_are_correct) {
     for (size_t i = 0; i < all.size(); ++i) {
         if (i == 0 || i == 3 || i == 5) {
             BOOST_CHECK_EQUAL(
-                    testblock.vtx[i].GetHash().ToString(),
+                    testblock.vtx[i]->GetHash().ToString(),
                     all[i].full().ToString());
             continue;
         }
         uint64_t shortID = GetShortID(
                 thin.shorttxidk0, thin.shorttxidk1,
-                testblock.vtx[i].GetHash());
+                testblock.vtx[i]->GetHash());
 
         BOOST_CHECK_EQUAL(shortID, all[i].shortid());
     }
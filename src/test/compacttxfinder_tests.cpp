@@ -20,9 +20,9 @@ BOOST_AUTO_TEST_CASE(compacttxfinder_test) {
     TestMemPoolEntryHelper entry;
 
     CBlock block = TestBlock1();
-    mpool.addUnchecked(block.vtx[1].GetHash(), entry.FromTx(block.vtx[1]));
-    mpool.addUnchecked(block.vtx[2].GetHash(), entry.FromTx(block.vtx[2]));
-    mpool.addUnchecked(block.vtx[3].GetHash(), entry.FromTx(block.vtx[3]));
+    mpool.addUnchecked(block.vtx[1]->GetHash(), entry.FromTx(block.vtx[1]));
+    mpool.addUnchecked(block.vtx[2]->GetHash(), entry.FromTx(block.vtx[2]));
+    mpool.addUnchecked(block.vtx[3]->GetHash(), entry.FromTx(block.vtx[3]));
 
     CompactBlock cmpct(block, CoinbaseOnlyPrefiller());
     CompactStub stub(cmpct);
@@ -33,23 +33,23 @@ BOOST_AUTO_TEST_CASE(compacttxfinder_test) {
 
     // Should find the txs in mpool
     BOOST_CHECK_EQUAL(
-            block.vtx[1].GetHash().ToString(),
-            finder(all[1]).GetHash().ToString());
+            block.vtx[1]->GetHash().ToString(),
+            finder(all[1])->GetHash().ToString());
     BOOST_CHECK_EQUAL(
-            block.vtx[2].GetHash().ToString(),
-            finder(all[2]).GetHash().ToString());
+            block.vtx[2]->GetHash().ToString(),
+            finder(all[2])->GetHash().ToString());
     BOOST_CHECK_EQUAL(
-            block.vtx[3].GetHash().ToString(),
-            finder(all[3]).GetHash().ToString());
+            block.vtx[3]->GetHash().ToString(),
+            finder(all[3])->GetHash().ToString());
 
     // Should not find txs not in mempool
-    BOOST_CHECK(finder(all[4]).IsNull());
+    BOOST_CHECK(!finder(all[4]));
 
     // If tx is erased from mempool, it should not be found
     LOCK(mpool.cs);
-    auto i = mpool.mapTx.find(block.vtx[1].GetHash());
+    auto i = mpool.mapTx.find(block.vtx[1]->GetHash());
     mpool.mapTx.erase(i);
-    BOOST_CHECK(finder(all[1]).IsNull());
+    BOOST_CHECK(!finder(all[1]));
 }
 
 
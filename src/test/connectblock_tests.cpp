@@ -0,0 +1,278 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "checkqueue.h"
+#include "coins.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "script/interpreter.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "undo.h"
+#include "version.h"
+
+#include <map>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+class CCoinsViewMap : public CCoinsView {
+public:
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override {
+        auto it = coins.find(outpoint);
+        if (it == coins.end())
+            return false;
+        coin = it->second;
+        return true;
+    }
+    std::map<COutPoint, Coin> coins;
+};
+
+const int CHAIN_HEIGHT = 120;
+
+// Spends of a P2SH output of this script count sigops, yet the script
+// passes.
+CScript SigOpsScript(int nSigOps) {
+    CScript script;
+    for (int i = 0; i < nSigOps; ++i)
+        script << OP_0 << OP_0 << OP_CHECKSIG << OP_DROP;
+    return script << OP_TRUE;
+}
+
+/**
+ * Random blocks spending a random UTXO set and each other, some of them
+ * invalid in one of the ways ConnectBlock catches.
+ */
+struct BlockGenerator {
+    struct Spendable {
+        COutPoint outpoint;
+        CAmount nValue;
+        CScript redeemScript; // empty if not P2SH
+    };
+
+    CCoinsViewMap utxo;
+    std::vector<Spendable> pool;
+    std::vector<COutPoint> spent;
+
+    CScript RandomScript(CScript& redeemScript) {
+        redeemScript.clear();
+        int r = insecure_rand() % 50;
+        if (r < 35)
+            return CScript() << OP_TRUE;
+        if (r < 49) {
+            redeemScript = SigOpsScript(1 + insecure_rand() % 30);
+            return GetScriptForDestination(CScriptID(redeemScript));
+        }
+        return CScript() << OP_FALSE;
+    }
+
+    void FillUTXO(size_t nCoins) {
+        for (size_t i = 0; i < nCoins; ++i) {
+            COutPoint outpoint(GetRandHash(), insecure_rand() % 3);
+            CScript redeemScript;
+            CTxOut out(1000 + insecure_rand() % 100000, RandomScript(redeemScript));
+            // Coinbases are mostly mature.
+            const bool fCoinBase = insecure_rand() % 5 == 0;
+            const int nHeight = fCoinBase
+                ? insecure_rand() % (CHAIN_HEIGHT - COINBASE_MATURITY + 1)
+                : insecure_rand() % CHAIN_HEIGHT;
+            utxo.coins.emplace(outpoint, Coin(out, nHeight, fCoinBase));
+            pool.push_back(Spendable{outpoint, out.nValue, redeemScript});
+        }
+    }
+
+    CTxIn SpendInput(const Spendable& s, int nVersion) {
+        CTxIn in(s.outpoint);
+        if (!s.redeemScript.empty())
+            in.scriptSig = CScript() << std::vector<unsigned char>(s.redeemScript.begin(), s.redeemScript.end());
+        if (nVersion >= 2 && insecure_rand() % 4 == 0)
+            in.nSequence = insecure_rand() % 20; // relative lock by height
+        return in;
+    }
+
+    CBlock Generate(size_t nTxs) {
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << insecure_rand();
+        coinbase.vout.resize(1);
+        coinbase.vout[0].nValue = 50 * COIN;
+        coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+        if (insecure_rand() % 10 == 0)
+            pool.push_back(Spendable{COutPoint(coinbase.GetHash(), 0), 50 * COIN, CScript()}); // immature
+
+        for (size_t t = 1; t < nTxs && !pool.empty(); ++t) {
+            CMutableTransaction tx;
+            tx.nVersion = 1 + insecure_rand() % 2;
+            CAmount nIn = 0;
+            const size_t nSpentBefore = spent.size();
+            const size_t nInputs = 1 + insecure_rand() % 3;
+            for (size_t i = 0; i < nInputs && !pool.empty(); ++i) {
+                const size_t n = insecure_rand() % pool.size();
+                tx.vin.push_back(SpendInput(pool[n], tx.nVersion));
+                nIn += pool[n].nValue;
+                spent.push_back(pool[n].outpoint);
+                pool.erase(pool.begin() + n);
+            }
+
+            switch (insecure_rand() % 40) {
+            case 0: // spent before
+                if (nSpentBefore)
+                    tx.vin.push_back(CTxIn(spent[insecure_rand() % nSpentBefore]));
+                break;
+            case 1: // does not exist
+                tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+                break;
+            case 2: // pays more than it spends
+                nIn *= 2;
+                break;
+            }
+
+            const size_t nOutputs = 1 + insecure_rand() % 3;
+            std::vector<CScript> redeemScripts(nOutputs);
+            for (size_t o = 0; o < nOutputs; ++o) {
+                CTxOut out(nIn / (nOutputs + 1), RandomScript(redeemScripts[o]));
+                if (insecure_rand() % 20 == 0)
+                    out = CTxOut(0, CScript() << OP_RETURN);
+                tx.vout.push_back(out);
+            }
+            for (size_t o = 0; o < nOutputs; ++o) {
+                if (insecure_rand() % 2)
+                    pool.push_back(Spendable{COutPoint(tx.GetHash(), o), tx.vout[o].nValue, redeemScripts[o]});
+            }
+            block.vtx.push_back(MakeTransactionRef(tx));
+        }
+
+        // Spend before creating.
+        if (block.vtx.size() > 2 && insecure_rand() % 10 == 0) {
+            size_t a = 1 + insecure_rand() % (block.vtx.size() - 1);
+            size_t b = 1 + insecure_rand() % (block.vtx.size() - 1);
+            std::swap(block.vtx[a], block.vtx[b]);
+        }
+        return block;
+    }
+};
+
+struct Outcome {
+    bool fValid;
+    std::string strRejectReason;
+    unsigned int nRejectCode;
+    int nDoS;
+    CAmount nFees;
+    std::string undo;
+    std::string coins;
+};
+
+Outcome Connect(bool fParallel, const CBlock& block, CCoinsView& base, const CBlockIndex& index,
+                const BlockConnectRules& rules, bool fDeferScripts)
+{
+    CCoinsViewCache view(&base);
+    CValidationState state;
+    CCheckQueueControl<CScriptCheck> control(NULL);
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+    CBlockUndo blockundo;
+    CAmount nFees = 0;
+
+    Outcome outcome;
+    outcome.fValid = fParallel
+        ? ConnectBlockTransactionsParallel(block, state, index, view, rules,
+                fDeferScripts ? &control : NULL, txdata, blockundo, nFees)
+        : ConnectBlockTransactions(block, state, index, view, rules,
+                fDeferScripts ? &control : NULL, txdata, blockundo, nFees);
+    outcome.strRejectReason = state.GetRejectReason();
+    outcome.nRejectCode = state.GetRejectCode();
+    outcome.nDoS = 0;
+    state.IsInvalid(outcome.nDoS);
+    outcome.nFees = outcome.fValid ? nFees : 0;
+
+    CDataStream undo(SER_DISK, CLIENT_VERSION);
+    if (outcome.fValid)
+        undo << blockundo;
+    outcome.undo = undo.str();
+
+    // A block that fails leaves the coins in an unspecified state.
+    CDataStream coins(SER_DISK, CLIENT_VERSION);
+    auto addCoin = [&coins, &view](const COutPoint& outpoint) {
+        const Coin& coin = view.AccessCoin(outpoint);
+        coins << coin.IsSpent();
+        if (!coin.IsSpent())
+            coins << coin;
+    };
+    for (auto& tx : block.vtx) {
+        if (!outcome.fValid)
+            break;
+        for (auto& in : tx->vin)
+            addCoin(in.prevout);
+        for (size_t o = 0; o < tx->vout.size(); ++o)
+            addCoin(COutPoint(tx->GetHash(), o));
+    }
+    outcome.coins = coins.str();
+    return outcome;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(connectblock_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(parallel_matches_serial)
+{
+    // Sequence locks look at the chain.
+    std::vector<CBlockIndex> chain(CHAIN_HEIGHT + 1);
+    for (int i = 0; i <= CHAIN_HEIGHT; ++i) {
+        chain[i].pprev = i ? &chain[i - 1] : NULL;
+        chain[i].nHeight = i;
+        chain[i].nTime = 1500000000 + 600 * i;
+    }
+    const CBlockIndex& index = chain.back();
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i)
+        threads.create_thread(&ThreadTxConnectCheck);
+
+    int nValid = 0;
+    std::set<std::string> reasons;
+    for (int trial = 0; trial < 300; ++trial) {
+        BlockGenerator gen;
+        gen.FillUTXO(40);
+        const CBlock block = gen.Generate(2 + insecure_rand() % 60);
+
+        BlockConnectRules rules;
+        rules.nScriptFlags = SCRIPT_VERIFY_P2SH;
+        rules.nLockTimeFlags = insecure_rand() % 2 ? LOCKTIME_VERIFY_SEQUENCE : 0;
+        rules.fStrictPayToScriptHash = true;
+        rules.fScriptChecks = insecure_rand() % 4 != 0;
+        rules.fCacheResults = false;
+        rules.nMaxSigOps = 100 + insecure_rand() % 1000;
+        const bool fDeferScripts = insecure_rand() % 2;
+
+        Outcome serial = Connect(false, block, gen.utxo, index, rules, fDeferScripts);
+        Outcome parallel = Connect(true, block, gen.utxo, index, rules, fDeferScripts);
+
+        BOOST_CHECK_EQUAL(serial.fValid, parallel.fValid);
+        BOOST_CHECK_EQUAL(serial.strRejectReason, parallel.strRejectReason);
+        BOOST_CHECK_EQUAL(serial.nRejectCode, parallel.nRejectCode);
+        BOOST_CHECK_EQUAL(serial.nDoS, parallel.nDoS);
+        BOOST_CHECK_EQUAL(serial.nFees, parallel.nFees);
+        BOOST_CHECK(serial.undo == parallel.undo);
+        BOOST_CHECK(serial.coins == parallel.coins);
+
+        nValid += serial.fValid;
+        reasons.insert(serial.strRejectReason);
+    }
+    threads.interrupt_all();
+    threads.join_all();
+
+    // The blocks cover both outcomes and several ways to be invalid.
+    BOOST_CHECK(nValid > 30);
+    BOOST_CHECK(reasons.size() > 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "test/test_random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -131,6 +132,50 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+static void TestSHA256D64(unsigned int backends) {
+    SHA256AutoDetect(backends);
+    // Odd count, so each SIMD width also leaves a tail for the generic path.
+    const size_t blocks = 8 + 4 + 3;
+    std::vector<unsigned char> in(64 * blocks);
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = insecure_rand();
+    std::vector<unsigned char> out(32 * blocks);
+    SHA256D64(out.data(), in.data(), blocks);
+    for (size_t i = 0; i < blocks; ++i) {
+        unsigned char expected[CHash256::OUTPUT_SIZE];
+        CHash256().Write(&in[64 * i], 64).Finalize(expected);
+        BOOST_CHECK(memcmp(expected, &out[32 * i], 32) == 0);
+    }
+    // In place, as used for merkle trees.
+    SHA256D64(in.data(), in.data(), blocks);
+    BOOST_CHECK(memcmp(in.data(), out.data(), out.size()) == 0);
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    TestSHA256D64(0);
+    TestSHA256D64(SHA256_SSE41);
+    TestSHA256D64(SHA256_AVX2);
+    TestSHA256D64(SHA256_SHANI);
+    TestSHA256D64(SHA256_ALL);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_backends) {
+    // The SHA extensions replace the generic transform for all hashing.
+    SHA256AutoDetect(0);
+    std::vector<unsigned char> data(1000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = insecure_rand();
+    unsigned char expected[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data.data(), data.size()).Finalize(expected);
+
+    SHA256AutoDetect(SHA256_SHANI);
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data.data(), data.size()).Finalize(hash);
+    BOOST_CHECK(memcmp(expected, hash, sizeof(hash)) == 0);
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
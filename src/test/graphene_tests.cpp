@@ -0,0 +1,219 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "graphene.h"
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+CTransactionRef RandomTx()
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000;
+    return MakeTransactionRef(tx);
+}
+
+CBlock RandomBlock(size_t nTxs)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << insecure_rand();
+    coinbase.vout.resize(1);
+
+    CBlock block;
+    block.nNonce = insecure_rand();
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 1; i < nTxs; ++i)
+        block.vtx.push_back(RandomTx());
+    return block;
+}
+
+GrapheneBlock RoundTrip(const GrapheneBlock& sent)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << sent;
+    GrapheneBlock received;
+    stream >> received;
+    return received;
+}
+
+// True if txs lists the transactions of the block, in order.
+bool Matches(const std::vector<ThinTx>& txs, const CBlock& block)
+{
+    if (txs.size() != block.vtx.size())
+        return false;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (!txs[i].equals(ThinTx(block.vtx[i]->GetHash())))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Two nodes with diverging mempools. The sender mines a block from its
+ * mempool and sends it to the receiver as a graphene block, sized for the
+ * receiver's mempool.
+ */
+struct GrapheneHarness {
+    struct Result {
+        double bytesPerTx;
+        double failureRate;
+    };
+
+    /**
+     * @param nBlockTxs Transactions in block
+     * @param nExtraTxs Transactions receiver has that are not in block
+     * @param divergence Share of the block's transactions receiver lacks
+     */
+    static Result Run(size_t nBlockTxs, size_t nExtraTxs, double divergence, int nTrials)
+    {
+        size_t nBytes = 0;
+        int nFailures = 0;
+        for (int trial = 0; trial < nTrials; ++trial) {
+            CBlock block = RandomBlock(nBlockTxs);
+
+            std::vector<uint256> receiverMempool;
+            const size_t nMissing = (nBlockTxs - 1) * divergence;
+            for (size_t i = 1 + nMissing; i < block.vtx.size(); ++i)
+                receiverMempool.push_back(block.vtx[i]->GetHash());
+            for (size_t i = 0; i < nExtraTxs; ++i)
+                receiverMempool.push_back(GetRandHash());
+            std::random_shuffle(receiverMempool.begin(), receiverMempool.end(),
+                    [](int n) { return insecure_rand() % n; });
+
+            GrapheneBlock sent(block, receiverMempool.size());
+            nBytes += GetSerializeSize(sent, SER_NETWORK, PROTOCOL_VERSION);
+            GrapheneBlock received = RoundTrip(sent);
+            received.selfValidate(MAX_BLOCK_SIZE);
+            try {
+                std::vector<ThinTx> txs = received.reconcile(receiverMempool);
+                BOOST_CHECK(Matches(txs, block));
+            }
+            catch (const graphene_decode_error&) {
+                ++nFailures;
+            }
+        }
+        return Result{double(nBytes) / (nTrials * nBlockTxs), double(nFailures) / nTrials};
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(graphene_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(graphene_reconcile)
+{
+    CBlock block = RandomBlock(300);
+    std::vector<uint256> mempool;
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        mempool.push_back(block.vtx[i]->GetHash());
+    for (int i = 0; i < 600; ++i)
+        mempool.push_back(GetRandHash());
+
+    GrapheneBlock gblock = RoundTrip(GrapheneBlock(block, mempool.size()));
+    BOOST_CHECK_NO_THROW(gblock.selfValidate(MAX_BLOCK_SIZE));
+    BOOST_CHECK(!gblock.order.empty());
+    std::vector<ThinTx> txs = gblock.reconcile(mempool);
+    BOOST_CHECK(Matches(txs, block));
+    for (const ThinTx& tx : txs)
+        BOOST_CHECK(tx.hasFull());
+
+    // Transactions receiver does not have are listed by cheap hash.
+    mempool.erase(mempool.begin(), mempool.begin() + 2);
+    txs = gblock.reconcile(mempool);
+    BOOST_CHECK(Matches(txs, block));
+    BOOST_CHECK(!txs[1].hasFull() && txs[1].cheap() == block.vtx[1]->GetHash().GetCheapHash());
+    BOOST_CHECK(!txs[2].hasFull());
+    BOOST_CHECK(txs[3].hasFull());
+
+    // Too different to decode.
+    mempool.erase(mempool.begin(), mempool.begin() + 100);
+    BOOST_CHECK_THROW(gblock.reconcile(mempool), graphene_decode_error);
+}
+
+BOOST_AUTO_TEST_CASE(graphene_canonical_order)
+{
+    CBlock block = RandomBlock(100);
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+            [](const CTransactionRef& a, const CTransactionRef& b) {
+                const uint256& ha = a->GetHash();
+                const uint256& hb = b->GetHash();
+                return std::lexicographical_compare(ha.begin(), ha.end(), hb.begin(), hb.end());
+            });
+    std::vector<uint256> mempool;
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        mempool.push_back(block.vtx[i]->GetHash());
+
+    // No order needs to be sent.
+    GrapheneBlock gblock = RoundTrip(GrapheneBlock(block, mempool.size()));
+    BOOST_CHECK(gblock.order.empty());
+    BOOST_CHECK(Matches(gblock.reconcile(mempool), block));
+}
+
+BOOST_AUTO_TEST_CASE(graphene_malformed)
+{
+    CBlock block = RandomBlock(10);
+    std::vector<uint256> mempool;
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        mempool.push_back(block.vtx[i]->GetHash());
+    const GrapheneBlock gblock(block, mempool.size());
+    BOOST_CHECK_NO_THROW(gblock.selfValidate(MAX_BLOCK_SIZE));
+
+    GrapheneBlock b(gblock);
+    b.coinbase = block.vtx[1];
+    BOOST_CHECK_THROW(b.selfValidate(MAX_BLOCK_SIZE), std::invalid_argument);
+
+    b = gblock;
+    b.order.push_back(0);
+    BOOST_CHECK_THROW(b.selfValidate(MAX_BLOCK_SIZE), std::invalid_argument);
+
+    b = gblock;
+    b.iblt = CIblt();
+    BOOST_CHECK_THROW(b.selfValidate(MAX_BLOCK_SIZE), std::invalid_argument);
+
+    // Order that is not a permutation of the transactions.
+    b = gblock;
+    std::fill(b.order.begin(), b.order.end(), 0);
+    BOOST_CHECK_NO_THROW(b.selfValidate(MAX_BLOCK_SIZE));
+    BOOST_CHECK_THROW(b.reconcile(mempool), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graphene_harness)
+{
+    // Block of 1000 transactions. Receiver has as many transactions that
+    // are not in the block as are, and lacks a share of those that are.
+    const size_t nBlockTxs = 1000;
+    const int nTrials = 20;
+
+    BOOST_TEST_MESSAGE("divergence  bytes/tx  decode failures");
+    for (double divergence : {0.0, 0.005, 0.01, 0.02, 0.05}) {
+        GrapheneHarness::Result r = GrapheneHarness::Run(nBlockTxs, nBlockTxs, divergence, nTrials);
+        BOOST_TEST_MESSAGE(strprintf("%9.1f%%  %8.2f  %14.0f%%",
+                divergence * 100, r.bytesPerTx, r.failureRate * 100));
+
+        // Most of the bytes are the order of the transactions, yet it's
+        // a fraction of the 8 bytes per transaction xthin needs.
+        BOOST_CHECK(r.bytesPerTx < 4);
+        if (divergence <= 0.005)
+            BOOST_CHECK(r.failureRate <= 0.1);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
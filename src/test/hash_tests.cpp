@@ -148,6 +148,21 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check SipHashUint256Batch against SipHashUint256, including counts
+    // that don't fill the last group of lanes.
+    std::vector<uint256> vals;
+    for (int i = 0; i < 11; ++i)
+        vals.push_back(GetRandHash());
+    for (size_t n = 0; n <= vals.size(); ++n) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        std::vector<uint64_t> out(n + 1, 0);
+        SipHashUint256Batch(k1, k2, vals.data(), n, out.data());
+        for (size_t i = 0; i < n; ++i)
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(k1, k2, vals[i]));
+        BOOST_CHECK_EQUAL(out[n], 0u);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "iblt.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <stdexcept>
+
+static uint64_t RandKey()
+{
+    return (uint64_t(insecure_rand()) << 32) | insecure_rand();
+}
+
+BOOST_FIXTURE_TEST_SUITE(iblt_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(iblt_lists_difference)
+{
+    CIblt a(CIblt::CellsFor(35), 42);
+    CIblt b(CIblt::CellsFor(35), 42);
+    BOOST_CHECK_EQUAL(a.size() % CIblt::NUM_HASHES, 0u);
+
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t key = RandKey();
+        a.insert(key);
+        b.insert(key);
+    }
+    std::set<uint64_t> onlyA, onlyB;
+    for (int i = 0; i < 20; ++i) {
+        onlyA.insert(RandKey());
+    }
+    for (int i = 0; i < 15; ++i) {
+        onlyB.insert(RandKey());
+    }
+    for (uint64_t key : onlyA)
+        a.insert(key);
+    for (uint64_t key : onlyB)
+        b.insert(key);
+
+    a -= b;
+    std::set<uint64_t> here, there;
+    BOOST_CHECK(a.peel(here, there));
+    BOOST_CHECK(here == onlyA);
+    BOOST_CHECK(there == onlyB);
+
+    // Erasing is the same as subtracting a table with the key.
+    CIblt c(CIblt::CellsFor(2), 1);
+    c.insert(1);
+    c.insert(2);
+    c.erase(1);
+    c.erase(3);
+    here.clear();
+    there.clear();
+    BOOST_CHECK(c.peel(here, there));
+    BOOST_CHECK(here == std::set<uint64_t>({2}));
+    BOOST_CHECK(there == std::set<uint64_t>({3}));
+}
+
+BOOST_AUTO_TEST_CASE(iblt_too_small)
+{
+    CIblt a(12, 0);
+    for (int i = 0; i < 100; ++i)
+        a.insert(RandKey());
+
+    std::set<uint64_t> here, there;
+    BOOST_CHECK(!a.peel(here, there));
+}
+
+BOOST_AUTO_TEST_CASE(iblt_serialize)
+{
+    CIblt a(30, 7);
+    a.insert(1234);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << a;
+    CIblt b;
+    stream >> b;
+    BOOST_CHECK_EQUAL(b.size(), a.size());
+    BOOST_CHECK_EQUAL(b.salt(), a.salt());
+
+    std::set<uint64_t> here, there;
+    BOOST_CHECK(b.peel(here, there));
+    BOOST_CHECK(here == std::set<uint64_t>({1234}));
+
+    // Only tables of the same size and salt can be subtracted.
+    BOOST_CHECK_THROW(b -= CIblt(30, 8), std::invalid_argument);
+    BOOST_CHECK_THROW(b -= CIblt(60, 7), std::invalid_argument);
+
+    // Can't be decoded if malformed.
+    BOOST_CHECK(!CIblt().peel(here, there));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
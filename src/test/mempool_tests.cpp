@@ -9,7 +9,9 @@
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
+#include <set>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -294,14 +296,14 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     tx1.vout.resize(1);
     tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx1.vout[0].nValue = 10 * COIN;
-    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 0, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx1), 10000LL, 0, 1, true, false, LockPoints(), 1));
 
     /* highest fee */
     CMutableTransaction tx2 = CMutableTransaction();
     tx2.vout.resize(1);
     tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx2.vout[0].nValue = 2 * COIN;
-    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 20000LL, 0, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx2), 20000LL, 0, 1, true, false, LockPoints(), 1));
     uint64_t tx2Size = ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION);
 
     /* lowest fee */
@@ -309,21 +311,21 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     tx3.vout.resize(1);
     tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx3.vout[0].nValue = 5 * COIN;
-    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 0LL, 0, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx3), 0LL, 0, 1, true, false, LockPoints(), 1));
 
     /* 2nd highest fee */
     CMutableTransaction tx4 = CMutableTransaction();
     tx4.vout.resize(1);
     tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx4.vout[0].nValue = 6 * COIN;
-    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 15000LL, 0, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx4), 15000LL, 0, 1, true, false, LockPoints(), 1));
 
     /* equal fee rate to tx1, but newer */
     CMutableTransaction tx5 = CMutableTransaction();
     tx5.vout.resize(1);
     tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx5.vout[0].nValue = 11 * COIN;
-    pool.addUnchecked(tx5.GetHash(), CTxMemPoolEntry(tx5, 10000LL, 1, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx5.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx5), 10000LL, 1, 1, true, false, LockPoints(), 1));
     BOOST_CHECK_EQUAL(pool.size(), size_t(5));
 
     std::vector<std::string> sortedOrder;
@@ -343,7 +345,7 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     tx6.vout[0].nValue = 20 * COIN;
     uint64_t tx6Size = ::GetSerializeSize(tx6, SER_NETWORK, PROTOCOL_VERSION);
 
-    pool.addUnchecked(tx6.GetHash(), CTxMemPoolEntry(tx6, 0LL, 1, 1, true, false, LockPoints(), 1));
+    pool.addUnchecked(tx6.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx6), 0LL, 1, 1, true, false, LockPoints(), 1));
     BOOST_CHECK_EQUAL(pool.size(), size_t(6));
     sortedOrder.push_back(tx6.GetHash().ToString());
     CheckSort<3>(pool, sortedOrder);
@@ -360,15 +362,15 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     /* set the fee to just below tx2's feerate when including ancestor */
     CAmount fee = (20000/tx2Size)*(tx7Size + tx6Size) - 1;
 
-    CTxMemPoolEntry entry7(tx7, fee, 2, 1, false, false, LockPoints(), 1);
+    CTxMemPoolEntry entry7(MakeTransactionRef(tx7), fee, 2, 1, false, false, LockPoints(), 1);
     pool.addUnchecked(tx7.GetHash(), entry7);
     BOOST_CHECK_EQUAL(pool.size(), size_t(7));
     sortedOrder.insert(sortedOrder.begin()+1, tx7.GetHash().ToString());
     CheckSort<3>(pool, sortedOrder);
 
     /* after tx6 is mined, tx7 should move up in the sort */
-    std::vector<CTransaction> vtx;
-    vtx.push_back(tx6);
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(tx6));
     std::list<CTransaction> dummy;
     pool.removeForBlock(vtx, 1, dummy, false);
 
@@ -378,4 +380,139 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<3>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolQueryHashesTest)
+{
+    // The txid array behind queryHashes stays in step with mapTx as
+    // transactions are added and removed.
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CTransaction> txs;
+    for (int i = 0; i < 10; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10000LL;
+        txs.push_back(tx);
+        pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+    }
+
+    std::list<CTransaction> removed;
+    pool.removeRecursive(txs[0], removed);
+    pool.removeRecursive(txs[9], removed);
+    pool.removeRecursive(txs[4], removed);
+    BOOST_CHECK_EQUAL(removed.size(), 3u);
+
+    std::vector<uint256> hashes;
+    pool.queryHashes(hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), 7u);
+    std::set<uint256> setHashes(hashes.begin(), hashes.end());
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK_EQUAL(setHashes.count(txs[i].GetHash()), (i == 0 || i == 9 || i == 4) ? 0u : 1u);
+
+    // Re-adding a removed transaction uses the freed space.
+    pool.addUnchecked(txs[4].GetHash(), entry.FromTx(txs[4]));
+    pool.queryHashes(hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), 8u);
+    BOOST_CHECK(std::count(hashes.begin(), hashes.end(), txs[4].GetHash()) == 1);
+
+    pool.clear();
+    pool.queryHashes(hashes);
+    BOOST_CHECK(hashes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRecentTxFilterTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CTransaction> txs;
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10000LL;
+        txs.push_back(tx);
+    }
+
+    // Built from the mempool on first use...
+    for (int i = 0; i < 10; i++)
+        pool.addUnchecked(txs[i].GetHash(), entry.Time(i).FromTx(txs[i]));
+    CBloomFilter filter = pool.GetRecentTxFilter();
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(filter.contains(txs[i].GetHash()));
+    BOOST_CHECK(!filter.contains(txs[10].GetHash()));
+
+    // ... then kept up to date as transactions are added.
+    for (int i = 10; i < 20; i++)
+        pool.addUnchecked(txs[i].GetHash(), entry.Time(i).FromTx(txs[i]));
+    filter = pool.GetRecentTxFilter();
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK(filter.contains(txs[i].GetHash()));
+
+    pool.clear();
+    BOOST_CHECK(pool.GetRecentTxFilter().IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolUpdateFromBlockTest)
+{
+    TestMemPoolEntryHelper entry;
+    auto spend = [](const uint256& hash) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.hash = hash;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10000LL;
+        return tx;
+    };
+
+    // Two transactions from a disconnected block, each with a chain of
+    // descendants that stayed in the mempool.
+    CMutableTransaction block1 = spend(GetRandHash());
+    CMutableTransaction child1 = spend(block1.GetHash());
+    CMutableTransaction block2 = spend(GetRandHash());
+    CMutableTransaction child2 = spend(block2.GetHash());
+    CMutableTransaction grandChild2 = spend(child2.GetHash());
+    std::vector<uint256> vHashes = { block1.GetHash(), block2.GetHash() };
+
+    for (uint64_t nLimit : { 100, 2 }) {
+        CTxMemPool pool(CFeeRate(0));
+        pool.addUnchecked(child1.GetHash(), entry.FromTx(child1));
+        pool.addUnchecked(child2.GetHash(), entry.FromTx(child2));
+        pool.addUnchecked(grandChild2.GetHash(), entry.FromTx(grandChild2));
+        pool.addUnchecked(block1.GetHash(), entry.FromTx(block1));
+        pool.addUnchecked(block2.GetHash(), entry.FromTx(block2));
+        pool.UpdateTransactionsFromBlock(vHashes, nLimit, 1000000);
+
+        LOCK(pool.cs);
+        auto it = pool.mapTx.find(block1.GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2u);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(it).size(), 1u);
+        it = pool.mapTx.find(child1.GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2u);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(it).size(), 1u);
+
+        if (nLimit == 100) {
+            it = pool.mapTx.find(block2.GetHash());
+            BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3u);
+            BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), 3u * it->GetTxSize());
+            it = pool.mapTx.find(grandChild2.GetHash());
+            BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 3u);
+            BOOST_CHECK_EQUAL(pool.mapTx.size(), 5u);
+        }
+        else {
+            // The chain with more descendants than the limit is removed.
+            BOOST_CHECK_EQUAL(pool.mapTx.size(), 2u);
+            BOOST_CHECK(!pool.mapTx.count(block2.GetHash()));
+            BOOST_CHECK(!pool.mapTx.count(grandChild2.GetHash()));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempoolgraph.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <iterator>
+#include <map>
+#include <set>
+
+namespace {
+
+typedef MempoolGraph::Node Node;
+
+std::set<Node> ToSet(const MempoolGraph::Range& r)
+{
+    return std::set<Node>(r.begin(), r.end());
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(mempoolgraph_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(links)
+{
+    MempoolGraph graph;
+    const Node a = graph.AddNode();
+    const Node b = graph.AddNode();
+    const Node c = graph.AddNode();
+
+    BOOST_CHECK(graph.AddLink(a, b));
+    BOOST_CHECK(!graph.AddLink(a, b));
+    BOOST_CHECK(graph.AddLink(a, c));
+    BOOST_CHECK(graph.AddLink(b, c));
+    BOOST_CHECK(ToSet(graph.Children(a)) == std::set<Node>({ b, c }));
+    BOOST_CHECK(ToSet(graph.Parents(c)) == std::set<Node>({ a, b }));
+    BOOST_CHECK(graph.Parents(a).empty());
+
+    BOOST_CHECK(graph.RemoveLink(a, c));
+    BOOST_CHECK(!graph.RemoveLink(a, c));
+    BOOST_CHECK(ToSet(graph.Children(a)) == std::set<Node>({ b }));
+    BOOST_CHECK(ToSet(graph.Parents(c)) == std::set<Node>({ b }));
+
+    // The number of a removed node is reused.
+    BOOST_CHECK(graph.RemoveLink(b, c));
+    graph.RemoveNode(c);
+    BOOST_CHECK_EQUAL(graph.AddNode(), c);
+    BOOST_CHECK(graph.Parents(c).empty());
+    BOOST_CHECK_EQUAL(graph.Size(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(walks)
+{
+    MempoolGraph graph;
+    const Node a = graph.AddNode();
+    const Node b = graph.AddNode();
+
+    graph.NewEpoch();
+    BOOST_CHECK(!graph.IsVisited(a));
+    BOOST_CHECK(graph.Visit(a));
+    BOOST_CHECK(!graph.Visit(a));
+    BOOST_CHECK(graph.IsVisited(a));
+    BOOST_CHECK(!graph.IsVisited(b));
+
+    graph.NewEpoch();
+    BOOST_CHECK(!graph.IsVisited(a));
+    BOOST_CHECK(graph.Visit(a));
+}
+
+// Links stay the same as the arena grows, and is compacted, as nodes come
+// and go.
+BOOST_AUTO_TEST_CASE(random_links)
+{
+    MempoolGraph graph;
+    std::set<Node> nodes;
+    std::map<Node, std::set<Node> > parents;
+    std::map<Node, std::set<Node> > children;
+
+    for (int i = 0; i < 20000; ++i) {
+        const int op = insecure_rand() % 10;
+        if (nodes.size() < 2 || op < 2) {
+            const Node n = graph.AddNode();
+            BOOST_CHECK(nodes.insert(n).second);
+            parents[n].clear();
+            children[n].clear();
+            continue;
+        }
+        auto pick = [&]() {
+            auto it = nodes.begin();
+            std::advance(it, insecure_rand() % nodes.size());
+            return *it;
+        };
+        const Node p = pick();
+        const Node c = pick();
+        if (p == c)
+            continue;
+        if (op < 7) {
+            const bool added = children[p].insert(c).second;
+            parents[c].insert(p);
+            BOOST_CHECK_EQUAL(graph.AddLink(p, c), added);
+        }
+        else if (op < 9) {
+            const bool removed = children[p].erase(c);
+            parents[c].erase(p);
+            BOOST_CHECK_EQUAL(graph.RemoveLink(p, c), removed);
+        }
+        else {
+            for (Node q : parents[p]) {
+                BOOST_CHECK(graph.RemoveLink(q, p));
+                children[q].erase(p);
+            }
+            for (Node q : children[p]) {
+                BOOST_CHECK(graph.RemoveLink(p, q));
+                parents[q].erase(p);
+            }
+            parents.erase(p);
+            children.erase(p);
+            nodes.erase(p);
+            graph.RemoveNode(p);
+        }
+    }
+    for (Node n : nodes) {
+        BOOST_CHECK(ToSet(graph.Parents(n)) == parents[n]);
+        BOOST_CHECK(ToSet(graph.Children(n)) == children[n]);
+        BOOST_CHECK_EQUAL(graph.Parents(n).size(), parents[n].size());
+        BOOST_CHECK_EQUAL(graph.Children(n).size(), children[n].size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
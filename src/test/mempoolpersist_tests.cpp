@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "miner.h"
+#include "pow.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+struct MempoolPersistSetup : public TestingSetup {
+    MempoolPersistSetup() : TestingSetup(CBaseChainParams::REGTEST) {
+        // Enough blocks for the first coinbases to mature.
+        for (int i = 0; i < COINBASE_MATURITY + 5; ++i)
+            coinbases.push_back(MineBlock());
+    }
+
+    CTransactionRef MineBlock() {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(CScript() << OP_TRUE));
+        CBlock& block = pblocktemplate->block;
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus()))
+            ++block.nNonce;
+        CValidationState state;
+        BOOST_CHECK(ProcessNewBlock(state, BlockSource{}, &block, true, NULL, connman));
+        return block.vtx[0];
+    }
+
+    std::vector<CTransactionRef> coinbases;
+};
+
+CMutableTransaction Spend(const COutPoint& prevout, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(nValue / 2, CScript() << OP_TRUE));
+    tx.vout.push_back(CTxOut(nValue / 2 - 10000, CScript() << OP_TRUE));
+    return tx;
+}
+
+bool Accept(const CTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(mempoolpersist_tests, MempoolPersistSetup)
+
+BOOST_AUTO_TEST_CASE(dump_and_load)
+{
+    const int64_t nNow = GetTime();
+    const int64_t nExpiry = DEFAULT_MEMPOOL_EXPIRY * 60 * 60;
+
+    // One about to expire.
+    SetMockTime(nNow - nExpiry + 60);
+    CMutableTransaction old = Spend(COutPoint(coinbases[0]->GetHash(), 0), coinbases[0]->vout[0].nValue);
+    BOOST_CHECK(Accept(old));
+
+    // A chain, loaded in the same batch.
+    SetMockTime(nNow - 100);
+    CMutableTransaction parent = Spend(COutPoint(coinbases[1]->GetHash(), 0), coinbases[1]->vout[0].nValue);
+    BOOST_CHECK(Accept(parent));
+    SetMockTime(nNow - 50);
+    CMutableTransaction child = Spend(COutPoint(parent.GetHash(), 0), parent.vout[0].nValue);
+    BOOST_CHECK(Accept(child));
+    CMutableTransaction other = Spend(COutPoint(coinbases[2]->GetHash(), 0), coinbases[2]->vout[0].nValue);
+    BOOST_CHECK(Accept(other));
+    BOOST_CHECK_EQUAL(mempool.size(), 4u);
+
+    // Deltas are kept for transactions in the mempool and those not (yet).
+    const uint256 unknown = GetRandHash();
+    mempool.GetFeeModifier().AddDelta(child.GetHash(), 5000);
+    mempool.GetFeeModifier().AddDelta(unknown, -1000);
+
+    BOOST_CHECK(DumpMempool());
+    {
+        LOCK(cs_main);
+        mempool.clear();
+    }
+    mempool.GetFeeModifier().RemoveDelta(child.GetHash());
+    mempool.GetFeeModifier().RemoveDelta(unknown);
+
+    // After the first has expired.
+    SetMockTime(nNow + 120);
+    BOOST_CHECK(LoadMempool());
+    {
+        LOCK(mempool.cs);
+        BOOST_CHECK_EQUAL(mempool.size(), 3u);
+        BOOST_CHECK(!mempool.exists(old.GetHash()));
+        auto it = mempool.mapTx.find(parent.GetHash());
+        BOOST_CHECK(it != mempool.mapTx.end() && it->GetTime() == nNow - 100);
+        it = mempool.mapTx.find(child.GetHash());
+        BOOST_CHECK(it != mempool.mapTx.end() && it->GetTime() == nNow - 50);
+        BOOST_CHECK(it != mempool.mapTx.end() && it->GetModifiedFee() == it->GetFee() + 5000);
+        BOOST_CHECK(mempool.exists(other.GetHash()));
+    }
+    BOOST_CHECK_EQUAL(mempool.GetFeeModifier().GetDelta(unknown), -1000);
+
+    // Loading again finds them there.
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3u);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(load_unknown_version)
+{
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    {
+        CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << uint64_t(2) << uint64_t(0);
+    }
+    BOOST_CHECK(!LoadMempool());
+    boost::filesystem::remove(path);
+    BOOST_CHECK(!LoadMempool());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
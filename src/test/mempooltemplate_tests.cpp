@@ -0,0 +1,180 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooltemplate.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <list>
+#include <set>
+
+namespace {
+
+CMutableTransaction Spend(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(1000, CScript() << OP_TRUE));
+    tx.vout.push_back(CTxOut(1000, CScript() << OP_TRUE));
+    return tx;
+}
+
+MempoolTemplateParams TemplateParams(uint64_t nBlockMaxSize)
+{
+    MempoolTemplateParams params;
+    params.hashPrevBlock = uint256S("0xbeef");
+    params.nHeight = 100;
+    params.nLockTimeCutoff = 0;
+    params.nBlockMaxSize = nBlockMaxSize;
+    params.fSkipNegativeDelta = false;
+    return params;
+}
+
+// The selection has every parent before its child, within the limits.
+void CheckSelection(const CTxMemPool& pool, const MempoolTemplate& selection,
+                    const MempoolTemplateParams& params)
+{
+    std::set<uint256> seen;
+    uint64_t nSize = 1000;
+    uint64_t nSigOps = 100;
+    for (CTxMemPool::txiter it : selection.GetTransactions()) {
+        for (CTxMemPool::txiter parent : pool.GetMemPoolParents(it))
+            BOOST_CHECK(seen.count(parent->GetTx().GetHash()));
+        seen.insert(it->GetTx().GetHash());
+        nSize += it->GetTxSize();
+        nSigOps += it->GetSigOpCount();
+    }
+    BOOST_CHECK_EQUAL(selection.GetBlockSize(), nSize);
+    BOOST_CHECK_EQUAL(selection.GetBlockSigOps(), nSigOps);
+    BOOST_CHECK(nSize < params.nBlockMaxSize);
+}
+
+std::set<uint256> Txids(const MempoolTemplate& selection)
+{
+    std::set<uint256> txids;
+    for (CTxMemPool::txiter it : selection.GetTransactions())
+        txids.insert(it->GetTx().GetHash());
+    return txids;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(mempooltemplate_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(template_follows_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK(pool.cs);
+    TestMemPoolEntryHelper entry;
+    const MempoolTemplateParams params = TemplateParams(1000000);
+    MempoolTemplate& selection = pool.GetBlockTemplate();
+
+    std::vector<CTransaction> txs;
+    std::vector<COutPoint> unspent;
+    auto addRandomTx = [&]() {
+        COutPoint prevout(GetRandHash(), 0);
+        if (!unspent.empty() && insecure_rand() % 2) {
+            const size_t n = insecure_rand() % unspent.size();
+            prevout = unspent[n];
+            unspent.erase(unspent.begin() + n);
+        }
+        CMutableTransaction tx = Spend(prevout);
+        pool.addUnchecked(tx.GetHash(), entry.Fee(1000 + insecure_rand() % 10000).FromTx(tx));
+        txs.push_back(tx);
+        unspent.push_back(COutPoint(tx.GetHash(), 0));
+        unspent.push_back(COutPoint(tx.GetHash(), 1));
+    };
+
+    for (int i = 0; i < 50; ++i)
+        addRandomTx();
+    BOOST_CHECK(selection.Update(params));
+    BOOST_CHECK(!selection.Update(params));
+    BOOST_CHECK_EQUAL(selection.GetTransactions().size(), pool.size());
+
+    // Everything fits, so what enters the mempool is selected and what
+    // leaves it is not.
+    std::list<CTransaction> removed;
+    for (int i = 0; i < 200; ++i) {
+        if (insecure_rand() % 4 == 0)
+            pool.removeRecursive(txs[insecure_rand() % txs.size()], removed);
+        else
+            addRandomTx();
+        BOOST_CHECK_EQUAL(selection.GetTransactions().size(), pool.size());
+        CheckSelection(pool, selection, params);
+    }
+    BOOST_CHECK(!selection.Update(params));
+
+    // Selecting from scratch gives the same transactions.
+    MempoolTemplate fromScratch(pool);
+    BOOST_CHECK(fromScratch.Update(params));
+    BOOST_CHECK(Txids(fromScratch) == Txids(selection));
+
+    // Built from scratch when the tip changes, or after clear.
+    MempoolTemplateParams next = params;
+    next.hashPrevBlock = uint256S("0xf00d");
+    BOOST_CHECK(selection.Update(next));
+    BOOST_CHECK(!selection.Update(next));
+    pool.clear();
+    BOOST_CHECK(selection.GetTransactions().empty());
+    BOOST_CHECK(selection.Update(next));
+}
+
+BOOST_AUTO_TEST_CASE(template_makes_room)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK(pool.cs);
+    TestMemPoolEntryHelper entry;
+    MempoolTemplate& selection = pool.GetBlockTemplate();
+
+    CMutableTransaction parent = Spend(COutPoint(GetRandHash(), 0));
+    const uint64_t nTxSize = ::GetSerializeSize(parent, SER_NETWORK, PROTOCOL_VERSION);
+    // Room for four transactions.
+    const MempoolTemplateParams params = TemplateParams(1000 + 4 * nTxSize + 1);
+
+    pool.addUnchecked(parent.GetHash(), entry.Fee(1000).FromTx(parent));
+    CMutableTransaction child = Spend(COutPoint(parent.GetHash(), 0));
+    pool.addUnchecked(child.GetHash(), entry.Fee(2500).FromTx(child));
+    CMutableTransaction low = Spend(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(low.GetHash(), entry.Fee(1500).FromTx(low));
+    CMutableTransaction mid = Spend(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(mid.GetHash(), entry.Fee(3000).FromTx(mid));
+    selection.Update(params);
+    BOOST_CHECK_EQUAL(selection.GetTransactions().size(), 4u);
+
+    // Takes the place of the lowest feerate transaction that no other
+    // depends on. The parent has a lower feerate, but its child is
+    // selected.
+    CMutableTransaction high = Spend(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(high.GetHash(), entry.Fee(5000).FromTx(high));
+    CheckSelection(pool, selection, params);
+    std::set<uint256> txids = Txids(selection);
+    BOOST_CHECK(txids.count(high.GetHash()));
+    BOOST_CHECK(!txids.count(low.GetHash()));
+    BOOST_CHECK(txids.count(parent.GetHash()));
+    BOOST_CHECK(txids.count(child.GetHash()));
+
+    // Not in place of a transaction with a higher feerate.
+    CMutableTransaction lowest = Spend(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(lowest.GetHash(), entry.Fee(100).FromTx(lowest));
+    BOOST_CHECK(Txids(selection) == txids);
+
+    // A child that pays for its parent brings it in.
+    CMutableTransaction lowParent = Spend(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(lowParent.GetHash(), entry.Fee(0).FromTx(lowParent));
+    BOOST_CHECK(!Txids(selection).count(lowParent.GetHash()));
+    CMutableTransaction richChild = Spend(COutPoint(lowParent.GetHash(), 0));
+    pool.addUnchecked(richChild.GetHash(), entry.Fee(20000).FromTx(richChild));
+    CheckSelection(pool, selection, params);
+    txids = Txids(selection);
+    BOOST_CHECK(txids.count(lowParent.GetHash()));
+    BOOST_CHECK(txids.count(richChild.GetHash()));
+    BOOST_CHECK(txids.count(high.GetHash()));
+    BOOST_CHECK(txids.count(parent.GetHash()));
+    BOOST_CHECK_EQUAL(txids.size(), 4u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
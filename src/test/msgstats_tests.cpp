@@ -0,0 +1,138 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "msgstats.h"
+#include "protocol.h"
+#include "sync.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(msgstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(histogram_buckets)
+{
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(-5), 0u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(0), 0u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(1), 1u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(2), 2u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(3), 2u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(4), 3u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(1000), 10u);
+    BOOST_CHECK_EQUAL(CDurationHistogram::BucketOf(int64_t(1) << 40),
+                      CDurationHistogram::NUM_BUCKETS - 1);
+
+    CDurationHistogram histogram;
+    histogram.Add(0);
+    histogram.Add(3);
+    histogram.Add(2);
+    std::vector<uint64_t> counts = histogram.GetCounts();
+    BOOST_CHECK_EQUAL(counts.size(), CDurationHistogram::NUM_BUCKETS);
+    BOOST_CHECK_EQUAL(counts[0], 1u);
+    BOOST_CHECK_EQUAL(counts[1], 0u);
+    BOOST_CHECK_EQUAL(counts[2], 2u);
+}
+
+BOOST_AUTO_TEST_CASE(record_by_command)
+{
+    CMessageStats stats;
+    BOOST_CHECK(stats.GetSnapshot().empty());
+
+    stats.Record(NetMsgType::TX, 250, 100, 10, 300);
+    stats.Record(NetMsgType::TX, 350, 50, 0, 900);
+    stats.Record(NetMsgType::BLOCK, 1000000, 20000, 5000, 25000);
+    stats.Record("nonsense", 10, 1, 0, 1);
+    stats.Record("garbage", 10, 1, 0, 1);
+
+    auto snapshot = stats.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(snapshot.size(), 3u);
+    // Known commands come in name order, unknown ones last.
+    BOOST_CHECK_EQUAL(snapshot[0].first, NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(snapshot[1].first, NetMsgType::TX);
+    BOOST_CHECK_EQUAL(snapshot[2].first, CMessageStats::OTHER);
+
+    const CMessageTypeStats::Snapshot& tx = snapshot[1].second;
+    BOOST_CHECK_EQUAL(tx.nMessages, 2u);
+    BOOST_CHECK_EQUAL(tx.nBytes, 600u);
+    BOOST_CHECK_EQUAL(tx.nHandlerMicros, 150u);
+    BOOST_CHECK_EQUAL(tx.nLockWaitMicros, 10u);
+    BOOST_CHECK_EQUAL(tx.nMaxHandlerMicros, 100u);
+    BOOST_CHECK_EQUAL(tx.nMaxLatencyMicros, 900u);
+    BOOST_CHECK_EQUAL(tx.vHandlerHistogram[CDurationHistogram::BucketOf(100)], 1u);
+    BOOST_CHECK_EQUAL(tx.vHandlerHistogram[CDurationHistogram::BucketOf(50)], 1u);
+    BOOST_CHECK_EQUAL(snapshot[2].second.nMessages, 2u);
+
+    CMessageTypeStats::Snapshot totals = stats.GetTotals();
+    BOOST_CHECK_EQUAL(totals.nMessages, 5u);
+    BOOST_CHECK_EQUAL(totals.nBytes, 1000620u);
+    BOOST_CHECK_EQUAL(totals.nMaxHandlerMicros, 20000u);
+    BOOST_CHECK_EQUAL(totals.nMaxLatencyMicros, 25000u);
+}
+
+BOOST_AUTO_TEST_CASE(command_index)
+{
+    for (const std::string& cmd : getAllNetMessageTypes())
+        BOOST_CHECK(CMessageStats::IndexOf(cmd) < getAllNetMessageTypes().size());
+    BOOST_CHECK(CMessageStats::IndexOf(NetMsgType::TX) != CMessageStats::IndexOf(NetMsgType::INV));
+    BOOST_CHECK_EQUAL(CMessageStats::IndexOf("unknown"), getAllNetMessageTypes().size());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_record)
+{
+    CMessageStats stats;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&stats, t] {
+            for (int i = 0; i < 1000; ++i)
+                stats.Record(NetMsgType::INV, 37, i, 0, t * 1000 + i);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    CMessageTypeStats::Snapshot totals = stats.GetTotals();
+    BOOST_CHECK_EQUAL(totals.nMessages, 4000u);
+    BOOST_CHECK_EQUAL(totals.nBytes, 4000u * 37);
+    BOOST_CHECK_EQUAL(totals.nMaxHandlerMicros, 999u);
+    BOOST_CHECK_EQUAL(totals.nMaxLatencyMicros, 3999u);
+}
+
+BOOST_AUTO_TEST_CASE(lock_wait)
+{
+    CCriticalSection cs;
+    const int64_t nStart = LockWaitMicros();
+    {
+        // Uncontended locks are not counted.
+        LOCK(cs);
+    }
+    BOOST_CHECK_EQUAL(LockWaitMicros(), nStart);
+
+    std::atomic<bool> fStarted(false);
+    int64_t nWaited = 0;
+    std::thread waiter;
+    {
+        LOCK(cs);
+        waiter = std::thread([&cs, &fStarted, &nWaited] {
+            const int64_t nBefore = LockWaitMicros();
+            fStarted = true;
+            {
+                LOCK(cs);
+            }
+            nWaited = LockWaitMicros() - nBefore;
+        });
+        while (!fStarted)
+            std::this_thread::yield();
+        MilliSleep(50);
+    }
+    waiter.join();
+    BOOST_CHECK(nWaited >= 40 * 1000);
+    // Other threads' waits don't count for this one.
+    BOOST_CHECK_EQUAL(LockWaitMicros(), nStart);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
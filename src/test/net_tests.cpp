@@ -11,6 +11,11 @@
 #include "net.h"
 #include "chainparams.h"
 #include "ipgroups.h"
+#include "test/dummyconnman.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
 
 using namespace std;
 
@@ -204,4 +209,68 @@ BOOST_AUTO_TEST_CASE(is_spv_client) {
     BOOST_CHECK(node.IsSPVClient());
 }
 
+#ifndef WIN32
+static std::unique_ptr<CNode> SocketPairNode(NodeId id, SOCKET& hRemote)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SOCKET hLocal = fds[0];
+    BOOST_REQUIRE(SetSocketNonBlocking(hLocal, true));
+    hRemote = fds[1];
+    return std::unique_ptr<CNode>(new CNode(id, NODE_NETWORK, 0, hLocal, CAddress(), 0));
+}
+
+BOOST_AUTO_TEST_CASE(push_message_gathers_header_and_payload) {
+    DummyConnman connman;
+    SOCKET hRemote;
+    std::unique_ptr<CNode> node = SocketPairNode(1, hRemote);
+
+    std::vector<unsigned char> data(1000, 0x42);
+    CSharedPayloadRef payload = std::make_shared<const CSharedPayload>(std::vector<unsigned char>(data));
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::TX;
+    msg.shared = payload;
+    static_cast<CConnman&>(connman).PushMessage(node.get(), std::move(msg));
+    BOOST_CHECK(node->vSendMsg.empty());
+    BOOST_CHECK_EQUAL(node->nSendSize, 0u);
+
+    std::vector<unsigned char> received(CMessageHeader::HEADER_SIZE + data.size() + 1);
+    ssize_t nBytes = recv(hRemote, received.data(), received.size(), MSG_DONTWAIT);
+    BOOST_REQUIRE_EQUAL(nBytes, (ssize_t)(CMessageHeader::HEADER_SIZE + data.size()));
+
+    CMessageHeader hdr(Params().NetworkMagic());
+    CSpanReader(SER_NETWORK, INIT_PROTO_VERSION, received.data(), received.data() + CMessageHeader::HEADER_SIZE) >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().NetworkMagic()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::TX);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, data.size());
+    uint256 hash = Hash(data.begin(), data.end());
+    BOOST_CHECK(memcmp(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+    BOOST_CHECK(std::equal(data.begin(), data.end(), received.begin() + CMessageHeader::HEADER_SIZE));
+    close(hRemote);
+}
+
+// A payload pushed to several peers is queued without being copied.
+BOOST_AUTO_TEST_CASE(push_message_shares_payload) {
+    DummyConnman connman;
+    CSharedPayloadRef payload = std::make_shared<const CSharedPayload>(std::vector<unsigned char>(4 << 20, 0x42));
+
+    for (NodeId id = 1; id <= 2; ++id) {
+        SOCKET hRemote;
+        std::unique_ptr<CNode> node = SocketPairNode(id, hRemote);
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        msg.shared = payload;
+        static_cast<CConnman&>(connman).PushMessage(node.get(), std::move(msg));
+
+        // The socket buffer can not take it all, the rest waits in the queue.
+        BOOST_REQUIRE_EQUAL(node->vSendMsg.size(), 1u);
+        BOOST_CHECK(node->vSendMsg.front().data() == payload->data.data());
+        BOOST_CHECK_EQUAL(node->nSendSize, payload->data.size());
+        BOOST_CHECK(node->nSendOffset > 0);
+        close(hRemote);
+    }
+    BOOST_CHECK_EQUAL(payload.use_count(), 1);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
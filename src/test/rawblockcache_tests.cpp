@@ -0,0 +1,113 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rawblockcache.h"
+#include "blockencodings.h"
+#include "blocksender.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "protocol.h"
+#include "streams.h"
+#include "test/dummyconnman.h"
+#include "test/test_bitcoin.h"
+#include "test/thinblockutil.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rawblockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    auto block = std::make_shared<CBlock>(TestBlock1());
+    block->nNonce = nNonce;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(rawblockcache_encodings)
+{
+    RawBlockCache cache(2);
+    auto block = MakeBlock(1);
+    const uint256 hash = block->GetHash();
+
+    BOOST_CHECK(!cache.Get(hash, RawBlockCache::FULL_BLOCK));
+    cache.Add(block);
+    BOOST_CHECK(cache.GetBlock(hash) == block);
+
+    // Encodings are serialized on first request and shared after that.
+    RawBlockCache::Payload full = cache.Get(hash, RawBlockCache::FULL_BLOCK);
+    BOOST_REQUIRE(full);
+    std::vector<unsigned char> expected;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, expected, 0) << *block;
+    BOOST_CHECK(full->data == expected);
+    BOOST_CHECK(cache.Get(hash, RawBlockCache::FULL_BLOCK) == full);
+
+    RawBlockCache::Payload cmpct = cache.Get(hash, RawBlockCache::CMPCT_BLOCK);
+    BOOST_REQUIRE(cmpct);
+    CompactBlock decoded;
+    CSpanReader(SER_NETWORK, PROTOCOL_VERSION, cmpct->data.data(), cmpct->data.data() + cmpct->data.size()) >> decoded;
+    BOOST_CHECK(decoded.header.GetHash() == hash);
+    BOOST_CHECK_EQUAL(decoded.prefilledtxn.size(), 1u);
+    BOOST_CHECK_EQUAL(decoded.BlockTxCount(), block->vtx.size());
+
+    RawBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 1u);
+    BOOST_CHECK_EQUAL(stats.nBytes, full->data.size() + cmpct->data.size());
+    BOOST_CHECK_EQUAL(stats.nHits, 2u);
+    BOOST_CHECK_EQUAL(stats.nMisses, 3u);
+    BOOST_CHECK_EQUAL(stats.nBytesServed, full->data.size());
+}
+
+BOOST_AUTO_TEST_CASE(rawblockcache_evicts_least_recently_used)
+{
+    RawBlockCache cache(2);
+    auto block1 = MakeBlock(1), block2 = MakeBlock(2), block3 = MakeBlock(3);
+    cache.Add(block1);
+    cache.Add(block2);
+    BOOST_CHECK(cache.Get(block1->GetHash(), RawBlockCache::FULL_BLOCK));
+    cache.Add(block3);
+
+    BOOST_CHECK(cache.GetBlock(block1->GetHash()));
+    BOOST_CHECK(!cache.GetBlock(block2->GetHash()));
+    BOOST_CHECK(cache.GetBlock(block3->GetHash()));
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 2u);
+
+    cache.Add(MakeBlock(4));
+    cache.Add(MakeBlock(5));
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0u);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 0u);
+
+    RawBlockCache disabled(0);
+    disabled.Add(block1);
+    BOOST_CHECK(!disabled.GetBlock(block1->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blocksender_serves_from_cache)
+{
+    auto block = MakeBlock(6);
+    const uint256 hash = block->GetHash();
+    GetRawBlockCache().Add(block);
+
+    // Not on disk, so the block can only be served from the cache.
+    CBlockIndex index(*block);
+    index.phashBlock = &hash;
+    index.nStatus = BLOCK_HAVE_DATA;
+    index.nFile = 9999;
+    index.nDataPos = 8;
+
+    RawBlockCache::Stats before = GetRawBlockCache().GetStats();
+    BlockSender sender;
+    DummyConnman connman;
+    DummyNode node;
+    sender.sendBlock(connman, node, index, MSG_BLOCK, index.nHeight);
+    sender.sendBlock(connman, node, index, MSG_BLOCK, index.nHeight);
+    BOOST_CHECK(connman.MsgWasSent(node, "block", 0));
+    BOOST_CHECK(connman.MsgWasSent(node, "block", 1));
+    RawBlockCache::Stats after = GetRawBlockCache().GetStats();
+    BOOST_CHECK_EQUAL(after.nHits - before.nHits, 1u);
+    BOOST_CHECK_EQUAL(after.nMisses - before.nMisses, 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include "serialize.h"
 #include "streams.h"
 #include "hash.h"
+#include "random.h"
 #include "test/test_bitcoin.h"
 
 #include <stdint.h>
@@ -345,4 +346,28 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(shared_tx)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 1);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 42;
+    CTransaction tx(mtx);
+    CTransactionRef ptx = MakeTransactionRef(tx);
+
+    // A shared transaction has the same encoding as the transaction itself.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    ss2 << ptx;
+    BOOST_CHECK(ss.str() == ss2.str());
+
+    CTransactionRef res;
+    ss2 >> res;
+    BOOST_REQUIRE(res);
+    BOOST_CHECK(*res == tx);
+    BOOST_CHECK(res != ptx);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
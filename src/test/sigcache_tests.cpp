@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, BasicTestingSetup)
+
+static CSignatureCache::Entry RandomEntry(FastRandomContext& rng)
+{
+    return CSignatureCache::Entry{rng.rand64(), rng.rand64()};
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_set_get_erase)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> sig;
+    BOOST_CHECK(key.Sign(hash, sig));
+
+    CSignatureCache cache(1 << 16);
+    CSignatureCache::Entry entry, other;
+    cache.ComputeEntry(entry, hash, sig, key.GetPubKey());
+    cache.ComputeEntry(other, GetRandHash(), sig, key.GetPubKey());
+
+    BOOST_CHECK(!cache.Get(entry));
+    cache.Set(entry);
+    BOOST_CHECK(cache.Get(entry));
+    BOOST_CHECK(!cache.Get(other));
+    cache.Set(entry);
+    cache.Erase(entry);
+    BOOST_CHECK(!cache.Get(entry));
+
+    CSignatureCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBytes, 1 << 16);
+    BOOST_CHECK_EQUAL(stats.nEntries, 0);
+    BOOST_CHECK_EQUAL(stats.nLookups, 4);
+    BOOST_CHECK_EQUAL(stats.nHits, 1);
+    BOOST_CHECK_EQUAL(stats.nInserts, 1);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0);
+
+    // A cache without budget stores nothing.
+    CSignatureCache disabled(0);
+    disabled.Set(entry);
+    BOOST_CHECK(!disabled.Get(entry));
+    BOOST_CHECK_EQUAL(disabled.GetStats().nBuckets, 0);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_budget)
+{
+    const size_t nBytes = 100 * CSignatureCache::BUCKET_SIZE + 10;
+    const size_t nCapacity = 100 * CSignatureCache::BUCKET_ENTRIES;
+    CSignatureCache cache(nBytes);
+    FastRandomContext rng(true);
+
+    std::vector<CSignatureCache::Entry> entries;
+    for (size_t i = 0; i < 4 * nCapacity; ++i) {
+        entries.push_back(RandomEntry(rng));
+        cache.Set(entries.back());
+    }
+
+    CSignatureCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBuckets, 100);
+    BOOST_CHECK(stats.nEntries <= nCapacity);
+    BOOST_CHECK(stats.nEntries > nCapacity / 2);
+    BOOST_CHECK_EQUAL(stats.nInserts, entries.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, entries.size() - stats.nEntries);
+
+    // The most recent insert is always kept.
+    BOOST_CHECK(cache.Get(entries.back()));
+    size_t hits = 0;
+    for (const auto& entry : entries)
+        hits += cache.Get(entry);
+    BOOST_CHECK_EQUAL(hits, stats.nEntries);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_concurrent)
+{
+    CSignatureCache cache(1 << 24);
+    FastRandomContext rng(true);
+    std::vector<CSignatureCache::Entry> present, absent;
+    for (int i = 0; i < 1000; ++i) {
+        present.push_back(RandomEntry(rng));
+        cache.Set(present.back());
+        // Same bucket, so the writer races the readers.
+        absent.push_back(CSignatureCache::Entry{present.back().a ^ 1, present.back().b});
+    }
+
+    // A reader racing a writer on the same bucket may miss, but only an
+    // entry that is present is ever reported as a hit.
+    std::atomic<uint64_t> hits(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int round = 0; round < 50; ++round) {
+                for (size_t i = 0; i < present.size(); ++i) {
+                    if (t == 0) {
+                        cache.Set(absent[i]);
+                        cache.Erase(absent[i]);
+                    } else {
+                        hits += cache.Get(present[i]);
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    CSignatureCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0);
+    BOOST_CHECK_EQUAL(stats.nEntries, present.size());
+    BOOST_CHECK_EQUAL(hits + stats.nContended, 3 * 50 * present.size());
+    for (size_t i = 0; i < present.size(); ++i) {
+        BOOST_CHECK(cache.Get(present[i]));
+        BOOST_CHECK(!cache.Get(absent[i]));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
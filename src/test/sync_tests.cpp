@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin XT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+
+namespace {
+
+struct LockProfileSetup : public BasicTestingSetup {
+    LockProfileSetup()
+    {
+        ResetLockProfile();
+        fLockProfiling = true;
+    }
+    ~LockProfileSetup()
+    {
+        fLockProfiling = DEFAULT_LOCKPROFILE;
+        ResetLockProfile();
+    }
+};
+
+LockSiteStats FindLock(const std::string& strName)
+{
+    LockSiteStats total;
+    for (const LockSiteStats& site : GetLockProfile())
+        if (site.strName == strName)
+            total.Add(site);
+    return total;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, LockProfileSetup)
+
+BOOST_AUTO_TEST_CASE(lockprofile_counts_sites)
+{
+    CCriticalSection csProfiled;
+    for (int i = 0; i < 3; ++i) {
+        LOCK(csProfiled);
+    }
+    {
+        TRY_LOCK(csProfiled, lockTried);
+        const bool fLocked = lockTried;
+        BOOST_CHECK(fLocked);
+    }
+
+    std::vector<LockSiteStats> sites;
+    for (const LockSiteStats& site : GetLockProfile())
+        if (site.strName == "csProfiled")
+            sites.push_back(site);
+    BOOST_REQUIRE_EQUAL(sites.size(), 2u);
+    BOOST_CHECK(sites[0].strSite.find("sync_tests.cpp:") != std::string::npos);
+    BOOST_CHECK(sites[0].strSite != sites[1].strSite);
+    BOOST_CHECK_EQUAL(sites[0].nAcquired + sites[1].nAcquired, 4u);
+    BOOST_CHECK_EQUAL(sites[0].nContended + sites[1].nContended, 0u);
+
+    ResetLockProfile();
+    BOOST_CHECK_EQUAL(FindLock("csProfiled").nAcquired, 0u);
+
+    fLockProfiling = false;
+    {
+        LOCK(csProfiled);
+    }
+    BOOST_CHECK_EQUAL(FindLock("csProfiled").nAcquired, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(lockprofile_wait_and_hold)
+{
+    CCriticalSection csContended;
+    std::atomic<bool> fStarted(false);
+    std::thread waiter;
+    {
+        LOCK(csContended);
+        waiter = std::thread([&csContended, &fStarted] {
+            fStarted = true;
+            LOCK(csContended);
+        });
+        while (!fStarted)
+            std::this_thread::yield();
+        MilliSleep(50);
+    }
+    waiter.join();
+
+    // The waiting thread has exited, its counters are kept.
+    LockSiteStats stats = FindLock("csContended");
+    BOOST_CHECK_EQUAL(stats.nAcquired, 2u);
+    BOOST_CHECK_EQUAL(stats.nContended, 1u);
+    BOOST_CHECK(stats.nWaitNanos >= 40 * 1000 * 1000);
+    BOOST_CHECK_EQUAL(stats.nWaitNanos, stats.nMaxWaitNanos);
+    BOOST_CHECK(stats.nHoldNanos >= 50 * 1000 * 1000);
+    BOOST_CHECK(stats.nMaxHoldNanos >= 50 * 1000 * 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 
 
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "options.h"
@@ -34,6 +35,7 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -57,6 +59,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         bool isObfuscated;
         pblocktree = new CBlockTreeDB(1 << 20, isObfuscated, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, isObfuscated, true);
+        pcoinsdbview->InitUtxoCommit();
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
         InitBlockIndex();
         {
@@ -65,8 +68,11 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             BOOST_CHECK(ok);
         }
         mapArgs["-par"] = "3";
-        for (int i=0; i < Opt().ScriptCheckThreads()-1; i++)
+        for (int i=0; i < Opt().ScriptCheckThreads()-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBlockCheck);
+        }
+        threadGroup.create_thread(&ThreadBlockWriter);
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         RegisterNodeSignals(GetNodeSignals());
@@ -90,7 +96,11 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(CMutableTransaction &tx, CTxMemPo
 }
 
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(CTransaction &txn, CTxMemPool *pool) {
-    bool hasNoDependencies = pool ? pool->HasNoInputsOf(txn) : hadNoDependencies;
+    return FromTx(MakeTransactionRef(txn), pool);
+}
+
+CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransactionRef &txn, CTxMemPool *pool) {
+    bool hasNoDependencies = pool ? pool->HasNoInputsOf(*txn) : hadNoDependencies;
 
     return CTxMemPoolEntry(txn, nFee, nTime, nHeight,
                            hasNoDependencies, spendsCoinbase, lp, sigOpCount);
@@ -25,18 +25,18 @@ BOOST_AUTO_TEST_CASE(uses_txfinder) {
     BOOST_CHECK_EQUAL(9, bb.numTxsMissing());
 
     struct TwoTxFinder : public TxFinder {
-        TwoTxFinder(const CTransaction& a, const CTransaction& b) : A(a), B(b) {
+        TwoTxFinder(const CTransactionRef& a, const CTransactionRef& b) : A(a), B(b) {
         }
 
-        virtual CTransaction operator()(const ThinTx& hash) const {
-            if (hash.equals(ThinTx(A.GetHash())))
+        virtual CTransactionRef operator()(const ThinTx& hash) const {
+            if (hash.equals(ThinTx(A->GetHash())))
                 return A;
-            if (hash.equals(ThinTx(B.GetHash())))
+            if (hash.equals(ThinTx(B->GetHash())))
                 return B;
-            return CTransaction();
+            return nullptr;
         }
 
-        CTransaction A, B;
+        CTransactionRef A, B;
     };
 
     bb = ThinBlockBuilder(stub.header(), stub.allTransactions(), TwoTxFinder(block.vtx[0], block.vtx[1]));
@@ -50,7 +50,7 @@ BOOST_AUTO_TEST_CASE(finish_block) {
     ThinBlockBuilder bb(stub.header(), stub.allTransactions(), NullFinder());
 
     // The order txs are added should not matter.
-    std::vector<CTransaction> txs = block.vtx;
+    std::vector<CTransactionRef> txs = block.vtx;
     std::random_shuffle(txs.begin(), txs.end());
     for (auto& t : txs)
         BOOST_CHECK(bb.addTransaction(t) == ThinBlockBuilder::TX_ADDED);
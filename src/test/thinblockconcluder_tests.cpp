@@ -48,13 +48,13 @@ BOOST_AUTO_TEST_CASE(xthin_concluder) {
 
     XThinReReqResponse resp;
     resp.block = uint256S("0xBADBAD");
-    resp.txRequested.push_back(CTransaction());
+    resp.txRequested.push_back(MakeTransactionRef());
 
     struct DummyWorker : public XThinWorker {
         DummyWorker(ThinBlockManager& mg, NodeId id) :
             XThinWorker(mg, id), addTxCalled(false) { }
 
-        bool addTx(const uint256& block, const CTransaction& tx) override {
+        bool addTx(const uint256& block, const CTransactionRef& tx) override {
             addTxCalled = true;
             return true;
         }
@@ -85,13 +85,13 @@ BOOST_AUTO_TEST_CASE(compact_concluder) {
 
     CompactReReqResponse resp;
     resp.blockhash = uint256S("0xBADBAD");
-    resp.txn.push_back(CTransaction());
+    resp.txn.push_back(MakeTransactionRef());
 
     struct DummyWorker : public CompactWorker {
         DummyWorker(ThinBlockManager& mg, NodeId id) :
             CompactWorker(mg, id), addTxCalled(false) { }
 
-        bool addTx(const uint256& block, const CTransaction& tx) override {
+        bool addTx(const uint256& block, const CTransactionRef& tx) override {
             addTxCalled = true;
             return true;
         }
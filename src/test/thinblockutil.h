@@ -18,8 +18,8 @@ CBlock TestBlock2();
 std::unique_ptr<ThinBlockManager> GetDummyThinBlockMg();
 
 struct NullFinder : public TxFinder {
-    virtual CTransaction operator()(const ThinTx& hash) const {
-        return CTransaction();
+    virtual CTransactionRef operator()(const ThinTx& hash) const {
+        return nullptr;
     }
 };
 
@@ -163,6 +163,10 @@ BOOST_AUTO_TEST_CASE(utxo_commit_addcursor) {
         }
     }
 
+    CUtxoCommit commit_cache;
+    BOOST_CHECK(cache.GetUtxoCommit(commit_cache));
+    BOOST_CHECK(commit_step == commit_cache);
+
     BOOST_ASSERT(cache.Flush());
     LogPrintf("Starting ECMH generation from cursor\n");
 
@@ -171,6 +175,46 @@ BOOST_AUTO_TEST_CASE(utxo_commit_addcursor) {
 
     BOOST_CHECK(commit_step == commit_cursor);
     LogPrintf("ECMH generation from cursor done\n");
+
+    // The database kept its commitment up to date while flushing.
+    CUtxoCommit commit_db;
+    BOOST_CHECK(pcoinsdbview->GetUtxoCommit(commit_db));
+    BOOST_CHECK(commit_step == commit_db);
+}
+
+BOOST_AUTO_TEST_CASE(utxo_commit_incremental) {
+
+    // Spending, overwriting and flushing through a stack of caches keeps
+    // the database commitment equal to one built from the full coin set.
+    CCoinsViewCache tip(pcoinsdbview);
+    tip.SetBestBlock(GetRandHash());
+
+    std::vector<COutPoint> outpoints;
+    for (int n = 0; n < 200; n++) {
+        Coin c = RandomCoin();
+        if (c.out.scriptPubKey.IsUnspendable())
+            continue;
+        outpoints.push_back(RandomOutpoint());
+        tip.AddCoin(outpoints.back(), std::move(c), false);
+    }
+    BOOST_CHECK(tip.Flush());
+
+    {
+        CCoinsViewCache view(&tip);
+        view.SetBestBlock(GetRandHash());
+        for (size_t n = 0; n < outpoints.size(); n += 3)
+            BOOST_CHECK(view.SpendCoin(outpoints[n]));
+        // Overwrite a coin that only the database has.
+        view.AddCoin(outpoints[1], RandomCoin(), true);
+        BOOST_CHECK(view.Flush());
+    }
+    BOOST_CHECK(tip.Flush());
+
+    CUtxoCommit commit_db, commit_cursor;
+    BOOST_CHECK(pcoinsdbview->GetUtxoCommit(commit_db));
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    BOOST_CHECK(commit_cursor.AddCoinView(pcursor.get()));
+    BOOST_CHECK(commit_db == commit_cursor);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -35,11 +35,11 @@ BOOST_AUTO_TEST_CASE(empty_bloom) {
     BOOST_CHECK(thinb.txHashes.size() == b.vtx.size());
     BOOST_ASSERT(thinb.missing.size() == b.vtx.size());
 
-    typedef std::vector<CTransaction>::const_iterator auto_;
+    typedef std::vector<CTransactionRef>::const_iterator auto_;
     auto_ m = thinb.missing.begin();
     auto_ v = b.vtx.begin();
     for (; m != thinb.missing.end(); ++m, ++v)
-        BOOST_CHECK_EQUAL(m->GetHash().ToString(), v->GetHash().ToString());
+        BOOST_CHECK_EQUAL((*m)->GetHash().ToString(), (*v)->GetHash().ToString());
 }
 
 BOOST_AUTO_TEST_CASE(only_coinbase) {
@@ -48,8 +48,7 @@ BOOST_AUTO_TEST_CASE(only_coinbase) {
     CBloomFilter filter(b.vtx.size(), 0.000001, insecure_rand.rand32(), BLOOM_UPDATE_ALL);
 
     // Filter out all
-    typedef std::vector<CTransaction>::const_iterator auto_;
-    for (auto_ t = b.vtx.begin(); t != b.vtx.end(); ++t)
+    for (const CTransactionRef& t : b.vtx)
         filter.insert(t->GetHash());
 
     // Should still get coinbase tx.
@@ -57,8 +56,8 @@ BOOST_AUTO_TEST_CASE(only_coinbase) {
     BOOST_CHECK_EQUAL(thinb.txHashes.size(), b.vtx.size());
     BOOST_CHECK_EQUAL(size_t(1), thinb.missing.size());
     BOOST_CHECK_EQUAL(
-            b.vtx[0].GetHash().ToString(),
-            thinb.missing[0].GetHash().ToString());
+            b.vtx[0]->GetHash().ToString(),
+            thinb.missing[0]->GetHash().ToString());
 
 }
 
@@ -68,9 +67,9 @@ BOOST_AUTO_TEST_CASE(filter_some) {
     FastRandomContext insecure_rand;
     CBloomFilter filter(b.vtx.size(), 0.000001, insecure_rand.rand32(), BLOOM_UPDATE_ALL);
 
-    filter.insert(b.vtx[1].GetHash());
-    filter.insert(b.vtx[2].GetHash());
-    filter.insert(b.vtx[3].GetHash());
+    filter.insert(b.vtx[1]->GetHash());
+    filter.insert(b.vtx[2]->GetHash());
+    filter.insert(b.vtx[3]->GetHash());
 
     XThinBlock thinb(b, filter);
 
@@ -98,8 +97,9 @@ struct ThinBlockMgDummy : public ThinBlockManager {
     }
 };
 
-struct NullProvider : public TxHashProvider {
-    virtual void operator()(std::vector<uint256>& dst) {
+struct NullProvider : public TxFilterProvider {
+    CBloomFilter operator()() override {
+        return CBloomFilter(1, 0.0001, 0, BLOOM_UPDATE_ALL);
     }
 };
 
@@ -107,7 +107,7 @@ BOOST_AUTO_TEST_CASE(requestBlock) {
     ThinBlockMgDummy mg;
     DummyNode node;
     DummyConnman connman;
-    XThinWorker w(mg, node.id, std::unique_ptr<TxHashProvider>(new NullProvider));
+    XThinWorker w(mg, node.id, std::unique_ptr<TxFilterProvider>(new NullProvider));
 
     std::vector<CInv> reqs;
     w.requestBlock(uint256S("0xfafafa"), reqs, connman, node);
@@ -138,7 +138,7 @@ BOOST_AUTO_TEST_CASE(xthin_stub_self_validate) {
         CBloomFilter matchNone;
         matchNone.clear();
         XThinBlock xblock(TestBlock1(), matchNone);
-        xblock.missing.push_back(CTransaction());
+        xblock.missing.push_back(MakeTransactionRef());
         BOOST_CHECK_THROW(xblock.selfValidate(MAX_BLOCK_SIZE), std::invalid_argument);
     }
 
@@ -179,13 +179,13 @@ BOOST_AUTO_TEST_CASE(xthin_req_response) {
 
     CBlock block = TestBlock2();
     std::set<uint64_t> requesting;
-    requesting.insert(block.vtx[1].GetHash().GetCheapHash());
-    requesting.insert(block.vtx[2].GetHash().GetCheapHash());
+    requesting.insert(block.vtx[1]->GetHash().GetCheapHash());
+    requesting.insert(block.vtx[2]->GetHash().GetCheapHash());
     XThinReReqResponse resp(block, requesting);
 
     BOOST_CHECK_EQUAL(static_cast<size_t>(2), resp.txRequested.size());
-    BOOST_CHECK(block.vtx[1] == resp.txRequested[0]);
-    BOOST_CHECK(block.vtx[2] == resp.txRequested[1]);
+    BOOST_CHECK(*block.vtx[1] == *resp.txRequested[0]);
+    BOOST_CHECK(*block.vtx[2] == *resp.txRequested[1]);
 };
 
 BOOST_AUTO_TEST_SUITE_END();
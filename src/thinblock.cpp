@@ -118,7 +118,7 @@ bool ThinBlockWorker::isStubBuilt(const uint256& block) const {
     return mg.isStubBuilt(block);
 }
 
-bool ThinBlockWorker::addTx(const uint256& block, const CTransaction& tx) {
+bool ThinBlockWorker::addTx(const uint256& block, const CTransactionRef& tx) {
     return mg.addTx(block, tx);
 }
 
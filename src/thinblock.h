@@ -5,6 +5,7 @@
 #define BITCOIN_THINBLOCK_H
 
 #include <boost/noncopyable.hpp>
+#include "primitives/transaction.h"
 #include "uint256.h"
 #include <stdexcept>
 #include <set>
@@ -13,7 +14,6 @@
 class CNode;
 class CConnman;
 class CInv;
-class CTransaction;
 class ThinBlockManager;
 typedef int NodeId;
 class CBlockHeader;
@@ -74,14 +74,14 @@ struct StubData {
     virtual std::vector<ThinTx> allTransactions() const = 0;
 
     // Transactions provded in the stub, if any.
-    virtual std::vector<CTransaction> missingProvided() const = 0;
+    virtual std::vector<CTransactionRef> missingProvided() const = 0;
 };
 inline StubData::~StubData() { }
 
 class TxFinder {
 public:
     // returned tx is null if not found (and needs to be downloaded)
-    virtual CTransaction operator()(const ThinTx& hash) const = 0;
+    virtual CTransactionRef operator()(const ThinTx& hash) const = 0;
     virtual ~TxFinder() = 0;
 };
 inline TxFinder::~TxFinder() { }
@@ -106,7 +106,7 @@ class ThinBlockWorker : boost::noncopyable {
 
         virtual ~ThinBlockWorker();
 
-        virtual bool addTx(const uint256& block, const CTransaction& tx);
+        virtual bool addTx(const uint256& block, const CTransactionRef& tx);
 
         virtual std::vector<std::pair<int, ThinTx> > getTxsMissing(const uint256&) const;
 
@@ -24,8 +24,8 @@ ThinBlockBuilder::ThinBlockBuilder(const CBlockHeader& header,
 
     missing = wanted.size();
     for (const ThinTx& h : wanted) {
-        CTransaction tx = txFinder(h);
-        if (!tx.IsNull())
+        CTransactionRef tx = txFinder(h);
+        if (tx)
             --missing;
 
         // keep null txs, we'll download them later.
@@ -46,8 +46,9 @@ void ThinBlockBuilder::updateWantedIndex()
     }
 }
 
-ThinBlockBuilder::TXAddRes ThinBlockBuilder::addTransaction(const CTransaction& tx) {
-    assert(!tx.IsNull());
+ThinBlockBuilder::TXAddRes ThinBlockBuilder::addTransaction(const CTransactionRef& ptx) {
+    assert(ptx && !ptx->IsNull());
+    const CTransaction& tx = *ptx;
 
     auto loc = end(wanted);
 
@@ -89,12 +90,12 @@ ThinBlockBuilder::TXAddRes ThinBlockBuilder::addTransaction(const CTransaction&
 
     size_t offset = std::distance(begin(wanted), loc);
 
-    if (!thinBlock.vtx[offset].IsNull()) {
+    if (thinBlock.vtx[offset]) {
         // We already have this one.
         return TX_DUP;
     }
 
-    thinBlock.vtx[offset] = tx;
+    thinBlock.vtx[offset] = ptx;
     missing--;
     return TX_ADDED;
 }
@@ -110,7 +111,7 @@ std::vector<std::pair<int, ThinTx> > ThinBlockBuilder::getTxsMissing() const {
 
     for (size_t i = 0; i < wanted.size(); ++i)
     {
-        if (thinBlock.vtx[i].IsNull())
+        if (!thinBlock.vtx[i])
             missing.push_back({i, wanted[i]});
     }
     assert(missing.size() == this->missing);
@@ -122,7 +123,7 @@ CBlock ThinBlockBuilder::finishBlock() {
         throw thinblock_error("TXs missing. Can't build thin block.");
 
     for (size_t i = 0; i < thinBlock.vtx.size(); ++i)
-        assert(!thinBlock.vtx[i].IsNull());
+        assert(thinBlock.vtx[i]);
 
     const uint256& root = BlockMerkleRoot(thinBlock);
 
@@ -36,7 +36,7 @@ class ThinBlockBuilder {
             TX_DUP
         };
 
-        TXAddRes addTransaction(const CTransaction& tx);
+        TXAddRes addTransaction(const CTransactionRef& tx);
 
         int numTxsMissing() const;
         std::vector<std::pair<int, ThinTx> > getTxsMissing() const;
@@ -45,20 +45,20 @@ int ThinBlockManager::numWorkers(const uint256& block) const {
 // When a stub provides transactions, add those to the transaction finder (wrap it).
 struct WrappedFinder : public TxFinder {
 
-    WrappedFinder(const std::vector<CTransaction>& stubTxs, const TxFinder& w) :
+    WrappedFinder(const std::vector<CTransactionRef>& stubTxs, const TxFinder& w) :
         txs(stubTxs), wrapped(w)
     { }
 
-    virtual CTransaction operator()(const ThinTx& hash) const {
+    virtual CTransactionRef operator()(const ThinTx& hash) const {
 
-        for (const CTransaction& t : txs)
-            if (hash.equals(t.GetHash()))
+        for (const CTransactionRef& t : txs)
+            if (hash.equals(t->GetHash()))
                 return t;
 
         return wrapped(hash);
     }
 
-    const std::vector<CTransaction> txs;
+    const std::vector<CTransactionRef> txs;
     const TxFinder& wrapped;
 };
 
@@ -85,7 +85,7 @@ void ThinBlockManager::buildStub(const StubData& s, const TxFinder& txFinder,
         }
 
         // The stub may provide transactions we're missing.
-        std::vector<CTransaction> provided = s.missingProvided();
+        std::vector<CTransactionRef> provided = s.missingProvided();
         for (auto& tx : provided)
             builders[h].builder->addTransaction(tx);
     }
@@ -113,7 +113,7 @@ bool ThinBlockManager::isStubBuilt(const uint256& block) {
 
 // Try to add transaction to the block peer is providing.
 // Returns true if tx belonged to block
-bool ThinBlockManager::addTx(const uint256& block, const CTransaction& tx) {
+bool ThinBlockManager::addTx(const uint256& block, const CTransactionRef& tx) {
 
     if (!builders.count(block))
         return false;
@@ -126,7 +126,7 @@ bool ThinBlockManager::addTx(const uint256& block, const CTransaction& tx) {
 
     if (res == ThinBlockBuilder::TX_UNWANTED) {
         LogPrint(Log::BLOCK, "tx %s does not belong to block %s\n",
-                tx.GetHash().ToString(), block.ToString());
+                tx->GetHash().ToString(), block.ToString());
         return false;
     }
 
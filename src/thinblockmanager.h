@@ -4,6 +4,7 @@
 #ifndef BITCOIN_THINBLOCKMG
 #define BITCOIN_THINBLOCKMG
 
+#include "primitives/transaction.h"
 #include "uint256.h"
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
@@ -21,7 +22,6 @@ struct XThinStub;
 struct StubData;
 class ThinBlockBuilder;
 class ThinBlockWorker;
-class CTransaction;
 class ThinTx;
 class CNode;
 typedef int NodeId;
@@ -56,7 +56,7 @@ class ThinBlockManager : boost::noncopyable {
                        CConnman&, CNode& from);
         bool isStubBuilt(const uint256& block);
 
-        bool addTx(const uint256& block, const CTransaction& tx);
+        bool addTx(const uint256& block, const CTransactionRef& tx);
         void removeIfExists(const uint256& block);
         std::vector<std::pair<int, ThinTx> > getTxsMissing(const uint256& block) const;
 
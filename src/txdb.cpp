@@ -29,6 +29,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_UTXO_COMMIT = 'U';
 
 namespace {
 
@@ -80,7 +81,11 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::GetUtxoCommit(CUtxoCommit &commit) const {
+    return db.Read(DB_UTXO_COMMIT, commit);
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUtxoCommit &commitDelta) {
     CDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
@@ -98,11 +103,20 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
     }
 
+    // The commitment is only kept while it matches the best block. A missing
+    // one (such as after an interrupted write, where blocks are replayed
+    // with idempotent coin updates) is rebuilt by InitUtxoCommit.
+    CUtxoCommit commit;
+    bool fCommit = GetUtxoCommit(commit);
+    if (fCommit)
+        commit.Add(commitDelta);
+
     // In the first batch, mark the database as being in the middle of a
     // transition from old_tip to hashBlock.
     // A vector is used for future extensibility, as we may want to support
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
+    batch.Erase(DB_UTXO_COMMIT);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -134,6 +148,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (fCommit)
+        batch.Write(DB_UTXO_COMMIT, commit);
 
     LogPrint(Log::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
@@ -141,6 +157,19 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::InitUtxoCommit() {
+    if (db.Exists(DB_UTXO_COMMIT))
+        return true;
+    if (!GetHeadBlocks().empty())
+        return error("%s: coin database is in an inconsistent state", __func__);
+
+    CUtxoCommit commit;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    if (!commit.AddCoinView(pcursor.get()))
+        return false;
+    return db.Write(DB_UTXO_COMMIT, commit, true);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -171,20 +200,60 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    return new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+}
+
+CCoinsViewSnapshot *CCoinsViewDB::Snapshot() const
+{
+    return new CCoinsViewDBSnapshot(const_cast<CDBWrapper&>(db));
+}
+
+CCoinsViewDBSnapshot::CCoinsViewDBSnapshot(CDBWrapper &dbIn) : db(dbIn), snapshot(dbIn.GetSnapshot())
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+    pcursor->Seek(DB_BEST_BLOCK);
+    char key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key == DB_BEST_BLOCK)
+        pcursor->GetValue(hashBlock);
+}
+
+CCoinsViewDBSnapshot::~CCoinsViewDBSnapshot()
+{
+    db.ReleaseSnapshot(snapshot);
+}
+
+CCoinsViewCursor *CCoinsViewDBSnapshot::Cursor(uint8_t prefix) const
+{
+    return new CCoinsViewDBCursor(db.NewIterator(snapshot), hashBlock, prefix);
+}
+
+CCoinsViewDBCursor::CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, int prefixIn) :
+    CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), prefix(prefixIn)
+{
+    if (prefix < 0) {
+        pcursor->Seek(DB_COIN);
+    } else {
+        uint256 first;
+        *first.begin() = prefix;
+        pcursor->Seek(std::make_pair(DB_COIN, first));
+    }
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    CacheKey();
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
+        keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    } else if (prefix >= 0 && *keyTmp.second.hash.begin() != prefix) {
+        keyTmp.first = 0; // Past the end of the range
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -215,12 +284,7 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -75,11 +75,17 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CUtxoCommit &commitDelta) override;
+    bool GetUtxoCommit(CUtxoCommit &commit) const override;
     CCoinsViewCursor *Cursor() const override;
+    CCoinsViewSnapshot *Snapshot() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+
+    //! Build the UTXO commitment from the full coin set if the database does
+    //! not have one. Requires the database to be in a consistent state.
+    bool InitUtxoCommit();
     size_t EstimateSize() const override;
 };
 
@@ -97,10 +103,32 @@ public:
     void Next();
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, int prefixIn = -1);
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! First txid byte the cursor is limited to, or -1 for all coins
+    int prefix;
+
+    void CacheKey();
+
+    friend class CCoinsViewDB;
+    friend class CCoinsViewDBSnapshot;
+};
+
+/** Specialization of CCoinsViewSnapshot on a snapshot of the coin database */
+class CCoinsViewDBSnapshot : public CCoinsViewSnapshot
+{
+public:
+    ~CCoinsViewDBSnapshot();
+
+    uint256 GetBestBlock() const override { return hashBlock; }
+    CCoinsViewCursor *Cursor(uint8_t prefix) const override;
+
+private:
+    CCoinsViewDBSnapshot(CDBWrapper &dbIn);
+    CDBWrapper &db;
+    const leveldb::Snapshot *snapshot;
+    uint256 hashBlock;
 
     friend class CCoinsViewDB;
 };
@@ -10,6 +10,7 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "mempooltemplate.h"
 #include "policy/fees.h"
 #include "streams.h"
 #include "timedata.h"
@@ -22,7 +23,7 @@
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _nHeight,
                                  bool poolHasNoInputsOf, bool _spendsCoinbase,
                                  LockPoints lp, unsigned int _sigOps):
@@ -30,7 +31,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
         hadNoDependencies(poolHasNoInputsOf), spendsCoinbase(_spendsCoinbase),
         lockPoints(lp), sigOpCount(_sigOps)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nTxSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
     nUsageSize = RecursiveDynamicUsage(tx);
 
     nCountWithDescendants = 1;
@@ -62,46 +63,49 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
-void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
-{
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        BOOST_FOREACH(const txiter childEntry, setChildren) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                BOOST_FOREACH(const txiter cacheEntry, cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
-                }
-            } else if (!setAllDescendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
-            }
+bool CTxMemPool::UpdateForDescendants(txiter updateIt, const std::set<uint256> &setExclude,
+                                      uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+                                      const std::vector<bool> &vExceeded)
+{
+    // Walked breadth first, with vDescendants as the queue. Stops as soon
+    // as there are too many, so the work done is bounded by the limits.
+    std::vector<txiter> vDescendants;
+    uint64_t nCount = 1;
+    uint64_t nSize = updateIt->GetTxSize();
+    graph.NewEpoch();
+    graph.Visit(updateIt->nGraphNode);
+    for (MempoolGraph::Node child : graph.Children(updateIt->nGraphNode)) {
+        if (graph.Visit(child))
+            vDescendants.push_back(vGraphEntries[child]);
+    }
+    for (size_t i = 0; i < vDescendants.size(); ++i) {
+        const txiter cit = vDescendants[i];
+        if (vExceeded[cit->nGraphNode])
+            return false;
+        ++nCount;
+        nSize += cit->GetTxSize();
+        if (nCount > limitDescendantCount || nSize > limitDescendantSize)
+            return false;
+        for (MempoolGraph::Node child : graph.Children(cit->nGraphNode)) {
+            if (graph.Visit(child))
+                vDescendants.push_back(vGraphEntries[child]);
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
-    // Update and add to cached descendant map
+    // vDescendants now contains all in-mempool descendants of updateIt.
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    BOOST_FOREACH(txiter cit, setAllDescendants) {
+    for (txiter cit : vDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetFee(), 1));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
+    return true;
 }
 
 // vHashesToUpdate is the set of transaction hashes from a disconnected block
@@ -109,63 +113,88 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 // for each entry, look for descendants that are outside hashesToUpdate, and
 // add fee/size information for such descendants to the parent.
 // for each such descendant, also update the ancestor state to include the parent.
-void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
+void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate,
+                                             uint64_t limitDescendantCount, uint64_t limitDescendantSize)
 {
     LOCK(cs);
-    // For each entry in vHashesToUpdate, store the set of in-mempool, but not
-    // in-vHashesToUpdate transactions, so that we don't have to recalculate
-    // descendants when we come across a previously seen entry.
-    cacheMap mapMemPoolDescendantsToUpdate;
-
     // Use a set for lookups into vHashesToUpdate (these entries are already
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
 
+    // Entries with more descendants than the limits allow, by node. Their
+    // state is left as it is, as is the state of their ancestors in the
+    // block, which are in it as well.
+    std::vector<bool> vExceeded(graph.Size(), false);
+    bool fExceeded = false;
+
     // Iterate in reverse, so that whenever we are looking at at a transaction
     // we are sure that all in-mempool descendants have already been processed.
-    // This maximizes the benefit of the descendant cache and guarantees that
-    // setMemPoolChildren will be updated, an assumption made in
-    // UpdateForDescendants.
+    // This guarantees that the children links will be updated, an assumption
+    // made in UpdateForDescendants.
     BOOST_REVERSE_FOREACH(const uint256 &hash, vHashesToUpdate) {
-        // we cache the in-mempool children to avoid duplicate updates
-        setEntries setChildren;
         // calculate children from mapNextTx
         txiter it = mapTx.find(hash);
         if (it == mapTx.end()) {
             continue;
         }
         std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(hash, 0));
-        // First calculate the children, and update setMemPoolChildren to
-        // include them, and update their setMemPoolParents to include this tx.
+        // First calculate the children, and link them to this tx.
         for (; iter != mapNextTx.end() && iter->first.hash == hash; ++iter) {
             const uint256 &childHash = iter->second.ptx->GetHash();
             txiter childIter = mapTx.find(childHash);
             assert(childIter != mapTx.end());
-            // We can skip updating entries we've encountered before or that
-            // are in the block (which are already accounted for).
-            if (setChildren.insert(childIter).second && !setAlreadyIncluded.count(childHash)) {
-                UpdateChild(it, childIter, true);
-                UpdateParent(childIter, it, true);
+            // We can skip entries that are in the block (which are already
+            // linked and accounted for).
+            if (!setAlreadyIncluded.count(childHash)) {
+                graph.AddLink(it->nGraphNode, childIter->nGraphNode);
             }
         }
-        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
+        if (!UpdateForDescendants(it, setAlreadyIncluded, limitDescendantCount, limitDescendantSize, vExceeded)) {
+            vExceeded[it->nGraphNode] = true;
+            fExceeded = true;
+        }
+    }
+    if (!fExceeded)
+        return;
+
+    setEntries stage;
+    for (size_t n = 0; n < vExceeded.size(); ++n) {
+        if (vExceeded[n])
+            CalculateDescendants(vGraphEntries[n], stage);
+    }
+    // Only the ancestors that are not being removed account for what is.
+    std::vector<txiter> vAncestors;
+    for (txiter removeIt : stage) {
+        vAncestors.clear();
+        WalkAncestors(removeIt, vAncestors);
+        for (txiter ancestorIt : vAncestors) {
+            if (!stage.count(ancestorIt))
+                mapTx.modify(ancestorIt, update_descendant_state(-(int64_t)removeIt->GetTxSize(), -removeIt->GetFee(), -1));
+        }
     }
+    for (txiter removeIt : stage)
+        UpdateLinksForRemoval(removeIt);
+    LogPrint(Log::MEMPOOL, "%s: removing %u transactions with too many descendants\n", __func__, stage.size());
+    for (txiter removeIt : stage)
+        removeUnchecked(removeIt);
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */)
 {
-    setEntries parentHashes;
+    // Entries to walk next, each visited in the graph when added.
+    std::vector<txiter> stage;
     const CTransaction &tx = entry.GetTx();
 
+    graph.NewEpoch();
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
-                if (parentHashes.size() + 1 > limitAncestorCount) {
+            if (piter != mapTx.end() && graph.Visit(piter->nGraphNode)) {
+                stage.push_back(piter);
+                if (stage.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
@@ -175,16 +204,20 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        graph.Visit(it->nGraphNode);
+        for (MempoolGraph::Node parent : graph.Parents(it->nGraphNode)) {
+            graph.Visit(parent);
+            stage.push_back(vGraphEntries[parent]);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+    while (!stage.empty()) {
+        txiter stageit = stage.back();
+        stage.pop_back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -198,13 +231,12 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
+        for (MempoolGraph::Node parent : graph.Parents(stageit->nGraphNode)) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (graph.Visit(parent)) {
+                stage.push_back(vGraphEntries[parent]);
             }
-            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (stage.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -214,6 +246,40 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     return true;
 }
 
+void CTxMemPool::WalkAncestors(txiter entry, std::vector<txiter>& ancestors)
+{
+    const size_t nBegin = ancestors.size();
+    graph.NewEpoch();
+    graph.Visit(entry->nGraphNode);
+    for (MempoolGraph::Node parent : graph.Parents(entry->nGraphNode)) {
+        if (graph.Visit(parent))
+            ancestors.push_back(vGraphEntries[parent]);
+    }
+    for (size_t i = nBegin; i < ancestors.size(); ++i) {
+        for (MempoolGraph::Node parent : graph.Parents(ancestors[i]->nGraphNode)) {
+            if (graph.Visit(parent))
+                ancestors.push_back(vGraphEntries[parent]);
+        }
+    }
+}
+
+void CTxMemPool::WalkDescendants(txiter entry, std::vector<txiter>& descendants)
+{
+    const size_t nBegin = descendants.size();
+    graph.NewEpoch();
+    graph.Visit(entry->nGraphNode);
+    for (MempoolGraph::Node child : graph.Children(entry->nGraphNode)) {
+        if (graph.Visit(child))
+            descendants.push_back(vGraphEntries[child]);
+    }
+    for (size_t i = nBegin; i < descendants.size(); ++i) {
+        for (MempoolGraph::Node child : graph.Children(descendants[i]->nGraphNode)) {
+            if (graph.Visit(child))
+                descendants.push_back(vGraphEntries[child]);
+        }
+    }
+}
+
 void CTxMemPool::queryAncestors(const uint256 txHash,
                                 std::vector<uint256>& vAncestors, uint64_t nLocalServices) {
     CTxMemPool::setEntries setAncestors;
@@ -234,18 +300,10 @@ void CTxMemPool::queryAncestors(const uint256 txHash,
 }
 
 
-void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+void CTxMemPool::UpdateAncestorsOf(txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
-    // add or remove this tx as a child of each parent
-    BOOST_FOREACH(txiter piter, parentIters) {
-        UpdateChild(piter, it, add);
-    }
-    const int64_t updateCount = (add ? 1 : -1);
-    const int64_t updateSize = updateCount * it->GetTxSize();
-    const CAmount updateFee = updateCount * it->GetFee();
     BOOST_FOREACH(txiter ancestorIt, setAncestors) {
-        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+        mapTx.modify(ancestorIt, update_descendant_state(it->GetTxSize(), it->GetFee(), 1));
     }
 }
 
@@ -261,68 +319,63 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
     mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount));
 }
 
-void CTxMemPool::UpdateChildrenForRemoval(txiter it)
+void CTxMemPool::UpdateLinksForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    BOOST_FOREACH(txiter updateIt, setMemPoolChildren) {
-        UpdateParent(updateIt, it, false);
-    }
+    const MempoolGraph::Node node = it->nGraphNode;
+    while (!graph.Parents(node).empty())
+        graph.RemoveLink(*graph.Parents(node).begin(), node);
+    while (!graph.Children(node).empty())
+        graph.RemoveLink(node, *graph.Children(node).begin());
 }
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::vector<txiter> vWalked;
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not the links (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         BOOST_FOREACH(txiter removeIt, entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            vWalked.clear();
+            WalkDescendants(removeIt, vWalked);
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetFee();
-            BOOST_FOREACH(txiter dit, setDescendants) {
+            BOOST_FOREACH(txiter dit, vWalked) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1));
             }
         }
     }
     BOOST_FOREACH(txiter removeIt, entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
-        // However, if we happen to be in the middle of processing a reorg, then
+        // If we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of
+        // of ancestors reachable via the links will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then the links
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
-        // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
-    }
-    // After updating all the ancestor sizes, we can now sever the link between each
-    // transaction being removed and any mempool children (ie, update setMemPoolParents
-    // for each direct child of a transaction being removed).
+        // and it's important that we use the links as the set of things to
+        // update for removal.
+        vWalked.clear();
+        WalkAncestors(removeIt, vWalked);
+        int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+        CAmount modifyFee = -removeIt->GetFee();
+        BOOST_FOREACH(txiter ancestorIt, vWalked) {
+            mapTx.modify(ancestorIt, update_descendant_state(modifySize, modifyFee, -1));
+        }
+    }
+    // After updating all the ancestor sizes, we can now sever the links
+    // between each transaction being removed and its parents and children.
     BOOST_FOREACH(txiter removeIt, entriesToRemove) {
-        UpdateChildrenForRemoval(removeIt);
+        UpdateLinksForRemoval(removeIt);
     }
 }
 
@@ -347,7 +400,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), blockTemplate(new MempoolTemplate(*this))
 {
     _clear(); //lock free clear
 
@@ -389,11 +442,17 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    newit->nGraphNode = graph.AddNode();
+    if (newit->nGraphNode >= vGraphEntries.size())
+        vGraphEntries.resize(newit->nGraphNode + 1);
+    vGraphEntries[newit->nGraphNode] = newit;
+    newit->vTxHashesIdx = vTxHashes.size();
+    vTxHashes.push_back(hash);
+    vTxEntries.push_back(newit);
+    if (recentTxFilter)
+        recentTxFilter->insert(hash);
 
     // Update cachedInnerUsage to include contained transaction's usage.
-    // (When we update the entry for in-mempool parents, memory usage will be
-    // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
 
     const CTransaction& tx = newit->GetTx();
@@ -413,10 +472,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     BOOST_FOREACH (const uint256 &phash, setParentTransactions) {
         txiter pit = mapTx.find(phash);
         if (pit != mapTx.end()) {
-            UpdateParent(newit, pit, true);
+            graph.AddLink(pit->nGraphNode, newit->nGraphNode);
         }
     }
-    UpdateAncestorsOf(true, newit, setAncestors);
+    UpdateAncestorsOf(newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
 
     // Update transaction's score for any feeDelta created by PrioritiseTransaction
@@ -425,6 +484,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         mapTx.modify(newit, update_fee_delta(delta));
     }
 
+    blockTemplate->AddTx(newit, setAncestors);
+
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
@@ -440,8 +501,17 @@ void CTxMemPool::removeUnchecked(txiter it)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    graph.RemoveNode(it->nGraphNode);
+    if (vTxHashes.size() > 1) {
+        const size_t idx = it->vTxHashesIdx;
+        vTxHashes[idx] = std::move(vTxHashes.back());
+        vTxEntries[idx] = vTxEntries.back();
+        vTxEntries[idx]->vTxHashesIdx = idx;
+    }
+    vTxHashes.pop_back();
+    vTxEntries.pop_back();
+    ++nRecentTxFilterRemoved;
+    blockTemplate->RemoveTx(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(hash);
@@ -455,22 +525,23 @@ void CTxMemPool::removeUnchecked(txiter it)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
+    std::vector<txiter> stage;
+    graph.NewEpoch();
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        graph.Visit(entryit->nGraphNode);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        BOOST_FOREACH(const txiter &childiter, setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+        for (MempoolGraph::Node child : graph.Children(it->nGraphNode)) {
+            if (graph.Visit(child) && !setDescendants.count(vGraphEntries[child])) {
+                stage.push_back(vGraphEntries[child]);
             }
         }
     }
@@ -561,22 +632,23 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                                 std::list<CTransaction>& conflicts, bool fCurrentEstimate)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    for (const CTransactionRef& ptx : vtx)
     {
-        uint256 hash = tx.GetHash();
+        uint256 hash = ptx->GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
         if (i != mapTx.end())
             entries.push_back(*i);
     }
     MempoolFeeModifier& modifier = GetFeeModifier();
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    for (const CTransactionRef& ptx : vtx)
     {
+        const CTransaction& tx = *ptx;
         txiter it = mapTx.find(tx.GetHash());
         if (it != mapTx.end()) {
             setEntries stage;
@@ -592,8 +664,14 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    graph.Clear();
+    vGraphEntries.clear();
     mapTx.clear();
+    vTxHashes.clear();
+    vTxEntries.clear();
+    recentTxFilter.reset();
+    nRecentTxFilterRemoved = 0;
+    blockTemplate->Clear();
     mapNextTx.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
@@ -629,10 +707,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        assert(vTxEntries[it->vTxHashesIdx] == it);
+        assert(vTxHashes[it->vTxHashesIdx] == tx.GetHash());
+        assert(vGraphEntries[it->nGraphNode] == it);
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -658,7 +735,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second.n == i);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        const LinkedEntries parents = GetMemPoolParents(it);
+        assert(parents.size() == setParentCheck.size());
+        assert(setParentCheck == setEntries(parents.begin(), parents.end()));
         // Also check to make sure ancestor size/fees are >= sum with immediate
         // parents.
         assert(it->GetSizeWithAncestors() >= parentSizes + it->GetTxSize());
@@ -677,7 +756,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childFees += childit->GetFee();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        const LinkedEntries children = GetMemPoolChildren(it);
+        assert(children.size() == setChildrenCheck.size());
+        assert(setChildrenCheck == setEntries(children.begin(), children.end()));
         // Also check to make sure size/fees is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -723,16 +804,34 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(vTxHashes.size() == mapTx.size());
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid) const
 {
-    vtxid.clear();
+    LOCK(cs);
+    vtxid = vTxHashes;
+}
 
+CBloomFilter CTxMemPool::GetRecentTxFilter()
+{
     LOCK(cs);
-    vtxid.reserve(mapTx.size());
-    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back(mi->GetTx().GetHash());
+    // Transactions that leave the mempool stay in the filter, where they
+    // are harmless as most of them are in blocks already, but take up room.
+    // Start over once many have left.
+    if (!recentTxFilter || nRecentTxFilterRemoved >= RECENT_TX_FILTER_ELEMENTS / 2) {
+        if (!recentTxFilter) {
+            recentTxFilter.reset(new CRotatingBloomFilter(RECENT_TX_FILTER_ELEMENTS,
+                    RECENT_TX_FILTER_FPRATE, GetRand(std::numeric_limits<uint32_t>::max()),
+                    BLOOM_UPDATE_ALL));
+        }
+        recentTxFilter->clear();
+        // Oldest first, so that the newest are kept if they don't all fit.
+        for (const CTxMemPoolEntry& e : mapTx.get<2>())
+            recentTxFilter->insert(e.GetTx().GetHash());
+        nRecentTxFilterRemoved = 0;
+    }
+    return recentTxFilter->GetFilter();
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
@@ -744,6 +843,15 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+CTransactionRef CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end())
+        return nullptr;
+    return i->GetSharedTx();
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -816,7 +924,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + GetFeeModifier().DynamicMemoryUsage() + memusage::DynamicUsage(mapLinks) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + GetFeeModifier().DynamicMemoryUsage() + graph.DynamicMemoryUsage() + memusage::DynamicUsage(vGraphEntries) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(vTxEntries) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants) {
@@ -853,40 +961,16 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, fCurrentEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
-{
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
-}
-
-void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
-{
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
-}
-
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+CTxMemPool::LinkedEntries CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return LinkedEntries(graph.Parents(entry->nGraphNode), vGraphEntries);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+CTxMemPool::LinkedEntries CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return LinkedEntries(graph.Children(entry->nGraphNode), vGraphEntries);
 }
 
 void CTxMemPool::TrimToSize(size_t sizelimit) {
@@ -6,12 +6,17 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <iterator>
 #include <list>
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "amount.h"
+#include "bloom.h"
 #include "coins.h"
 #include "mempoolfeemodifier.h"
+#include "mempoolgraph.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "utilhash.h"
@@ -43,6 +48,7 @@ struct LockPoints
 };
 
 class CTxMemPool;
+class MempoolTemplate;
 
 /** \class CTxMemPoolEntry
  *
@@ -64,7 +70,7 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
-    CTransaction tx;
+    CTransactionRef tx;
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nUsageSize; //! ... and total memory usage
@@ -91,13 +97,14 @@ private:
     CAmount nFeesWithAncestors;
 
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _nHeight,
                     bool poolHasNoInputsOf, bool spendsCoinbase, LockPoints lp,
                     unsigned int nSigOps);
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    const CTransactionRef& GetSharedTx() const { return this->tx; }
     CAmount GetFee() const { return nFee; }
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
@@ -127,6 +134,9 @@ public:
     CAmount GetFeesWithAncestors() const { return nFeesWithAncestors; }
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
+
+    mutable size_t vTxHashesIdx; //!< Index in CTxMemPool::vTxHashes
+    mutable MempoolGraph::Node nGraphNode; //!< Node in CTxMemPool::graph
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -283,6 +293,10 @@ public:
     size_t DynamicMemoryUsage() const { return 0; }
 };
 
+/** Capacity and false positive rate of CTxMemPool::GetRecentTxFilter(). */
+static const unsigned int RECENT_TX_FILTER_ELEMENTS = 10000;
+static const double RECENT_TX_FILTER_FPRATE = 0.0001;
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -306,7 +320,7 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the set of in-mempool direct parents and direct children in graph.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -339,7 +353,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the links in graph may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -352,11 +366,12 @@ public:
  *
  * Adding transactions from a disconnected block can be very time consuming,
  * because we don't have a way to limit the number of in-mempool descendants.
- * To bound CPU processing, we limit the amount of work we're willing to do
- * to properly update the descendant information for a tx being added from
- * a disconnected block.  If we would exceed the limit, then we instead mark
- * the entry as "dirty", and set the feerate for sorting purposes to be equal
- * the feerate of the transaction without any descendants.
+ * To bound CPU processing, UpdateTransactionsFromBlock() stops walking the
+ * descendants of a transaction once there are more than the descendant
+ * limits allow, and removes the transaction and its descendants instead.
+ *
+ * Ancestors and descendants are walked over the links in graph, which marks
+ * the entries a walk has visited, rather than collecting them in sets.
  *
  */
 class CTxMemPool
@@ -402,22 +417,63 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
-private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
-
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    // In-mempool parents or children of an entry. Invalidated by changes
+    // to the mempool.
+    class LinkedEntries {
+    public:
+        class const_iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef txiter value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const txiter* pointer;
+            typedef const txiter& reference;
+
+            const_iterator(const MempoolGraph::Node* p, const std::vector<txiter>& entries) :
+                p(p), entries(&entries) { }
+            reference operator*() const { return (*entries)[*p]; }
+            pointer operator->() const { return &(*entries)[*p]; }
+            const_iterator& operator++() { ++p; return *this; }
+            bool operator==(const const_iterator& o) const { return p == o.p; }
+            bool operator!=(const const_iterator& o) const { return p != o.p; }
+        private:
+            const MempoolGraph::Node* p;
+            const std::vector<txiter>* entries;
+        };
+
+        LinkedEntries(const MempoolGraph::Range& nodes, const std::vector<txiter>& entries) :
+            nodes(nodes), entries(entries) { }
+        const_iterator begin() const { return const_iterator(nodes.begin(), entries); }
+        const_iterator end() const { return const_iterator(nodes.end(), entries); }
+        size_t size() const { return nodes.size(); }
+        bool empty() const { return nodes.empty(); }
+    private:
+        MempoolGraph::Range nodes;
+        const std::vector<txiter>& entries;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    LinkedEntries GetMemPoolParents(txiter entry) const;
+    LinkedEntries GetMemPoolChildren(txiter entry) const;
+private:
+    // Links between entries. vGraphEntries holds the entry of each node.
+    MempoolGraph graph;
+    std::vector<txiter> vGraphEntries;
     MempoolFeeModifier feemodifier;
 
-    void UpdateParent(txiter entry, txiter parent, bool add);
-    void UpdateChild(txiter entry, txiter child, bool add);
+    // Txids of all entries in one contiguous array, so that a pass over
+    // all of them (such as computing compact block short IDs) doesn't walk
+    // mapTx. vTxEntries holds the entries at the same positions. Removal
+    // moves the last element into the freed position.
+    std::vector<uint256> vTxHashes;
+    std::vector<txiter> vTxEntries;
+
+    // Filter over recently added transactions, see GetRecentTxFilter.
+    // Created on first use so that its tweak is drawn after startup.
+    std::unique_ptr<CRotatingBloomFilter> recentTxFilter;
+    size_t nRecentTxFilterRemoved;
+
+    // Transactions of the next block, see MempoolTemplate.
+    std::unique_ptr<MempoolTemplate> blockTemplate;
 
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
@@ -444,11 +500,18 @@ public:
     void removeRecursive(const CTransaction &tx, std::list<CTransaction>& removed);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+    void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     virtual void clear();
     void _clear(); //lock free
     void queryHashes(std::vector<uint256>& vtxid) const;
+    /**
+     * Filter over the transactions most recently added to the mempool, sent
+     * with xthin requests so that the peer leaves them out of the block.
+     * Maintained as transactions come and go, rather than built from the
+     * whole mempool for each request.
+     */
+    CBloomFilter GetRecentTxFilter();
     bool isSpent(const COutPoint& outpoint) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -476,8 +539,12 @@ public:
      *  child transactions present in hashesToUpdate, which are already accounted
      *  for).  Note: hashesToUpdate should be the set of transactions from the
      *  disconnected block that have been accepted back into the mempool.
+     *  Transactions that turn out to have more in-mempool descendants than
+     *  limitDescendantCount and limitDescendantSize allow are removed, along
+     *  with their descendants.
      */
-    void UpdateTransactionsFromBlock(const std::vector<uint256> &hashesToUpdate);
+    void UpdateTransactionsFromBlock(const std::vector<uint256> &hashesToUpdate,
+                                     uint64_t limitDescendantCount, uint64_t limitDescendantSize);
 
     /** Try to calculate all in-mempool ancestors of entry.
      *  (these are all calculated including the tx itself)
@@ -487,7 +554,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from graph. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true);
 
@@ -522,6 +589,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** Returns the transaction, or null if it is not in the pool. */
+    CTransactionRef get(const uint256& hash) const;
 
     bool exists(const COutPoint& outpoint) const
     {
@@ -542,6 +611,8 @@ public:
     MempoolFeeModifier& GetFeeModifier() { return feemodifier; }
     const MempoolFeeModifier& GetFeeModifier() const { return feemodifier; }
 
+    MempoolTemplate& GetBlockTemplate() { return *blockTemplate; }
+
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
      *  the descendants for a single transaction that has been added to the
@@ -552,21 +623,25 @@ private:
      *  updated and hence their state is already reflected in the parent
      *  state).
      *
-     *  cachedDescendants will be updated with the descendants of the transaction
-     *  being updated, so that future invocations don't need to walk the
-     *  same transaction again, if encountered in another transaction chain.
+     *  Returns false, without updating anything, if the transaction has
+     *  more descendants than the limits allow, or any in vExceeded.
      */
-    void UpdateForDescendants(txiter updateIt,
-            cacheMap &cachedDescendants,
-            const std::set<uint256> &setExclude);
-    /** Update ancestors of hash to add/remove it as a descendant transaction. */
-    void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
+    bool UpdateForDescendants(txiter updateIt,
+            const std::set<uint256> &setExclude,
+            uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+            const std::vector<bool> &vExceeded);
+    /** Update ancestors of hash to add it as a descendant transaction. */
+    void UpdateAncestorsOf(txiter hash, setEntries &setAncestors);
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
     /** For each transaction being removed, update ancestors and any direct children. */
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
-    /** Sever link between specified transaction and direct children. */
-    void UpdateChildrenForRemoval(txiter entry);
+    /** Sever links between specified transaction and its parents and children. */
+    void UpdateLinksForRemoval(txiter entry);
+    /** Append all in-mempool ancestors or descendants of an entry, not
+     *  including itself, to the vector. */
+    void WalkAncestors(txiter entry, std::vector<txiter>& ancestors);
+    void WalkDescendants(txiter entry, std::vector<txiter>& descendants);
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
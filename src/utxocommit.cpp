@@ -70,7 +70,7 @@ uint256 CUtxoCommit::GetHash() const {
 }
 
 bool CUtxoCommit::AddCoinView(CCoinsViewCursor *pcursor) {
-    LogPrintf("Adding existing UTXO set to the UTXO commitment");
+    LogPrintf("Adding existing UTXO set to the UTXO commitment\n");
 
     // TODO: Parallelize
     int n = 0;
@@ -14,22 +14,17 @@
 #include <algorithm>
 #include <unordered_set>
 
-bool isCollision(const std::vector<uint64_t>& txHashes, const uint64_t& hash) {
-    return std::find(txHashes.begin(), txHashes.end(), hash)
-        != txHashes.end();
-}
-
 XThinBlock::XThinBlock() { }
 
 XThinBlock::XThinBlock(const CBlock& block, const CBloomFilter& bloom, bool checkCollision) {
     header = block.GetBlockHeader();
+    txHashes.reserve(block.vtx.size());
 
-    typedef std::vector<CTransaction>::const_iterator auto_;
-
-    for (auto_ tx = block.vtx.begin(); tx != block.vtx.end(); ++tx) {
+    std::unordered_set<uint64_t> seen;
+    for (const CTransactionRef& tx : block.vtx) {
 
         uint64_t hash = tx->GetHash().GetCheapHash();
-        if (checkCollision && isCollision(txHashes, hash))
+        if (checkCollision && !seen.insert(hash).second)
             throw xthin_collision_error();
         txHashes.push_back(hash);
 
@@ -37,12 +32,12 @@ XThinBlock::XThinBlock(const CBlock& block, const CBloomFilter& bloom, bool chec
         // block is seen.
         if (missing.empty())
         {
-            missing.push_back(*tx);
+            missing.push_back(tx);
             continue;
         }
 
         if (!bloom.contains(tx->GetHash()))
-            missing.push_back(*tx);
+            missing.push_back(tx);
     }
 }
 
@@ -69,8 +64,7 @@ void XThinBlock::selfValidate(uint64_t currMaxBlockSize) const {
         copy.insert(*t);
     }
 
-    typedef std::vector<CTransaction>::const_iterator auto__;
-    for (auto__ t = missing.begin(); t != missing.end(); ++t) {
+    for (const CTransactionRef& t : missing) {
         auto_ found = std::find(txHashes.begin(), txHashes.end(), t->GetHash().GetCheapHash());
         if (found != txHashes.end())
             continue;
@@ -80,31 +74,10 @@ void XThinBlock::selfValidate(uint64_t currMaxBlockSize) const {
     }
 }
 
-// Filter where we tell the node we're requesting a thin block
-// from what transactions *not* to include.
-CBloomFilter createDontWantFilter(TxHashProvider& hashProvider)
-{
-    std::vector<uint256> hashes;
-    hashProvider(hashes);
-
-    // TODO: Generate a filter in a smart way based on mempool size.
-    // From comment for MAX_BLOOM_FILTER_SIZE: 10,000 items and <0.0001%
-    int filterElements = std::min(10000, static_cast<int>(hashes.size()));
-    int toInsert = filterElements;
-    filterElements = std::max(1, filterElements); // >= 1 required by bloom filter
-    FastRandomContext insecure_rand;
-    CBloomFilter filter(filterElements, 0.0001,
-            insecure_rand.rand32(), BLOOM_UPDATE_ALL);
-
-    for (int i = 0; i < toInsert; ++i)
-        filter.insert(hashes[i]);
-    return filter;
-};
-
 XThinWorker::XThinWorker(ThinBlockManager& m, NodeId n,
-                std::unique_ptr<TxHashProvider> h) :
+                std::unique_ptr<TxFilterProvider> f) :
     ThinBlockWorker(m, n),
-    HashProvider(h.release())
+    FilterProvider(f.release())
 {
 }
 
@@ -116,7 +89,9 @@ void XThinWorker::requestBlock(const uint256& block,
                                std::vector<CInv>& getDataReq,
                                CConnman& connman, CNode& node)
 {
-    CBloomFilter dontWant = createDontWantFilter(*HashProvider);
+    // Filter where we tell the node we're requesting a thin block
+    // from what transactions *not* to include.
+    CBloomFilter dontWant = (*FilterProvider)();
 
     CInv inv(MSG_XTHINBLOCK, block);
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -137,10 +112,9 @@ XThinReReqResponse::XThinReReqResponse(const CBlock& srcBlock,
     if (srcBlock.vtx.size() < requesting.size())
         throw std::runtime_error("more transactions in re-request than in block");
 
-    typedef std::vector<CTransaction>::const_iterator auto_;
-    for (auto_ t = srcBlock.vtx.begin(); t != srcBlock.vtx.end(); ++t)
+    for (const CTransactionRef& t : srcBlock.vtx)
         if (requesting.count(t->GetHash().GetCheapHash()))
-            txRequested.push_back(*t);
+            txRequested.push_back(t);
 
     if (txRequested.size() < requesting.size())
         throw std::runtime_error("request contained transactions not in block");
@@ -34,7 +34,7 @@ class XThinBlock {
 
         CBlockHeader header;
         std::vector<uint64_t> txHashes; // all transactions in the block
-        std::vector<CTransaction> missing; // transactions that were missing
+        std::vector<CTransactionRef> missing; // transactions that were missing
 
         // primitive check to see if block is valid
         // throws on error
@@ -54,7 +54,7 @@ class XThinWorker : public ThinBlockWorker {
 
     public:
         XThinWorker(ThinBlockManager&, NodeId,
-                std::unique_ptr<struct TxHashProvider>);
+                std::unique_ptr<struct TxFilterProvider>);
 
         // only for unit testing
         XThinWorker(ThinBlockManager&, NodeId);
@@ -64,17 +64,17 @@ class XThinWorker : public ThinBlockWorker {
                           CConnman&, CNode& node) override;
 
     private:
-        std::unique_ptr<struct TxHashProvider> HashProvider;
+        std::unique_ptr<struct TxFilterProvider> FilterProvider;
 
 };
 
-// Functor for providing list of transactions that
+// Functor for providing a filter of transactions that
 // we already have (and don't need when requesting a thin block)
-struct TxHashProvider {
-    virtual void operator()(std::vector<uint256>& dst) = 0;
-    virtual ~TxHashProvider() = 0;
+struct TxFilterProvider {
+    virtual CBloomFilter operator()() = 0;
+    virtual ~TxFilterProvider() = 0;
 };
-inline TxHashProvider::~TxHashProvider() { }
+inline TxFilterProvider::~TxFilterProvider() { }
 
 struct XThinStub : public StubData {
     XThinStub(const XThinBlock& b) : xblock(b) {
@@ -95,7 +95,7 @@ struct XThinStub : public StubData {
     }
 
     // Transactions provded in the stub, if any.
-    virtual std::vector<CTransaction> missingProvided() const {
+    virtual std::vector<CTransactionRef> missingProvided() const {
         return xblock.missing;
     }
 
@@ -127,7 +127,7 @@ struct XThinReReqResponse {
     XThinReReqResponse(const CBlock& srcBlock, const std::set<uint64_t>& requesting);
 
     uint256 block;
-    std::vector<CTransaction> txRequested;
+    std::vector<CTransactionRef> txRequested;
 
     ADD_SERIALIZE_METHODS;
 